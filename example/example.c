@@ -13,6 +13,12 @@ static void test_spg_get_spacegroup_type(void);
 static void test_spg_get_symmetry_from_database(void);
 static void test_spg_refine_cell(void);
 static void test_spg_get_dataset(void);
+static void test_spg_get_dataset_of_supercell(void);
+static void test_spg_get_datasets_batch(void);
+static void test_spg_get_symprec_spectrum(void);
+static void test_spg_context(void);
+static void test_spg_get_symmetry_of_perturbed(void);
+static void test_spg_tracker(void);
 static void test_spg_get_ir_reciprocal_mesh(void);
 static void test_spg_get_stabilized_reciprocal_mesh(void);
 static void test_spg_get_tetrahedra_relative_grid_address(void);
@@ -42,6 +48,12 @@ int main(void)
   test_spg_get_symmetry_from_database();
   test_spg_refine_cell();
   test_spg_get_dataset();
+  test_spg_get_dataset_of_supercell();
+  test_spg_get_datasets_batch();
+  test_spg_get_symprec_spectrum();
+  test_spg_context();
+  test_spg_get_symmetry_of_perturbed();
+  test_spg_tracker();
   test_spg_get_ir_reciprocal_mesh();
   test_spg_get_stabilized_reciprocal_mesh();
   /* test_spg_get_tetrahedra_relative_grid_address(); */
@@ -385,6 +397,234 @@ static void test_spg_get_dataset(void)
   show_spg_dataset(lattice_2, origin_shift_2, position_2, num_atom_2, types_2);
 }
 
+static void test_spg_get_dataset_of_supercell(void)
+{
+  SpglibDataset *dataset;
+  double lattice[3][3] = {{4,0,0},{0,4,0},{0,0,6}};
+  double position[][3] =
+    {
+      {0,0,0},
+      {0.5,0.5,0.25},
+      {0.3,0.3,0},
+      {0.7,0.7,0},
+      {0.2,0.8,0.25},
+      {0.8,0.2,0.25},
+      {0,0,0.5},
+      {0.5,0.5,0.75},
+      {0.3,0.3,0.5},
+      {0.7,0.7,0.5},
+      {0.2,0.8,0.75},
+      {0.8,0.2,0.75}
+    };
+  int types[] = {1,1,2,2,2,2,1,1,2,2,2,2};
+  int num_atom = 12;
+  double primitive_lattice[3][3] = {{4,0,0},{0,4,0},{0,0,3}};
+  double primitive_position[][3] =
+    {
+      {0,0,0},
+      {0.5,0.5,0.5},
+      {0.3,0.3,0},
+      {0.7,0.7,0},
+      {0.2,0.8,0.5},
+      {0.8,0.2,0.5}
+    };
+  int primitive_types[] = {1,1,2,2,2,2};
+  int supercell_matrix[3][3] = {{1,0,0},{0,1,0},{0,0,2}};
+
+  printf("*** Example of spg_get_dataset_of_supercell (Rutile 1x1x2) ***:\n");
+  dataset = spg_get_dataset_of_supercell(lattice,
+					 position,
+					 types,
+					 num_atom,
+					 supercell_matrix,
+					 primitive_lattice,
+					 primitive_position,
+					 primitive_types,
+					 6,
+					 1e-5);
+  printf("International: %s (%d)\n",
+	 dataset->international_symbol, dataset->spacegroup_number);
+  printf("Number of operations: %d (32)\n", dataset->n_operations);
+  spg_free_dataset(dataset);
+}
+
+static void test_spg_get_datasets_batch(void)
+{
+  SpglibDataset *datasets[2];
+  double lattices[2][3][3] = {{{4,0,0},{0,4,0},{0,0,3}},
+			      {{4,0,0},{0,4,0},{0,0,4}}};
+  double positions[][3] =
+    {
+      {0,0,0},
+      {0.5,0.5,0.5},
+      {0.3,0.3,0},
+      {0.7,0.7,0},
+      {0.2,0.8,0.5},
+      {0.8,0.2,0.5},
+      {0,0,0},
+      {0.5,0.5,0.5}
+    };
+  int types[] = {1,1,2,2,2,2,1,1};
+  int offsets[] = {0, 6, 8};
+  int i, num_found;
+
+  printf("*** Example of spg_get_datasets_batch (Rutile and BCC) ***:\n");
+  num_found = spg_get_datasets_batch(datasets,
+				     2,
+				     lattices,
+				     positions,
+				     types,
+				     offsets,
+				     1e-5);
+  printf("Number of structures found: %d (2)\n", num_found);
+  for (i = 0; i < 2; i++) {
+    printf("International: %s (%d)\n",
+	   datasets[i]->international_symbol,
+	   datasets[i]->spacegroup_number);
+    spg_free_dataset(datasets[i]);
+  }
+}
+
+static void test_spg_get_symprec_spectrum(void)
+{
+  double lattice[3][3] = {{4,0,0},{0,4,0},{0,0,3}};
+  double position[][3] =
+    {
+      {0,0,0},
+      {0.5,0.5,0.5},
+      {0.3,0.3,0},
+      {0.7,0.7,0},
+      {0.2,0.8,0.5},
+      {0.8,0.2,0.5},
+    };
+  int types[] = {1,1,2,2,2,2};
+  int num_atom = 6;
+  int i, num_ranges;
+  int spacegroup_numbers[20];
+  double symprecs[20];
+
+  /* One O atom is displaced by 0.04 Angstrom along x. */
+  position[2][0] += 0.01;
+
+  printf("*** Example of spg_get_symprec_spectrum (distorted Rutile) ***:\n");
+  num_ranges = spg_get_symprec_spectrum(symprecs,
+					spacegroup_numbers,
+					20,
+					lattice,
+					position,
+					types,
+					num_atom,
+					1e-5,
+					0.1);
+  for (i = 0; i < num_ranges; i++) {
+    printf("symprec <= %f: %d\n", symprecs[i], spacegroup_numbers[i]);
+  }
+  printf("(Pm (6) up to 0.056569 and P4_2/mnm (136) above)\n");
+}
+
+static void test_spg_context(void)
+{
+  SpglibContext *context;
+  const SpglibDataset *dataset;
+  double lattice[3][3] = {{4,0,0},{0,4,0},{0,0,3}};
+  double position[][3] =
+    {
+      {0,0,0},
+      {0.5,0.5,0.5},
+      {0.3,0.3,0},
+      {0.7,0.7,0},
+      {0.2,0.8,0.5},
+      {0.8,0.2,0.5},
+    };
+  int types[] = {1,1,2,2,2,2};
+  int num_atom = 6;
+  int mesh[] = {8, 8, 8};
+  int is_shift[] = {1, 1, 1};
+  int grid_address[512][3];
+  int map[512];
+  char symbol[11];
+  int number, num_ir;
+
+  printf("*** Example of spg_alloc_context (Rutile) ***:\n");
+  context = spg_alloc_context(lattice, position, types, num_atom, 1e-5);
+  dataset = spg_context_get_dataset(context);
+  number = spg_context_get_international(symbol, context);
+  num_ir = spg_context_get_ir_reciprocal_mesh(grid_address,
+					      map,
+					      mesh,
+					      is_shift,
+					      1,
+					      context);
+  printf("International: %s (%d), %d operations\n",
+	 symbol, number, dataset->n_operations);
+  printf("Number of irreducible k-points with 8x8x8 mesh is %d (40).\n",
+	 num_ir);
+  spg_free_context(context);
+}
+
+static void test_spg_get_symmetry_of_perturbed(void)
+{
+  SpglibContext *context;
+  double lattice[3][3] = {{4,0,0},{0,4,0},{0,0,3}};
+  double position[][3] =
+    {
+      {0,0,0},
+      {0.5,0.5,0.5},
+      {0.3,0.3,0},
+      {0.7,0.7,0},
+      {0.2,0.8,0.5},
+      {0.8,0.2,0.5},
+    };
+  int types[] = {1,1,2,2,2,2};
+  int num_atom = 6;
+  int max_size = 16;
+  int moved_atoms[] = {0};
+  double moved_positions[][3] = {{0.005, 0, 0}};
+  int rotation[max_size][3][3];
+  double translation[max_size][3];
+  int size;
+
+  printf("*** Example of spg_get_symmetry_of_perturbed (Rutile with a displaced Ti) ***:\n");
+  context = spg_alloc_context(lattice, position, types, num_atom, 1e-5);
+  size = spg_get_symmetry_of_perturbed(rotation,
+				       translation,
+				       max_size,
+				       context,
+				       moved_atoms,
+				       moved_positions,
+				       1);
+  printf("Number of operations: %d (2)\n", size);
+  spg_free_context(context);
+}
+
+static void test_spg_tracker(void)
+{
+  SpglibTracker *tracker;
+  double lattice[3][3] = {{4,0,0},{0,4,0},{0,0,3}};
+  double position[][3] =
+    {
+      {0,0,0},
+      {0.5,0.5,0.5},
+      {0.3,0.3,0},
+      {0.7,0.7,0},
+      {0.2,0.8,0.5},
+      {0.8,0.2,0.5},
+    };
+  int types[] = {1,1,2,2,2,2};
+  int num_atom = 6;
+  int i;
+
+  printf("*** Example of spg_alloc_tracker (Rutile with O moving along x) ***:\n");
+  tracker = spg_alloc_tracker(1e-5, 0);
+  for (i = 0; i < 3; i++) {
+    printf("Frame %d: %d\n",
+	   i, spg_tracker_push_frame(tracker, lattice, position, types, num_atom));
+    position[2][0] += 0.01;
+  }
+  printf("(136, 6, 6)\n");
+  spg_free_tracker(tracker);
+}
+
 static void test_spg_get_ir_reciprocal_mesh(void)
 {
   double lattice[3][3] = {{4,0,0},{0,4,0},{0,0,3}};
@@ -16,9 +16,12 @@ static PyObject * refine_cell(PyObject *self, PyObject *args);
 static PyObject * get_symmetry(PyObject *self, PyObject *args);
 static PyObject *
 get_symmetry_with_collinear_spin(PyObject *self, PyObject *args);
+static PyObject * get_symmetry_with_magmoms(PyObject *self, PyObject *args);
 static PyObject * find_primitive(PyObject *self, PyObject *args);
 static PyObject * get_grid_point_from_address(PyObject *self, PyObject *args);
 static PyObject * get_ir_reciprocal_mesh(PyObject *self, PyObject *args);
+static PyObject *
+get_ir_reciprocal_mesh_with_shift(PyObject *self, PyObject *args);
 static PyObject * get_stabilized_reciprocal_mesh(PyObject *self, PyObject *args);
 static PyObject * get_grid_points_by_rotations(PyObject *self, PyObject *args);
 static PyObject * get_BZ_grid_points_by_rotations(PyObject *self, PyObject *args);
@@ -45,12 +48,16 @@ static PyMethodDef functions[] = {
   {"symmetry", get_symmetry, METH_VARARGS, "Symmetry operations"},
   {"symmetry_with_collinear_spin", get_symmetry_with_collinear_spin,
    METH_VARARGS, "Symmetry operations with collinear spin magnetic moments"},
+  {"symmetry_with_magmoms", get_symmetry_with_magmoms, METH_VARARGS,
+   "Symmetry operations with non-collinear magnetic moments"},
   {"primitive", find_primitive, METH_VARARGS,
    "Find primitive cell in the input cell"},
   {"grid_point_from_address", get_grid_point_from_address, METH_VARARGS,
    "Translate grid adress to grid point index"},
   {"ir_reciprocal_mesh", get_ir_reciprocal_mesh, METH_VARARGS,
    "Reciprocal mesh points with map"},
+  {"ir_reciprocal_mesh_with_shift", get_ir_reciprocal_mesh_with_shift,
+   METH_VARARGS, "Reciprocal mesh points shifted by a rational fraction with map"},
   {"stabilized_reciprocal_mesh", get_stabilized_reciprocal_mesh, METH_VARARGS,
    "Reciprocal mesh points with map"},
   {"grid_points_by_rotations", get_grid_points_by_rotations, METH_VARARGS,
@@ -151,7 +158,7 @@ static PyObject * get_dataset(PyObject *self, PyObject *args)
   PyArrayObject* position;
   PyArrayObject* atom_type;
   PyObject *array, *vec, *mat, *rot, *trans, *wyckoffs, *equiv_atoms;
-  PyObject *brv_lattice, *brv_types, *brv_positions;
+  PyObject *brv_lattice, *brv_types, *brv_positions, *permutations;
 
   if (!PyArg_ParseTuple(args, "OOOdd",
 			&lattice,
@@ -174,7 +181,7 @@ static PyObject * get_dataset(PyObject *self, PyObject *args)
 			      symprec,
 			      angle_tolerance);
 
-  array = PyList_New(13);
+  array = PyList_New(14);
   n = 0;
 
   /* Space group number, international symbol, hall symbol */
@@ -273,6 +280,23 @@ static PyObject * get_dataset(PyObject *self, PyObject *args)
   PyList_SetItem(array, n, brv_positions);
   n++;
 
+  /* Permutations of atoms by the operations */
+  if (dataset->permutations == NULL) {
+    Py_INCREF(Py_None);
+    PyList_SetItem(array, n, Py_None);
+  } else {
+    permutations = PyList_New(dataset->n_operations);
+    for (i = 0; i < dataset->n_operations; i++) {
+      vec = PyList_New(dataset->n_atoms);
+      for (j = 0; j < dataset->n_atoms; j++) {
+	PyList_SetItem(vec, j, PyLong_FromLong((long) dataset->permutations[i * dataset->n_atoms + j]));
+      }
+      PyList_SetItem(permutations, i, vec);
+    }
+    PyList_SetItem(array, n, permutations);
+  }
+  n++;
+
   spg_free_dataset(dataset);
 
   return array;
@@ -493,6 +517,63 @@ static PyObject * get_symmetry_with_collinear_spin(PyObject *self,
   return PyLong_FromLong((long) num_sym);
 }
 
+static PyObject * get_symmetry_with_magmoms(PyObject *self, PyObject *args)
+{
+  int is_time_reversal;
+  double symprec, angle_tolerance;
+  PyArrayObject* lattice;
+  PyArrayObject* position;
+  PyArrayObject* rotation;
+  PyArrayObject* translation;
+  PyArrayObject* time_reversal;
+  PyArrayObject* atom_type;
+  PyArrayObject* magmom;
+  PyArrayObject* equiv_atoms_py;
+
+  if (!PyArg_ParseTuple(args, "OOOOOOOOidd",
+			&rotation,
+			&translation,
+			&time_reversal,
+			&equiv_atoms_py,
+			&lattice,
+			&position,
+			&atom_type,
+			&magmom,
+			&is_time_reversal,
+			&symprec,
+			&angle_tolerance)) {
+    return NULL;
+  }
+
+  SPGCONST double (*lat)[3] = (double(*)[3])lattice->data;
+  SPGCONST double (*pos)[3] = (double(*)[3])position->data;
+  SPGCONST double (*magmoms)[3] = (double(*)[3])magmom->data;
+  const int *types = (int*)atom_type->data;
+  const int num_atom = position->dimensions[0];
+  int (*rot)[3][3] = (int(*)[3][3])rotation->data;
+  double (*trans)[3] = (double(*)[3])translation->data;
+  int *time_reversals = (int*)time_reversal->data;
+  int *equiv_atoms = (int*)equiv_atoms_py->data;
+  const int num_sym_from_array_size = rotation->dimensions[0];
+
+  /* num_sym has to be larger than num_sym_from_array_size. */
+  const int num_sym =
+    spgat_get_symmetry_with_magmoms(rot,
+				    trans,
+				    time_reversals,
+				    equiv_atoms,
+				    num_sym_from_array_size,
+				    lat,
+				    pos,
+				    types,
+				    magmoms,
+				    is_time_reversal,
+				    num_atom,
+				    symprec,
+				    angle_tolerance);
+  return PyLong_FromLong((long) num_sym);
+}
+
 static PyObject * get_grid_point_from_address(PyObject *self, PyObject *args)
 {
   PyArrayObject* grid_address_py;
@@ -560,6 +641,57 @@ static PyObject * get_ir_reciprocal_mesh(PyObject *self, PyObject *args)
   return PyLong_FromLong((long) num_ir);
 }
 
+static PyObject *
+get_ir_reciprocal_mesh_with_shift(PyObject *self, PyObject *args)
+{
+  double symprec;
+  PyArrayObject* grid_address_py;
+  PyArrayObject* map;
+  PyArrayObject* mesh;
+  PyArrayObject* shift;
+  int shift_denominator;
+  int is_time_reversal;
+  PyArrayObject* lattice;
+  PyArrayObject* position;
+  PyArrayObject* atom_type;
+  if (!PyArg_ParseTuple(args, "OOOOiiOOOd",
+			&grid_address_py,
+			&map,
+			&mesh,
+			&shift,
+			&shift_denominator,
+			&is_time_reversal,
+			&lattice,
+			&position,
+			&atom_type,
+			&symprec)) {
+    return NULL;
+  }
+
+  SPGCONST double (*lat)[3] = (double(*)[3])lattice->data;
+  SPGCONST double (*pos)[3] = (double(*)[3])position->data;
+  const int* types = (int*)atom_type->data;
+  const int* mesh_int = (int*)mesh->data;
+  const int* shift_int = (int*)shift->data;
+  const int num_atom = position->dimensions[0];
+  int (*grid_address)[3] = (int(*)[3])grid_address_py->data;
+  int *map_int = (int*)map->data;
+
+  const int num_ir = spg_get_ir_reciprocal_mesh_with_shift(grid_address,
+							   map_int,
+							   mesh_int,
+							   shift_int,
+							   shift_denominator,
+							   is_time_reversal,
+							   lat,
+							   pos,
+							   types,
+							   num_atom,
+							   symprec);
+
+  return PyLong_FromLong((long) num_ir);
+}
+
 static PyObject * get_stabilized_reciprocal_mesh(PyObject *self, PyObject *args)
 {
   PyArrayObject* grid_address_py;
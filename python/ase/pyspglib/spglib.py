@@ -5,13 +5,16 @@ Spglib interface for ASE
 import pyspglib._spglib as spg
 import numpy as np
 
-def get_symmetry(bulk, use_magmoms=False, symprec=1e-5, angle_tolerance=-1.0):
+def get_symmetry(bulk, use_magmoms=False, symprec=1e-5, angle_tolerance=-1.0,
+                 is_time_reversal=True):
     """
     Return symmetry operations as hash.
     Hash key 'rotations' gives the numpy integer array
     of the rotation matrices for scaled positions
     Hash key 'translations' gives the numpy double array
     of the translation vectors in scaled positions
+    With non-collinear magnetic moments, hash key 'time_reversals'
+    gives 1 for the operations combined with time reversal
     """
 
     # Atomic positions have to be specified by scaled positions for spglib.
@@ -29,6 +32,27 @@ def get_symmetry(bulk, use_magmoms=False, symprec=1e-5, angle_tolerance=-1.0):
     if use_magmoms:
         magmoms = bulk.get_magnetic_moments()
         equivalent_atoms = np.zeros(len(magmoms), dtype='intc')
+        if magmoms.ndim == 2:
+            magmoms = np.array(magmoms, dtype='double', order='C')
+            time_reversals = np.zeros(multi, dtype='intc')
+            num_sym = spg.symmetry_with_magmoms(rotation,
+                                                translation,
+                                                time_reversals,
+                                                equivalent_atoms,
+                                                lattice,
+                                                positions,
+                                                numbers,
+                                                magmoms,
+                                                is_time_reversal * 1,
+                                                symprec,
+                                                angle_tolerance)
+            return ({'rotations': np.array(rotation[:num_sym],
+                                           dtype='intc', order='C'),
+                     'translations': np.array(translation[:num_sym],
+                                              dtype='double', order='C'),
+                     'time_reversals': np.array(time_reversals[:num_sym],
+                                                dtype='intc')},
+                    equivalent_atoms)
         num_sym = spg.symmetry_with_collinear_spin(rotation,
                                                    translation,
                                                    equivalent_atoms,
@@ -89,7 +113,8 @@ def get_symmetry_dataset(bulk, symprec=1e-5, angle_tolerance=-1.0):
             'equivalent_atoms',
             'brv_lattice',
             'brv_types',
-            'brv_positions')
+            'brv_positions',
+            'permutations')
     dataset = {}
     for key, data in zip(keys, spg.dataset(lattice,
                                            positions,
@@ -116,6 +141,9 @@ def get_symmetry_dataset(bulk, symprec=1e-5, angle_tolerance=-1.0):
     dataset['brv_types'] = np.array(dataset['brv_types'], dtype='intc')
     dataset['brv_positions'] = np.array(dataset['brv_positions'],
                                         dtype='double', order='C')
+    if dataset['permutations'] is not None:
+        dataset['permutations'] = np.array(dataset['permutations'],
+                                           dtype='intc', order='C')
 
     return dataset
 
@@ -264,6 +292,34 @@ def get_ir_reciprocal_mesh(mesh,
   
     return mapping, mesh_points
 
+def get_ir_reciprocal_mesh_with_shift(mesh,
+                                      bulk,
+                                      shift,
+                                      shift_denominator,
+                                      is_time_reversal=True,
+                                      symprec=1e-5):
+    """
+    Return k-points mesh and k-point map to the irreducible k-points
+    for a mesh shifted by shift / shift_denominator of one mesh.
+    Only the rotations that keep the shifted mesh are used.
+    """
+
+    mapping = np.zeros(np.prod(mesh), dtype='intc')
+    mesh_points = np.zeros((np.prod(mesh), 3), dtype='intc')
+    spg.ir_reciprocal_mesh_with_shift(
+        mesh_points,
+        mapping,
+        np.array(mesh, dtype='intc'),
+        np.array(shift, dtype='intc'),
+        shift_denominator,
+        is_time_reversal * 1,
+        np.array(bulk.get_cell().T, dtype='double', order='C'),
+        np.array(bulk.get_scaled_positions(), dtype='double', order='C'),
+        np.array(bulk.get_atomic_numbers(), dtype='intc'),
+        symprec)
+  
+    return mapping, mesh_points
+
 def get_grid_points_by_rotations(address_orig,
                                  reciprocal_rotations,
                                  mesh,
@@ -11,7 +11,9 @@ sources = [
 	'../../src/kpoint.c',
 	'../../src/lattice.c',
 	'../../src/mathfunc.c',
+	'../../src/mem.c',
 	'../../src/niggli.c',
+	'../../src/overlap.c',
 	'../../src/pointgroup.c',
 	'../../src/primitive.c',
 	'../../src/refinement.c',
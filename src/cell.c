@@ -5,16 +5,20 @@
 #include <stdio.h>
 #include "cell.h"
 #include "mathfunc.h"
+#include "mem.h"
 
 #include "debug.h"
 
 /* cell->size = 0 is a sign of False */
+/* NULL is returned if memory could not be allocated. */
 Cell * cel_alloc_cell( const int size )
 {
     Cell *cell;
     int i, j;
     
-    cell = (Cell*) malloc( sizeof( Cell ) );
+    if ((cell = (Cell*) mem_malloc( sizeof( Cell ) )) == NULL) {
+      return NULL;
+    }
 
     for ( i = 0; i < 3; i++ ) {
       for ( j = 0; j < 3; j++ ) {
@@ -22,31 +26,41 @@ Cell * cel_alloc_cell( const int size )
       }
     }
     cell->size = size;
+    cell->types = NULL;
+    cell->position = NULL;
     
     if ( size > 0 ) {
-      if ((cell->types = (int *) malloc(sizeof(int) * size)) == NULL) {
-        warning_print("spglib: Memory of cell could not be allocated.");
-        exit(1);
+      if ((cell->types = (int *) mem_malloc(sizeof(int) * size)) == NULL) {
+        goto err;
       }
       if ((cell->position =
-	   (double (*)[3]) malloc(sizeof(double[3]) * size)) == NULL) {
-        warning_print("spglib: Memory of cell could not be allocated.");
-        exit(1);
+	   (double (*)[3]) mem_malloc(sizeof(double[3]) * size)) == NULL) {
+        goto err;
       }
     }
 
     return cell;
+
+ err:
+    mem_free( cell->types );
+    cell->types = NULL;
+    mem_free( cell );
+    cell = NULL;
+    return NULL;
 }
 
 void cel_free_cell( Cell * cell )
 {
+  if ( cell == NULL ) {
+    return;
+  }
   if ( cell->size > 0 ) {
-    free( cell->position );
+    mem_free( cell->position );
     cell->position = NULL;
-    free( cell->types );
+    mem_free( cell->types );
     cell->types = NULL;
   }
-  free ( cell );
+  mem_free ( cell );
   cell = NULL;
 }
 
@@ -69,7 +83,9 @@ Cell * cel_copy_cell( SPGCONST Cell * cell )
 {
   Cell * cell_new;
   
-  cell_new = cel_alloc_cell( cell->size );
+  if ((cell_new = cel_alloc_cell( cell->size )) == NULL) {
+    return NULL;
+  }
   cel_set_cell( cell_new,
 		cell->lattice,
 		cell->position,
@@ -4,12 +4,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "mathfunc.h"
+#include "mem.h"
 #include "kpoint.h"
 
 #include "debug.h"
 
 #define NUM_DIM_SEARCH 125
 
+/* Grid points are examined by slabs of the slowest axis of mesh. */
+/* slab_weights[i] is the weight of the i-th grid point of the slab, */
+/* or 0 if it is not irreducible. */
+struct _IrGridPointIterator {
+  int mesh[3];
+  int is_shift[3];
+  MatINT *rot_reciprocal;
+  int num_slab;
+  int slab_size;
+  int slab;
+  int position;
+  int *slab_weights;
+};
+
 static int search_space[NUM_DIM_SEARCH][3] = {
   { 0,  0,  0},
   { 0,  0,  1},
@@ -170,6 +185,10 @@ static int search_space[NUM_DIM_SEARCH][3] = {
 
 static MatINT *get_point_group_reciprocal(const MatINT * rotations,
 					  const int is_time_reversal);
+static MatINT *get_point_group_reciprocal_on_mesh(const MatINT * rotations,
+						  const int is_time_reversal,
+						  const int mesh[3],
+						  const int is_shift[3]);
 static MatINT *get_point_group_reciprocal_with_q(const MatINT * rot_reciprocal,
 						 const double symprec,
 						 const int num_q,
@@ -179,18 +198,84 @@ static int get_ir_reciprocal_mesh(int grid_address[][3],
 				  const int mesh[3],
 				  const int is_shift[3],
 				  const MatINT * rot_reciprocal);
+static int get_ir_reciprocal_mesh_by_orbits(int grid_address[][3],
+					    int map[],
+					    const int mesh[3],
+					    const int is_shift[3],
+					    const MatINT * rot_reciprocal);
+#ifndef _OPENMP
+static int get_ir_reciprocal_mesh_normal(int grid_address[][3],
+					 int map[],
+					 const int mesh[3],
+					 const int is_shift[3],
+					 const MatINT * rot_reciprocal);
+#else
 static int
 get_ir_reciprocal_mesh_openmp(int grid_address[][3],
 			      int map[],
 			      const int mesh[3],
 			      const int is_shift[3],
 			      const MatINT* rot_reciprocal);
+#endif
+static int get_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					     int map[],
+					     const int mesh[3],
+					     const int shift[3],
+					     const int shift_denominator,
+					     const MatINT * rot_reciprocal);
+static MatINT *get_rotations_on_shifted_mesh(const MatINT * rot_reciprocal,
+					     const int mesh[3],
+					     const int shift[3],
+					     const int shift_denominator);
+static int get_rotation_on_shifted_mesh(int rot_mesh[3][3],
+					SPGCONST int rot[3][3],
+					const int mesh[3],
+					const int shift[3],
+					const int shift_denominator);
+static int is_group_on_mesh(const MatINT * rot_reciprocal,
+			    const int mesh[3],
+			    const int is_shift[3]);
+static int is_rotation_on_mesh(SPGCONST int rot[3][3],
+			       const int mesh[3],
+			       const int is_shift[3]);
+static int get_ir_weight(const int grid_point,
+			 const int mesh[3],
+			 const int is_shift[3],
+			 const MatINT * rot_reciprocal);
+static int is_ir_grid_point(const int grid_point,
+			    const int mesh[3],
+			    const int is_shift[3],
+			    const MatINT * rot_reciprocal);
+static int get_smallest_image(const int grid_point,
+			      const int mesh[3],
+			      const int is_shift[3],
+			      const MatINT * rot_reciprocal);
+static int get_num_stabilizer(const int grid_point,
+			      const int mesh[3],
+			      const int is_shift[3],
+			      const MatINT * rot_reciprocal);
+static int get_smith_normal_form(int mesh[3],
+				 int P[3][3],
+				 int Q[3][3],
+				 SPGCONST int grid_matrix[3][3]);
+static MatINT *get_rotations_on_generalized_mesh(const MatINT * rot_reciprocal,
+						 const int mesh[3],
+						 const int is_shift[3],
+						 SPGCONST int transformation[3][3]);
+static int get_rotation_on_generalized_mesh(int rot_grid[3][3],
+					    SPGCONST int rot[3][3],
+					    const int mesh[3],
+					    const int is_shift[3],
+					    SPGCONST int transformation[3][3],
+					    SPGCONST int inv_transformation[3][3]);
 static int relocate_BZ_grid_address(int bz_grid_address[][3],
 				    int bz_map[],
 				    SPGCONST int grid_address[][3],
 				    const int mesh[3],
 				    SPGCONST double rec_lattice[3][3],
-				    const int is_shift[3]);
+				    const int is_shift[3],
+				    SPGCONST int transformation[3][3],
+				    const double tolerance);
 static double get_tolerance_for_BZ_reduction(SPGCONST double rec_lattice[3][3],
 					     const int mesh[3]);
 static int get_ir_triplets_at_q(int map_triplets[],
@@ -223,6 +308,15 @@ static void grid_point_to_address_double(int address_double[3],
 static void get_grid_address(int address[3],
 			     const int address_double[3],
 			     const int mesh[3]);
+static int get_grid_point_scaled_mesh(const int address_scaled[3],
+				      const int mesh[3],
+				      const int shift[3],
+				      const int shift_denominator);
+static void grid_point_to_address_scaled(int address_scaled[3],
+					 const int grid_point,
+					 const int mesh[3],
+					 const int shift[3],
+					 const int shift_denominator);
 static void get_vector_modulo(int v[3], const int m[3]);
 
 int kpt_get_grid_point(const int grid_address[3],
@@ -257,26 +351,72 @@ int kpt_get_irreducible_reciprocal_mesh(int grid_address[][3],
   MatINT *rot_reciprocal;
 
   rot_reciprocal = get_point_group_reciprocal(rotations, is_time_reversal);
+  if (rot_reciprocal == NULL) {
+    return 0;
+  }
 
-#ifdef _OPENMP
-  num_ir = get_ir_reciprocal_mesh_openmp(grid_address,
-					 map,
-					 mesh,
-					 is_shift,
-					 rot_reciprocal);
-  
-#else
   num_ir = get_ir_reciprocal_mesh(grid_address,
 				  map,
 				  mesh,
 				  is_shift,
 				  rot_reciprocal);
-#endif
   
   mat_free_MatINT(rot_reciprocal);
   return num_ir;
 }
 
+/* The mesh is shifted by a rational fraction of one mesh, */
+/* q = (address + shift / shift_denominator) / mesh, where shift[i] */
+/* is taken modulo shift_denominator. Only the rotations that map the */
+/* shifted mesh onto itself are used. With shift_denominator = 2, the */
+/* results are those of kpt_get_irreducible_reciprocal_mesh if the */
+/* mesh keeps the symmetry. 0 is returned on failure. */
+int kpt_get_irreducible_reciprocal_mesh_with_shift(int grid_address[][3],
+						   int map[],
+						   const int mesh[3],
+						   const int shift[3],
+						   const int shift_denominator,
+						   const int is_time_reversal,
+						   const MatINT *rotations)
+{
+  int i, num_ir;
+  int shift_mod[3];
+  MatINT *rot_reciprocal, *rot_mesh;
+
+  if (shift_denominator < 1) {
+    return 0;
+  }
+
+  for (i = 0; i < 3; i++) {
+    shift_mod[i] = ((shift[i] % shift_denominator) + shift_denominator) %
+      shift_denominator;
+  }
+
+  rot_reciprocal = get_point_group_reciprocal(rotations, is_time_reversal);
+  if (rot_reciprocal == NULL) {
+    return 0;
+  }
+  rot_mesh = get_rotations_on_shifted_mesh(rot_reciprocal,
+					   mesh,
+					   shift_mod,
+					   shift_denominator);
+  mat_free_MatINT(rot_reciprocal);
+  rot_reciprocal = NULL;
+  if (rot_mesh == NULL) {
+    return 0;
+  }
+
+  num_ir = get_ir_reciprocal_mesh_with_shift(grid_address,
+					     map,
+					     mesh,
+					     shift_mod,
+					     shift_denominator,
+					     rot_mesh);
+
+  mat_free_MatINT(rot_mesh);
+  return num_ir;
+}
+
 int kpt_get_stabilized_reciprocal_mesh(int grid_address[][3],
 				       int map[],
 				       const int mesh[3],
@@ -291,30 +431,304 @@ int kpt_get_stabilized_reciprocal_mesh(int grid_address[][3],
   double tolerance;
   
   rot_reciprocal = get_point_group_reciprocal(rotations, is_time_reversal);
+  if (rot_reciprocal == NULL) {
+    return 0;
+  }
   tolerance = 0.01 / (mesh[0] + mesh[1] + mesh[2]);
   rot_reciprocal_q = get_point_group_reciprocal_with_q(rot_reciprocal,
 						       tolerance,
 						       num_q,
 						       qpoints);
+  if (rot_reciprocal_q == NULL) {
+    mat_free_MatINT(rot_reciprocal);
+    return 0;
+  }
 
-#ifdef _OPENMP
-  num_ir = get_ir_reciprocal_mesh_openmp(grid_address,
-					 map,
-					 mesh,
-					 is_shift,
-					 rot_reciprocal_q);
-#else
   num_ir = get_ir_reciprocal_mesh(grid_address,
 				  map,
 				  mesh,
 				  is_shift,
 				  rot_reciprocal_q);
-#endif
   mat_free_MatINT(rot_reciprocal_q);
   mat_free_MatINT(rot_reciprocal);
   return num_ir;
 }
 
+/* Irreducible grid points are found without arrays of the mesh size. */
+/* A grid point is irreducible if no rotation moves it onto a smaller */
+/* grid point. Only the rotations that keep the mesh and shift are */
+/* used, so that the weights are found from the orbits of the */
+/* irreducible grid points alone. They are the same as those of */
+/* kpt_get_irreducible_reciprocal_mesh if the mesh keeps the symmetry. */
+/* NULL is returned if memory could not be allocated. */
+IrGridPoints * kpt_get_ir_grid_points(const int mesh[3],
+				      const int is_shift[3],
+				      const int is_time_reversal,
+				      const MatINT *rotations)
+{
+  int i, j, num_grid, num_ir, capacity, num_slab, slab_size, slab;
+  int address_double[3];
+  int *grid_points, *is_ir;
+  IrGridPoints *ir_grid_points;
+
+  is_ir = NULL;
+  num_grid = mesh[0] * mesh[1] * mesh[2];
+
+  if ((ir_grid_points = (IrGridPoints*) mem_malloc(sizeof(IrGridPoints)))
+      == NULL) {
+    return NULL;
+  }
+  ir_grid_points->size = 0;
+  ir_grid_points->grid_points = NULL;
+  ir_grid_points->weights = NULL;
+  ir_grid_points->grid_address = NULL;
+  ir_grid_points->rot_reciprocal = NULL;
+
+  if ((ir_grid_points->rot_reciprocal =
+       get_point_group_reciprocal_on_mesh(rotations,
+					  is_time_reversal,
+					  mesh,
+					  is_shift)) == NULL) {
+    goto err;
+  }
+
+  /* At least num_grid / (order of group) grid points are irreducible. */
+  capacity = num_grid / (ir_grid_points->rot_reciprocal->size > 0 ?
+			 ir_grid_points->rot_reciprocal->size : 1) + 1;
+  if ((ir_grid_points->grid_points = (int*) mem_malloc(sizeof(int) * capacity))
+      == NULL) {
+    goto err;
+  }
+
+  /* Grid points are checked in parallel by slabs as in */
+  /* kpt_get_next_ir_grid_points, and collected in ascending order. */
+#ifndef GRID_ORDER_XYZ
+  num_slab = mesh[2];
+  slab_size = mesh[0] * mesh[1];
+#else
+  num_slab = mesh[0];
+  slab_size = mesh[1] * mesh[2];
+#endif
+  if ((is_ir = (int*) mem_malloc(sizeof(int) * (slab_size > 0 ?
+						  slab_size : 1))) == NULL) {
+    goto err;
+  }
+
+  num_ir = 0;
+  for (slab = 0; slab < num_slab; slab++) {
+#pragma omp parallel for
+    for (i = 0; i < slab_size; i++) {
+      is_ir[i] = is_ir_grid_point(slab * slab_size + i,
+				  mesh,
+				  is_shift,
+				  ir_grid_points->rot_reciprocal);
+    }
+
+    for (i = 0; i < slab_size; i++) {
+      if (! is_ir[i]) {
+	continue;
+      }
+      if (num_ir == capacity) {
+	if ((grid_points = (int*) mem_malloc(sizeof(int) * capacity * 2))
+	    == NULL) {
+	  goto err;
+	}
+	for (j = 0; j < num_ir; j++) {
+	  grid_points[j] = ir_grid_points->grid_points[j];
+	}
+	mem_free(ir_grid_points->grid_points);
+	ir_grid_points->grid_points = grid_points;
+	capacity *= 2;
+      }
+      ir_grid_points->grid_points[num_ir] = slab * slab_size + i;
+      num_ir++;
+    }
+  }
+  ir_grid_points->size = num_ir;
+  mem_free(is_ir);
+  is_ir = NULL;
+
+  if ((ir_grid_points->weights =
+       (int*) mem_malloc(sizeof(int) * (num_ir > 0 ? num_ir : 1))) == NULL) {
+    goto err;
+  }
+  if ((ir_grid_points->grid_address = (int (*)[3])
+       mem_malloc(sizeof(int[3]) * (num_ir > 0 ? num_ir : 1))) == NULL) {
+    goto err;
+  }
+
+  for (i = 0; i < num_ir; i++) {
+    grid_point_to_address_double(address_double,
+				 ir_grid_points->grid_points[i],
+				 mesh,
+				 is_shift);
+    get_grid_address(ir_grid_points->grid_address[i], address_double, mesh);
+  }
+
+  /* Orbit of a group is as large as the group over the stabilizer. */
+#pragma omp parallel for
+  for (i = 0; i < num_ir; i++) {
+    ir_grid_points->weights[i] =
+      ir_grid_points->rot_reciprocal->size /
+      get_num_stabilizer(ir_grid_points->grid_points[i],
+			 mesh,
+			 is_shift,
+			 ir_grid_points->rot_reciprocal);
+  }
+
+  return ir_grid_points;
+
+ err:
+  mem_free(is_ir);
+  is_ir = NULL;
+  kpt_free_ir_grid_points(ir_grid_points);
+  return NULL;
+}
+
+void kpt_free_ir_grid_points(IrGridPoints *ir_grid_points)
+{
+  if (ir_grid_points == NULL) {
+    return;
+  }
+
+  mem_free(ir_grid_points->grid_address);
+  ir_grid_points->grid_address = NULL;
+  mem_free(ir_grid_points->weights);
+  ir_grid_points->weights = NULL;
+  mem_free(ir_grid_points->grid_points);
+  ir_grid_points->grid_points = NULL;
+  mat_free_MatINT(ir_grid_points->rot_reciprocal);
+  ir_grid_points->rot_reciprocal = NULL;
+  mem_free(ir_grid_points);
+}
+
+/* Irreducible grid point onto which grid_point is mapped in */
+/* kpt_get_ir_grid_points. */
+int kpt_get_ir_grid_point(const int grid_point,
+			  const int mesh[3],
+			  const int is_shift[3],
+			  const MatINT *rot_reciprocal)
+{
+  return get_smallest_image(grid_point, mesh, is_shift, rot_reciprocal);
+}
+
+/* The irreducible grid points are those of kpt_get_ir_grid_points. */
+/* NULL is returned if memory could not be allocated. */
+IrGridPointIterator *
+kpt_alloc_ir_grid_point_iterator(const int mesh[3],
+				 const int is_shift[3],
+				 const int is_time_reversal,
+				 const MatINT *rotations)
+{
+  int i;
+  IrGridPointIterator *iterator;
+
+  if ((iterator = (IrGridPointIterator*)
+       mem_malloc(sizeof(IrGridPointIterator))) == NULL) {
+    return NULL;
+  }
+  iterator->rot_reciprocal = NULL;
+  iterator->slab_weights = NULL;
+
+  for (i = 0; i < 3; i++) {
+    iterator->mesh[i] = mesh[i];
+    iterator->is_shift[i] = is_shift[i];
+  }
+#ifndef GRID_ORDER_XYZ
+  iterator->num_slab = mesh[2];
+  iterator->slab_size = mesh[0] * mesh[1];
+#else
+  iterator->num_slab = mesh[0];
+  iterator->slab_size = mesh[1] * mesh[2];
+#endif
+  iterator->slab = 0;
+  iterator->position = iterator->slab_size;
+
+  if ((iterator->rot_reciprocal =
+       get_point_group_reciprocal_on_mesh(rotations,
+					  is_time_reversal,
+					  mesh,
+					  is_shift)) == NULL) {
+    goto err;
+  }
+
+  if ((iterator->slab_weights = (int*)
+       mem_malloc(sizeof(int) * (iterator->slab_size > 0 ?
+				 iterator->slab_size : 1))) == NULL) {
+    goto err;
+  }
+
+  return iterator;
+
+ err:
+  kpt_free_ir_grid_point_iterator(iterator);
+  return NULL;
+}
+
+void kpt_free_ir_grid_point_iterator(IrGridPointIterator *iterator)
+{
+  if (iterator == NULL) {
+    return;
+  }
+
+  mem_free(iterator->slab_weights);
+  iterator->slab_weights = NULL;
+  mat_free_MatINT(iterator->rot_reciprocal);
+  iterator->rot_reciprocal = NULL;
+  mem_free(iterator);
+}
+
+/* Irreducible grid points following those given by the previous */
+/* call are stored up to max_size in ascending order. The number */
+/* stored is returned, which is 0 after the last one. */
+int kpt_get_next_ir_grid_points(int grid_points[],
+				int weights[],
+				int grid_address[][3],
+				const int max_size,
+				IrGridPointIterator *iterator)
+{
+  int i, num_ir;
+  int address_double[3];
+
+  num_ir = 0;
+  while (num_ir < max_size) {
+    if (iterator->position == iterator->slab_size) {
+      if (iterator->slab == iterator->num_slab) {
+	break;
+      }
+
+#pragma omp parallel for
+      for (i = 0; i < iterator->slab_size; i++) {
+	iterator->slab_weights[i] =
+	  get_ir_weight(iterator->slab * iterator->slab_size + i,
+			iterator->mesh,
+			iterator->is_shift,
+			iterator->rot_reciprocal);
+      }
+      iterator->slab++;
+      iterator->position = 0;
+    }
+
+    for (; iterator->position < iterator->slab_size && num_ir < max_size;
+	 iterator->position++) {
+      if (iterator->slab_weights[iterator->position] == 0) {
+	continue;
+      }
+      grid_points[num_ir] = ((iterator->slab - 1) * iterator->slab_size +
+			     iterator->position);
+      weights[num_ir] = iterator->slab_weights[iterator->position];
+      grid_point_to_address_double(address_double,
+				   grid_points[num_ir],
+				   iterator->mesh,
+				   iterator->is_shift);
+      get_grid_address(grid_address[num_ir], address_double, iterator->mesh);
+      num_ir++;
+    }
+  }
+
+  return num_ir;
+}
+
 void kpt_get_grid_points_by_rotations(int rot_grid_points[],
 				      const int address_orig[3],
 				      const MatINT * rot_reciprocal,
@@ -369,12 +783,132 @@ int kpt_relocate_BZ_grid_address(int bz_grid_address[][3],
 				 SPGCONST double rec_lattice[3][3],
 				 const int is_shift[3])
 {
+  SPGCONST int identity[3][3] = {
+    { 1, 0, 0 },
+    { 0, 1, 0 },
+    { 0, 0, 1 }
+  };
+
   return relocate_BZ_grid_address(bz_grid_address,
 				  bz_map,
 				  grid_address,
 				  mesh,
 				  rec_lattice,
-				  is_shift);
+				  is_shift,
+				  identity,
+				  get_tolerance_for_BZ_reduction(rec_lattice, mesh));
+}
+
+/* A generalized regular grid is given by q = M^-1 (n + is_shift / 2) */
+/* for integers n, where M is grid_matrix. With the Smith normal form */
+/* P M Q = diag(mesh), q = Q (address * 2 + shift) / (mesh * 2) and */
+/* the grid is a regular mesh in the basis transformed by Q. */
+/* transformation is Q and shift is P is_shift (mod 2). */
+/* 0 is returned if grid_matrix is singular. */
+int kpt_get_generalized_mesh(int mesh[3],
+			     int shift[3],
+			     int transformation[3][3],
+			     SPGCONST int grid_matrix[3][3],
+			     const int is_shift[3])
+{
+  int i;
+  int P[3][3];
+
+  if (! get_smith_normal_form(mesh, P, transformation, grid_matrix)) {
+    return 0;
+  }
+
+  mat_multiply_matrix_vector_i3(shift, P, is_shift);
+  for (i = 0; i < 3; i++) {
+    shift[i] = ((shift[i] % 2) + 2) % 2;
+  }
+
+  return 1;
+}
+
+/* grid_address is given in the basis of kpt_get_generalized_mesh, */
+/* and the indices of map are those of kpt_get_grid_point with its */
+/* mesh. Only the rotations keeping the grid are used. */
+/* 0 is returned on failure. */
+int kpt_get_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					   int map[],
+					   SPGCONST int grid_matrix[3][3],
+					   const int is_shift[3],
+					   const int is_time_reversal,
+					   const MatINT *rotations)
+{
+  int num_ir;
+  int mesh[3], shift[3], transformation[3][3];
+  MatINT *rot_reciprocal, *rot_grid;
+
+  if (! kpt_get_generalized_mesh(mesh,
+				 shift,
+				 transformation,
+				 grid_matrix,
+				 is_shift)) {
+    return 0;
+  }
+
+  rot_reciprocal = get_point_group_reciprocal(rotations, is_time_reversal);
+  if (rot_reciprocal == NULL) {
+    return 0;
+  }
+  rot_grid = get_rotations_on_generalized_mesh(rot_reciprocal,
+					       mesh,
+					       shift,
+					       transformation);
+  mat_free_MatINT(rot_reciprocal);
+  rot_reciprocal = NULL;
+  if (rot_grid == NULL) {
+    return 0;
+  }
+
+  num_ir = get_ir_reciprocal_mesh(grid_address,
+				  map,
+				  mesh,
+				  shift,
+				  rot_grid);
+
+  mat_free_MatINT(rot_grid);
+  return num_ir;
+}
+
+/* Lattice translations are searched in the basis of rec_lattice, */
+/* so the distances are those of kpt_relocate_BZ_grid_address for a */
+/* diagonal grid_matrix. 0 is returned if grid_matrix is singular. */
+int kpt_relocate_BZ_generalized_grid_address(int bz_grid_address[][3],
+					     int bz_map[],
+					     SPGCONST int grid_address[][3],
+					     SPGCONST int grid_matrix[3][3],
+					     SPGCONST double rec_lattice[3][3],
+					     const int is_shift[3])
+{
+  int mesh[3], shift[3], transformation[3][3];
+  double inv_grid_matrix[3][3], microzone[3][3];
+  const int unit_mesh[3] = {1, 1, 1};
+
+  if (! kpt_get_generalized_mesh(mesh,
+				 shift,
+				 transformation,
+				 grid_matrix,
+				 is_shift)) {
+    return 0;
+  }
+
+  /* Basis vectors of the microzone are columns of rec_lattice M^-1. */
+  mat_cast_matrix_3i_to_3d(inv_grid_matrix, grid_matrix);
+  mat_inverse_matrix_d3(inv_grid_matrix, inv_grid_matrix, 0.5);
+  mat_multiply_matrix_d3(microzone, rec_lattice, inv_grid_matrix);
+
+  return relocate_BZ_grid_address(bz_grid_address,
+				  bz_map,
+				  grid_address,
+				  mesh,
+				  rec_lattice,
+				  shift,
+				  transformation,
+				  get_tolerance_for_BZ_reduction(microzone,
+								 unit_mesh));
 }
 
 int kpt_get_ir_triplets_at_q(int map_triplets[],
@@ -389,6 +923,9 @@ int kpt_get_ir_triplets_at_q(int map_triplets[],
   MatINT *rot_reciprocal;
 
   rot_reciprocal = get_point_group_reciprocal(rotations, is_time_reversal);
+  if (rot_reciprocal == NULL) {
+    return 0;
+  }
   num_ir = get_ir_triplets_at_q(map_triplets,
 				map_q,
 				grid_address,
@@ -468,7 +1005,14 @@ static MatINT *get_point_group_reciprocal(const MatINT * rotations,
   } else {
     rot_reciprocal = mat_alloc_MatINT(rotations->size);
   }
-  unique_rot = (int*)malloc(sizeof(int) * rot_reciprocal->size);
+  if (rot_reciprocal == NULL) {
+    return NULL;
+  }
+  if ((unique_rot = (int*)mem_malloc(sizeof(int) * rot_reciprocal->size))
+      == NULL) {
+    mat_free_MatINT(rot_reciprocal);
+    return NULL;
+  }
   for (i = 0; i < rot_reciprocal->size; i++) {
     unique_rot[i] = -1;
   }
@@ -497,10 +1041,53 @@ static MatINT *get_point_group_reciprocal(const MatINT * rotations,
     ;
   }
 
-  rot_return = mat_alloc_MatINT(num_rot);
-  for (i = 0; i < num_rot; i++) {
-    mat_copy_matrix_i3(rot_return->mat[i], rot_reciprocal->mat[unique_rot[i]]);    }
-  free(unique_rot);
+  if ((rot_return = mat_alloc_MatINT(num_rot)) != NULL) {
+    for (i = 0; i < num_rot; i++) {
+      mat_copy_matrix_i3(rot_return->mat[i],
+			 rot_reciprocal->mat[unique_rot[i]]);
+    }
+  }
+  mem_free(unique_rot);
+  mat_free_MatINT(rot_reciprocal);
+
+  return rot_return;
+}
+
+/* Only the rotations that keep the mesh and shift are returned. They */
+/* form a subgroup, since products of them keep the mesh as well. */
+static MatINT *get_point_group_reciprocal_on_mesh(const MatINT * rotations,
+						  const int is_time_reversal,
+						  const int mesh[3],
+						  const int is_shift[3])
+{
+  int i, num_rot;
+  MatINT *rot_reciprocal, *rot_return;
+
+  if ((rot_reciprocal = get_point_group_reciprocal(rotations,
+						   is_time_reversal))
+      == NULL) {
+    return NULL;
+  }
+
+  num_rot = 0;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    if (is_rotation_on_mesh(rot_reciprocal->mat[i], mesh, is_shift)) {
+      num_rot++;
+    }
+  }
+
+  if ((rot_return = mat_alloc_MatINT(num_rot)) == NULL) {
+    mat_free_MatINT(rot_reciprocal);
+    return NULL;
+  }
+
+  num_rot = 0;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    if (is_rotation_on_mesh(rot_reciprocal->mat[i], mesh, is_shift)) {
+      mat_copy_matrix_i3(rot_return->mat[num_rot], rot_reciprocal->mat[i]);
+      num_rot++;
+    }
+  }
   mat_free_MatINT(rot_reciprocal);
 
   return rot_return;
@@ -518,7 +1105,10 @@ static MatINT *get_point_group_reciprocal_with_q(const MatINT * rot_reciprocal,
 
   is_all_ok = 0;
   num_rot = 0;
-  ir_rot = (int*)malloc(sizeof(int) * rot_reciprocal->size);
+  if ((ir_rot = (int*)mem_malloc(sizeof(int) * rot_reciprocal->size))
+      == NULL) {
+    return NULL;
+  }
   for (i = 0; i < rot_reciprocal->size; i++) {
     ir_rot[i] = -1;
   }
@@ -554,22 +1144,239 @@ static MatINT *get_point_group_reciprocal_with_q(const MatINT * rot_reciprocal,
     }
   }
 
-  rot_reciprocal_q = mat_alloc_MatINT(num_rot);
-  for (i = 0; i < num_rot; i++) {
-    mat_copy_matrix_i3(rot_reciprocal_q->mat[i],
-		       rot_reciprocal->mat[ir_rot[i]]);  
+  if ((rot_reciprocal_q = mat_alloc_MatINT(num_rot)) != NULL) {
+    for (i = 0; i < num_rot; i++) {
+      mat_copy_matrix_i3(rot_reciprocal_q->mat[i],
+			 rot_reciprocal->mat[ir_rot[i]]);  
+    }
   }
 
-  free(ir_rot);
+  mem_free(ir_rot);
 
   return rot_reciprocal_q;
 }
 
+/* The orbits of the grid points are followed if rot_reciprocal is a */
+/* group acting on the mesh, and otherwise the mapping is searched */
+/* point by point as before. The results are the same for a group. */
 static int get_ir_reciprocal_mesh(int grid_address[][3],
 				  int map[],
 				  const int mesh[3],
 				  const int is_shift[3],
 				  const MatINT *rot_reciprocal)
+{
+  if (is_group_on_mesh(rot_reciprocal, mesh, is_shift)) {
+    return get_ir_reciprocal_mesh_by_orbits(grid_address,
+					    map,
+					    mesh,
+					    is_shift,
+					    rot_reciprocal);
+  }
+
+#ifdef _OPENMP
+  return get_ir_reciprocal_mesh_openmp(grid_address,
+				       map,
+				       mesh,
+				       is_shift,
+				       rot_reciprocal);
+#else
+  return get_ir_reciprocal_mesh_normal(grid_address,
+				       map,
+				       mesh,
+				       is_shift,
+				       rot_reciprocal);
+#endif
+}
+
+/* When a grid point is not reached by the orbits found so far, it is */
+/* irreducible and its orbit is marked at once, so each rotation is */
+/* applied only to the irreducible points. */
+static int get_ir_reciprocal_mesh_by_orbits(int grid_address[][3],
+					    int map[],
+					    const int mesh[3],
+					    const int is_shift[3],
+					    const MatINT * rot_reciprocal)
+{
+  int i, j, num_grid, grid_point_rot, num_ir;
+  int address_double[3], address_rot[3], mesh_double[3];
+
+  num_grid = mesh[0] * mesh[1] * mesh[2];
+  for (i = 0; i < 3; i++) {
+    mesh_double[i] = mesh[i] * 2;
+  }
+
+#pragma omp parallel for private(address_double)
+  for (i = 0; i < num_grid; i++) {
+    grid_point_to_address_double(address_double, i, mesh, is_shift);
+    get_grid_address(grid_address[i], address_double, mesh);
+    map[i] = -1;
+  }
+
+  num_ir = 0;
+  for (i = 0; i < num_grid; i++) {
+    if (map[i] > -1) {
+      continue;
+    }
+
+    map[i] = i;
+    num_ir++;
+    grid_point_to_address_double(address_double, i, mesh, is_shift);
+    for (j = 0; j < rot_reciprocal->size; j++) {
+      mat_multiply_matrix_vector_i3(address_rot,
+				    rot_reciprocal->mat[j],
+				    address_double);
+      get_vector_modulo(address_rot, mesh_double);
+      grid_point_rot = get_grid_point_double_mesh(address_rot, mesh);
+      if (map[grid_point_rot] == -1) {
+	map[grid_point_rot] = i;
+      }
+    }
+  }
+
+  return num_ir;
+}
+
+/* Addresses are scaled by shift_denominator as they are doubled */
+/* for a half shift, and rot_reciprocal has to be a group on the */
+/* shifted mesh. */
+static int get_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					     int map[],
+					     const int mesh[3],
+					     const int shift[3],
+					     const int shift_denominator,
+					     const MatINT * rot_reciprocal)
+{
+  int i, j, num_grid, grid_point_rot, num_ir;
+  int address_scaled[3], address_double[3], address_rot[3], mesh_scaled[3];
+
+  num_grid = mesh[0] * mesh[1] * mesh[2];
+  for (i = 0; i < 3; i++) {
+    mesh_scaled[i] = mesh[i] * shift_denominator;
+  }
+
+#pragma omp parallel for private(j, address_scaled, address_double)
+  for (i = 0; i < num_grid; i++) {
+    grid_point_to_address_scaled(address_scaled,
+				 i,
+				 mesh,
+				 shift,
+				 shift_denominator);
+    /* Unshifted address doubled, to be centered by get_grid_address */
+    for (j = 0; j < 3; j++) {
+      address_double[j] = (address_scaled[j] - shift[j]) / shift_denominator * 2;
+    }
+    get_grid_address(grid_address[i], address_double, mesh);
+    map[i] = -1;
+  }
+
+  num_ir = 0;
+  for (i = 0; i < num_grid; i++) {
+    if (map[i] > -1) {
+      continue;
+    }
+
+    map[i] = i;
+    num_ir++;
+    grid_point_to_address_scaled(address_scaled,
+				 i,
+				 mesh,
+				 shift,
+				 shift_denominator);
+    for (j = 0; j < rot_reciprocal->size; j++) {
+      mat_multiply_matrix_vector_i3(address_rot,
+				    rot_reciprocal->mat[j],
+				    address_scaled);
+      get_vector_modulo(address_rot, mesh_scaled);
+      grid_point_rot = get_grid_point_scaled_mesh(address_rot,
+						  mesh,
+						  shift,
+						  shift_denominator);
+      if (map[grid_point_rot] == -1) {
+	map[grid_point_rot] = i;
+      }
+    }
+  }
+
+  return num_ir;
+}
+
+/* NULL is returned if memory could not be allocated. */
+static MatINT *get_rotations_on_shifted_mesh(const MatINT * rot_reciprocal,
+					     const int mesh[3],
+					     const int shift[3],
+					     const int shift_denominator)
+{
+  int i, num_rot;
+  int rot_mesh[3][3];
+  MatINT *rotations;
+
+  num_rot = 0;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    if (get_rotation_on_shifted_mesh(rot_mesh,
+				     rot_reciprocal->mat[i],
+				     mesh,
+				     shift,
+				     shift_denominator)) {
+      num_rot++;
+    }
+  }
+
+  if ((rotations = mat_alloc_MatINT(num_rot)) == NULL) {
+    return NULL;
+  }
+
+  num_rot = 0;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    if (get_rotation_on_shifted_mesh(rot_mesh,
+				     rot_reciprocal->mat[i],
+				     mesh,
+				     shift,
+				     shift_denominator)) {
+      mat_copy_matrix_i3(rotations->mat[num_rot], rot_mesh);
+      num_rot++;
+    }
+  }
+
+  return rotations;
+}
+
+/* rot_mesh = diag(mesh) R diag(mesh)^-1 acts on scaled addresses as */
+/* R acts on q. 0 is returned if it is not an integer matrix or if it */
+/* does not keep the shift, i.e., R does not keep the shifted mesh. */
+static int get_rotation_on_shifted_mesh(int rot_mesh[3][3],
+					SPGCONST int rot[3][3],
+					const int mesh[3],
+					const int shift[3],
+					const int shift_denominator)
+{
+  int i, j;
+  int shift_rot[3];
+
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      if ((mesh[i] * rot[i][j]) % mesh[j] != 0) {
+	return 0;
+      }
+      rot_mesh[i][j] = mesh[i] * rot[i][j] / mesh[j];
+    }
+  }
+
+  mat_multiply_matrix_vector_i3(shift_rot, rot_mesh, shift);
+  for (i = 0; i < 3; i++) {
+    if ((shift_rot[i] - shift[i]) % shift_denominator != 0) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+#ifndef _OPENMP
+static int get_ir_reciprocal_mesh_normal(int grid_address[][3],
+					 int map[],
+					 const int mesh[3],
+					 const int is_shift[3],
+					 const MatINT *rot_reciprocal)
 {
   /* In the following loop, mesh is doubled. */
   /* Even and odd mesh numbers correspond to */
@@ -634,7 +1441,9 @@ static int get_ir_reciprocal_mesh(int grid_address[][3],
 
   return num_ir;
 }
+#endif
 
+#ifdef _OPENMP
 static int
 get_ir_reciprocal_mesh_openmp(int grid_address[][3],
 			      int map[],
@@ -699,23 +1508,385 @@ get_ir_reciprocal_mesh_openmp(int grid_address[][3],
   
   return num_ir;
 }
+#endif
+
+/* 1 is returned if the rotations are closed under the product and */
+/* each of them moves the (shifted) grid points onto grid points. */
+static int is_group_on_mesh(const MatINT * rot_reciprocal,
+			    const int mesh[3],
+			    const int is_shift[3])
+{
+  int i, j, k;
+  int product[3][3];
+
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    if (! is_rotation_on_mesh(rot_reciprocal->mat[i], mesh, is_shift)) {
+      return 0;
+    }
+
+    for (j = 0; j < rot_reciprocal->size; j++) {
+      mat_multiply_matrix_i3(product,
+			     rot_reciprocal->mat[i],
+			     rot_reciprocal->mat[j]);
+      for (k = 0; k < rot_reciprocal->size; k++) {
+	if (mat_check_identity_matrix_i3(product, rot_reciprocal->mat[k])) {
+	  break;
+	}
+      }
+      if (k == rot_reciprocal->size) {
+	return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+static int is_rotation_on_mesh(SPGCONST int rot[3][3],
+			       const int mesh[3],
+			       const int is_shift[3])
+{
+  int i, j;
+  int shift_rot[3];
+
+  /* The shift is kept: R * is_shift = is_shift (mod 2) */
+  mat_multiply_matrix_vector_i3(shift_rot, rot, is_shift);
+  for (i = 0; i < 3; i++) {
+    if ((shift_rot[i] - is_shift[i]) % 2 != 0) {
+      return 0;
+    }
+  }
+
+  /* The mesh is kept: R_ij * mesh[j] = 0 (mod mesh[i]) */
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      if ((rot[i][j] * mesh[j]) % mesh[i] != 0) {
+	return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+static int is_ir_grid_point(const int grid_point,
+			    const int mesh[3],
+			    const int is_shift[3],
+			    const MatINT * rot_reciprocal)
+{
+  int i;
+  int address_double[3], address_rot[3], mesh_double[3];
+
+  for (i = 0; i < 3; i++) {
+    mesh_double[i] = mesh[i] * 2;
+  }
+  grid_point_to_address_double(address_double, grid_point, mesh, is_shift);
+
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    mat_multiply_matrix_vector_i3(address_rot,
+				  rot_reciprocal->mat[i],
+				  address_double);
+    get_vector_modulo(address_rot, mesh_double);
+    if (get_grid_point_double_mesh(address_rot, mesh) < grid_point) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int get_smallest_image(const int grid_point,
+			      const int mesh[3],
+			      const int is_shift[3],
+			      const MatINT * rot_reciprocal)
+{
+  int i, image, smallest_image;
+  int address_double[3], address_rot[3], mesh_double[3];
+
+  for (i = 0; i < 3; i++) {
+    mesh_double[i] = mesh[i] * 2;
+  }
+  grid_point_to_address_double(address_double, grid_point, mesh, is_shift);
+
+  smallest_image = grid_point;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    mat_multiply_matrix_vector_i3(address_rot,
+				  rot_reciprocal->mat[i],
+				  address_double);
+    get_vector_modulo(address_rot, mesh_double);
+    image = get_grid_point_double_mesh(address_rot, mesh);
+    if (image < smallest_image) {
+      smallest_image = image;
+    }
+  }
+
+  return smallest_image;
+}
+
+static int get_num_stabilizer(const int grid_point,
+			      const int mesh[3],
+			      const int is_shift[3],
+			      const MatINT * rot_reciprocal)
+{
+  int i, num_stabilizer;
+  int address_double[3], address_rot[3], mesh_double[3];
+
+  for (i = 0; i < 3; i++) {
+    mesh_double[i] = mesh[i] * 2;
+  }
+  grid_point_to_address_double(address_double, grid_point, mesh, is_shift);
+
+  num_stabilizer = 0;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    mat_multiply_matrix_vector_i3(address_rot,
+				  rot_reciprocal->mat[i],
+				  address_double);
+    get_vector_modulo(address_rot, mesh_double);
+    if (get_grid_point_double_mesh(address_rot, mesh) == grid_point) {
+      num_stabilizer++;
+    }
+  }
+
+  return num_stabilizer;
+}
+
+/* Order of the group over the stabilizer if grid_point is the */
+/* smallest in its orbit, and 0 otherwise. */
+static int get_ir_weight(const int grid_point,
+			 const int mesh[3],
+			 const int is_shift[3],
+			 const MatINT * rot_reciprocal)
+{
+  int i, image, num_stabilizer;
+  int address_double[3], address_rot[3], mesh_double[3];
+
+  for (i = 0; i < 3; i++) {
+    mesh_double[i] = mesh[i] * 2;
+  }
+  grid_point_to_address_double(address_double, grid_point, mesh, is_shift);
+
+  num_stabilizer = 0;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    mat_multiply_matrix_vector_i3(address_rot,
+				  rot_reciprocal->mat[i],
+				  address_double);
+    get_vector_modulo(address_rot, mesh_double);
+    image = get_grid_point_double_mesh(address_rot, mesh);
+    if (image < grid_point) {
+      return 0;
+    }
+    if (image == grid_point) {
+      num_stabilizer++;
+    }
+  }
+
+  return rot_reciprocal->size / num_stabilizer;
+}
+
+/* P grid_matrix Q = diag(mesh) by elementary operations on rows (P) */
+/* and columns (Q), with mesh[0] | mesh[1] | mesh[2] and mesh[i] > 0. */
+/* 0 is returned if grid_matrix is singular. */
+static int get_smith_normal_form(int mesh[3],
+				 int P[3][3],
+				 int Q[3][3],
+				 SPGCONST int grid_matrix[3][3])
+{
+  int i, j, k, l, pivot_i, pivot_j, quotient, tmp, is_done;
+  int A[3][3];
+
+  mat_copy_matrix_i3(A, grid_matrix);
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      P[i][j] = (i == j);
+      Q[i][j] = (i == j);
+    }
+  }
+
+  for (k = 0; k < 3; k++) {
+    do {
+      /* The smallest non-zero element of the block is the pivot. */
+      pivot_i = -1;
+      pivot_j = -1;
+      for (i = k; i < 3; i++) {
+	for (j = k; j < 3; j++) {
+	  if (A[i][j] != 0 &&
+	      (pivot_i < 0 || abs(A[i][j]) < abs(A[pivot_i][pivot_j]))) {
+	    pivot_i = i;
+	    pivot_j = j;
+	  }
+	}
+      }
+      if (pivot_i < 0) {
+	return 0;
+      }
+
+      for (l = 0; l < 3; l++) {
+	tmp = A[k][l]; A[k][l] = A[pivot_i][l]; A[pivot_i][l] = tmp;
+	tmp = P[k][l]; P[k][l] = P[pivot_i][l]; P[pivot_i][l] = tmp;
+      }
+      for (l = 0; l < 3; l++) {
+	tmp = A[l][k]; A[l][k] = A[l][pivot_j]; A[l][pivot_j] = tmp;
+	tmp = Q[l][k]; Q[l][k] = Q[l][pivot_j]; Q[l][pivot_j] = tmp;
+      }
+
+      /* The remainders are smaller than the pivot if not zero. */
+      is_done = 1;
+      for (i = k + 1; i < 3; i++) {
+	quotient = A[i][k] / A[k][k];
+	for (l = 0; l < 3; l++) {
+	  A[i][l] -= quotient * A[k][l];
+	  P[i][l] -= quotient * P[k][l];
+	}
+	if (A[i][k] != 0) {
+	  is_done = 0;
+	}
+      }
+      for (j = k + 1; j < 3; j++) {
+	quotient = A[k][j] / A[k][k];
+	for (l = 0; l < 3; l++) {
+	  A[l][j] -= quotient * A[l][k];
+	  Q[l][j] -= quotient * Q[l][k];
+	}
+	if (A[k][j] != 0) {
+	  is_done = 0;
+	}
+      }
+
+      /* The pivot has to divide the rest of the block. */
+      for (i = k + 1; i < 3 && is_done; i++) {
+	for (j = k + 1; j < 3; j++) {
+	  if (A[i][j] % A[k][k] != 0) {
+	    for (l = 0; l < 3; l++) {
+	      A[k][l] += A[i][l];
+	      P[k][l] += P[i][l];
+	    }
+	    is_done = 0;
+	    break;
+	  }
+	}
+      }
+    } while (! is_done);
+
+    if (A[k][k] < 0) {
+      for (l = 0; l < 3; l++) {
+	A[k][l] = -A[k][l];
+	P[k][l] = -P[k][l];
+      }
+    }
+    mesh[k] = A[k][k];
+  }
+
+  return 1;
+}
+
+/* NULL is returned if memory could not be allocated. */
+static MatINT *get_rotations_on_generalized_mesh(const MatINT * rot_reciprocal,
+						 const int mesh[3],
+						 const int is_shift[3],
+						 SPGCONST int transformation[3][3])
+{
+  int i, num_rot;
+  int rot_grid[3][3], inv_transformation[3][3];
+  MatINT *rotations;
+
+  mat_inverse_matrix_i3(inv_transformation, transformation);
+
+  num_rot = 0;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    if (get_rotation_on_generalized_mesh(rot_grid,
+					 rot_reciprocal->mat[i],
+					 mesh,
+					 is_shift,
+					 transformation,
+					 inv_transformation)) {
+      num_rot++;
+    }
+  }
+
+  if ((rotations = mat_alloc_MatINT(num_rot)) == NULL) {
+    return NULL;
+  }
+
+  num_rot = 0;
+  for (i = 0; i < rot_reciprocal->size; i++) {
+    if (get_rotation_on_generalized_mesh(rot_grid,
+					 rot_reciprocal->mat[i],
+					 mesh,
+					 is_shift,
+					 transformation,
+					 inv_transformation)) {
+      mat_copy_matrix_i3(rotations->mat[num_rot], rot_grid);
+      num_rot++;
+    }
+  }
+
+  return rotations;
+}
+
+/* rot_grid = diag(mesh) Q^-1 R Q diag(mesh)^-1 acts on grid addresses */
+/* as R acts on q. 0 is returned if it is not an integer matrix or if */
+/* the shift is not kept, i.e., R does not keep the grid. */
+static int get_rotation_on_generalized_mesh(int rot_grid[3][3],
+					    SPGCONST int rot[3][3],
+					    const int mesh[3],
+					    const int is_shift[3],
+					    SPGCONST int transformation[3][3],
+					    SPGCONST int inv_transformation[3][3])
+{
+  int i, j;
+  int rot_transformed[3][3];
+
+  mat_multiply_matrix_i3(rot_transformed, rot, transformation);
+  mat_multiply_matrix_i3(rot_transformed, inv_transformation, rot_transformed);
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      if ((mesh[i] * rot_transformed[i][j]) % mesh[j] != 0) {
+	return 0;
+      }
+      rot_grid[i][j] = mesh[i] * rot_transformed[i][j] / mesh[j];
+    }
+  }
+
+  return is_rotation_on_mesh(rot_grid, mesh, is_shift);
+}
 
 /* Relocate grid addresses to first Brillouin zone */
 /* bz_grid_address[prod(mesh + 1)][3] */
 /* bz_map[prod(mesh * 2)] */
+/* grid_address is in the basis transformed by transformation (Q), */
+/* and lattice translations of rec_lattice are brought into it by */
+/* Q^-1, which is the identity for a diagonal mesh. */
 static int relocate_BZ_grid_address(int bz_grid_address[][3],
 				    int bz_map[],
 				    SPGCONST int grid_address[][3],
 				    const int mesh[3],
 				    SPGCONST double rec_lattice[3][3],
-				    const int is_shift[3])
+				    const int is_shift[3],
+				    SPGCONST int transformation[3][3],
+				    const double tolerance)
 {
-  double tolerance, min_distance;
-  double q_vector[3], distance[NUM_DIM_SEARCH];
+  double min_distance;
+  double q_vector[3], distance[NUM_DIM_SEARCH], rec_lattice_q[3][3];
   int bzmesh[3], bzmesh_double[3], bz_address_double[3];
+  int translation[NUM_DIM_SEARCH][3], inv_transformation[3][3];
+  int address[3], lattice_point[3];
   int i, j, k, min_index, boundary_num_gp, total_num_gp, bzgp, gp;
+  int is_diagonal;
+  SPGCONST int identity[3][3] = {
+    { 1, 0, 0 },
+    { 0, 1, 0 },
+    { 0, 0, 1 }
+  };
+
+  is_diagonal = mat_check_identity_matrix_i3(transformation, identity);
+  mat_inverse_matrix_i3(inv_transformation, transformation);
+  mat_multiply_matrix_di3(rec_lattice_q, rec_lattice, transformation);
+  for (i = 0; i < NUM_DIM_SEARCH; i++) {
+    mat_multiply_matrix_vector_i3(translation[i],
+				  inv_transformation,
+				  search_space[i]);
+  }
 
-  tolerance = get_tolerance_for_BZ_reduction(rec_lattice, mesh);
   for (i = 0; i < 3; i++) {
     bzmesh[i] = mesh[i] * 2;
     bzmesh_double[i] = bzmesh[i] * 2;
@@ -727,13 +1898,36 @@ static int relocate_BZ_grid_address(int bz_grid_address[][3],
   boundary_num_gp = 0;
   total_num_gp = mesh[0] * mesh[1] * mesh[2];
   for (i = 0; i < total_num_gp; i++) {
+    /* Q may take the grid point far from the origin in the basis of */
+    /* rec_lattice, so it is brought back to the nearest lattice point */
+    /* there before the search. Addresses of a diagonal mesh are */
+    /* already around the origin and kept. */
+    if (is_diagonal) {
+      mat_copy_vector_i3(address, grid_address[i]);
+    } else {
+      for (k = 0; k < 3; k++) {
+	q_vector[k] = (grid_address[i][k] * 2 + is_shift[k]) /
+	  ((double)mesh[k]) / 2;
+      }
+      mat_multiply_matrix_vector_id3(q_vector, transformation, q_vector);
+      for (k = 0; k < 3; k++) {
+	lattice_point[k] = mat_Nint(q_vector[k]);
+      }
+      mat_multiply_matrix_vector_i3(lattice_point,
+				    inv_transformation,
+				    lattice_point);
+      for (k = 0; k < 3; k++) {
+	address[k] = grid_address[i][k] - lattice_point[k] * mesh[k];
+      }
+    }
+
     for (j = 0; j < NUM_DIM_SEARCH; j++) {
       for (k = 0; k < 3; k++) {
 	q_vector[k] = 
-	  ((grid_address[i][k] + search_space[j][k] * mesh[k]) * 2 +
+	  ((address[k] + translation[j][k] * mesh[k]) * 2 +
 	   is_shift[k]) / ((double)mesh[k]) / 2;
       }
-      mat_multiply_matrix_vector_d3(q_vector, rec_lattice, q_vector);
+      mat_multiply_matrix_vector_d3(q_vector, rec_lattice_q, q_vector);
       distance[j] = mat_norm_squared_d3(q_vector);
     }
     min_distance = distance[0];
@@ -755,7 +1949,7 @@ static int relocate_BZ_grid_address(int bz_grid_address[][3],
 	
 	for (k = 0; k < 3; k++) {
 	  bz_grid_address[gp][k] = 
-	    grid_address[i][k] + search_space[j][k] * mesh[k];
+	    address[k] + translation[j][k] * mesh[k];
 	  bz_address_double[k] = bz_grid_address[gp][k] * 2 + is_shift[k];
 	}
 	get_vector_modulo(bz_address_double, bzmesh_double);
@@ -832,23 +2026,25 @@ static int get_ir_triplets_at_q(int map_triplets[],
 						       tolerance,
 						       1,
 						       stabilizer_q);
-#ifdef _OPENMP
-  num_ir_q = get_ir_reciprocal_mesh_openmp(grid_address,
-					   map_q,
-					   mesh,
-					   is_shift,
-					   rot_reciprocal_q);
-#else
+  if (rot_reciprocal_q == NULL) {
+    return 0;
+  }
   num_ir_q = get_ir_reciprocal_mesh(grid_address,
 				    map_q,
 				    mesh,
 				    is_shift,
 				    rot_reciprocal_q);
-#endif
   mat_free_MatINT(rot_reciprocal_q);
 
-  third_q = (int*) malloc(sizeof(int) * num_ir_q);
-  ir_grid_points = (int*) malloc(sizeof(int) * num_ir_q);
+  third_q = (int*) mem_malloc(sizeof(int) * num_ir_q);
+  ir_grid_points = (int*) mem_malloc(sizeof(int) * num_ir_q);
+  if (third_q == NULL || ir_grid_points == NULL) {
+    mem_free(third_q);
+    third_q = NULL;
+    mem_free(ir_grid_points);
+    ir_grid_points = NULL;
+    return 0;
+  }
   num_ir_q = 0;
   for (i = 0; i < num_grid; i++) {
     if (map_q[i] == i) {
@@ -888,9 +2084,9 @@ static int get_ir_triplets_at_q(int map_triplets[],
     map_triplets[i] = map_triplets[map_q[i]];
   }
   
-  free(third_q);
+  mem_free(third_q);
   third_q = NULL;
-  free(ir_grid_points);
+  mem_free(ir_grid_points);
   ir_grid_points = NULL;
 
   return num_ir_triplets;
@@ -914,7 +2110,10 @@ static int get_BZ_triplets_at_q(int triplets[][3],
   }
 
   num_ir = 0;
-  ir_grid_points = (int*) malloc(sizeof(int) * num_map_triplets);
+  if ((ir_grid_points = (int*) mem_malloc(sizeof(int) * num_map_triplets))
+      == NULL) {
+    return 0;
+  }
   for (i = 0; i < num_map_triplets; i++) {
     if (map_triplets[i] == i) {
       ir_grid_points[num_ir] = i;
@@ -949,7 +2148,7 @@ static int get_BZ_triplets_at_q(int triplets[][3],
     }
   }
 
-  free(ir_grid_points);
+  mem_free(ir_grid_points);
   
   return num_ir;
 }
@@ -1089,6 +2288,36 @@ static void get_grid_address(int address[3],
   }  
 }
 
+/* address_scaled = address * shift_denominator + shift (mod */
+/* mesh * shift_denominator) */
+static int get_grid_point_scaled_mesh(const int address_scaled[3],
+				      const int mesh[3],
+				      const int shift[3],
+				      const int shift_denominator)
+{
+  int i, address[3];
+
+  for (i = 0; i < 3; i++) {
+    address[i] = (address_scaled[i] - shift[i]) / shift_denominator;
+  }
+  return get_grid_point_single_mesh(address, mesh);
+}
+
+static void grid_point_to_address_scaled(int address_scaled[3],
+					 const int grid_point,
+					 const int mesh[3],
+					 const int shift[3],
+					 const int shift_denominator)
+{
+  int i;
+  const int no_shift[3] = {0, 0, 0};
+
+  grid_point_to_address_double(address_scaled, grid_point, mesh, no_shift);
+  for (i = 0; i < 3; i++) {
+    address_scaled[i] = address_scaled[i] / 2 * shift_denominator + shift[i];
+  }
+}
+
 static void get_vector_modulo(int v[3], const int m[3])
 {
   int i;
@@ -11,6 +11,19 @@
 /* element first. But when GRID_ORDER_XYZ is defined, it is changed to right */ 
 /* element first. */
 
+/* Irreducible grid points of a mesh in ascending order, */
+/* with the number of grid points mapped to each and its address. */
+typedef struct {
+  int size;
+  int *grid_points;
+  int *weights;
+  int (*grid_address)[3];
+  MatINT *rot_reciprocal;
+} IrGridPoints;
+
+/* Iterator over irreducible grid points of a mesh */
+typedef struct _IrGridPointIterator IrGridPointIterator;
+
 int kpt_get_grid_point(const int grid_address[3],
 		       const int mesh[3]);
 int kpt_get_irreducible_reciprocal_mesh(int grid_address[][3],
@@ -19,6 +32,13 @@ int kpt_get_irreducible_reciprocal_mesh(int grid_address[][3],
 					const int is_shift[3],
 					const int is_time_reversal,
 					const MatINT *rotations);
+int kpt_get_irreducible_reciprocal_mesh_with_shift(int grid_address[][3],
+						   int map[],
+						   const int mesh[3],
+						   const int shift[3],
+						   const int shift_denominator,
+						   const int is_time_reversal,
+						   const MatINT *rotations);
 int kpt_get_stabilized_reciprocal_mesh(int grid_address[][3],
 				       int map[],
 				       const int mesh[3],
@@ -27,6 +47,26 @@ int kpt_get_stabilized_reciprocal_mesh(int grid_address[][3],
 				       const MatINT * rotations,
 				       const int num_q,
 				       SPGCONST double qpoints[][3]);
+IrGridPoints * kpt_get_ir_grid_points(const int mesh[3],
+				      const int is_shift[3],
+				      const int is_time_reversal,
+				      const MatINT *rotations);
+void kpt_free_ir_grid_points(IrGridPoints *ir_grid_points);
+int kpt_get_ir_grid_point(const int grid_point,
+			  const int mesh[3],
+			  const int is_shift[3],
+			  const MatINT *rot_reciprocal);
+IrGridPointIterator *
+kpt_alloc_ir_grid_point_iterator(const int mesh[3],
+				 const int is_shift[3],
+				 const int is_time_reversal,
+				 const MatINT *rotations);
+void kpt_free_ir_grid_point_iterator(IrGridPointIterator *iterator);
+int kpt_get_next_ir_grid_points(int grid_points[],
+				int weights[],
+				int grid_address[][3],
+				const int max_size,
+				IrGridPointIterator *iterator);
 void kpt_get_grid_points_by_rotations(int rot_grid_points[],
 				      const int address_orig[3],
 				      const MatINT * rot_reciprocal,
@@ -44,6 +84,23 @@ int kpt_relocate_BZ_grid_address(int bz_grid_address[][3],
 				 const int mesh[3],
 				 SPGCONST double rec_lattice[3][3],
 				 const int is_shift[3]);
+int kpt_get_generalized_mesh(int mesh[3],
+			     int shift[3],
+			     int transformation[3][3],
+			     SPGCONST int grid_matrix[3][3],
+			     const int is_shift[3]);
+int kpt_get_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					   int map[],
+					   SPGCONST int grid_matrix[3][3],
+					   const int is_shift[3],
+					   const int is_time_reversal,
+					   const MatINT *rotations);
+int kpt_relocate_BZ_generalized_grid_address(int bz_grid_address[][3],
+					     int bz_map[],
+					     SPGCONST int grid_address[][3],
+					     SPGCONST int grid_matrix[3][3],
+					     SPGCONST double rec_lattice[3][3],
+					     const int is_shift[3]);
 int kpt_get_ir_triplets_at_q(int map_triplets[],
 			     int map_q[],
 			     int grid_address[][3],
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "mathfunc.h"
+#include "mem.h"
 
 #include "debug.h"
 
@@ -305,6 +306,32 @@ int mat_inverse_matrix_d3(double m[3][3],
   return 1;
 }
 
+/* m^-1 of a unimodular integer matrix. 0 is returned if |det| != 1. */
+int mat_inverse_matrix_i3(int m[3][3],
+			  SPGCONST int a[3][3])
+{
+  int det;
+  int c[3][3];
+  det = mat_get_determinant_i3(a);
+  if (det != 1 && det != -1) {
+    debug_print("No integer inverse matrix\n");
+    return 0;
+  }
+
+  /* 1/det = det */
+  c[0][0] = (a[1][1] * a[2][2] - a[1][2] * a[2][1]) * det;
+  c[1][0] = (a[1][2] * a[2][0] - a[1][0] * a[2][2]) * det;
+  c[2][0] = (a[1][0] * a[2][1] - a[1][1] * a[2][0]) * det;
+  c[0][1] = (a[2][1] * a[0][2] - a[2][2] * a[0][1]) * det;
+  c[1][1] = (a[2][2] * a[0][0] - a[2][0] * a[0][2]) * det;
+  c[2][1] = (a[2][0] * a[0][1] - a[2][1] * a[0][0]) * det;
+  c[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * det;
+  c[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * det;
+  c[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * det;
+  mat_copy_matrix_i3(m, c);
+  return 1;
+}
+
 /* m = b^-1 a b */
 int mat_get_similar_matrix_d3(double m[3][3],
 			      SPGCONST double a[3][3],
@@ -394,17 +421,20 @@ double mat_Dmod1(const double a)
     return a - (int) a;
 }
 
+/* NULL is returned if memory could not be allocated. */
 MatINT * mat_alloc_MatINT(const int size)
 {
   MatINT *matint;
-  matint = (MatINT*) malloc( sizeof( MatINT ) );
+  if ( ( matint = (MatINT*) mem_malloc( sizeof( MatINT ) ) ) == NULL ) {
+    return NULL;
+  }
   matint->size = size;
   if ( size > 0 ) {
-    if ( ( matint->mat = (int (*)[3][3]) malloc( sizeof(int[3][3]) * size) )
-	 == NULL ) {
-      warning_print("spglib: Memory could not be allocated ");
-      warning_print("(MatINT, line %d, %s).\n", __LINE__, __FILE__);
-      exit(1);
+    if ( ( matint->mat =
+	   (int (*)[3][3]) mem_malloc( sizeof(int[3][3]) * size) ) == NULL ) {
+      mem_free( matint );
+      matint = NULL;
+      return NULL;
     }
   }
   return matint;
@@ -412,25 +442,31 @@ MatINT * mat_alloc_MatINT(const int size)
 
 void mat_free_MatINT(MatINT * matint)
 {
+  if ( matint == NULL ) {
+    return;
+  }
   if ( matint->size > 0 ) {
-    free( matint->mat );
+    mem_free( matint->mat );
     matint->mat = NULL;
   }
-  free( matint );
+  mem_free( matint );
   matint = NULL;
 }
 
+/* NULL is returned if memory could not be allocated. */
 VecDBL * mat_alloc_VecDBL(const int size)
 {
   VecDBL *vecdbl;
-  vecdbl = (VecDBL*) malloc( sizeof( VecDBL ) );
+  if ( ( vecdbl = (VecDBL*) mem_malloc( sizeof( VecDBL ) ) ) == NULL ) {
+    return NULL;
+  }
   vecdbl->size = size;
   if ( size > 0 ) {
-    if ( ( vecdbl->vec = (double (*)[3]) malloc( sizeof(double[3]) * size) )
-	 == NULL ) {
-      warning_print("spglib: Memory could not be allocated ");
-      warning_print("(VecDBL, line %d, %s).\n", __LINE__, __FILE__);
-      exit(1);
+    if ( ( vecdbl->vec =
+	   (double (*)[3]) mem_malloc( sizeof(double[3]) * size) ) == NULL ) {
+      mem_free( vecdbl );
+      vecdbl = NULL;
+      return NULL;
     }
   }
   return vecdbl;
@@ -438,11 +474,14 @@ VecDBL * mat_alloc_VecDBL(const int size)
 
 void mat_free_VecDBL(VecDBL * vecdbl)
 {
+  if ( vecdbl == NULL ) {
+    return;
+  }
   if ( vecdbl->size > 0 ) {
-    free( vecdbl->vec );
+    mem_free( vecdbl->vec );
     vecdbl->vec = NULL;
   }
-  free( vecdbl );
+  mem_free( vecdbl );
   vecdbl = NULL;
 }
 
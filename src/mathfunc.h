@@ -67,6 +67,8 @@ void mat_cast_matrix_3d_to_3i(int m[3][3],
 int mat_inverse_matrix_d3(double m[3][3],
 			  SPGCONST double a[3][3],
 			  const double precision);
+int mat_inverse_matrix_i3(int m[3][3],
+			  SPGCONST int a[3][3]);
 int mat_get_similar_matrix_d3(double m[3][3],
 			      SPGCONST double a[3][3],
 			      SPGCONST double b[3][3],
@@ -0,0 +1,265 @@
+/* mem.c */
+/* Copyright (C) 2015 Atsushi Togo */
+
+#include <stdlib.h>
+#include "mem.h"
+
+#include "debug.h"
+
+#define DEFAULT_BLOCK_SIZE 65536
+
+typedef struct _MemBlock {
+  struct _MemBlock *next;
+  size_t size;
+  size_t used;
+} MemBlock;
+
+struct _MemArena {
+  MemBlock *head;
+  size_t block_size;
+};
+
+/* Every allocation is preceded by this header, so that mem_free */
+/* knows where the memory came from. Its size keeps the alignment */
+/* of the memory that follows. */
+typedef union {
+  struct {
+    MemArena *arena;
+    size_t size;
+  } h;
+  double align[2];
+} MemHeader;
+
+static SPG_THREAD_LOCAL int is_failed = 0;
+static SPG_THREAD_LOCAL MemArena *current_arena = NULL;
+#ifdef SPG_FAULT_INJECTION
+static SPG_THREAD_LOCAL int allocation_countdown = 0;
+static SPG_THREAD_LOCAL int num_allocations = 0;
+#endif
+
+static MemHeader * alloc_from_arena(MemArena *arena, const size_t size);
+static MemBlock * alloc_block(const size_t size);
+static char * get_block_data(MemBlock *block);
+static size_t get_aligned_size(const size_t size);
+
+void * mem_malloc(const size_t size)
+{
+  MemHeader *header;
+
+#ifdef SPG_FAULT_INJECTION
+  if (allocation_countdown > 0 && --allocation_countdown == 0) {
+    is_failed = 1;
+    return NULL;
+  }
+#endif
+
+  if (current_arena == NULL) {
+    header = (MemHeader*) malloc(sizeof(MemHeader) + size);
+    if (header != NULL) {
+      header->h.arena = NULL;
+      header->h.size = size;
+    }
+  } else {
+    header = alloc_from_arena(current_arena, size);
+  }
+
+  if (header == NULL) {
+    warning_print("spglib: Memory could not be allocated (%lu bytes).\n",
+		  (unsigned long)size);
+    is_failed = 1;
+    return NULL;
+  }
+
+#ifdef SPG_FAULT_INJECTION
+  num_allocations++;
+#endif
+
+  return header + 1;
+}
+
+void mem_free(void *ptr)
+{
+  MemHeader *header;
+  MemBlock *block;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+#ifdef SPG_FAULT_INJECTION
+  num_allocations--;
+#endif
+
+  header = ((MemHeader*)ptr) - 1;
+  if (header->h.arena == NULL) {
+    free(header);
+    return;
+  }
+
+  /* Only the last allocation can be given back to the arena. */
+  block = header->h.arena->head;
+  if (block != NULL &&
+      (char*)header + header->h.size == get_block_data(block) + block->used) {
+    block->used -= header->h.size;
+  }
+}
+
+void mem_clear_failure(void)
+{
+  is_failed = 0;
+}
+
+int mem_is_failed(void)
+{
+  return is_failed;
+}
+
+/* NULL is returned if memory could not be allocated. */
+MemArena * mem_alloc_arena(const size_t block_size)
+{
+  MemArena *arena;
+
+  if ((arena = (MemArena*) malloc(sizeof(MemArena))) == NULL) {
+    is_failed = 1;
+    return NULL;
+  }
+
+  arena->block_size = block_size > 0 ? block_size : DEFAULT_BLOCK_SIZE;
+  if ((arena->head = alloc_block(arena->block_size)) == NULL) {
+    is_failed = 1;
+    free(arena);
+    return NULL;
+  }
+
+  return arena;
+}
+
+void mem_free_arena(MemArena *arena)
+{
+  MemBlock *block;
+
+  if (arena == NULL) {
+    return;
+  }
+
+  if (current_arena == arena) {
+    current_arena = NULL;
+  }
+
+  while (arena->head != NULL) {
+    block = arena->head;
+    arena->head = block->next;
+    free(block);
+  }
+  free(arena);
+}
+
+/* When the arena has grown to several blocks, they are replaced by */
+/* one block of the total size, so that a repeated workload is served */
+/* from a single block. */
+void mem_reset_arena(MemArena *arena)
+{
+  size_t total;
+  MemBlock *block;
+
+  if (arena == NULL) {
+    return;
+  }
+
+  if (arena->head != NULL && arena->head->next == NULL) {
+    arena->head->used = 0;
+    return;
+  }
+
+  total = 0;
+  while (arena->head != NULL) {
+    block = arena->head;
+    arena->head = block->next;
+    total += block->size;
+    free(block);
+  }
+
+  /* If this fails, a block is allocated again at the next request. */
+  arena->head = alloc_block(total);
+}
+
+void mem_set_arena(MemArena *arena)
+{
+  current_arena = arena;
+}
+
+MemArena * mem_get_arena(void)
+{
+  return current_arena;
+}
+
+#ifdef SPG_FAULT_INJECTION
+void mem_set_allocation_countdown(const int n)
+{
+  allocation_countdown = n > 0 ? n : 0;
+}
+
+int mem_get_allocation_countdown(void)
+{
+  return allocation_countdown;
+}
+
+int mem_get_num_allocations(void)
+{
+  return num_allocations;
+}
+#endif
+
+static MemHeader * alloc_from_arena(MemArena *arena, const size_t size)
+{
+  size_t aligned_size;
+  MemHeader *header;
+  MemBlock *block;
+
+  aligned_size = get_aligned_size(sizeof(MemHeader) + size);
+  block = arena->head;
+
+  if (block == NULL || block->used + aligned_size > block->size) {
+    if ((block = alloc_block(aligned_size > arena->block_size ?
+			     aligned_size : arena->block_size)) == NULL) {
+      return NULL;
+    }
+    block->next = arena->head;
+    arena->head = block;
+  }
+
+  header = (MemHeader*)(get_block_data(block) + block->used);
+  block->used += aligned_size;
+  header->h.arena = arena;
+  header->h.size = aligned_size;
+
+  return header;
+}
+
+static MemBlock * alloc_block(const size_t size)
+{
+  MemBlock *block;
+
+  if ((block = (MemBlock*) malloc(get_aligned_size(sizeof(MemBlock)) + size))
+      == NULL) {
+    return NULL;
+  }
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+
+  return block;
+}
+
+/* Memory of a block starts after its aligned header. */
+static char * get_block_data(MemBlock *block)
+{
+  return (char*)block + get_aligned_size(sizeof(MemBlock));
+}
+
+static size_t get_aligned_size(const size_t size)
+{
+  return (size + sizeof(MemHeader) - 1) / sizeof(MemHeader) *
+    sizeof(MemHeader);
+}
@@ -0,0 +1,51 @@
+/* mem.h */
+/* Copyright (C) 2015 Atsushi Togo */
+
+#ifndef __mem_H__
+#define __mem_H__
+
+#include <stddef.h>
+
+/* Storage class of per-thread variables */
+#if defined(_MSC_VER)
+#define SPG_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define SPG_THREAD_LOCAL __thread
+#else
+#define SPG_THREAD_LOCAL
+#endif
+
+/* Bump allocator made of a chain of large blocks. While an arena is */
+/* set to a thread, mem_malloc of the thread takes memory from it and */
+/* mem_free gives memory back only if it was the last allocation. */
+/* Everything is released at once by mem_reset_arena. */
+typedef struct _MemArena MemArena;
+
+/* mem_malloc returns NULL instead of terminating the process when */
+/* memory is exhausted. The failure is recorded per thread until */
+/* mem_clear_failure is called. Memory obtained by mem_malloc has to */
+/* be released by mem_free, not by free. */
+void * mem_malloc(const size_t size);
+void mem_free(void *ptr);
+void mem_clear_failure(void);
+int mem_is_failed(void);
+
+MemArena * mem_alloc_arena(const size_t block_size);
+void mem_free_arena(MemArena *arena);
+void mem_reset_arena(MemArena *arena);
+void mem_set_arena(MemArena *arena);
+MemArena * mem_get_arena(void);
+
+#ifdef SPG_FAULT_INJECTION
+/* Only in the library built for tests. The n-th call of mem_malloc */
+/* from now on this thread fails, or none if n = 0. */
+/* mem_get_allocation_countdown returns the number of calls left */
+/* before the failure, 0 once it has happened. */
+/* mem_get_num_allocations returns the number of allocations of the */
+/* thread not yet released by mem_free. */
+void mem_set_allocation_countdown(const int n);
+int mem_get_allocation_countdown(void);
+int mem_get_num_allocations(void);
+#endif
+
+#endif
@@ -6,40 +6,58 @@
 #include <string.h>
 #include "niggli.h"
 
-static double A, B, C, eta, xi, zeta, eps;
-static int l, m, n;
-static double *tmat = NULL;
-static double *lattice = NULL;
-
-static void initialize(const double *lattice_, const double eps_);
-static void finalize(double *lattice_);
-static void reset(void);
-static void step0(void);
-static int step1(void);
-static int step2(void);
-static int step3(void);
-static int step4(void);
-static int step5(void);
-static int step6(void);
-static int step7(void);
-static int step8(void);
-static void set_parameters(void);
-static void set_angle_types(void);
-static double * get_transpose(const double *M);
-static double * get_metric(const double *M);
-static double * multiply_matrices(const double *A, const double *B);
+#define NIGGLI_MAX_NUM_LOOP 10
+
+/* State of one reduction. It is kept on the caller's stack so that */
+/* niggli_reduce can be called from several threads at once. */
+typedef struct {
+  double A;
+  double B;
+  double C;
+  double eta;
+  double xi;
+  double zeta;
+  double eps;
+  int l;
+  int m;
+  int n;
+  double tmat[9];
+  double lattice[9];
+} NiggliParams;
+
+static void initialize(NiggliParams *p,
+		       const double *lattice_,
+		       const double eps_);
+static void finalize(double *lattice_, NiggliParams *p);
+static void reset(NiggliParams *p);
+static void step0(NiggliParams *p);
+static int step1(NiggliParams *p);
+static int step2(NiggliParams *p);
+static int step3(NiggliParams *p);
+static int step4(NiggliParams *p);
+static int step5(NiggliParams *p);
+static int step6(NiggliParams *p);
+static int step7(NiggliParams *p);
+static int step8(NiggliParams *p);
+static void set_parameters(NiggliParams *p);
+static void set_angle_types(NiggliParams *p);
+static void get_transpose(double M_T[9], const double M[9]);
+static void get_metric(double G[9], const double M[9]);
+static void multiply_matrices(double M[9],
+			      const double L[9],
+			      const double R[9]);
 
 #ifdef NIGGLI_DEBUG
 #define debug_print(...) printf(__VA_ARGS__)
-static void debug_show(void);
-static void debug_show(void)
+static void debug_show(const NiggliParams *p);
+static void debug_show(const NiggliParams *p)
 {
   int i;
-  printf("%f %f %f %f %f %f\n", A, B, C, xi, eta, zeta);
-  printf("%d %d %d\n", l, m, n);
+  printf("%f %f %f %f %f %f\n", p->A, p->B, p->C, p->xi, p->eta, p->zeta);
+  printf("%d %d %d\n", p->l, p->m, p->n);
   
   for (i = 0; i < 3; i++) {
-    printf("%f %f %f\n", lattice[i * 3], lattice[i * 3 + 1], lattice[i * 3 + 2]);
+    printf("%f %f %f\n", p->lattice[i * 3], p->lattice[i * 3 + 1], p->lattice[i * 3 + 2]);
   }
 }
 #else
@@ -47,63 +65,65 @@ static void debug_show(void)
 #define debug_show(...)
 #endif
 
-void niggli_reduce(double *lattice_, const double eps_)
+/* 0 is returned if the reduction does not converge. */
+int niggli_reduce(double *lattice_, const double eps_)
 {
   int i;
+  NiggliParams p;
 
-  initialize(lattice_, eps_);
-  step0();
+  initialize(&p, lattice_, eps_);
+  step0(&p);
   
-  for (i = 0; i < 10; i++) {
-    if (step1()) {
+  for (i = 0; i < NIGGLI_MAX_NUM_LOOP; i++) {
+    if (step1(&p)) {
       debug_print("step1\n");
-      debug_show();
+      debug_show(&p);
       debug_print("\n");
     }
 
-    if (step2()) {
+    if (step2(&p)) {
       debug_print("step2\n");
-      debug_show();
+      debug_show(&p);
       debug_print("\n");
       continue;
     }
 
-    if (step3()) {
+    if (step3(&p)) {
       debug_print("step3\n");
-      debug_show();
+      debug_show(&p);
       debug_print("\n");
     }
 
-    if (step4()) {
+    if (step4(&p)) {
       debug_print("step4\n");
-      debug_show();
+      debug_show(&p);
       debug_print("\n");
     }
 
-    if (step5()) {
+    if (step5(&p)) {
       debug_print("step5\n");
-      debug_show();
+      debug_show(&p);
       debug_print("\n");
       continue;
     }
 
-    if (step6()) {
+    if (step6(&p)) {
       debug_print("step6\n");
-      debug_show();
+      debug_show(&p);
       debug_print("\n");
       continue;
     }
 
-    if (step7()) {
+    if (step7(&p)) {
       debug_print("step7\n");
-      debug_show();
+      debug_show(&p);
       debug_print("\n");
       continue;
     }
 
-    if (step8()) {
+    if (step8(&p)) {
       debug_print("step7\n");
-      debug_show();
+      debug_show(&p);
       debug_print("\n");
       continue;
     }
@@ -111,225 +131,220 @@ void niggli_reduce(double *lattice_, const double eps_)
     break;
   }
 
-  finalize(lattice_);
+  finalize(lattice_, &p);
+
+  if (i == NIGGLI_MAX_NUM_LOOP) {
+    debug_print("Niggli reduction did not converge.\n");
+    return 0;
+  }
+  return 1;
 }
 
-static void initialize(const double *lattice_, const double eps_)
+static void initialize(NiggliParams *p,
+		       const double *lattice_,
+		       const double eps_)
 {
-  tmat = (double*)malloc(sizeof(double) * 9);
-  eps = eps_;
-  lattice = (double*)malloc(sizeof(double) * 9);
-  memcpy(lattice, lattice_, sizeof(double) * 9);
+  p->eps = eps_;
+  memcpy(p->lattice, lattice_, sizeof(double) * 9);
 }
 
-static void finalize(double *lattice_)
+static void finalize(double *lattice_, NiggliParams *p)
 {
-  free(tmat);
-  memcpy(lattice_, lattice, sizeof(double) * 9);
-  free(lattice);
+  memcpy(lattice_, p->lattice, sizeof(double) * 9);
 }
 
-static void reset(void)
+static void reset(NiggliParams *p)
 {
-  double *lat_tmp;
+  double lat_tmp[9];
   
-  lat_tmp = multiply_matrices(lattice, tmat);
+  multiply_matrices(lat_tmp, p->lattice, p->tmat);
 
-  memcpy(lattice, lat_tmp, sizeof(double) * 9);
-  step0();
-  free(lat_tmp);
+  memcpy(p->lattice, lat_tmp, sizeof(double) * 9);
+  step0(p);
 }
 
-static void step0(void)
+static void step0(NiggliParams *p)
 {
-  set_parameters();
-  set_angle_types();
+  set_parameters(p);
+  set_angle_types(p);
 }
 
-static int step1(void)
+static int step1(NiggliParams *p)
 {
-  if (A > B + eps ||
-      (! (fabs(A -B) > eps) && fabs(xi) > fabs(eta) + eps)) {
-    tmat[0] = 0,  tmat[1] = -1, tmat[2] = 0;
-    tmat[3] = -1, tmat[4] = 0,  tmat[5] = 0;
-    tmat[6] = 0,  tmat[7] = 0,  tmat[8] = -1;
-    reset();
+  if (p->A > p->B + p->eps ||
+      (! (fabs(p->A -p->B) > p->eps) && fabs(p->xi) > fabs(p->eta) + p->eps)) {
+    p->tmat[0] = 0,  p->tmat[1] = -1, p->tmat[2] = 0;
+    p->tmat[3] = -1, p->tmat[4] = 0,  p->tmat[5] = 0;
+    p->tmat[6] = 0,  p->tmat[7] = 0,  p->tmat[8] = -1;
+    reset(p);
     return 1;
   }
   else {return 0;}
 }
 
-static int step2(void)
+static int step2(NiggliParams *p)
 {
-  if (B > C + eps ||
-      (! (fabs(B - C) > eps) && fabs(eta) > fabs(zeta) + eps)) {
-    tmat[0] = -1, tmat[1] = 0,  tmat[2] = 0;
-    tmat[3] = 0,  tmat[4] = 0,  tmat[5] = -1;
-    tmat[6] = 0,  tmat[7] = -1, tmat[8] = 0;
-    reset();
+  if (p->B > p->C + p->eps ||
+      (! (fabs(p->B - p->C) > p->eps) && fabs(p->eta) > fabs(p->zeta) + p->eps)) {
+    p->tmat[0] = -1, p->tmat[1] = 0,  p->tmat[2] = 0;
+    p->tmat[3] = 0,  p->tmat[4] = 0,  p->tmat[5] = -1;
+    p->tmat[6] = 0,  p->tmat[7] = -1, p->tmat[8] = 0;
+    reset(p);
     return 1;
   }
   else {return 0;}
 }
 
-static int step3(void)
+static int step3(NiggliParams *p)
 {
   int i, j, k;
-  if (l * m * n == 1) {
-    if (l == -1) {i = -1;} else {i = 1;}
-    if (m == -1) {j = -1;} else {j = 1;}
-    if (n == -1) {k = -1;} else {k = 1;}
-    tmat[0] = i, tmat[1] = 0, tmat[2] = 0;
-    tmat[3] = 0, tmat[4] = j, tmat[5] = 0;
-    tmat[6] = 0, tmat[7] = 0, tmat[8] = k;
-    reset();
+  if (p->l * p->m * p->n == 1) {
+    if (p->l == -1) {i = -1;} else {i = 1;}
+    if (p->m == -1) {j = -1;} else {j = 1;}
+    if (p->n == -1) {k = -1;} else {k = 1;}
+    p->tmat[0] = i, p->tmat[1] = 0, p->tmat[2] = 0;
+    p->tmat[3] = 0, p->tmat[4] = j, p->tmat[5] = 0;
+    p->tmat[6] = 0, p->tmat[7] = 0, p->tmat[8] = k;
+    reset(p);
     return 1;
   }
   else {return 0;}
 }
 
-static int step4(void)
+static int step4(NiggliParams *p)
 {
   int i, j, k;
-  if (l * m * n == 0 || l * m * n == -1) {
-    if (l == -1) {i = -1;} else {i = 1;}
-    if (m == -1) {j = -1;} else {j = 1;}
-    if (n == -1) {k = -1;} else {k = 1;}
+  if (p->l * p->m * p->n == 0 || p->l * p->m * p->n == -1) {
+    if (p->l == -1) {i = -1;} else {i = 1;}
+    if (p->m == -1) {j = -1;} else {j = 1;}
+    if (p->n == -1) {k = -1;} else {k = 1;}
 
     if (i * j * k == -1) {
-      if (l == 0) {i = -1;}
-      if (m == 0) {j = -1;}
-      if (n == 0) {k = -1;}
+      if (p->l == 0) {i = -1;}
+      if (p->m == 0) {j = -1;}
+      if (p->n == 0) {k = -1;}
     }
     
-    tmat[0] = i, tmat[1] = 0, tmat[2] = 0;
-    tmat[3] = 0, tmat[4] = j, tmat[5] = 0;
-    tmat[6] = 0, tmat[7] = 0, tmat[8] = k;
-    reset();
+    p->tmat[0] = i, p->tmat[1] = 0, p->tmat[2] = 0;
+    p->tmat[3] = 0, p->tmat[4] = j, p->tmat[5] = 0;
+    p->tmat[6] = 0, p->tmat[7] = 0, p->tmat[8] = k;
+    reset(p);
     return 1;
   }
   else {return 0;}
 }
 
-static int step5(void)
+static int step5(NiggliParams *p)
 {
-  if (fabs(xi) > B + eps ||
-      (! (fabs(B - xi) > eps) && 2 * eta < zeta - eps) ||
-      (! (fabs(B + xi) > eps) && zeta < -eps)) {
-    tmat[0] = 1, tmat[1] = 0, tmat[2] = 0;
-    tmat[3] = 0, tmat[4] = 1, tmat[5] = 0;
-    tmat[6] = 0, tmat[7] = 0, tmat[8] = 1;
-    if (xi > 0) {tmat[5] = -1;}
-    if (xi < 0) {tmat[5] = 1;}
-    reset();
+  if (fabs(p->xi) > p->B + p->eps ||
+      (! (fabs(p->B - p->xi) > p->eps) && 2 * p->eta < p->zeta - p->eps) ||
+      (! (fabs(p->B + p->xi) > p->eps) && p->zeta < -p->eps)) {
+    p->tmat[0] = 1, p->tmat[1] = 0, p->tmat[2] = 0;
+    p->tmat[3] = 0, p->tmat[4] = 1, p->tmat[5] = 0;
+    p->tmat[6] = 0, p->tmat[7] = 0, p->tmat[8] = 1;
+    if (p->xi > 0) {p->tmat[5] = -1;}
+    if (p->xi < 0) {p->tmat[5] = 1;}
+    reset(p);
     return 1;
   }
   else {return 0;}
 }
 
-static int step6(void)
+static int step6(NiggliParams *p)
 {
-  if (fabs(eta) > A + eps ||
-      (! (fabs(A - eta) > eps) && 2 * xi < zeta - eps) ||
-      (! (fabs(A + eta) > eps) && zeta < -eps)) {
-    tmat[0] = 1, tmat[1] = 0, tmat[2] = 0;
-    tmat[3] = 0, tmat[4] = 1, tmat[5] = 0;
-    tmat[6] = 0, tmat[7] = 0, tmat[8] = 1;
-    if (eta > 0) {tmat[2] = -1;}
-    if (eta < 0) {tmat[2] = 1;}
-    reset();
+  if (fabs(p->eta) > p->A + p->eps ||
+      (! (fabs(p->A - p->eta) > p->eps) && 2 * p->xi < p->zeta - p->eps) ||
+      (! (fabs(p->A + p->eta) > p->eps) && p->zeta < -p->eps)) {
+    p->tmat[0] = 1, p->tmat[1] = 0, p->tmat[2] = 0;
+    p->tmat[3] = 0, p->tmat[4] = 1, p->tmat[5] = 0;
+    p->tmat[6] = 0, p->tmat[7] = 0, p->tmat[8] = 1;
+    if (p->eta > 0) {p->tmat[2] = -1;}
+    if (p->eta < 0) {p->tmat[2] = 1;}
+    reset(p);
     return 1;
   }
   else {return 0;}
 }
 
-static int step7(void)
+static int step7(NiggliParams *p)
 {
-  if (fabs(zeta) > A + eps ||
-      (! (fabs(A - zeta) > eps) && 2 * xi < eta - eps) ||
-      (! (fabs(A + zeta) > eps) && eta < -eps)) {
-    tmat[0] = 1, tmat[1] = 0, tmat[2] = 0;
-    tmat[3] = 0, tmat[4] = 1, tmat[5] = 0;
-    tmat[6] = 0, tmat[7] = 0, tmat[8] = 1;
-    if (zeta > 0) {tmat[1] = -1;}
-    if (zeta < 0) {tmat[1] = 1;}
-    reset();
+  if (fabs(p->zeta) > p->A + p->eps ||
+      (! (fabs(p->A - p->zeta) > p->eps) && 2 * p->xi < p->eta - p->eps) ||
+      (! (fabs(p->A + p->zeta) > p->eps) && p->eta < -p->eps)) {
+    p->tmat[0] = 1, p->tmat[1] = 0, p->tmat[2] = 0;
+    p->tmat[3] = 0, p->tmat[4] = 1, p->tmat[5] = 0;
+    p->tmat[6] = 0, p->tmat[7] = 0, p->tmat[8] = 1;
+    if (p->zeta > 0) {p->tmat[1] = -1;}
+    if (p->zeta < 0) {p->tmat[1] = 1;}
+    reset(p);
     return 1;
   }
   else {return 0;}
 }
 
-static int step8(void)
+static int step8(NiggliParams *p)
 {
-  if (xi + eta + zeta + A + B < -eps ||
-      (! (fabs(xi + eta + zeta + A + B) > eps) && 2 * (A + eta) + zeta > eps)) {
-    tmat[0] = 1, tmat[1] = 0, tmat[2] = 1;
-    tmat[3] = 0, tmat[4] = 1, tmat[5] = 1;
-    tmat[6] = 0, tmat[7] = 0, tmat[8] = 1;
-    reset();
+  if (p->xi + p->eta + p->zeta + p->A + p->B < -p->eps ||
+      (! (fabs(p->xi + p->eta + p->zeta + p->A + p->B) > p->eps) && 2 * (p->A + p->eta) + p->zeta > p->eps)) {
+    p->tmat[0] = 1, p->tmat[1] = 0, p->tmat[2] = 1;
+    p->tmat[3] = 0, p->tmat[4] = 1, p->tmat[5] = 1;
+    p->tmat[6] = 0, p->tmat[7] = 0, p->tmat[8] = 1;
+    reset(p);
     return 1;
   }
   else {return 0;}
 }
 
-static void set_angle_types(void)
+static void set_angle_types(NiggliParams *p)
 {
-  l = 0, m = 0, n = 0;
-  if (xi < -eps) {l = -1;}
-  if (xi > eps) {l = 1;}
-  if (eta < -eps) {m = -1;}
-  if (eta > eps) {m = 1;}
-  if (zeta < -eps) {n = -1;}
-  if (zeta > eps) {n = 1;}
+  p->l = 0, p->m = 0, p->n = 0;
+  if (p->xi < -p->eps) {p->l = -1;}
+  if (p->xi > p->eps) {p->l = 1;}
+  if (p->eta < -p->eps) {p->m = -1;}
+  if (p->eta > p->eps) {p->m = 1;}
+  if (p->zeta < -p->eps) {p->n = -1;}
+  if (p->zeta > p->eps) {p->n = 1;}
 }
 
-static void set_parameters(void)
+static void set_parameters(NiggliParams *p)
 {
-  double *G;
+  double G[9];
 
-  G = get_metric(lattice);
+  get_metric(G, p->lattice);
 
-  A = G[0];
-  B = G[4];
-  C = G[8];
-  xi = G[5] * 2;
-  eta = G[2] * 2;
-  zeta = G[1] * 2;
-
-  free(G);
+  p->A = G[0];
+  p->B = G[4];
+  p->C = G[8];
+  p->xi = G[5] * 2;
+  p->eta = G[2] * 2;
+  p->zeta = G[1] * 2;
 }
 
-static double * get_transpose(const double *M)
+static void get_transpose(double M_T[9], const double M[9])
 {
   int i, j;
-  double *M_T;
 
-  M_T = (double*)malloc(sizeof(double) * 9);
   for (i = 0; i < 3; i++) {
     for (j = 0; j < 3; j++) {
       M_T[i * 3 + j] = M[j * 3 + i];
     }
   }
-  return M_T;
 }
 
-static double * get_metric(const double *M)
+static void get_metric(double G[9], const double M[9])
 {
-  double *G, *M_T;
-
-  M_T = get_transpose(M);
+  double M_T[9];
 
-  G = multiply_matrices(M_T, M);
-  free(M_T);
-  return G;
+  get_transpose(M_T, M);
+  multiply_matrices(G, M_T, M);
 }
 
-static double * multiply_matrices(const double *L, const double *R)
+static void multiply_matrices(double M[9],
+			      const double L[9],
+			      const double R[9])
 {
   int i, j, k;
-  double *M;
 
-  M = (double*)malloc(sizeof(double) * 9);
   for (i = 0; i < 3; i++) {
     for (j = 0; j < 3; j++) {
       M[i * 3 + j] = 0;
@@ -338,5 +353,4 @@ static double * multiply_matrices(const double *L, const double *R)
       }
     }
   }
-  return M;
 }
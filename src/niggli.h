@@ -2,6 +2,6 @@
 #ifndef __NIGGLI_H__
 #define __NIGGLI_H__
 
-void niggli_reduce(double *lattice_, const double eps_);
+int niggli_reduce(double *lattice_, const double eps_);
 
 #endif
@@ -0,0 +1,977 @@
+/* overlap.c */
+/* Copyright (C) 2015 Atsushi Togo */
+
+#include <math.h>
+#include <stdlib.h>
+#include "cell.h"
+#include "mathfunc.h"
+#include "mem.h"
+#include "overlap.h"
+
+#include "debug.h"
+
+/* Distance kernels using AVX2 and AVX-512 are compiled by GCC and */
+/* clang on x86 and chosen at run time from what the CPU supports. */
+#if (defined(__x86_64__) || defined(__i386__)) &&			\
+  (defined(__clang__) ||						\
+   (defined(__GNUC__) &&						\
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define OVL_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Upper bound of number of bins along an axis */
+#define MAX_NUM_BINS 1000
+/* Search window is slightly widened against rounding errors. */
+#define WIDTH_MARGIN 1.01
+/* Distances to the rarest type are used up to this number of its atoms. */
+#define MAX_NUM_FINGERPRINT_ATOMS 16
+/* Number of distances computed by one call of the distance kernel */
+#define DISTANCE_CHUNK_SIZE 32
+
+typedef struct {
+  double distance;
+  int index;
+} CheckKey;
+
+static int set_type_index(OverlapChecker *checker);
+static int set_check_order(OverlapChecker *checker);
+static void set_num_bins(OverlapChecker *checker);
+static int get_bin_index(const OverlapChecker *checker,
+			 const double pos[3]);
+static void set_search_window(int lo[3],
+			      int hi[3],
+			      const OverlapChecker *checker,
+			      const double pos[3]);
+static int set_row_ranges(int start[2],
+			  int end[2],
+			  const OverlapChecker *checker,
+			  const int row,
+			  const int lo,
+			  const int hi);
+static double get_nearest_distance(int *nearest,
+				   const OverlapChecker *checker,
+				   const double pos[3],
+				   const int atom_index);
+static int set_distance_kernel(OverlapChecker *checker,
+			       const OverlapKernel kernel);
+static void get_distances(double distance[],
+			  const OverlapChecker *checker,
+			  const double pos[3],
+			  const int start,
+			  const int num);
+#ifdef OVL_X86_SIMD
+static void get_distances_avx2(double distance[],
+			       const OverlapChecker *checker,
+			       const double pos[3],
+			       const int start,
+			       const int num);
+static void get_distances_avx512(double distance[],
+				 const OverlapChecker *checker,
+				 const double pos[3],
+				 const int start,
+				 const int num);
+#endif
+static double check_overlap(int mapping[],
+			    const OverlapChecker *checker,
+			    const double trans[3],
+			    SPGCONST int rot[3][3],
+			    const int is_identity,
+			    int hint[],
+			    const int is_distance);
+static void set_hint(int hint[], const int atom_index);
+static int compare_int(const void *a, const void *b);
+static int compare_check_key(const void *a, const void *b);
+
+/* NULL is returned if memory could not be allocated. */
+OverlapChecker * ovl_overlap_checker_init(SPGCONST Cell *cell,
+					  const double symprec)
+{
+  return ovl_overlap_checker_init_with_kernel(cell, symprec, OVL_KERNEL_AUTO);
+}
+
+/* Same as ovl_overlap_checker_init with the distance kernel chosen, */
+/* so that tests can compare the kernels. NULL is also returned if */
+/* the kernel is not supported by the compiler or the CPU. */
+OverlapChecker *
+ovl_overlap_checker_init_with_kernel(SPGCONST Cell *cell,
+				     const double symprec,
+				     const OverlapKernel kernel)
+{
+  int i, j, k, num_keys, size;
+  int *key, *count;
+  OverlapChecker *checker;
+
+  if ((checker = (OverlapChecker*) mem_malloc(sizeof(OverlapChecker)))
+      == NULL) {
+    return NULL;
+  }
+
+  size = cell->size > 0 ? cell->size : 1;
+  checker->cell = cell;
+  checker->symprec = symprec;
+  checker->bin_start = NULL;
+  checker->check_order = NULL;
+  checker->position[0] = NULL;
+  checker->type_index = (int*) mem_malloc(sizeof(int) * size);
+  checker->atom_index = (int*) mem_malloc(sizeof(int) * size);
+  checker->position[0] = (double*) mem_malloc(sizeof(double) * size * 3);
+  key = (int*) mem_malloc(sizeof(int) * size);
+  if (checker->type_index == NULL ||
+      checker->atom_index == NULL ||
+      checker->position[0] == NULL ||
+      key == NULL) {
+    goto err;
+  }
+  checker->position[1] = checker->position[0] + size;
+  checker->position[2] = checker->position[1] + size;
+  if (! set_distance_kernel(checker, kernel)) {
+    goto err;
+  }
+
+  if (! set_type_index(checker)) {
+    goto err;
+  }
+  if (! set_check_order(checker)) {
+    goto err;
+  }
+  set_num_bins(checker);
+
+  num_keys = checker->num_types *
+    checker->num_bins[0] * checker->num_bins[1] * checker->num_bins[2];
+  if ((checker->bin_start = (int*) mem_malloc(sizeof(int) * (num_keys + 1)))
+      == NULL) {
+    goto err;
+  }
+
+  /* Counting sort of atoms by (type, bin) */
+  count = checker->bin_start;
+  for (i = 0; i < num_keys + 1; i++) {
+    count[i] = 0;
+  }
+  for (i = 0; i < cell->size; i++) {
+    key[i] = checker->type_index[i] * (num_keys / checker->num_types) +
+      get_bin_index(checker, cell->position[i]);
+    count[key[i] + 1]++;
+  }
+  for (i = 0; i < num_keys; i++) {
+    count[i + 1] += count[i];
+  }
+  for (i = 0; i < cell->size; i++) {
+    j = count[key[i]];
+    checker->atom_index[j] = i;
+    for (k = 0; k < 3; k++) {
+      checker->position[k][j] = cell->position[i][k];
+    }
+    count[key[i]]++;
+  }
+  /* Shift back: count[k] has become the start of key k + 1. */
+  for (i = num_keys; i > 0; i--) {
+    count[i] = count[i - 1];
+  }
+  count[0] = 0;
+
+  mem_free(key);
+  key = NULL;
+
+  debug_print("ovl_overlap_checker_init: bins %d %d %d, types %d\n",
+	      checker->num_bins[0], checker->num_bins[1],
+	      checker->num_bins[2], checker->num_types);
+
+  return checker;
+
+ err:
+  mem_free(key);
+  key = NULL;
+  ovl_overlap_checker_free(checker);
+  return NULL;
+}
+
+void ovl_overlap_checker_free(OverlapChecker *checker)
+{
+  if (checker == NULL) {
+    return;
+  }
+  mem_free(checker->type_index);
+  checker->type_index = NULL;
+  mem_free(checker->bin_start);
+  checker->bin_start = NULL;
+  mem_free(checker->atom_index);
+  checker->atom_index = NULL;
+  mem_free(checker->position[0]);
+  checker->position[0] = NULL;
+  mem_free(checker->check_order);
+  checker->check_order = NULL;
+  mem_free(checker);
+  checker = NULL;
+}
+
+/* Return index of an atom of the same type as atom_index which */
+/* overlaps pos. -1 is returned if it is not found. */
+int ovl_search_overlap_atom(const OverlapChecker *checker,
+			    const double pos[3],
+			    const int atom_index)
+{
+  int i, j, k, l, m, n, row, offset, num_bins, num_ranges;
+  int lo[3], hi[3], b[3], start[2], end[2];
+  double symprec2;
+  double distance[DISTANCE_CHUNK_SIZE];
+
+  symprec2 = checker->symprec * checker->symprec;
+
+  set_search_window(lo, hi, checker, pos);
+
+  num_bins = checker->num_bins[0] * checker->num_bins[1] * checker->num_bins[2];
+  offset = checker->type_index[atom_index] * num_bins;
+
+  for (i = lo[2]; i <= hi[2]; i++) {
+    b[2] = ((i % checker->num_bins[2]) + checker->num_bins[2]) %
+      checker->num_bins[2];
+    for (j = lo[1]; j <= hi[1]; j++) {
+      b[1] = ((j % checker->num_bins[1]) + checker->num_bins[1]) %
+	checker->num_bins[1];
+      row = offset + (b[2] * checker->num_bins[1] + b[1]) * checker->num_bins[0];
+      num_ranges = set_row_ranges(start, end, checker, row, lo[0], hi[0]);
+      for (k = 0; k < num_ranges; k++) {
+	for (l = start[k]; l < end[k]; l += DISTANCE_CHUNK_SIZE) {
+	  n = end[k] - l < DISTANCE_CHUNK_SIZE ? end[k] - l : DISTANCE_CHUNK_SIZE;
+	  checker->get_distances(distance, checker, pos, l, n);
+	  for (m = 0; m < n; m++) {
+	    if (distance[m] < symprec2) {
+	      return checker->atom_index[l + m];
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  return -1;
+}
+
+/* Return number of atoms of the same type as atom_index which */
+/* overlap pos. At most max_size of them are stored in atoms, and */
+/* their squared distances in distances unless it is NULL. */
+int ovl_get_overlap_atoms(int atoms[],
+			  double distances[],
+			  const int max_size,
+			  const OverlapChecker *checker,
+			  const double pos[3],
+			  const int atom_index)
+{
+  int i, j, k, l, m, n, row, offset, num_bins, num_ranges, num_atoms;
+  int lo[3], hi[3], b[3], start[2], end[2];
+  double symprec2;
+  double distance[DISTANCE_CHUNK_SIZE];
+
+  symprec2 = checker->symprec * checker->symprec;
+  num_atoms = 0;
+
+  set_search_window(lo, hi, checker, pos);
+
+  num_bins = checker->num_bins[0] * checker->num_bins[1] * checker->num_bins[2];
+  offset = checker->type_index[atom_index] * num_bins;
+
+  for (i = lo[2]; i <= hi[2]; i++) {
+    b[2] = ((i % checker->num_bins[2]) + checker->num_bins[2]) %
+      checker->num_bins[2];
+    for (j = lo[1]; j <= hi[1]; j++) {
+      b[1] = ((j % checker->num_bins[1]) + checker->num_bins[1]) %
+	checker->num_bins[1];
+      row = offset + (b[2] * checker->num_bins[1] + b[1]) * checker->num_bins[0];
+      num_ranges = set_row_ranges(start, end, checker, row, lo[0], hi[0]);
+      for (k = 0; k < num_ranges; k++) {
+	for (l = start[k]; l < end[k]; l += DISTANCE_CHUNK_SIZE) {
+	  n = end[k] - l < DISTANCE_CHUNK_SIZE ? end[k] - l : DISTANCE_CHUNK_SIZE;
+	  checker->get_distances(distance, checker, pos, l, n);
+	  for (m = 0; m < n; m++) {
+	    if (distance[m] < symprec2) {
+	      if (num_atoms < max_size) {
+		atoms[num_atoms] = checker->atom_index[l + m];
+		if (distances != NULL) {
+		  distances[num_atoms] = distance[m];
+		}
+	      }
+	      num_atoms++;
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  return num_atoms;
+}
+
+/* Check if all atoms are mapped onto atoms of the same type by */
+/* (rot, trans). */
+int ovl_check_total_overlap(const OverlapChecker *checker,
+			    const double trans[3],
+			    SPGCONST int rot[3][3],
+			    const int is_identity)
+{
+  return check_overlap(NULL, checker, trans, rot, is_identity, NULL, 0) > -1;
+}
+
+/* Same as ovl_check_total_overlap. Atoms that made recent checks */
+/* fail are kept in hint and tested first, since a wrong operation */
+/* usually fails at the same defect. hint has OVL_NUM_HINTS elements, */
+/* which are initialized by -1. */
+int ovl_check_total_overlap_with_hint(const OverlapChecker *checker,
+				      const double trans[3],
+				      SPGCONST int rot[3][3],
+				      const int is_identity,
+				      int hint[])
+{
+  return check_overlap(NULL, checker, trans, rot, is_identity, hint, 0) > -1;
+}
+
+/* Largest squared distance between an atom moved by (rot, trans) */
+/* and its nearest atom of the same type. (rot, trans) is accepted by */
+/* ovl_check_total_overlap with a tolerance t <= symprec if and only */
+/* if the returned value is smaller than t * t. -1 is returned if an */
+/* atom has no counterpart within symprec. hint may be NULL. */
+double ovl_get_overlap_distance(const OverlapChecker *checker,
+				const double trans[3],
+				SPGCONST int rot[3][3],
+				const int is_identity,
+				int hint[])
+{
+  return check_overlap(NULL, checker, trans, rot, is_identity, hint, 1);
+}
+
+/* Same as ovl_get_overlap_distance, and mapping[i] is set to the */
+/* nearest atom to the atom i moved by (rot, trans). mapping is */
+/* meaningful only if the returned value is not -1. */
+double ovl_get_overlap_mapping(int mapping[],
+			       const OverlapChecker *checker,
+			       const double trans[3],
+			       SPGCONST int rot[3][3],
+			       const int is_identity,
+			       int hint[])
+{
+  return check_overlap(mapping, checker, trans, rot, is_identity, hint, 1);
+}
+
+/* Atom types are relabeled to 0, 1, ..., num_types - 1. */
+/* 0 is returned if memory could not be allocated. */
+static int set_type_index(OverlapChecker *checker)
+{
+  int i, lo, hi, mid, num_types;
+  int *types;
+  SPGCONST Cell *cell;
+
+  cell = checker->cell;
+  if ((types = (int*) mem_malloc(sizeof(int) * (cell->size > 0 ?
+						 cell->size : 1))) == NULL) {
+    return 0;
+  }
+
+  for (i = 0; i < cell->size; i++) {
+    types[i] = cell->types[i];
+  }
+  qsort(types, cell->size, sizeof(int), compare_int);
+
+  num_types = 0;
+  for (i = 0; i < cell->size; i++) {
+    if (i == 0 || types[i] != types[num_types - 1]) {
+      types[num_types] = types[i];
+      num_types++;
+    }
+  }
+
+  for (i = 0; i < cell->size; i++) {
+    lo = 0;
+    hi = num_types - 1;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (types[mid] < cell->types[i]) {
+	lo = mid + 1;
+      } else {
+	hi = mid;
+      }
+    }
+    checker->type_index[i] = lo;
+  }
+
+  mem_free(types);
+  types = NULL;
+
+  checker->num_types = num_types > 0 ? num_types : 1;
+
+  return 1;
+}
+
+/* Atoms in hint are tested first, and then the others in check_order. */
+/* With is_distance, the largest squared distance to the nearest atoms */
+/* is returned, and otherwise 0. -1 is returned if an atom has no */
+/* counterpart, which is then put at the front of hint. */
+/* mapping may be NULL and is set only with is_distance. */
+static double check_overlap(int mapping[],
+			    const OverlapChecker *checker,
+			    const double trans[3],
+			    SPGCONST int rot[3][3],
+			    const int is_identity,
+			    int hint[],
+			    const int is_distance)
+{
+  int i, j, k, l, num_hints, nearest;
+  double dist, max_dist;
+  double pos_rot[3];
+  SPGCONST Cell *cell;
+
+  cell = checker->cell;
+  max_dist = 0;
+  num_hints = 0;
+  if (hint != NULL) {
+    while (num_hints < OVL_NUM_HINTS && hint[num_hints] > -1) {
+      num_hints++;
+    }
+  }
+
+  for (l = -num_hints; l < cell->size; l++) {
+    if (l < 0) {
+      i = hint[l + num_hints];
+    } else {
+      i = checker->check_order[l];
+      for (k = 0; k < num_hints; k++) {
+	if (hint[k] == i) {
+	  break;
+	}
+      }
+      if (k < num_hints) {
+	continue;
+      }
+    }
+
+    if (is_identity) { /* Identity matrix is treated as special for speed. */
+      for (j = 0; j < 3; j++) {
+	pos_rot[j] = cell->position[i][j] + trans[j];
+      }
+    } else {
+      mat_multiply_matrix_vector_id3(pos_rot,
+				     rot,
+				     cell->position[i]);
+      for (j = 0; j < 3; j++) {
+	pos_rot[j] += trans[j];
+      }
+    }
+
+    if (is_distance) {
+      dist = get_nearest_distance(&nearest, checker, pos_rot, i);
+      if (mapping != NULL) {
+	mapping[i] = nearest;
+      }
+    } else {
+      dist = ovl_search_overlap_atom(checker, pos_rot, i) < 0 ? -1 : 0;
+    }
+    if (dist < 0) {
+      if (hint != NULL) {
+	set_hint(hint, i);
+      }
+      return -1;
+    }
+    if (dist > max_dist) {
+      max_dist = dist;
+    }
+  }
+
+  return max_dist;
+}
+
+/* The atom is moved to the front. */
+static void set_hint(int hint[], const int atom_index)
+{
+  int i, k;
+
+  for (k = 0; k < OVL_NUM_HINTS - 1; k++) {
+    if (hint[k] == atom_index) {
+      break;
+    }
+  }
+  for (i = k; i > 0; i--) {
+    hint[i] = hint[i - 1];
+  }
+  hint[0] = atom_index;
+}
+
+/* When the rarest type has only a few atoms, e.g., a dopant, these */
+/* atoms come first, and the others follow in the order of the */
+/* distance to the nearest of them, so that a wrong operation fails */
+/* at the defect and its neighbours soon. Otherwise atoms are in the */
+/* input order. */
+/* 0 is returned if memory could not be allocated. */
+static int set_check_order(OverlapChecker *checker)
+{
+  int i, j, k, rarest, num_rarest, size;
+  int *count, *rarest_atoms;
+  double dist;
+  double d[3];
+  CheckKey *keys;
+  SPGCONST Cell *cell;
+
+  cell = checker->cell;
+  size = cell->size > 0 ? cell->size : 1;
+  keys = NULL;
+  rarest_atoms = NULL;
+  if ((checker->check_order = (int*) mem_malloc(sizeof(int) * size))
+      == NULL) {
+    return 0;
+  }
+  for (i = 0; i < cell->size; i++) {
+    checker->check_order[i] = i;
+  }
+
+  if ((count = (int*) mem_malloc(sizeof(int) * checker->num_types))
+      == NULL) {
+    return 0;
+  }
+  for (i = 0; i < checker->num_types; i++) {
+    count[i] = 0;
+  }
+  for (i = 0; i < cell->size; i++) {
+    count[checker->type_index[i]]++;
+  }
+  rarest = 0;
+  for (i = 1; i < checker->num_types; i++) {
+    if (count[i] < count[rarest]) {
+      rarest = i;
+    }
+  }
+  num_rarest = count[rarest];
+  mem_free(count);
+  count = NULL;
+
+  if (num_rarest > MAX_NUM_FINGERPRINT_ATOMS ||
+      num_rarest == cell->size) {
+    return 1;
+  }
+
+  rarest_atoms = (int*) mem_malloc(sizeof(int) * num_rarest);
+  keys = (CheckKey*) mem_malloc(sizeof(CheckKey) * size);
+  if (rarest_atoms == NULL || keys == NULL) {
+    mem_free(keys);
+    mem_free(rarest_atoms);
+    return 0;
+  }
+
+  j = 0;
+  for (i = 0; i < cell->size; i++) {
+    if (checker->type_index[i] == rarest) {
+      rarest_atoms[j] = i;
+      j++;
+    }
+  }
+
+  for (i = 0; i < cell->size; i++) {
+    keys[i].index = i;
+    if (checker->type_index[i] == rarest) {
+      keys[i].distance = -1;
+      continue;
+    }
+    for (j = 0; j < num_rarest; j++) {
+      for (k = 0; k < 3; k++) {
+	d[k] = cell->position[i][k] - cell->position[rarest_atoms[j]][k];
+	d[k] -= mat_Nint(d[k]);
+      }
+      mat_multiply_matrix_vector_d3(d, cell->lattice, d);
+      dist = mat_norm_squared_d3(d);
+      if (j == 0 || dist < keys[i].distance) {
+	keys[i].distance = dist;
+      }
+    }
+  }
+
+  qsort(keys, cell->size, sizeof(CheckKey), compare_check_key);
+  for (i = 0; i < cell->size; i++) {
+    checker->check_order[i] = keys[i].index;
+  }
+
+  mem_free(keys);
+  keys = NULL;
+  mem_free(rarest_atoms);
+  rarest_atoms = NULL;
+
+  return 1;
+}
+
+/* A sphere of radius symprec spans symprec * |b_i| along the i-th */
+/* fractional axis, where b_i is the i-th row of the inverse lattice. */
+/* Bins are chosen not to be narrower than this width and to hold */
+/* about one atom per type. */
+static void set_num_bins(OverlapChecker *checker)
+{
+  int i, max_i, num_bins, num_bins_max;
+  double det, norm;
+  double inv_lat[3][3];
+  SPGCONST Cell *cell;
+
+  cell = checker->cell;
+
+  for (i = 0; i < 3; i++) {
+    checker->num_bins[i] = 1;
+    checker->width[i] = 1;
+  }
+
+  det = mat_get_determinant_d3(cell->lattice);
+  if (mat_Dabs(det) < 1e-300 || checker->symprec <= 0) {
+    return;
+  }
+
+  mat_inverse_matrix_d3(inv_lat, cell->lattice, 0);
+  for (i = 0; i < 3; i++) {
+    norm = sqrt(mat_norm_squared_d3(inv_lat[i]));
+    checker->width[i] = checker->symprec * norm * WIDTH_MARGIN;
+    if (checker->width[i] * MAX_NUM_BINS < 1) {
+      checker->num_bins[i] = MAX_NUM_BINS;
+    } else {
+      checker->num_bins[i] = (int)(1.0 / checker->width[i]);
+      if (checker->num_bins[i] < 1) {
+	checker->num_bins[i] = 1;
+      }
+    }
+  }
+
+  num_bins_max = cell->size / checker->num_types;
+  if (num_bins_max < 1) {
+    num_bins_max = 1;
+  }
+
+  while (1) {
+    num_bins =
+      checker->num_bins[0] * checker->num_bins[1] * checker->num_bins[2];
+    if (num_bins <= num_bins_max) {
+      break;
+    }
+    max_i = 0;
+    for (i = 1; i < 3; i++) {
+      if (checker->num_bins[i] > checker->num_bins[max_i]) {
+	max_i = i;
+      }
+    }
+    checker->num_bins[max_i] = checker->num_bins[max_i] * 4 / 5;
+    if (checker->num_bins[max_i] < 1) {
+      checker->num_bins[max_i] = 1;
+    }
+  }
+}
+
+/* Range of bins, which may exceed [0, num_bins), covering the */
+/* tolerance window around pos. */
+static void set_search_window(int lo[3],
+			      int hi[3],
+			      const OverlapChecker *checker,
+			      const double pos[3])
+{
+  int i, n;
+  double w;
+
+  for (i = 0; i < 3; i++) {
+    n = checker->num_bins[i];
+    w = pos[i] - floor(pos[i]);
+    lo[i] = (int)floor((w - checker->width[i]) * n);
+    hi[i] = (int)floor((w + checker->width[i]) * n);
+    if (hi[i] - lo[i] + 1 >= n) {
+      lo[i] = 0;
+      hi[i] = n - 1;
+    }
+  }
+}
+
+/* Squared distance to the nearest atom of the same type as */
+/* atom_index, or -1 if none is closer than symprec. The index of */
+/* the nearest atom is set to nearest. */
+static double get_nearest_distance(int *nearest,
+				   const OverlapChecker *checker,
+				   const double pos[3],
+				   const int atom_index)
+{
+  int i, j, k, l, m, n, row, offset, num_bins, num_ranges;
+  int lo[3], hi[3], b[3], start[2], end[2];
+  double symprec2, min_dist;
+  double distance[DISTANCE_CHUNK_SIZE];
+
+  symprec2 = checker->symprec * checker->symprec;
+  min_dist = -1;
+  *nearest = -1;
+
+  set_search_window(lo, hi, checker, pos);
+
+  num_bins = checker->num_bins[0] * checker->num_bins[1] * checker->num_bins[2];
+  offset = checker->type_index[atom_index] * num_bins;
+
+  for (i = lo[2]; i <= hi[2]; i++) {
+    b[2] = ((i % checker->num_bins[2]) + checker->num_bins[2]) %
+      checker->num_bins[2];
+    for (j = lo[1]; j <= hi[1]; j++) {
+      b[1] = ((j % checker->num_bins[1]) + checker->num_bins[1]) %
+	checker->num_bins[1];
+      row = offset + (b[2] * checker->num_bins[1] + b[1]) * checker->num_bins[0];
+      num_ranges = set_row_ranges(start, end, checker, row, lo[0], hi[0]);
+      for (k = 0; k < num_ranges; k++) {
+	for (l = start[k]; l < end[k]; l += DISTANCE_CHUNK_SIZE) {
+	  n = end[k] - l < DISTANCE_CHUNK_SIZE ? end[k] - l : DISTANCE_CHUNK_SIZE;
+	  checker->get_distances(distance, checker, pos, l, n);
+	  for (m = 0; m < n; m++) {
+	    if (distance[m] < symprec2 &&
+		(min_dist < 0 || distance[m] < min_dist)) {
+	      min_dist = distance[m];
+	      *nearest = checker->atom_index[l + m];
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  return min_dist;
+}
+
+/* Bins lo..hi along a of a row are stored contiguously except where */
+/* the window wraps around the cell, so their atoms are given as at */
+/* most two ranges of sorted atoms in the order of the bins. */
+static int set_row_ranges(int start[2],
+			  int end[2],
+			  const OverlapChecker *checker,
+			  const int row,
+			  const int lo,
+			  const int hi)
+{
+  int n, b_lo, b_hi;
+
+  n = checker->num_bins[0];
+  b_lo = ((lo % n) + n) % n;
+  b_hi = ((hi % n) + n) % n;
+
+  if (b_lo <= b_hi) {
+    start[0] = checker->bin_start[row + b_lo];
+    end[0] = checker->bin_start[row + b_hi + 1];
+    return 1;
+  }
+
+  start[0] = checker->bin_start[row + b_lo];
+  end[0] = checker->bin_start[row + n];
+  start[1] = checker->bin_start[row];
+  end[1] = checker->bin_start[row + b_hi + 1];
+  return 2;
+}
+
+/* 0 is returned if the kernel is not supported. */
+static int set_distance_kernel(OverlapChecker *checker,
+			       const OverlapKernel kernel)
+{
+  switch (kernel) {
+  case OVL_KERNEL_AUTO:
+    checker->get_distances = get_distances;
+#ifdef OVL_X86_SIMD
+    if (__builtin_cpu_supports("avx512f")) {
+      checker->get_distances = get_distances_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+      checker->get_distances = get_distances_avx2;
+    }
+#endif
+    return 1;
+  case OVL_KERNEL_SCALAR:
+    checker->get_distances = get_distances;
+    return 1;
+#ifdef OVL_X86_SIMD
+  case OVL_KERNEL_AVX2:
+    checker->get_distances = get_distances_avx2;
+    return __builtin_cpu_supports("avx2");
+  case OVL_KERNEL_AVX512:
+    checker->get_distances = get_distances_avx512;
+    return __builtin_cpu_supports("avx512f");
+#endif
+  default:
+    return 0;
+  }
+}
+
+/* Squared distances in the minimum image convention between pos and */
+/* the sorted atoms start..start+num-1. The SIMD kernels below follow */
+/* the same order of operations, so that they give identical results. */
+static void get_distances(double distance[],
+			  const OverlapChecker *checker,
+			  const double pos[3],
+			  const int start,
+			  const int num)
+{
+  int i, j;
+  double d[3];
+
+  for (i = 0; i < num; i++) {
+    for (j = 0; j < 3; j++) {
+      d[j] = pos[j] - checker->position[j][start + i];
+      d[j] -= mat_Nint(d[j]);
+    }
+    mat_multiply_matrix_vector_d3(d, checker->cell->lattice, d);
+    distance[i] = d[0]*d[0]+d[1]*d[1]+d[2]*d[2];
+  }
+}
+
+#ifdef OVL_X86_SIMD
+/* Four atoms at a time. The last atoms are handled by masked loads. */
+__attribute__((target("avx2")))
+static void get_distances_avx2(double distance[],
+			       const OverlapChecker *checker,
+			       const double pos[3],
+			       const int start,
+			       const int num)
+{
+  int i, j;
+  __m256i mask;
+  __m256d half, zero, s, dist;
+  __m256d p[3], a[3][3], d[3], c[3];
+
+  half = _mm256_set1_pd(0.5);
+  zero = _mm256_setzero_pd();
+  for (i = 0; i < 3; i++) {
+    p[i] = _mm256_set1_pd(pos[i]);
+    for (j = 0; j < 3; j++) {
+      a[i][j] = _mm256_set1_pd(checker->cell->lattice[i][j]);
+    }
+  }
+
+  for (i = 0; i < num; i += 4) {
+    mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(num - i),
+			      _mm256_setr_epi64x(0, 1, 2, 3));
+    for (j = 0; j < 3; j++) {
+      d[j] = _mm256_sub_pd(p[j],
+			   _mm256_maskload_pd(checker->position[j] + start + i,
+					      mask));
+      /* mat_Nint: truncation of d + 0.5 or d - 0.5 */
+      s = _mm256_blendv_pd(_mm256_add_pd(d[j], half),
+			   _mm256_sub_pd(d[j], half),
+			   _mm256_cmp_pd(d[j], zero, _CMP_LT_OQ));
+      d[j] = _mm256_sub_pd(d[j],
+			   _mm256_round_pd(s, _MM_FROUND_TO_ZERO |
+					   _MM_FROUND_NO_EXC));
+    }
+    for (j = 0; j < 3; j++) {
+      c[j] = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a[j][0], d[0]),
+					 _mm256_mul_pd(a[j][1], d[1])),
+			   _mm256_mul_pd(a[j][2], d[2]));
+    }
+    dist = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c[0], c[0]),
+				       _mm256_mul_pd(c[1], c[1])),
+			 _mm256_mul_pd(c[2], c[2]));
+    _mm256_maskstore_pd(distance + i, mask, dist);
+  }
+}
+
+/* Eight atoms at a time. AVX-512 implies FMA, so the explicitly */
+/* rounded arithmetic is used to keep products from being fused. */
+__attribute__((target("avx512f")))
+static void get_distances_avx512(double distance[],
+				 const OverlapChecker *checker,
+				 const double pos[3],
+				 const int start,
+				 const int num)
+{
+  int i, j;
+  __mmask8 mask;
+  __m512d half, zero, s, dist;
+  __m512d p[3], a[3][3], d[3], c[3];
+
+  half = _mm512_set1_pd(0.5);
+  zero = _mm512_setzero_pd();
+  for (i = 0; i < 3; i++) {
+    p[i] = _mm512_set1_pd(pos[i]);
+    for (j = 0; j < 3; j++) {
+      a[i][j] = _mm512_set1_pd(checker->cell->lattice[i][j]);
+    }
+  }
+
+  for (i = 0; i < num; i += 8) {
+    mask = num - i < 8 ? (__mmask8)((1 << (num - i)) - 1) : (__mmask8)0xff;
+    for (j = 0; j < 3; j++) {
+      d[j] = _mm512_sub_round_pd(p[j],
+				 _mm512_maskz_loadu_pd(mask,
+						       checker->position[j] +
+						       start + i),
+				 _MM_FROUND_CUR_DIRECTION);
+      /* mat_Nint: truncation of d + 0.5 or d - 0.5 */
+      s = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(d[j], zero, _CMP_LT_OQ),
+			       _mm512_add_round_pd(d[j], half,
+						   _MM_FROUND_CUR_DIRECTION),
+			       _mm512_sub_round_pd(d[j], half,
+						   _MM_FROUND_CUR_DIRECTION));
+      d[j] = _mm512_sub_round_pd(d[j],
+				 _mm512_roundscale_pd(s, _MM_FROUND_TO_ZERO |
+						      _MM_FROUND_NO_EXC),
+				 _MM_FROUND_CUR_DIRECTION);
+    }
+    for (j = 0; j < 3; j++) {
+      c[j] = _mm512_add_round_pd
+	(_mm512_add_round_pd(_mm512_mul_round_pd(a[j][0], d[0],
+						 _MM_FROUND_CUR_DIRECTION),
+			     _mm512_mul_round_pd(a[j][1], d[1],
+						 _MM_FROUND_CUR_DIRECTION),
+			     _MM_FROUND_CUR_DIRECTION),
+	 _mm512_mul_round_pd(a[j][2], d[2], _MM_FROUND_CUR_DIRECTION),
+	 _MM_FROUND_CUR_DIRECTION);
+    }
+    dist = _mm512_add_round_pd
+      (_mm512_add_round_pd(_mm512_mul_round_pd(c[0], c[0],
+					       _MM_FROUND_CUR_DIRECTION),
+			   _mm512_mul_round_pd(c[1], c[1],
+					       _MM_FROUND_CUR_DIRECTION),
+			   _MM_FROUND_CUR_DIRECTION),
+       _mm512_mul_round_pd(c[2], c[2], _MM_FROUND_CUR_DIRECTION),
+       _MM_FROUND_CUR_DIRECTION);
+    _mm512_mask_storeu_pd(distance + i, mask, dist);
+  }
+}
+#endif
+
+static int get_bin_index(const OverlapChecker *checker,
+			 const double pos[3])
+{
+  int i, n;
+  int b[3];
+
+  for (i = 0; i < 3; i++) {
+    n = checker->num_bins[i];
+    b[i] = (int)((pos[i] - floor(pos[i])) * n);
+    if (b[i] < 0) {
+      b[i] = 0;
+    }
+    if (b[i] > n - 1) {
+      b[i] = n - 1;
+    }
+  }
+
+  return (b[2] * checker->num_bins[1] + b[1]) * checker->num_bins[0] + b[0];
+}
+
+static int compare_int(const void *a, const void *b)
+{
+  int ia, ib;
+
+  ia = *((const int*)a);
+  ib = *((const int*)b);
+
+  if (ia < ib) {
+    return -1;
+  }
+  if (ia > ib) {
+    return 1;
+  }
+  return 0;
+}
+
+static int compare_check_key(const void *a, const void *b)
+{
+  const CheckKey *ka, *kb;
+
+  ka = (const CheckKey*)a;
+  kb = (const CheckKey*)b;
+
+  if (ka->distance != kb->distance) {
+    return ka->distance < kb->distance ? -1 : 1;
+  }
+  if (ka->index != kb->index) {
+    return ka->index < kb->index ? -1 : 1;
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+/* overlap.h */
+/* Copyright (C) 2015 Atsushi Togo */
+
+#ifndef __overlap_H__
+#define __overlap_H__
+
+#include "cell.h"
+#include "mathfunc.h"
+
+#define OVL_NUM_HINTS 4
+
+/* Kernel computing distances between a point and the sorted atoms. */
+/* OVL_KERNEL_AUTO is the fastest kernel the CPU supports. */
+typedef enum {
+  OVL_KERNEL_AUTO,
+  OVL_KERNEL_SCALAR,
+  OVL_KERNEL_AVX2,
+  OVL_KERNEL_AVX512
+} OverlapKernel;
+
+/* Cell list of atoms bucketed by atom type and by a regular grid of */
+/* bins in fractional coordinates. An atom overlapping a point can */
+/* only be found in the bins covering the tolerance window of the */
+/* point, so an overlap search costs O(1) instead of O(N). */
+/* The cell is referred to, not copied, and must outlive the checker. */
+/* Atoms are tested in check_order, where atoms near defects come */
+/* first if they can be told from the types. Sorted positions are */
+/* kept as structure of arrays, position[i][j] being the i-th */
+/* coordinate of the j-th sorted atom, for the distance kernel. */
+typedef struct _OverlapChecker {
+  SPGCONST Cell *cell;
+  double symprec;
+  double width[3];
+  int num_bins[3];
+  int num_types;
+  int *type_index;
+  int *bin_start;
+  int *atom_index;
+  int *check_order;
+  double *position[3];
+  void (*get_distances)(double distance[],
+			const struct _OverlapChecker *checker,
+			const double pos[3],
+			const int start,
+			const int num);
+} OverlapChecker;
+
+OverlapChecker * ovl_overlap_checker_init(SPGCONST Cell *cell,
+					  const double symprec);
+OverlapChecker *
+ovl_overlap_checker_init_with_kernel(SPGCONST Cell *cell,
+				     const double symprec,
+				     const OverlapKernel kernel);
+void ovl_overlap_checker_free(OverlapChecker *checker);
+int ovl_search_overlap_atom(const OverlapChecker *checker,
+			    const double pos[3],
+			    const int atom_index);
+int ovl_get_overlap_atoms(int atoms[],
+			  double distances[],
+			  const int max_size,
+			  const OverlapChecker *checker,
+			  const double pos[3],
+			  const int atom_index);
+int ovl_check_total_overlap(const OverlapChecker *checker,
+			    const double trans[3],
+			    SPGCONST int rot[3][3],
+			    const int is_identity);
+int ovl_check_total_overlap_with_hint(const OverlapChecker *checker,
+				      const double trans[3],
+				      SPGCONST int rot[3][3],
+				      const int is_identity,
+				      int hint[]);
+double ovl_get_overlap_distance(const OverlapChecker *checker,
+				const double trans[3],
+				SPGCONST int rot[3][3],
+				const int is_identity,
+				int hint[]);
+double ovl_get_overlap_mapping(int mapping[],
+			       const OverlapChecker *checker,
+			       const double trans[3],
+			       SPGCONST int rot[3][3],
+			       const int is_identity,
+			       int hint[]);
+
+#endif
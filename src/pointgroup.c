@@ -402,6 +402,7 @@ Pointgroup ptg_get_transformation_matrix(int transform_mat[3][3],
   debug_print("ptg_get_transformation_matrix:\n");
 
   for (i = 0; i < 3; i++) {
+    axes[i] = 0;
     for (j = 0; j < 3; j++) {
       transform_mat[i][j] = 0;
     }
@@ -412,8 +413,11 @@ Pointgroup ptg_get_transformation_matrix(int transform_mat[3][3],
   if (pg_num > 0) {
     pointgroup = ptg_get_pointgroup(pg_num);
     pointsym = get_pointsymmetry(rotations, num_rotations);
-    get_axes(axes, pointgroup.laue, &pointsym);
-    set_transformation_matrix(transform_mat, axes);
+    if (get_axes(axes, pointgroup.laue, &pointsym)) {
+      set_transformation_matrix(transform_mat, axes);
+    } else {
+      pointgroup.number = 0;
+    }
   }
 
   debug_print("transformation matrix:\n");
@@ -605,42 +609,30 @@ static int get_axes(int axes[3],
     axes[0] = 0;
     axes[1] = 1;
     axes[2] = 2;
-    break;
+    return 1;
   case LAUE2M:
-    laue2m(axes, pointsym);
-    break;
+    return laue2m(axes, pointsym);
   case LAUEMMM:
-    lauennn(axes, pointsym, 2);
-    break;
+    return lauennn(axes, pointsym, 2);
   case LAUE4M:
-    laue_one_axis(axes, pointsym, 4);
-    break;
+    return laue_one_axis(axes, pointsym, 4);
   case LAUE4MMM:
-    laue_one_axis(axes, pointsym, 4);
-    break;
+    return laue_one_axis(axes, pointsym, 4);
   case LAUE3:
-    laue_one_axis(axes, pointsym, 3);
-    break;
+    return laue_one_axis(axes, pointsym, 3);
   case LAUE3M:
-    laue_one_axis(axes, pointsym, 3);
-    break;
+    return laue_one_axis(axes, pointsym, 3);
   case LAUE6M:
-    laue_one_axis(axes, pointsym, 3);
-    break;
+    return laue_one_axis(axes, pointsym, 3);
   case LAUE6MMM:
-    laue_one_axis(axes, pointsym, 3);
-    break;
+    return laue_one_axis(axes, pointsym, 3);
   case LAUEM3:
-    lauennn(axes, pointsym, 2);
-    break;
+    return lauennn(axes, pointsym, 2);
   case LAUEM3M:
-    lauennn(axes, pointsym, 4);
-    break;
+    return lauennn(axes, pointsym, 4);
   default:
-    break;
+    return 0;
   }
-
-  return 1;
 }
 
 static int laue2m(int axes[3],
@@ -1130,12 +1122,20 @@ static int lauennn(int axes[3],
       if (! ((axis == axes[0]) ||
 	     (axis == axes[1]) ||
 	     (axis == axes[2]))) {
+	if (count == 3) {
+	  return 0;
+	}
 	axes[count] = axis;
 	count++;
       }
     }
   }
 
+  /* Rotations found at a large tolerance may not give three axes. */
+  if (count < 3) {
+    return 0;
+  }
+
   sort_axes(axes);
 
   return 1;
@@ -3,9 +3,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "cell.h"
 #include "lattice.h"
 #include "mathfunc.h"
+#include "mem.h"
+#include "overlap.h"
 #include "primitive.h"
 #include "symmetry.h"
 
@@ -13,24 +16,57 @@
 
 #define INCREASE_RATE 2.0
 #define REDUCE_RATE 0.95
+#define TIGHT_MARGIN 0.25
 
-static Primitive * get_primitive(SPGCONST Cell * cell, const double symprec);
+static Primitive * get_primitive(SPGCONST Cell * cell,
+				 const double symprec,
+				 SymmetryCache * cache);
 static int set_primitive_positions(Cell * primitive_cell,
 				   const VecDBL * position,
 				   const Cell * cell,
-				   int * const * table);
+				   const int overlap_rows[],
+				   const int row_index[]);
 static VecDBL * get_positions_primitive(SPGCONST Cell * cell,
 					SPGCONST double prim_lat[3][3]);
-static int get_overlap_table(int ** table,
+static int get_overlap_table(int overlap_rows[],
+			     int row_index[],
 			     SPGCONST Cell *primitive_cell,
 			     const VecDBL * position,
 			     const int *types,
 			     const double symprec);
-static int check_overlap_table(SPGCONST int **overlap_table,
-			       const int cell_size,
-			       const int ratio);
-static void free_overlap_table(int ** table, const int size);
-static int ** allocate_overlap_table(const int size);
+static int set_overlap_rows(int overlap_rows[],
+			    int row_index[],
+			    int atoms[],
+			    double distances[],
+			    const OverlapChecker *checker,
+			    const VecDBL * position,
+			    const int num_rows_max,
+			    const double tolerance);
+static int get_overlap_row(int atoms[],
+			   double distances[],
+			   int *is_tight,
+			   const OverlapChecker *checker,
+			   const double pos[3],
+			   const int atom_index,
+			   const double tolerance);
+static int compare_int(const void *a, const void *b);
+static int set_mapped_overlap_rows(int overlap_rows[],
+				   int row_index[],
+				   const int * mapping_table,
+				   const int cell_size,
+				   const int primitive_size);
+static int check_supercell_lattice(SPGCONST Cell * cell,
+				   SPGCONST Cell * primitive_cell,
+				   SPGCONST int supercell_matrix[3][3],
+				   const double symprec);
+static int set_supercell_mapping_table(int * mapping_table,
+				       SPGCONST Cell * cell,
+				       SPGCONST Cell * primitive_cell,
+				       SPGCONST int supercell_matrix[3][3],
+				       const double symprec);
+static VecDBL * get_supercell_pure_translations(SPGCONST Cell * cell,
+						const int * mapping_table,
+						const int ratio);
 static Cell * get_cell_with_smallest_lattice(SPGCONST Cell * cell,
 					     const double symprec);
 static Cell * get_primitive_cell(int * mapping_table,
@@ -51,19 +87,22 @@ static int get_primitive_lattice_vectors(double prim_lattice[3][3],
 					 const double symprec);
 static VecDBL * get_translation_candidates(const VecDBL * pure_trans);
 
+/* NULL is returned if memory could not be allocated. */
 Primitive * prm_alloc_primitive(const int size)
 {
   Primitive *primitive;
 
-  primitive = (Primitive*) malloc(sizeof(Primitive));
+  if ((primitive = (Primitive*) mem_malloc(sizeof(Primitive))) == NULL) {
+    return NULL;
+  }
   primitive->size = size;
   if (size > 0) {
-    if ((primitive->mapping_table = (int*) malloc(sizeof(int) * size)) == NULL)
-      {
-	warning_print("spglib: Memory could not be allocated ");
-	warning_print("(Primitive, line %d, %s).\n", __LINE__, __FILE__);
-	exit(1);
-      }
+    if ((primitive->mapping_table = (int*) mem_malloc(sizeof(int) * size))
+	== NULL) {
+      mem_free(primitive);
+      primitive = NULL;
+      return NULL;
+    }
   }
   primitive->tolerance = 0;
   primitive->pure_trans = NULL;
@@ -74,14 +113,17 @@ Primitive * prm_alloc_primitive(const int size)
 
 void prm_free_primitive(Primitive * primitive)
 {
+  if (primitive == NULL) {
+    return;
+  }
   if (primitive->size > 0) {
-    free(primitive->mapping_table);
+    mem_free(primitive->mapping_table);
     primitive->mapping_table = NULL;
   }
   primitive->size = 0;
   mat_free_VecDBL(primitive->pure_trans);
   cel_free_cell(primitive->cell);
-  free(primitive);
+  mem_free(primitive);
   primitive = NULL;
 }
 
@@ -90,32 +132,249 @@ Cell * prm_get_primitive_cell(SPGCONST Cell * cell, const double symprec)
   Cell *primitive_cell;
   Primitive *primitive;
 
-  primitive = get_primitive(cell, symprec);
+  if ((primitive = get_primitive(cell, symprec, NULL)) == NULL) {
+    return NULL;
+  }
   primitive_cell = cel_copy_cell(primitive->cell);
   prm_free_primitive(primitive);
 
   return primitive_cell;
 }
 
-Primitive * prm_get_primitive(SPGCONST Cell * cell, const double symprec)
+/* cache may be NULL. */
+Primitive * prm_get_primitive(SPGCONST Cell * cell,
+			      const double symprec,
+			      SymmetryCache * cache)
 {
-  return get_primitive(cell, symprec);
+  return get_primitive(cell, symprec, cache);
+}
+
+/* cell is a supercell of primitive_cell with the lattice */
+/* primitive_cell->lattice * supercell_matrix. This is verified in */
+/* O(N): the lattices have to agree within symprec, and each atom of */
+/* primitive_cell has to overlap exactly det(supercell_matrix) atoms */
+/* of cell. Then the primitive cell is searched in primitive_cell */
+/* instead of cell, which also allows primitive_cell not to be */
+/* primitive. primitive->cell->size = 0 is returned if cell is not */
+/* such a supercell. */
+/* NULL is returned if memory could not be allocated. */
+Primitive * prm_get_primitive_of_supercell(SPGCONST Cell * cell,
+					   SPGCONST Cell * primitive_cell,
+					   SPGCONST int supercell_matrix[3][3],
+					   const double symprec)
+{
+  int i, is_found;
+  Primitive *primitive, *hint;
+
+  hint = NULL;
+
+  if ((primitive = prm_alloc_primitive(cell->size)) == NULL) {
+    return NULL;
+  }
+
+  if (! check_supercell_lattice(cell,
+				primitive_cell,
+				supercell_matrix,
+				symprec)) {
+    goto not_found;
+  }
+  if ((is_found = set_supercell_mapping_table(primitive->mapping_table,
+					      cell,
+					      primitive_cell,
+					      supercell_matrix,
+					      symprec)) < 0) {
+    goto err;
+  }
+  if (! is_found) {
+    goto not_found;
+  }
+
+  if ((hint = get_primitive(primitive_cell, symprec, NULL)) == NULL) {
+    goto err;
+  }
+  if (hint->cell->size == 0) {
+    goto not_found;
+  }
+
+  for (i = 0; i < cell->size; i++) {
+    primitive->mapping_table[i] =
+      hint->mapping_table[primitive->mapping_table[i]];
+  }
+  if ((primitive->pure_trans =
+       get_supercell_pure_translations(cell,
+				       primitive->mapping_table,
+				       cell->size / hint->cell->size))
+      == NULL) {
+    goto err;
+  }
+  primitive->cell = hint->cell;
+  hint->cell = NULL;
+  primitive->tolerance = hint->tolerance;
+  prm_free_primitive(hint);
+  hint = NULL;
+
+  return primitive;
+
+ not_found:
+  warning_print("spglib: Supercell does not match the primitive cell ");
+  warning_print("(line %d, %s).\n", __LINE__, __FILE__);
+  prm_free_primitive(hint);
+  hint = NULL;
+  primitive->cell = cel_alloc_cell(0);
+  primitive->pure_trans = mat_alloc_VecDBL(0);
+  if (primitive->cell != NULL && primitive->pure_trans != NULL) {
+    return primitive;
+  }
+
+ err:
+  prm_free_primitive(hint);
+  prm_free_primitive(primitive);
+  return NULL;
+}
+
+/* Primitive cell of cell with the lattice */
+/* cell->lattice * inverse(supercell_matrix), where the atom i of cell */
+/* is known to be mapped onto the atom mapping_table[i] of the */
+/* primitive cell, e.g., as found for the previous frame of molecular */
+/* dynamics. The position of the primitive atom j is averaged over */
+/* the atoms i with mapping_table[i] = j, which may be numbered in any */
+/* order, and then each atom is verified to overlap its primitive */
+/* atom, which costs O(N) without searching atoms. */
+/* primitive->cell->size = 0 is returned if this fails. */
+/* NULL is returned if memory could not be allocated. */
+Primitive * prm_get_primitive_with_mapping_table(SPGCONST Cell * cell,
+						 SPGCONST int supercell_matrix[3][3],
+						 const int * mapping_table,
+						 const int primitive_size,
+						 const double symprec)
+{
+  int i, ratio, is_set;
+  int *overlap_rows, *row_index;
+  double inv_mat[3][3], mat[3][3];
+  Primitive *primitive;
+  VecDBL *position;
+
+  overlap_rows = NULL;
+  row_index = NULL;
+  position = NULL;
+
+  if ((primitive = prm_alloc_primitive(cell->size)) == NULL) {
+    return NULL;
+  }
+
+  ratio = mat_get_determinant_i3(supercell_matrix);
+  if (ratio < 0) {
+    ratio = -ratio;
+  }
+  if (primitive_size < 1 || primitive_size * ratio != cell->size) {
+    goto not_found;
+  }
+
+  overlap_rows = (int*) mem_malloc(sizeof(int) * cell->size);
+  row_index = (int*) mem_malloc(sizeof(int) * cell->size);
+  if (overlap_rows == NULL || row_index == NULL) {
+    goto err;
+  }
+  if ((is_set = set_mapped_overlap_rows(overlap_rows,
+					row_index,
+					mapping_table,
+					cell->size,
+					primitive_size)) < 0) {
+    goto err;
+  }
+  if (! is_set) {
+    goto not_found;
+  }
+
+  if ((primitive->cell = cel_alloc_cell(primitive_size)) == NULL) {
+    goto err;
+  }
+  mat_cast_matrix_3i_to_3d(mat, supercell_matrix);
+  mat_inverse_matrix_d3(inv_mat, mat, 0);
+  mat_multiply_matrix_d3(primitive->cell->lattice, cell->lattice, inv_mat);
+  if ((position = get_positions_primitive(cell, primitive->cell->lattice))
+      == NULL) {
+    goto err;
+  }
+  if ((is_set = set_primitive_positions(primitive->cell,
+					position,
+					cell,
+					overlap_rows,
+					row_index)) < 0) {
+    goto err;
+  }
+  if (! is_set) {
+    goto not_found;
+  }
+  for (i = 0; i < cell->size; i++) {
+    if (cell->types[i] != primitive->cell->types[mapping_table[i]] ||
+	! cel_is_overlap(position->vec[i],
+			 primitive->cell->position[mapping_table[i]],
+			 primitive->cell->lattice,
+			 symprec)) {
+      goto not_found;
+    }
+  }
+
+  for (i = 0; i < cell->size; i++) {
+    primitive->mapping_table[i] = mapping_table[i];
+  }
+  if ((primitive->pure_trans =
+       get_supercell_pure_translations(cell, mapping_table, ratio))
+      == NULL) {
+    goto err;
+  }
+  primitive->tolerance = symprec;
+
+  mat_free_VecDBL(position);
+  mem_free(row_index);
+  mem_free(overlap_rows);
+
+  return primitive;
+
+ not_found:
+  mat_free_VecDBL(position);
+  position = NULL;
+  cel_free_cell(primitive->cell);
+  primitive->cell = cel_alloc_cell(0);
+  primitive->pure_trans = mat_alloc_VecDBL(0);
+  if (primitive->cell != NULL && primitive->pure_trans != NULL) {
+    mem_free(row_index);
+    mem_free(overlap_rows);
+    return primitive;
+  }
+
+ err:
+  mat_free_VecDBL(position);
+  mem_free(row_index);
+  mem_free(overlap_rows);
+  prm_free_primitive(primitive);
+  return NULL;
 }
 
 /* If primitive could not be found, primitive->size = 0 is returned. */
-static Primitive * get_primitive(SPGCONST Cell * cell, const double symprec)
+/* NULL is returned if memory could not be allocated. */
+static Primitive * get_primitive(SPGCONST Cell * cell,
+				 const double symprec,
+				 SymmetryCache * cache)
 {
   int i, attempt, is_found = 0;
   double tolerance;
   Primitive *primitive;
 
-  primitive = prm_alloc_primitive(cell->size);
+  if ((primitive = prm_alloc_primitive(cell->size)) == NULL) {
+    return NULL;
+  }
 
   tolerance = symprec;
   for (attempt = 0; attempt < 100; attempt++) {
-    primitive->pure_trans = sym_get_pure_translation(cell, tolerance);
+    primitive->pure_trans = sym_get_pure_translation(cell, tolerance, cache);
+    if (primitive->pure_trans == NULL) {
+      goto err;
+    }
     if (primitive->pure_trans->size == 0) {
       mat_free_VecDBL(primitive->pure_trans);
+      primitive->pure_trans = NULL;
       continue;
     }
 
@@ -131,13 +390,19 @@ static Primitive * get_primitive(SPGCONST Cell * cell, const double symprec)
 					   tolerance);
     }
 
+    if (primitive->cell == NULL) {
+      goto err;
+    }
+
     if (primitive->cell->size > 0) {
       is_found = 1;
       break;
     }
 
     cel_free_cell(primitive->cell);
+    primitive->cell = NULL;
     mat_free_VecDBL(primitive->pure_trans);
+    primitive->pure_trans = NULL;
     
     tolerance *= REDUCE_RATE;
     warning_print("spglib: Reduce tolerance to %f ", tolerance);
@@ -149,9 +414,16 @@ static Primitive * get_primitive(SPGCONST Cell * cell, const double symprec)
   } else {
     primitive->cell = cel_alloc_cell(0);
     primitive->pure_trans = mat_alloc_VecDBL(0);
+    if (primitive->cell == NULL || primitive->pure_trans == NULL) {
+      goto err;
+    }
   }
 
   return primitive;
+
+ err:
+  prm_free_primitive(primitive);
+  return NULL;
 }
 
 static Cell * get_cell_with_smallest_lattice(SPGCONST Cell * cell,
@@ -168,7 +440,9 @@ static Cell * get_cell_with_smallest_lattice(SPGCONST Cell * cell,
 				  symprec)) {
     mat_inverse_matrix_d3(inv_lat, min_lat, 0);
     mat_multiply_matrix_d3(trans_mat, inv_lat, cell->lattice);
-    smallest_cell = cel_alloc_cell(cell->size);
+    if ((smallest_cell = cel_alloc_cell(cell->size)) == NULL) {
+      return NULL;
+    }
     mat_copy_matrix_d3(smallest_cell->lattice, min_lat);
     for (i = 0; i < cell->size; i++) {
       smallest_cell->types[i] = cell->types[i];
@@ -186,12 +460,13 @@ static Cell * get_cell_with_smallest_lattice(SPGCONST Cell * cell,
 }
 
 /* If primitive could not be found, primitive->size = 0 is returned. */
+/* NULL is returned if memory could not be allocated. */
 static Cell * get_primitive_cell(int * mapping_table,
 				 SPGCONST Cell * cell,
 				 const VecDBL * pure_trans,
 				 const double symprec)
 {
-  int multi;
+  int multi, is_trimmed;
   double prim_lattice[3][3];
   Cell * primitive_cell;
 
@@ -204,11 +479,16 @@ static Cell * get_primitive_cell(int * mapping_table,
 						  cell,
 						  pure_trans,
 						  symprec);
+  if (multi < 0) {
+    return NULL;
+  }
   if (! multi) {
     goto not_found;
   }
 
-  primitive_cell = cel_alloc_cell(cell->size / multi);
+  if ((primitive_cell = cel_alloc_cell(cell->size / multi)) == NULL) {
+    return NULL;
+  }
 
   if (! lat_smallest_lattice_vector(primitive_cell->lattice,
 				    prim_lattice,
@@ -218,8 +498,12 @@ static Cell * get_primitive_cell(int * mapping_table,
   }
 
   /* Fit atoms into new primitive cell */
-  if (! trim_cell(primitive_cell, mapping_table, cell, symprec)) {
+  is_trimmed = trim_cell(primitive_cell, mapping_table, cell, symprec);
+  if (is_trimmed < 1) {
     cel_free_cell(primitive_cell);
+    if (is_trimmed < 0) {
+      return NULL;
+    }
     goto not_found;
   }
 
@@ -234,96 +518,117 @@ static Cell * get_primitive_cell(int * mapping_table,
 }
 
 
+/* -1 is returned if memory could not be allocated. */
 static int trim_cell(Cell * primitive_cell,
 		     int * mapping_table,
 		     SPGCONST Cell * cell,
 		     const double symprec)
 {
-  int i, index_prim_atom;
+  int i, ratio, index_prim_atom, is_set, is_found;
+  int *overlap_rows, *row_index;
   VecDBL * position;
-  int **overlap_table;
 
-  overlap_table = allocate_overlap_table(cell->size);
+  ratio = cell->size / primitive_cell->size;
+  overlap_rows = (int*) mem_malloc(sizeof(int) * primitive_cell->size * ratio);
+  row_index = (int*) mem_malloc(sizeof(int) * cell->size);
   position = get_positions_primitive(cell, primitive_cell->lattice);
+  if (overlap_rows == NULL || row_index == NULL || position == NULL) {
+    is_found = -1;
+    goto ret;
+  }
 
-  if (! get_overlap_table(overlap_table,
-			  primitive_cell,
-			  position,
-			  cell->types,
-			  symprec)) {goto err;}
+  is_found = get_overlap_table(overlap_rows,
+			       row_index,
+			       primitive_cell,
+			       position,
+			       cell->types,
+			       symprec);
+  if (is_found < 1) {
+    goto ret;
+  }
 
   index_prim_atom = 0;
   for (i = 0; i < cell->size; i++) {
-    if (overlap_table[i][0] == i) {
+    if (overlap_rows[row_index[i] * ratio] == i) {
       mapping_table[i] = index_prim_atom;
       index_prim_atom++;
     } else {
-      mapping_table[i] = mapping_table[overlap_table[i][0]];
+      mapping_table[i] = mapping_table[overlap_rows[row_index[i] * ratio]];
     }
   }
 
-  if (! set_primitive_positions(primitive_cell,
-				position,
-				cell,
-				overlap_table)) {goto err;}
-
-  mat_free_VecDBL(position);
-  free_overlap_table(overlap_table, cell->size);
-  return 1;
+  is_set = set_primitive_positions(primitive_cell,
+				   position,
+				   cell,
+				   overlap_rows,
+				   row_index);
+  if (is_set < 1) {
+    is_found = is_set;
+  }
 
- err:
+ ret:
   mat_free_VecDBL(position);
-  free_overlap_table(overlap_table, cell->size);
-  return 0;
+  mem_free(row_index);
+  mem_free(overlap_rows);
+  return is_found;
 }
 
+/* The positions of the atoms in the row row_index[i] of */
+/* overlap_rows are averaged to the primitive atom row_index[i]. */
+/* -1 is returned if memory could not be allocated. */
 static int set_primitive_positions(Cell * primitive_cell,
 				   const VecDBL * position,
 				   const Cell * cell,
-				   int * const * table)
+				   const int overlap_rows[],
+				   const int row_index[])
 {
-  int i, j, k, ratio, index_prim_atom;
+  int i, j, k, ratio, index_prim_atom, num_prim_atoms;
   int *is_equivalent;
+  const int *row;
 
-  is_equivalent = (int*)malloc(cell->size * sizeof(int));
+  if ((is_equivalent = (int*)mem_malloc(cell->size * sizeof(int))) == NULL) {
+    return -1;
+  }
   for (i = 0; i < cell->size; i++) {
     is_equivalent[i] = 0;
   }
   ratio = cell->size / primitive_cell->size;
 
   /* Copy positions. Positions of overlapped atoms are averaged. */
-  index_prim_atom = 0;
+  num_prim_atoms = 0;
   for (i = 0; i < cell->size; i++) {
 
     if (! is_equivalent[i]) {
+      index_prim_atom = row_index[i];
       primitive_cell->types[index_prim_atom] = cell->types[i];
+      row = overlap_rows + row_index[i] * ratio;
 
       for (j = 0; j < 3; j++) {
 	primitive_cell->position[index_prim_atom][j] = 0;
       }
 
       for (j = 0; j < ratio; j++) { /* Loop for averaging positions */
-	is_equivalent[table[i][j]] = 1;
+	is_equivalent[row[j]] = 1;
 
 	for (k = 0; k < 3; k++) {
 	  /* boundary treatment */
 	  /* One is at right and one is at left or vice versa. */
-	  if (mat_Dabs(position->vec[table[i][0]][k] -
-		       position->vec[table[i][j]][k]) > 0.5) {
-	    if (position->vec[table[i][j]][k] < 0) {
+	  if (mat_Dabs(position->vec[row[0]][k] -
+		       position->vec[row[j]][k]) > 0.5) {
+	    if (position->vec[row[j]][k] < 0) {
 	      primitive_cell->position[index_prim_atom][k] =
 		primitive_cell->position[index_prim_atom][k] +
-		position->vec[table[i][j]][k] + 1;
+		position->vec[row[j]][k] + 1;
 	    } else {
 	      primitive_cell->position[index_prim_atom][k] =
 		primitive_cell->position[index_prim_atom][k] +
-		position->vec[table[i][j]][k] - 1;
+		position->vec[row[j]][k] - 1;
 	    }
 
 	  } else {
 	    primitive_cell->position[index_prim_atom][k] =
 	      primitive_cell->position[index_prim_atom][k] +
-	      position->vec[table[i][j]][k];
+	      position->vec[row[j]][k];
 	  }
 	}
 	
@@ -336,14 +641,14 @@ static int set_primitive_positions(Cell * primitive_cell,
 	  primitive_cell->position[index_prim_atom][j] -
 	  mat_Nint(primitive_cell->position[index_prim_atom][j]);
       }
-      index_prim_atom++;
+      num_prim_atoms++;
     }
   }
 
-  free(is_equivalent);
+  mem_free(is_equivalent);
   is_equivalent = NULL;
 
-  if (! (index_prim_atom == primitive_cell->size)) {
+  if (! (num_prim_atoms == primitive_cell->size)) {
     warning_print("spglib: Atomic positions of primitive cell could not be determined ");
     warning_print("(line %d, %s).\n", __LINE__, __FILE__);
     goto err;
@@ -362,7 +667,9 @@ static VecDBL * get_positions_primitive(SPGCONST Cell * cell,
   double tmp_matrix[3][3], axis_inv[3][3];
   VecDBL * position;
 
-  position = mat_alloc_VecDBL(cell->size);
+  if ((position = mat_alloc_VecDBL(cell->size)) == NULL) {
+    return NULL;
+  }
 
   mat_inverse_matrix_d3(tmp_matrix, prim_lat, 0);
   mat_multiply_matrix_d3(axis_inv, tmp_matrix, cell->lattice);
@@ -380,47 +687,74 @@ static VecDBL * get_positions_primitive(SPGCONST Cell * cell,
 }
 
 
-/* If overlap_table is correctly obtained, */
-/* shape of overlap_table will be (cell->size, cell->size / primitive->size). */
-static int get_overlap_table(int **overlap_table,
+/* If overlap table is correctly obtained, the atoms overlapping */
+/* the atom i are listed in ascending order in the row */
+/* overlap_rows[row_index[i] * ratio], where */
+/* ratio = cell->size / primitive->size. */
+/* -1 is returned if memory could not be allocated. */
+static int get_overlap_table(int overlap_rows[],
+			     int row_index[],
 			     SPGCONST Cell *primitive_cell,
 			     const VecDBL * position,
 			     const int *types,
 			     const double symprec)
 {
-  int i, j, attempt, num_overlap, ratio, cell_size;
+  int attempt, ratio, cell_size, num_overlap, is_tight, is_found;
+  int *atoms;
   double trim_tolerance;
+  double *distances;
+  Cell trimmed_cell;
+  OverlapChecker *checker;
 
   cell_size = position->size;
   ratio = cell_size / primitive_cell->size;
   trim_tolerance = symprec;
-  
+
+  atoms = (int*) mem_malloc(sizeof(int) * cell_size);
+  distances = (double*) mem_malloc(sizeof(double) * cell_size);
+  if (atoms == NULL || distances == NULL) {
+    is_found = -1;
+    goto ret;
+  }
+
+  /* Atoms are looked up in the primitive lattice by the checker. */
+  /* Its window is twice as wide as the tolerance to see the gap */
+  /* around overlapping atoms (see get_overlap_row). */
+  trimmed_cell.size = cell_size;
+  mat_copy_matrix_d3(trimmed_cell.lattice, primitive_cell->lattice);
+  trimmed_cell.types = (int*) types;
+  trimmed_cell.position = position->vec;
+
   for (attempt = 0; attempt < 100; attempt++) {
-    /* Each value of -1 has to be overwritten by 0 or positive numbers. */
-    for (i = 0; i < cell_size; i++) {
-      for (j = 0; j < cell_size; j++) {
-        overlap_table[i][j] = -1;
-      }
+    if ((checker = ovl_overlap_checker_init(&trimmed_cell,
+					    trim_tolerance * 2)) == NULL) {
+      is_found = -1;
+      goto ret;
     }
 
-    for (i = 0; i < cell_size; i++) {
-      num_overlap = 0;
-      for (j = 0; j < cell_size; j++) {
-	if (types[i] == types[j]) {
-	  if (cel_is_overlap(position->vec[i],
-			     position->vec[j],
-			     primitive_cell->lattice,
-			     trim_tolerance)) {
-	    overlap_table[i][num_overlap] = j;
-	    num_overlap++;
-	  }
-	}
-      }
+    if (set_overlap_rows(overlap_rows,
+			 row_index,
+			 atoms,
+			 distances,
+			 checker,
+			 position,
+			 primitive_cell->size,
+			 trim_tolerance)) {
+      ovl_overlap_checker_free(checker);
+      checker = NULL;
+      is_found = 1;
+      goto ret;
     }
 
-    if (check_overlap_table(overlap_table, cell_size, ratio)) {
-      goto found;
-    }
+    num_overlap = get_overlap_row(atoms,
+				  distances,
+				  &is_tight,
+				  checker,
+				  position->vec[cell_size - 1],
+				  cell_size - 1,
+				  trim_tolerance);
+    ovl_overlap_checker_free(checker);
+    checker = NULL;
 
     if (num_overlap < ratio) {
       trim_tolerance *= INCREASE_RATE;
@@ -434,68 +768,151 @@ static int get_overlap_table(int **overlap_table,
 
   warning_print("spglib: Could not trim cell into primitive ");
   warning_print("(line %d, %s).\n", __LINE__, __FILE__);
-  return 0;
-
- found:
-  return 1;
+  is_found = 0;
 
+ ret:
+  mem_free(distances);
+  mem_free(atoms);
+  return is_found;
 }
 
+/* Each atom has to overlap ratio atoms, and the same ones as the */
+/* first of them does. Rows are stored once, so there are at most */
+/* num_rows_max of them if this is satisfied. The row of an atom */
+/* is searched unless it is already known to be equal to a row */
+/* found before (see get_overlap_row), which makes this O(N) */
+/* instead of O(N * ratio) for a clean supercell. */
+/* 0 is returned if the condition is not satisfied. */
+static int set_overlap_rows(int overlap_rows[],
+			    int row_index[],
+			    int atoms[],
+			    double distances[],
+			    const OverlapChecker *checker,
+			    const VecDBL * position,
+			    const int num_rows_max,
+			    const double tolerance)
+{
+  int i, j, ratio, num_rows, num_overlap, is_small_window, is_tight;
+  int *row;
 
-static int check_overlap_table(SPGCONST int **overlap_table,
-			       const int cell_size,
-			       const int ratio) {
-  int i, j, index_compared, all_ok;
+  ratio = position->size / num_rows_max;
 
-  all_ok = 1;
-  for (i = 0; i < cell_size; i++) {
-    index_compared = overlap_table[i][0];
-    for (j = 0; j < cell_size; j++) {
-      if (! (overlap_table[i][j] == overlap_table[index_compared][j])) {
-	all_ok = 0;
-	break;
-      }
-      if (j < ratio) {
-	if (overlap_table[i][j] == -1) {
-	  all_ok = 0;
-	  break;
-	}
-      } else {
-	if (overlap_table[i][j] > -1) {
-	  all_ok = 0;
-	  break;
+  for (i = 0; i < position->size; i++) {
+    row_index[i] = -1;
+  }
+
+  /* Triangle inequality is valid with fractional coordinates */
+  /* reduced into [-0.5, 0.5) only if the window is small enough. */
+  is_small_window = 1;
+  for (i = 0; i < 3; i++) {
+    if (checker->width[i] > 0.5) {
+      is_small_window = 0;
+    }
+  }
+
+  num_rows = 0;
+  for (i = 0; i < position->size; i++) {
+    if (row_index[i] > -1) {
+      continue;
+    }
+
+    is_tight = is_small_window;
+    num_overlap = get_overlap_row(atoms,
+				  distances,
+				  &is_tight,
+				  checker,
+				  position->vec[i],
+				  i,
+				  tolerance);
+    if (num_overlap != ratio) {
+      return 0;
+    }
+
+    if (atoms[0] < i) {
+      row = overlap_rows + row_index[atoms[0]] * ratio;
+      for (j = 0; j < ratio; j++) {
+	if (atoms[j] != row[j]) {
+	  return 0;
 	}
       }
+      row_index[i] = row_index[atoms[0]];
+      continue;
     }
-    if (! all_ok) {
-      break;
+
+    if (num_rows == num_rows_max) {
+      return 0;
+    }
+    row = overlap_rows + num_rows * ratio;
+    for (j = 0; j < ratio; j++) {
+      row[j] = atoms[j];
+      if (is_tight && row_index[atoms[j]] < 0) {
+	row_index[atoms[j]] = num_rows;
+      }
     }
+    row_index[i] = num_rows;
+    num_rows++;
   }
-  return all_ok;
+
+  return 1;
 }
 
-static void free_overlap_table(int **table, const int size)
+/* Atoms of the same type within tolerance from pos are stored in */
+/* ascending order and their number is returned. The checker window */
+/* has to be twice as wide as tolerance. */
+/* If these atoms are within a radius R of pos and the other atoms */
+/* are farther than tolerance + R, each of these atoms overlaps */
+/* exactly the same atoms by the triangle inequality. Then is_tight */
+/* is kept, otherwise it is set to zero. Margins of TIGHT_MARGIN */
+/* times tolerance are left for rounding errors. */
+static int get_overlap_row(int atoms[],
+			   double distances[],
+			   int *is_tight,
+			   const OverlapChecker *checker,
+			   const double pos[3],
+			   const int atom_index,
+			   const double tolerance)
 {
-  int i;
-  for (i = 0; i < size; i++) {
-    free(table[i]);
-    table[i] = NULL;
+  int i, num_found, num_overlap;
+  double radius, gap;
+
+  num_found = ovl_get_overlap_atoms(atoms,
+				    distances,
+				    checker->cell->size,
+				    checker,
+				    pos,
+				    atom_index);
+
+  radius = 0;
+  gap = 4 * tolerance * tolerance;
+  num_overlap = 0;
+  for (i = 0; i < num_found; i++) {
+    if (distances[i] < tolerance * tolerance) {
+      atoms[num_overlap] = atoms[i];
+      num_overlap++;
+      if (distances[i] > radius) {
+	radius = distances[i];
+      }
+    } else {
+      if (distances[i] < gap) {
+	gap = distances[i];
+      }
+    }
   }
-  free(table);
-  table = NULL;
-}
+  radius = sqrt(radius);
+  gap = sqrt(gap);
 
-static int ** allocate_overlap_table(const int size)
-{
-  int i;
-  int **table = (int**)malloc(size * sizeof(int*));
-  for (i = 0; i < size; i++) {
-    table[i] = (int*)malloc(size * sizeof(int));
+  if (radius > tolerance * TIGHT_MARGIN ||
+      gap < tolerance * (1 + TIGHT_MARGIN) + radius * 2) {
+    *is_tight = 0;
   }
-  return table;
+
+  qsort(atoms, num_overlap, sizeof(int), compare_int);
+
+  return num_overlap;
 }
 
 
+/* -1 is returned if memory could not be allocated. */
 static int get_primitive_lattice_vectors_iterative(double prim_lattice[3][3],
 						   SPGCONST Cell * cell,
 						   const VecDBL * pure_trans,
@@ -506,14 +923,19 @@ static int get_primitive_lattice_vectors_iterative(double prim_lattice[3][3],
   VecDBL * vectors, * pure_trans_reduced, *tmp_vec;
 
   tolerance = symprec;
-  pure_trans_reduced = mat_alloc_VecDBL(pure_trans->size);
+  if ((pure_trans_reduced = mat_alloc_VecDBL(pure_trans->size)) == NULL) {
+    return -1;
+  }
   for (i = 0; i < pure_trans->size; i++) {
     mat_copy_vector_d3(pure_trans_reduced->vec[i], pure_trans->vec[i]);
   }
   
   for (attempt = 0; attempt < 100; attempt++) {
     multi = pure_trans_reduced->size;
-    vectors = get_translation_candidates(pure_trans_reduced);
+    if ((vectors = get_translation_candidates(pure_trans_reduced)) == NULL) {
+      mat_free_VecDBL(pure_trans_reduced);
+      return -1;
+    }
 
     /* Lattice of primitive cell is found among pure translation vectors */
     if (get_primitive_lattice_vectors(prim_lattice,
@@ -527,7 +949,11 @@ static int get_primitive_lattice_vectors_iterative(double prim_lattice[3][3],
       goto found;
     } else {
 
-      tmp_vec = mat_alloc_VecDBL(multi);
+      mat_free_VecDBL(vectors);
+      if ((tmp_vec = mat_alloc_VecDBL(multi)) == NULL) {
+	mat_free_VecDBL(pure_trans_reduced);
+	return -1;
+      }
       for (i = 0; i < multi; i++) {
 	mat_copy_vector_d3(tmp_vec->vec[i], pure_trans_reduced->vec[i]);
       }
@@ -535,17 +961,19 @@ static int get_primitive_lattice_vectors_iterative(double prim_lattice[3][3],
       pure_trans_reduced = sym_reduce_pure_translation(cell,
 						       tmp_vec,
 						       tolerance);
+      mat_free_VecDBL(tmp_vec);
+      if (pure_trans_reduced == NULL) {
+	return -1;
+      }
       warning_print("Tolerance is reduced to %f (%d), size = %d\n",
 		    tolerance, attempt, pure_trans_reduced->size);
 
-      mat_free_VecDBL(tmp_vec);
-      mat_free_VecDBL(vectors);
-
       tolerance *= REDUCE_RATE;
     }
   }
 
   /* Not found */
+  mat_free_VecDBL(pure_trans_reduced);
   return 0;
 
  found:
@@ -632,7 +1060,9 @@ static VecDBL * get_translation_candidates(const VecDBL * pure_trans)
   VecDBL * vectors;
 
   multi = pure_trans->size;
-  vectors = mat_alloc_VecDBL(multi+2);
+  if ((vectors = mat_alloc_VecDBL(multi+2)) == NULL) {
+    return NULL;
+  }
 
   /* store pure translations in original cell */ 
   /* as trial primitive lattice vectors */
@@ -655,3 +1085,188 @@ static VecDBL * get_translation_candidates(const VecDBL * pure_trans)
   return vectors;
 }
 
+static int compare_int(const void *a, const void *b)
+{
+  return *(const int*)a - *(const int*)b;
+}
+
+static int check_supercell_lattice(SPGCONST Cell * cell,
+				   SPGCONST Cell * primitive_cell,
+				   SPGCONST int supercell_matrix[3][3],
+				   const double symprec)
+{
+  int i, j, ratio;
+  double supercell_lattice[3][3], diff[3];
+
+  ratio = mat_get_determinant_i3(supercell_matrix);
+  if (ratio < 0) {
+    ratio = -ratio;
+  }
+  if (ratio == 0 || primitive_cell->size * ratio != cell->size) {
+    return 0;
+  }
+
+  mat_multiply_matrix_di3(supercell_lattice,
+			  primitive_cell->lattice,
+			  supercell_matrix);
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      diff[j] = supercell_lattice[j][i] - cell->lattice[j][i];
+    }
+    if (mat_norm_squared_d3(diff) > symprec * symprec) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Atoms of cell are put in primitive_cell->lattice behind the atoms */
+/* of primitive_cell, and the atoms overlapping each atom of */
+/* primitive_cell are searched by an overlap checker. */
+/* -1 is returned if memory could not be allocated. */
+static int set_supercell_mapping_table(int * mapping_table,
+				       SPGCONST Cell * cell,
+				       SPGCONST Cell * primitive_cell,
+				       SPGCONST int supercell_matrix[3][3],
+				       const double symprec)
+{
+  int i, j, k, ratio, num_prim_atom, num_overlap, is_found;
+  int *atoms;
+  double position[3];
+  Cell *joined_cell;
+  OverlapChecker *checker;
+
+  num_prim_atom = primitive_cell->size;
+  ratio = cell->size / num_prim_atom;
+  atoms = NULL;
+  checker = NULL;
+  is_found = -1;
+
+  if ((joined_cell = cel_alloc_cell(num_prim_atom + cell->size)) == NULL) {
+    goto ret;
+  }
+  mat_copy_matrix_d3(joined_cell->lattice, primitive_cell->lattice);
+  for (i = 0; i < num_prim_atom; i++) {
+    mat_copy_vector_d3(joined_cell->position[i], primitive_cell->position[i]);
+    joined_cell->types[i] = primitive_cell->types[i];
+  }
+  for (i = 0; i < cell->size; i++) {
+    mat_multiply_matrix_vector_id3(position,
+				   supercell_matrix,
+				   cell->position[i]);
+    for (j = 0; j < 3; j++) {
+      joined_cell->position[num_prim_atom + i][j] =
+	position[j] - mat_Nint(position[j]);
+    }
+    joined_cell->types[num_prim_atom + i] = cell->types[i];
+    mapping_table[i] = -1;
+  }
+
+  if ((atoms = (int*) mem_malloc(sizeof(int) * (ratio + 1))) == NULL) {
+    goto ret;
+  }
+  if ((checker = ovl_overlap_checker_init(joined_cell, symprec)) == NULL) {
+    goto ret;
+  }
+
+  is_found = 0;
+  for (i = 0; i < num_prim_atom; i++) {
+    num_overlap = ovl_get_overlap_atoms(atoms,
+					NULL,
+					ratio + 1,
+					checker,
+					joined_cell->position[i],
+					i);
+    if (num_overlap != ratio + 1) {
+      goto ret;
+    }
+    for (j = 0; j < num_overlap; j++) {
+      k = atoms[j] - num_prim_atom;
+      if (k < 0) {
+	if (atoms[j] != i) {
+	  goto ret;
+	}
+	continue;
+      }
+      if (mapping_table[k] > -1) {
+	goto ret;
+      }
+      mapping_table[k] = i;
+    }
+  }
+  is_found = 1;
+
+ ret:
+  ovl_overlap_checker_free(checker);
+  mem_free(atoms);
+  cel_free_cell(joined_cell);
+  return is_found;
+}
+
+/* Lattice translations of primitive cell in the supercell are the */
+/* displacements between atoms mapped to the same primitive atom. */
+/* NULL is returned if memory could not be allocated. */
+static VecDBL * get_supercell_pure_translations(SPGCONST Cell * cell,
+						const int * mapping_table,
+						const int ratio)
+{
+  int i, j, num_trans;
+  VecDBL *pure_trans;
+
+  if ((pure_trans = mat_alloc_VecDBL(ratio)) == NULL) {
+    return NULL;
+  }
+
+  num_trans = 0;
+  for (i = 0; i < cell->size; i++) {
+    if (mapping_table[i] == mapping_table[0]) {
+      for (j = 0; j < 3; j++) {
+	pure_trans->vec[num_trans][j] =
+	  cell->position[i][j] - cell->position[0][j];
+	pure_trans->vec[num_trans][j] -=
+	  mat_Nint(pure_trans->vec[num_trans][j]);
+      }
+      num_trans++;
+    }
+  }
+
+  return pure_trans;
+}
+
+/* Overlap rows of trim_cell made from mapping_table. Each primitive */
+/* atom has to be mapped from the same number of atoms. */
+/* -1 is returned if memory could not be allocated. */
+static int set_mapped_overlap_rows(int overlap_rows[],
+				   int row_index[],
+				   const int * mapping_table,
+				   const int cell_size,
+				   const int primitive_size)
+{
+  int i, ratio, is_found;
+  int *num_mapped;
+
+  if ((num_mapped = (int*) mem_malloc(sizeof(int) * primitive_size))
+      == NULL) {
+    return -1;
+  }
+  for (i = 0; i < primitive_size; i++) {
+    num_mapped[i] = 0;
+  }
+
+  ratio = cell_size / primitive_size;
+  is_found = 1;
+  for (i = 0; i < cell_size; i++) {
+    if (mapping_table[i] < 0 || mapping_table[i] >= primitive_size ||
+	num_mapped[mapping_table[i]] == ratio) {
+      is_found = 0;
+      break;
+    }
+    row_index[i] = mapping_table[i];
+    overlap_rows[mapping_table[i] * ratio + num_mapped[mapping_table[i]]] = i;
+    num_mapped[mapping_table[i]]++;
+  }
+
+  mem_free(num_mapped);
+  return is_found;
+}
@@ -19,5 +19,16 @@ typedef struct {
 Primitive * prm_alloc_primitive(const int size);
 void prm_free_primitive(Primitive * primitive);
 Cell * prm_get_primitive_cell(SPGCONST Cell * cell, const double symprec);
-Primitive * prm_get_primitive(SPGCONST Cell * cell, const double symprec);
+Primitive * prm_get_primitive(SPGCONST Cell * cell,
+			       const double symprec,
+			       SymmetryCache * cache);
+Primitive * prm_get_primitive_of_supercell(SPGCONST Cell * cell,
+					   SPGCONST Cell * primitive_cell,
+					   SPGCONST int supercell_matrix[3][3],
+					   const double symprec);
+Primitive * prm_get_primitive_with_mapping_table(SPGCONST Cell * cell,
+						 SPGCONST int supercell_matrix[3][3],
+						 const int * mapping_table,
+						 const int primitive_size,
+						 const double symprec);
 #endif
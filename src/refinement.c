@@ -7,6 +7,7 @@
 #include "refinement.h"
 #include "cell.h"
 #include "mathfunc.h"
+#include "mem.h"
 #include "pointgroup.h"
 #include "primitive.h"
 #include "spg_database.h"
@@ -69,20 +70,22 @@ static Symmetry * reduce_symmetry_in_frame(const int frame[3],
 static VecDBL * reduce_lattice_points(SPGCONST double lattice[3][3],
 				      const VecDBL *lattice_trans,
 				      const double symprec);
-static void set_equivalent_atoms(int * equiv_atoms_cell,
-				 SPGCONST Cell * primitive,
-				 SPGCONST Cell * cell,
-				 const int * equiv_atoms_prim,
-				 const int * mapping_table);
-static void set_equivalent_atoms_broken_symmetry(int * equiv_atoms_cell,
-						 SPGCONST Cell * cell,
-						 const Symmetry *symmetry,
-						 const int * mapping_table,
-						 const double symprec);
+static int set_equivalent_atoms(int * equiv_atoms_cell,
+				SPGCONST Cell * primitive,
+				SPGCONST Cell * cell,
+				const int * equiv_atoms_prim,
+				const int * mapping_table);
+static int set_equivalent_atoms_broken_symmetry(int * equiv_atoms_cell,
+						SPGCONST Cell * cell,
+						const Symmetry *symmetry,
+						const int * permutations,
+						const int * mapping_table,
+						const double symprec);
 static int search_equivalent_atom(const int atom_index,
 				  SPGCONST Cell * cell,
 				  const Symmetry *symmetry,
-				  const double symprec);
+				  const int * permutations,
+				  const OverlapChecker *checker);
 
 static SPGCONST int identity[3][3] = {
   { 1, 0, 0},
@@ -92,6 +95,7 @@ static SPGCONST int identity[3][3] = {
 
 
 /* symmetry->size = 0 is returned when it failed. */
+/* NULL is returned if memory could not be allocated. */
 Symmetry *
 ref_get_refined_symmetry_operations(SPGCONST Cell * cell,
 				    SPGCONST Cell * primitive,
@@ -104,12 +108,14 @@ ref_get_refined_symmetry_operations(SPGCONST Cell * cell,
 					 symprec);
 }
 
+/* NULL is returned if memory could not be allocated. */
 Cell * ref_get_Wyckoff_positions(int * wyckoffs,
 				 int * equiv_atoms,
 				 SPGCONST Cell * primitive,
 				 SPGCONST Cell * cell,
 				 SPGCONST Spacegroup * spacegroup,
 				 SPGCONST Symmetry * symmetry,
+				 const int * permutations,
 				 const int * mapping_table,
 				 const double symprec)
 {
@@ -118,14 +124,21 @@ Cell * ref_get_Wyckoff_positions(int * wyckoffs,
   int *wyckoffs_bravais, *equiv_atoms_bravais;
   int operation_index[2];
 
-  wyckoffs_bravais = (int*)malloc(sizeof(int) * primitive->size * 4);
-  equiv_atoms_bravais = (int*)malloc(sizeof(int) * primitive->size * 4);
+  bravais = NULL;
+  wyckoffs_bravais = (int*)mem_malloc(sizeof(int) * primitive->size * 4);
+  equiv_atoms_bravais = (int*)mem_malloc(sizeof(int) * primitive->size * 4);
+  if (wyckoffs_bravais == NULL || equiv_atoms_bravais == NULL) {
+    goto ret;
+  }
   
   bravais = get_bravais_exact_positions_and_lattice(wyckoffs_bravais,
 						    equiv_atoms_bravais,
 						    spacegroup,
 						    primitive,
 						    symprec);
+  if (bravais == NULL || bravais->size == 0) {
+    goto ret;
+  }
 
   for (i = 0; i < cell->size; i++) {
     wyckoffs[i] = wyckoffs_bravais[mapping_table[i]];
@@ -136,28 +149,37 @@ Cell * ref_get_Wyckoff_positions(int * wyckoffs,
 
   /* Check symmetry breaking by unusual multiplicity of primitive cell. */
   if (cell->size * num_prim_sym != symmetry->size * primitive->size) {
-    set_equivalent_atoms_broken_symmetry(equiv_atoms,
-					 cell,
-					 symmetry,
-					 mapping_table,
-					 symprec);
+    if (! set_equivalent_atoms_broken_symmetry(equiv_atoms,
+					       cell,
+					       symmetry,
+					       permutations,
+					       mapping_table,
+					       symprec)) {
+      cel_free_cell(bravais);
+      bravais = NULL;
+    }
   } else {
-    set_equivalent_atoms(equiv_atoms,
-			 primitive,
-			 cell,
-			 equiv_atoms_bravais,
-			 mapping_table);
+    if (! set_equivalent_atoms(equiv_atoms,
+			       primitive,
+			       cell,
+			       equiv_atoms_bravais,
+			       mapping_table)) {
+      cel_free_cell(bravais);
+      bravais = NULL;
+    }
   }
   
-  free(equiv_atoms_bravais);
+ ret:
+  mem_free(equiv_atoms_bravais);
   equiv_atoms_bravais = NULL;
-  free(wyckoffs_bravais);
+  mem_free(wyckoffs_bravais);
   wyckoffs_bravais = NULL;
   
   return bravais;
 }
 
 /* Only the atoms corresponding to those in primitive are returned. */
+/* NULL is returned if memory could not be allocated. */
 static Cell * get_bravais_exact_positions_and_lattice(int * wyckoffs,
 						      int * equiv_atoms,
 						      SPGCONST Spacegroup *spacegroup,
@@ -170,22 +192,36 @@ static Cell * get_bravais_exact_positions_and_lattice(int * wyckoffs,
   Cell *bravais, *conv_prim;
   VecDBL *exact_positions;
 
+  bravais = NULL;
+  exact_positions = NULL;
+  wyckoffs_prim = NULL;
+  equiv_atoms_prim = NULL;
+
   /* Positions of primitive atoms are represented wrt Bravais lattice */
   conv_prim = get_conventional_primitive(spacegroup, primitive);
   /* Symmetries in database (wrt Bravais lattice) */
   conv_sym = spgdb_get_spacegroup_operations(spacegroup->hall_number);
+  if (conv_prim == NULL || conv_sym == NULL) {
+    goto ret;
+  }
   /* Lattice vectors are set. */
   get_conventional_lattice(conv_prim->lattice, spacegroup);
 
   /* Symmetrize atomic positions of conventional unit cell */
-  wyckoffs_prim = (int*)malloc(sizeof(int) * primitive->size);
-  equiv_atoms_prim = (int*)malloc(sizeof(int) * primitive->size);
+  wyckoffs_prim = (int*)mem_malloc(sizeof(int) * primitive->size);
+  equiv_atoms_prim = (int*)mem_malloc(sizeof(int) * primitive->size);
+  if (wyckoffs_prim == NULL || equiv_atoms_prim == NULL) {
+    goto ret;
+  }
   exact_positions = ssm_get_exact_positions(wyckoffs_prim,
 					    equiv_atoms_prim,
 					    conv_prim,
 					    conv_sym,
 					    spacegroup->hall_number,
 					    symprec);
+  if (exact_positions == NULL) {
+    goto ret;
+  }
   if (exact_positions->size > 0) {
     for (i = 0; i < conv_prim->size; i++) {
       mat_copy_vector_d3(conv_prim->position[i], exact_positions->vec[i]);
@@ -203,9 +239,9 @@ static Cell * get_bravais_exact_positions_and_lattice(int * wyckoffs,
 			     equiv_atoms_prim);
 
  ret:
-  free(wyckoffs_prim);
+  mem_free(wyckoffs_prim);
   wyckoffs_prim = NULL;
-  free(equiv_atoms_prim);
+  mem_free(equiv_atoms_prim);
   equiv_atoms_prim = NULL;
   mat_free_VecDBL(exact_positions);
   cel_free_cell(conv_prim);
@@ -225,7 +261,9 @@ static Cell * expand_positions(int * wyckoffs,
   Cell * bravais;
 
   num_pure_trans = get_number_of_pure_translation(conv_sym);
-  bravais = cel_alloc_cell(conv_prim->size * num_pure_trans);
+  if ((bravais = cel_alloc_cell(conv_prim->size * num_pure_trans)) == NULL) {
+    return NULL;
+  }
 
   num_atom = 0;
   for (i = 0; i < conv_sym->size; i++) {
@@ -273,7 +311,9 @@ static Cell * get_conventional_primitive(SPGCONST Spacegroup * spacegroup,
   double inv_brv[3][3], trans_mat[3][3];
   Cell * conv_prim;
 
-  conv_prim = cel_alloc_cell(primitive->size);
+  if ((conv_prim = cel_alloc_cell(primitive->size)) == NULL) {
+    return NULL;
+  }
 
   mat_inverse_matrix_d3(inv_brv, spacegroup->bravais_lattice, 0);
   mat_multiply_matrix_d3(trans_mat, inv_brv, primitive->lattice);
@@ -469,12 +509,18 @@ get_refined_symmetry_operations(SPGCONST Cell * cell,
   Symmetry *conv_sym, *prim_sym, *symmetry;
 
   /* Primitive symmetry from database */
-  conv_sym = spgdb_get_spacegroup_operations(spacegroup->hall_number);
+  if ((conv_sym = spgdb_get_spacegroup_operations(spacegroup->hall_number))
+      == NULL) {
+    return NULL;
+  }
   set_translation_with_origin_shift(conv_sym, spacegroup->origin_shift);
   mat_inverse_matrix_d3(inv_mat, primitive->lattice, symprec);
   mat_multiply_matrix_d3(t_mat, inv_mat, spacegroup->bravais_lattice);
   prim_sym = get_primitive_db_symmetry(t_mat, conv_sym, symprec);
   sym_free_symmetry(conv_sym);
+  if (prim_sym == NULL) {
+    return NULL;
+  }
 
   /* Input cell symmetry from primitive symmetry */
   mat_inverse_matrix_d3(inv_mat, primitive->lattice, symprec);
@@ -492,16 +538,20 @@ get_refined_symmetry_operations(SPGCONST Cell * cell,
   return symmetry;
 }
 
-static void set_equivalent_atoms(int * equiv_atoms_cell,
-				 SPGCONST Cell * primitive,
-				 SPGCONST Cell * cell,
-				 const int * equiv_atoms_prim,
-				 const int * mapping_table)
+/* 0 is returned if memory could not be allocated. */
+static int set_equivalent_atoms(int * equiv_atoms_cell,
+				SPGCONST Cell * primitive,
+				SPGCONST Cell * cell,
+				const int * equiv_atoms_prim,
+				const int * mapping_table)
 {
   int i, j;
   int *equiv_atoms;
 
-  equiv_atoms = (int*) malloc(sizeof(int) * primitive->size);
+  if ((equiv_atoms = (int*) mem_malloc(sizeof(int) * primitive->size))
+      == NULL) {
+    return 0;
+  }
   for (i = 0; i < primitive->size; i++) {
     for (j = 0; j < cell->size; j++) {
       if (mapping_table[j] == equiv_atoms_prim[i]) {
@@ -513,17 +563,30 @@ static void set_equivalent_atoms(int * equiv_atoms_cell,
   for (i = 0; i < cell->size; i++) {
     equiv_atoms_cell[i] = equiv_atoms[mapping_table[i]];
   }
-  free(equiv_atoms);
+  mem_free(equiv_atoms);
   equiv_atoms = NULL;
+
+  return 1;
 }
 
-static void set_equivalent_atoms_broken_symmetry(int * equiv_atoms_cell,
-						 SPGCONST Cell * cell,
-						 const Symmetry *symmetry,
-						 const int * mapping_table,
-						 const double symprec)
+/* permutations may be NULL, then atoms are searched by a checker. */
+/* 0 is returned if memory could not be allocated. */
+static int set_equivalent_atoms_broken_symmetry(int * equiv_atoms_cell,
+						SPGCONST Cell * cell,
+						const Symmetry *symmetry,
+						const int * permutations,
+						const int * mapping_table,
+						const double symprec)
 {
   int i, j;
+  OverlapChecker *checker;
+
+  checker = NULL;
+  if (permutations == NULL) {
+    if ((checker = ovl_overlap_checker_init(cell, symprec)) == NULL) {
+      return 0;
+    }
+  }
 
   for (i = 0; i < cell->size; i++) {
     equiv_atoms_cell[i] = i;
@@ -534,7 +597,8 @@ static void set_equivalent_atoms_broken_symmetry(int * equiv_atoms_cell,
 	    equiv_atoms_cell[search_equivalent_atom(i,
 						    cell,
 						    symmetry,
-						    symprec)];
+						    permutations,
+						    checker)];
 	} else {
 	  equiv_atoms_cell[i] = equiv_atoms_cell[j];
 	}
@@ -542,27 +606,32 @@ static void set_equivalent_atoms_broken_symmetry(int * equiv_atoms_cell,
       }
     }
   }
+
+  ovl_overlap_checker_free(checker);
+  checker = NULL;
+
+  return 1;
 }
 
+/* The atom before atom_index onto which atom_index is moved by the */
+/* first of the operations doing so. */
 static int search_equivalent_atom(const int atom_index,
 				  SPGCONST Cell * cell,
 				  const Symmetry *symmetry,
-				  const double symprec)
+				  const int * permutations,
+				  const OverlapChecker *checker)
 {
   int i, j;
-  double pos_rot[3];
 
   for (i = 0; i < symmetry->size; i++) {
-    mat_multiply_matrix_vector_id3(pos_rot,
-				   symmetry->rot[i],
-				   cell->position[atom_index]);
-    for (j = 0; j < 3; j++) {
-      pos_rot[j] += symmetry->trans[i][j];
-    }
-    for (j = 0; j < atom_index; j++) {
-      if (cel_is_overlap(cell->position[j], pos_rot, cell->lattice, symprec)) {
-	return j;
-      }
+    j = sym_get_image_atom(permutations,
+			   checker,
+			   cell,
+			   symmetry,
+			   i,
+			   atom_index);
+    if (j > -1 && j < atom_index) {
+      return j;
     }
   }
   return atom_index;
@@ -599,8 +668,12 @@ static Symmetry * get_primitive_db_symmetry(SPGCONST double t_mat[3][3],
   VecDBL *t_prim;
   Symmetry *prim_sym;
   
+  prim_sym = NULL;
   r_prim = mat_alloc_MatINT(conv_sym->size);
   t_prim = mat_alloc_VecDBL(conv_sym->size);
+  if (r_prim == NULL || t_prim == NULL) {
+    goto ret;
+  }
 
   mat_inverse_matrix_d3(inv_mat, t_mat, symprec);
 
@@ -627,7 +700,9 @@ static Symmetry * get_primitive_db_symmetry(SPGCONST double t_mat[3][3],
     ;
   }
 
-  prim_sym = sym_alloc_symmetry(num_op);
+  if ((prim_sym = sym_alloc_symmetry(num_op)) == NULL) {
+    goto ret;
+  }
   for (i = 0; i < num_op; i++) {
     mat_copy_matrix_i3(prim_sym->rot[i], r_prim->mat[i]);
     for (j = 0; j < 3; j++) {
@@ -635,6 +710,7 @@ static Symmetry * get_primitive_db_symmetry(SPGCONST double t_mat[3][3],
     }
   }
 
+ ret:
   mat_free_MatINT(r_prim);
   mat_free_VecDBL(t_prim);
 
@@ -710,8 +786,14 @@ static Symmetry * reduce_symmetry_in_frame(const int frame[3],
   mat_cast_matrix_3i_to_3d(tmp_mat, t_mat);
   mat_inverse_matrix_d3(inv_tmat, tmp_mat, symprec);
 
+  symmetry = NULL;
+  t_sym = NULL;
+  pure_trans = NULL;
+
   /* transformed lattice points */
-  lattice_trans = mat_alloc_VecDBL(frame[0]*frame[1]*frame[2]);
+  if ((lattice_trans = mat_alloc_VecDBL(frame[0]*frame[1]*frame[2])) == NULL) {
+    return NULL;
+  }
   num_trans = 0;
   for (i = 0; i < frame[0]; i++) {
     for (j = 0; j < frame[1]; j++) {
@@ -734,7 +816,9 @@ static Symmetry * reduce_symmetry_in_frame(const int frame[3],
   }
 
   /* transformed symmetry operations of primitive cell */
-  t_sym = sym_alloc_symmetry(prim_sym->size);
+  if ((t_sym = sym_alloc_symmetry(prim_sym->size)) == NULL) {
+    goto ret;
+  }
   size_sym_orig = 0;
   for (i = 0; i < prim_sym->size; i++) {
     /* R' = T^-1*R*T */
@@ -761,6 +845,9 @@ static Symmetry * reduce_symmetry_in_frame(const int frame[3],
   pure_trans = reduce_lattice_points(lattice,
 				     lattice_trans,
 				     symprec);
+  if (pure_trans == NULL) {
+    goto ret;
+  }
 
   if (! (pure_trans->size == multiplicity)) {
     symmetry = sym_alloc_symmetry(0);
@@ -768,7 +855,10 @@ static Symmetry * reduce_symmetry_in_frame(const int frame[3],
   }
 
   /* copy symmetry operations upon lattice points */
-  symmetry = sym_alloc_symmetry(pure_trans->size * size_sym_orig);
+  if ((symmetry = sym_alloc_symmetry(pure_trans->size * size_sym_orig))
+      == NULL) {
+    goto ret;
+  }
   for (i = 0; i < pure_trans->size; i++) {
     for (j = 0; j < size_sym_orig; j++) {
       mat_copy_matrix_i3(symmetry->rot[size_sym_orig * i + j],
@@ -800,7 +890,9 @@ static VecDBL * reduce_lattice_points(SPGCONST double lattice[3][3],
   VecDBL *pure_trans, *t;
   
   num_pure_trans = 0;
-  t = mat_alloc_VecDBL(lattice_trans->size);
+  if ((t = mat_alloc_VecDBL(lattice_trans->size)) == NULL) {
+    return NULL;
+  }
   for (i = 0; i < lattice_trans->size; i++) {
     is_found = 0;
     for (j = 0; j < num_pure_trans; j++) {
@@ -815,7 +907,10 @@ static VecDBL * reduce_lattice_points(SPGCONST double lattice[3][3],
     }
   }
 
-  pure_trans = mat_alloc_VecDBL(num_pure_trans);
+  if ((pure_trans = mat_alloc_VecDBL(num_pure_trans)) == NULL) {
+    mat_free_VecDBL(t);
+    return NULL;
+  }
   for (i = 0; i < num_pure_trans; i++) {
     mat_copy_vector_d3(pure_trans->vec[i], t->vec[i]);
   }
@@ -20,6 +20,7 @@ Cell * ref_get_Wyckoff_positions(int * wyckoffs,
 				 SPGCONST Cell * cell,
 				 SPGCONST Spacegroup * spacegroup,
 				 SPGCONST Symmetry * symmetry,
+				 const int * permutations,
 				 const int * mapping_table,
 				 const double symprec);
 
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include "cell.h"
 #include "mathfunc.h"
+#include "mem.h"
 #include "symmetry.h"
 #include "sitesym_database.h"
 
@@ -20,13 +21,15 @@ static void get_exact_location(double position[3],
 			       SPGCONST Symmetry * conv_sym,
 			       SPGCONST double bravais_lattice[3][3],
 			       const double symprec);
-static int get_Wyckoff_notation(double position[3],
+static int get_Wyckoff_notation(VecDBL * pos_rot,
+				double position[3],
 				SPGCONST Symmetry * conv_sym,
 				SPGCONST double bravais_lattice[3][3],
 				const int hall_number,
 				const double symprec);
 
 
+/* NULL is returned if memory could not be allocated. */
 VecDBL * ssm_get_exact_positions(int *wyckoffs,
 				 int *equiv_atoms,
 				 SPGCONST Cell * bravais,
@@ -52,12 +55,27 @@ static VecDBL * get_exact_positions(int * wyckoffs,
   int i, j, k, l, num_indep_atoms;
   double pos[3];
   int *indep_atoms;
-  VecDBL *positions;
+  VecDBL *positions, *pos_rot;
 
   debug_print("get_symmetrized_positions\n");
 
-  indep_atoms = (int*) malloc(sizeof(int) * bravais->size);
-  positions = mat_alloc_VecDBL(bravais->size);
+  if ((indep_atoms = (int*) mem_malloc(sizeof(int) * bravais->size))
+      == NULL) {
+    return NULL;
+  }
+  if ((positions = mat_alloc_VecDBL(bravais->size)) == NULL) {
+    mem_free(indep_atoms);
+    indep_atoms = NULL;
+    return NULL;
+  }
+  /* Work space of get_Wyckoff_notation */
+  if ((pos_rot = mat_alloc_VecDBL(conv_sym->size)) == NULL) {
+    mat_free_VecDBL(positions);
+    positions = NULL;
+    mem_free(indep_atoms);
+    indep_atoms = NULL;
+    return NULL;
+  }
   num_indep_atoms = 0;
 
   for (i = 0; i < bravais->size; i++) {
@@ -94,7 +112,8 @@ static VecDBL * get_exact_positions(int * wyckoffs,
 		       conv_sym,
 		       bravais->lattice,
 		       symprec);
-    wyckoffs[i] = get_Wyckoff_notation(positions->vec[i],
+    wyckoffs[i] = get_Wyckoff_notation(pos_rot,
+				       positions->vec[i],
 				       conv_sym,
 				       bravais->lattice,
 				       hall_number,
@@ -104,7 +123,9 @@ static VecDBL * get_exact_positions(int * wyckoffs,
     ;
   }
 
-  free(indep_atoms);
+  mat_free_VecDBL(pos_rot);
+  pos_rot = NULL;
+  mem_free(indep_atoms);
   indep_atoms = NULL;
 
   return positions;
@@ -173,7 +194,9 @@ static void get_exact_location(double position[3],
 
 }
 
-static int get_Wyckoff_notation(double position[3],
+/* pos_rot has conv_sym->size elements. */
+static int get_Wyckoff_notation(VecDBL * pos_rot,
+				double position[3],
 				SPGCONST Symmetry * conv_sym,
 				SPGCONST double bravais_lattice[3][3],
 				const int hall_number,
@@ -183,9 +206,7 @@ static int get_Wyckoff_notation(double position[3],
   int indices_wyc[2];
   int rot[3][3];
   double trans[3], orbit[3];
-  VecDBL *pos_rot;
 
-  pos_rot = mat_alloc_VecDBL(conv_sym->size);
   for (i = 0; i < conv_sym->size; i++) {
     mat_multiply_matrix_vector_id3(pos_rot->vec[i], conv_sym->rot[i], position);
     for (j = 0; j < 3; j++) {
@@ -225,7 +246,6 @@ static int get_Wyckoff_notation(double position[3],
   }
 
  end:
-  mat_free_VecDBL(pos_rot);
   return wyckoff_letter;
 }
 
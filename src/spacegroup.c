@@ -8,6 +8,7 @@
 #include "hall_symbol.h"
 #include "lattice.h"
 #include "mathfunc.h"
+#include "mem.h"
 #include "niggli.h"
 #include "pointgroup.h"
 #include "primitive.h"
@@ -130,7 +131,8 @@ static double change_of_basis_501[3][3] = {{ 0, 0, 1},
 					   { 0,-1, 0},
 					   { 1, 0, 0}};
 
-static int spacegroup_to_hall_number[230] = {
+/* The last one is a sentinel for the number of settings of No.230. */
+static int spacegroup_to_hall_number[231] = {
     1,   2,   3,   6,   9,  18,  21,  30,  39,  57,
    60,  63,  72,  81,  90, 108, 109, 112, 115, 116,
   119, 122, 123, 124, 125, 128, 134, 137, 143, 149,
@@ -154,12 +156,82 @@ static int spacegroup_to_hall_number[230] = {
   495, 497, 498, 500, 501, 502, 503, 504, 505, 506,
   507, 508, 509, 510, 511, 512, 513, 514, 515, 516,
   517, 518, 520, 521, 523, 524, 525, 527, 529, 530,
+  531,
 };
 
+/* First settings of the space groups by point group, which decides */
+/* the holohedry. match_hall_symbol_db fails for the other point */
+/* groups, so only these are tried. The centering is not a key, since */
+/* operations found at a reduced tolerance may include centering */
+/* translations that the lattice does not show. */
+typedef struct {
+  int num_candidates;
+  int candidates[28];
+} HallCandidates;
+
+static HallCandidates hall_candidates[33] = {
+  { 0, {0}},
+  { 1, {1}},
+  { 1, {2}},
+  { 3, {3, 6, 9}},
+  { 4, {18, 21, 30, 39}},
+  { 6, {57, 60, 63, 72, 81, 90}},
+  { 9, {108, 109, 112, 115, 116, 119, 122, 123, 124}},
+  {22, {125, 128, 134, 137, 143, 149, 155, 161, 164, 170, 173, 176, 182,
+	185, 191, 197, 203, 209, 212, 215, 218, 221}},
+  {28, {227, 228, 230, 233, 239, 245, 251, 257, 263, 266, 269, 275, 278,
+	284, 290, 292, 298, 304, 310, 313, 316, 322, 334, 335, 337, 338, 341,
+	343}},
+  { 6, {349, 350, 351, 352, 353, 354}},
+  { 2, {355, 356}},
+  { 6, {357, 358, 359, 361, 363, 364}},
+  {10, {366, 367, 368, 369, 370, 371, 372, 373, 374, 375}},
+  {12, {376, 377, 378, 379, 380, 381, 382, 383, 384, 385, 386, 387}},
+  {12, {388, 389, 390, 391, 392, 393, 394, 395, 396, 397, 398, 399}},
+  {20, {400, 401, 402, 404, 406, 407, 408, 410, 412, 413, 414, 416, 418,
+	419, 420, 422, 424, 425, 426, 428}},
+  { 4, {430, 431, 432, 433}},
+  { 2, {435, 436}},
+  { 7, {438, 439, 440, 441, 442, 443, 444}},
+  { 6, {446, 447, 448, 449, 450, 452}},
+  { 6, {454, 455, 456, 457, 458, 460}},
+  { 6, {462, 463, 464, 465, 466, 467}},
+  { 1, {468}},
+  { 2, {469, 470}},
+  { 6, {471, 472, 473, 474, 475, 476}},
+  { 4, {477, 478, 479, 480}},
+  { 4, {481, 482, 483, 484}},
+  { 4, {485, 486, 487, 488}},
+  { 5, {489, 490, 491, 492, 493}},
+  { 7, {494, 495, 497, 498, 500, 501, 502}},
+  { 8, {503, 504, 505, 506, 507, 508, 509, 510}},
+  { 6, {511, 512, 513, 514, 515, 516}},
+  {10, {517, 518, 520, 521, 523, 524, 525, 527, 529, 530}}
+};
+
+static Primitive * get_primitive_and_spacegroup(Spacegroup * spacegroup,
+						SPGCONST Cell * cell,
+						const double symprec,
+						const double angle_tolerance,
+						SymmetryCache * cache);
+static int set_spectrum(int found[],
+			const double tolerances[],
+			const int num_tol,
+			const double symprec_min,
+			const double symprec_max,
+			SPGCONST Cell * cell,
+			const double angle_tolerance,
+			SymmetryCache * cache);
+static int count_smaller(const double values[],
+			 const int size,
+			 const double value);
+static int compare_double(const void *a, const void *b);
 static Spacegroup search_spacegroup(SPGCONST Cell * primitive,
 				    const int candidates[],
 				    const int num_candidates,
-				    const double symprec);
+				    const double symprec,
+				    const double angle_tolerance,
+				    SymmetryCache * cache);
 static Spacegroup get_spacegroup(const int hall_number,
 				 const double origin_shift[3],
 				 SPGCONST double conv_lattice[3][3]);
@@ -169,7 +241,10 @@ static int iterative_search_hall_number(double origin_shift[3],
 					const int num_candidates,
 					SPGCONST Cell * primitive,
 					SPGCONST Symmetry * symmetry,
-					const double symprec);
+					const double symprec,
+					const double angle_tolerance);
+static const int * get_hall_candidates(int *num_candidates,
+				       const int pointgroup_number);
 static Symmetry * get_symmetry_settings(double conv_lattice[3][3],
 					Pointgroup *pointgroup,
 					Centering *centering,
@@ -179,7 +254,7 @@ static Symmetry * get_symmetry_settings(double conv_lattice[3][3],
 static int search_hall_number(double origin_shift[3],
 			      double conv_lattice[3][3],
 			      const int candidates[],
-			      const int num_candidates,
+			      int num_candidates,
 			      SPGCONST double primitive_lattice[3][3],
 			      SPGCONST Symmetry * symmetry,
 			      const double symprec);
@@ -208,49 +283,206 @@ static Symmetry * get_conventional_symmetry(SPGCONST double transform_mat[3][3],
 					    const Centering centering,
 					    const Symmetry *primitive_sym);
 
+/* NULL is returned if memory could not be allocated. */
 Primitive * spa_get_spacegroup(Spacegroup * spacegroup,
 			       SPGCONST Cell * cell,
-			       const double symprec)
+			       const double symprec,
+			       const double angle_tolerance)
 {
-  int attempt;
-  double tolerance;
   Primitive *primitive;
+  SymmetryCache *cache;
 
-  tolerance = symprec;
+  /* Overlaps found at the first tolerance are reused by the retries. */
+  if ((cache = sym_alloc_cache()) == NULL) {
+    return NULL;
+  }
+  primitive = get_primitive_and_spacegroup(spacegroup,
+					   cell,
+					   symprec,
+					   angle_tolerance,
+					   cache);
+  sym_free_cache(cache);
+  cache = NULL;
 
-  for (attempt = 0; attempt < 100; attempt++) {
-    primitive = prm_get_primitive(cell, tolerance);
-    if (primitive->size > 0) {
-      *spacegroup = search_spacegroup(primitive->cell,
-				      spacegroup_to_hall_number,
-				      230,
-				      primitive->tolerance);
-      if (spacegroup->number > 0) {
-	break;
-      }
+  return primitive;
+}
+
+/* Same as spa_get_spacegroup for a supercell of primitive_cell with */
+/* the lattice primitive_cell->lattice * supercell_matrix. If this is */
+/* verified, the space group is searched with primitive_cell, and */
+/* otherwise it falls back to spa_get_spacegroup. */
+/* NULL is returned if memory could not be allocated. */
+Primitive * spa_get_spacegroup_of_supercell(Spacegroup * spacegroup,
+					    SPGCONST Cell * cell,
+					    SPGCONST Cell * primitive_cell,
+					    SPGCONST int supercell_matrix[3][3],
+					    const double symprec,
+					    const double angle_tolerance)
+{
+  Primitive *primitive;
+
+  if ((primitive = prm_get_primitive_of_supercell(cell,
+						  primitive_cell,
+						  supercell_matrix,
+						  symprec)) == NULL) {
+    return NULL;
+  }
+
+  if (primitive->cell->size > 0) {
+    *spacegroup = search_spacegroup(primitive->cell,
+				    NULL,
+				    0,
+				    primitive->tolerance,
+				    angle_tolerance,
+				    NULL);
+    if (spacegroup->number > 0) {
+      return primitive;
     }
-    
-    warning_print("spglib: Attempt %d tolerance = %f failed.", attempt, tolerance);
-    warning_print(" (line %d, %s).\n", __LINE__, __FILE__);
+    if (mem_is_failed()) {
+      prm_free_primitive(primitive);
+      return NULL;
+    }
+  }
 
-    tolerance *= REDUCE_RATE;
-    prm_free_primitive(primitive);
+  warning_print("spglib: Space group is searched without the supercell hint ");
+  warning_print("(line %d, %s).\n", __LINE__, __FILE__);
+  prm_free_primitive(primitive);
+  primitive = NULL;
+
+  return spa_get_spacegroup(spacegroup, cell, symprec, angle_tolerance);
+}
+
+/* Space groups found by spa_get_spacegroup with symprec in */
+/* [symprec_min, symprec_max]. numbers[i] is found for symprec in */
+/* (symprecs[i - 1], symprecs[i]], where symprecs[-1] is read as */
+/* symprec_min. Symmetry operations can change only at the critical */
+/* tolerances of the input and primitive cells, so the ranges are */
+/* taken between them, and all searches share the overlap distances. */
+/* A range is searched only where the operations differ from those of */
+/* the previous range (see set_spectrum), since the space group is */
+/* not monotonic in the tolerance. Successive ranges with the same */
+/* space group are merged. The number of ranges is returned. */
+/* 0 is returned if max_size is too small or memory could not be */
+/* allocated. */
+int spa_get_symprec_spectrum(double symprecs[],
+			     int numbers[],
+			     const int max_size,
+			     SPGCONST Cell * cell,
+			     const double symprec_min,
+			     const double symprec_max,
+			     const double angle_tolerance)
+{
+  int i, j, num_tol, num_ranges;
+  double *tolerances;
+  int *found;
+  Spacegroup spacegroup;
+  Primitive *primitive;
+  SymmetryCache *cache;
+
+  num_ranges = 0;
+  tolerances = NULL;
+  found = NULL;
+  primitive = NULL;
+
+  if ((cache = sym_alloc_cache()) == NULL) {
+    return 0;
   }
 
-  if (primitive->size == 0) {
-    warning_print("spglib: Space group could not be found ");
-    warning_print("(line %d, %s).\n", __LINE__, __FILE__);
-    primitive = prm_alloc_primitive(0);
-    primitive->cell = cel_alloc_cell(0);
-    primitive->pure_trans = mat_alloc_VecDBL(0);
+  /* The lattice symmetry used in the search is that of the primitive */
+  /* cell, so its critical tolerances are collected, too. */
+  if ((primitive = get_primitive_and_spacegroup(&spacegroup,
+						cell,
+						symprec_max,
+						angle_tolerance,
+						cache)) == NULL) {
+    goto ret;
+  }
+  if ((tolerances = (double*)
+       mem_malloc(sizeof(double) *
+		  (48 * (cell->size + primitive->cell->size + 2) + 1)))
+      == NULL) {
+    goto ret;
+  }
+  if ((num_tol = sym_get_critical_tolerances(tolerances,
+					     cell,
+					     symprec_max,
+					     angle_tolerance,
+					     cache)) < 0) {
+    goto ret;
+  }
+  if (primitive->cell->size > 0) {
+    if ((i = sym_get_critical_tolerances(tolerances + num_tol,
+					 primitive->cell,
+					 symprec_max,
+					 angle_tolerance,
+					 cache)) < 0) {
+      goto ret;
+    }
+    num_tol += i;
   }
 
-  return primitive;
+  /* Upper ends of the ranges */
+  qsort(tolerances, num_tol, sizeof(double), compare_double);
+  j = 0;
+  for (i = 0; i < num_tol; i++) {
+    if (tolerances[i] > symprec_min && tolerances[i] < symprec_max &&
+	(j == 0 || tolerances[i] > tolerances[j - 1])) {
+      tolerances[j] = tolerances[i];
+      j++;
+    }
+  }
+  tolerances[j] = symprec_max;
+  num_tol = j + 1;
+
+  if ((found = (int*) mem_malloc(sizeof(int) * num_tol)) == NULL) {
+    goto ret;
+  }
+  found[num_tol - 1] = spacegroup.number;
+  if (! set_spectrum(found,
+		     tolerances,
+		     num_tol - 1,
+		     symprec_min,
+		     symprec_max,
+		     cell,
+		     angle_tolerance,
+		     cache)) {
+    goto ret;
+  }
+
+  for (i = 0; i < num_tol; i++) {
+    if (num_ranges > 0 && numbers[num_ranges - 1] == found[i]) {
+      symprecs[num_ranges - 1] = tolerances[i];
+      continue;
+    }
+    if (num_ranges == max_size) {
+      warning_print("spglib: Indicated max size(=%d) is less than number ",
+		    max_size);
+      warning_print("spglib: of tolerance ranges.\n");
+      num_ranges = 0;
+      goto ret;
+    }
+    symprecs[num_ranges] = tolerances[i];
+    numbers[num_ranges] = found[i];
+    num_ranges++;
+  }
+
+ ret:
+  mem_free(found);
+  found = NULL;
+  mem_free(tolerances);
+  tolerances = NULL;
+  prm_free_primitive(primitive);
+  primitive = NULL;
+  sym_free_cache(cache);
+  cache = NULL;
+
+  return num_ranges;
 }
 
 Spacegroup spa_get_spacegroup_with_hall_number(SPGCONST Cell * primitive,
 					       const int hall_number,
-					       const double symprec)
+					       const double symprec,
+					       const double angle_tolerance)
 {
   int num_candidates;
   int candidate[1];
@@ -265,7 +497,9 @@ Spacegroup spa_get_spacegroup_with_hall_number(SPGCONST Cell * primitive,
   spacegroup = search_spacegroup(primitive,
 				 candidate,
 				 num_candidates,
-				 symprec);
+				 symprec,
+				 angle_tolerance,
+				 NULL);
   if (spacegroup.number > 0) {
     goto ret;
   }
@@ -279,10 +513,274 @@ Spacegroup spa_get_spacegroup_with_hall_number(SPGCONST Cell * primitive,
   return spacegroup;
 }
 
+/* Same as the search of spa_get_spacegroup in primitive, whose */
+/* symmetry operations are already known, e.g., carried over from a */
+/* previous frame of molecular dynamics by sym_get_tracked_operation. */
+Spacegroup spa_get_spacegroup_with_symmetry(SPGCONST Cell * primitive,
+					    SPGCONST Symmetry * symmetry,
+					    const double symprec,
+					    const double angle_tolerance)
+{
+  int hall_number;
+  double conv_lattice[3][3];
+  double origin_shift[3];
+
+  hall_number = 0;
+  if (symmetry->size > 0) {
+    hall_number = iterative_search_hall_number(origin_shift,
+					       conv_lattice,
+					       NULL,
+					       0,
+					       primitive,
+					       symmetry,
+					       symprec,
+					       angle_tolerance);
+  }
+
+  return get_spacegroup(hall_number, origin_shift, conv_lattice);
+}
+
+/* NULL is returned if memory could not be allocated. */
+static Primitive * get_primitive_and_spacegroup(Spacegroup * spacegroup,
+						SPGCONST Cell * cell,
+						const double symprec,
+						const double angle_tolerance,
+						SymmetryCache * cache)
+{
+  int attempt;
+  double tolerance;
+  Primitive *primitive;
+
+  tolerance = symprec;
+
+  for (attempt = 0; attempt < 100; attempt++) {
+    if ((primitive = prm_get_primitive(cell, tolerance, cache)) == NULL) {
+      return NULL;
+    }
+    if (primitive->size > 0) {
+      *spacegroup = search_spacegroup(primitive->cell,
+				      NULL,
+				      0,
+				      primitive->tolerance,
+				      angle_tolerance,
+				      cache);
+      if (spacegroup->number > 0) {
+	break;
+      }
+      if (mem_is_failed()) {
+	prm_free_primitive(primitive);
+	return NULL;
+      }
+    }
+    
+    warning_print("spglib: Attempt %d tolerance = %f failed.", attempt, tolerance);
+    warning_print(" (line %d, %s).\n", __LINE__, __FILE__);
+
+    tolerance *= REDUCE_RATE;
+    prm_free_primitive(primitive);
+    primitive = NULL;
+  }
+
+  if (primitive == NULL) {
+    spacegroup->number = 0;
+    warning_print("spglib: Space group could not be found ");
+    warning_print("(line %d, %s).\n", __LINE__, __FILE__);
+    if ((primitive = prm_alloc_primitive(0)) == NULL) {
+      return NULL;
+    }
+    primitive->cell = cel_alloc_cell(0);
+    primitive->pure_trans = mat_alloc_VecDBL(0);
+    if (primitive->cell == NULL || primitive->pure_trans == NULL) {
+      prm_free_primitive(primitive);
+      return NULL;
+    }
+  }
+
+  return primitive;
+}
+
+/* found[i] is set to the space group of the range */
+/* (tolerances[i - 1], tolerances[i]] for i < num_tol, searched at */
+/* its middle to stay away from the critical tolerances. The */
+/* primitive cell is searched again only where the pure translations */
+/* of cell change, and the space group of the primitive cell only */
+/* where it or its own critical tolerances change. Other ranges have */
+/* the same symmetry operations as the previous one and take its */
+/* space group. */
+/* 0 is returned if memory could not be allocated. */
+static int set_spectrum(int found[],
+			const double tolerances[],
+			const int num_tol,
+			const double symprec_min,
+			const double symprec_max,
+			SPGCONST Cell * cell,
+			const double angle_tolerance,
+			SymmetryCache * cache)
+{
+  int i, num_pure_tol, num_prim_tol, num_pure, prim_pure, num_ops, number;
+  int succeeded;
+  double tolerance, ratio;
+  double *pure_tol, *prim_tol;
+  Spacegroup spacegroup;
+  Primitive *primitive, *next, *retried;
+
+  succeeded = 0;
+  num_prim_tol = 0;
+  num_pure = -1;
+  prim_pure = -1;
+  num_ops = -1;
+  number = 0;
+  ratio = 1;
+  primitive = NULL;
+  prim_tol = NULL;
+
+  if ((pure_tol = (double*) mem_malloc(sizeof(double) * cell->size))
+      == NULL) {
+    goto ret;
+  }
+  if ((prim_tol = (double*) mem_malloc(sizeof(double) *
+				       48 * (cell->size + 1))) == NULL) {
+    goto ret;
+  }
+  if ((num_pure_tol = sym_get_pure_translation_tolerances(pure_tol,
+							  cell,
+							  symprec_max,
+							  cache)) < 0) {
+    goto ret;
+  }
+  qsort(pure_tol, num_pure_tol, sizeof(double), compare_double);
+
+  for (i = 0; i < num_tol; i++) {
+    tolerance = ((i > 0 ? tolerances[i - 1] : symprec_min) +
+		 tolerances[i]) / 2;
+
+    if (count_smaller(pure_tol, num_pure_tol, tolerance) != num_pure) {
+      num_pure = count_smaller(pure_tol, num_pure_tol, tolerance);
+      if ((next = prm_get_primitive(cell, tolerance, cache)) == NULL) {
+	goto ret;
+      }
+      /* The tolerance may have been reduced to find the primitive */
+      /* cell. It is reduced alike in the following ranges, and the */
+      /* primitive cell is the same as long as the pure translations */
+      /* at the reduced tolerance are. */
+      if (next->size > 0) {
+	ratio = next->tolerance / tolerance;
+	if (count_smaller(pure_tol, num_pure_tol, next->tolerance) ==
+	    prim_pure) {
+	  prm_free_primitive(next);
+	  next = NULL;
+	} else {
+	  prim_pure = count_smaller(pure_tol, num_pure_tol, next->tolerance);
+	  if ((num_prim_tol = sym_get_critical_tolerances(prim_tol,
+							  next->cell,
+							  symprec_max,
+							  angle_tolerance,
+							  cache)) < 0) {
+	    prm_free_primitive(next);
+	    next = NULL;
+	    goto ret;
+	  }
+	  qsort(prim_tol, num_prim_tol, sizeof(double), compare_double);
+	}
+      } else {
+	prim_pure = -1;
+      }
+      if (next != NULL) {
+	num_ops = -1;
+	prm_free_primitive(primitive);
+	primitive = next;
+	next = NULL;
+      }
+    }
+    if (primitive->size == 0) {
+      found[i] = 0;
+      continue;
+    }
+
+    if (count_smaller(prim_tol, num_prim_tol, tolerance * ratio) != num_ops) {
+      num_ops = count_smaller(prim_tol, num_prim_tol, tolerance * ratio);
+      spacegroup = search_spacegroup(primitive->cell,
+				     NULL,
+				     0,
+				     tolerance * ratio,
+				     angle_tolerance,
+				     cache);
+      if (spacegroup.number == 0) {
+	if (mem_is_failed()) {
+	  goto ret;
+	}
+	/* Retried with reduced tolerances */
+	if ((retried = get_primitive_and_spacegroup(&spacegroup,
+						    cell,
+						    tolerance,
+						    angle_tolerance,
+						    cache)) == NULL) {
+	  goto ret;
+	}
+	prm_free_primitive(retried);
+	retried = NULL;
+      }
+      number = spacegroup.number;
+    }
+    found[i] = number;
+  }
+
+  succeeded = 1;
+
+ ret:
+  prm_free_primitive(primitive);
+  primitive = NULL;
+  mem_free(prim_tol);
+  prim_tol = NULL;
+  mem_free(pure_tol);
+  pure_tol = NULL;
+
+  return succeeded;
+}
+
+/* Number of the sorted values smaller than value */
+static int count_smaller(const double values[],
+			 const int size,
+			 const double value)
+{
+  int lower, upper, middle;
+
+  lower = 0;
+  upper = size;
+  while (lower < upper) {
+    middle = (lower + upper) / 2;
+    if (values[middle] < value) {
+      lower = middle + 1;
+    } else {
+      upper = middle;
+    }
+  }
+
+  return lower;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+  double x, y;
+
+  x = *((const double*)a);
+  y = *((const double*)b);
+
+  if (x < y) {
+    return -1;
+  }
+  if (x > y) {
+    return 1;
+  }
+  return 0;
+}
+
 static Spacegroup search_spacegroup(SPGCONST Cell * primitive,
 				    const int candidates[],
 				    const int num_candidates,
-				    const double symprec)
+				    const double symprec,
+				    const double angle_tolerance,
+				    SymmetryCache * cache)
 {
   int hall_number;
   double conv_lattice[3][3];
@@ -290,15 +788,16 @@ static Spacegroup search_spacegroup(SPGCONST Cell * primitive,
   Symmetry *symmetry;
 
   hall_number = 0;
-  symmetry = sym_get_operation(primitive, symprec);
-  if (symmetry->size > 0) {
+  symmetry = sym_get_operation(primitive, symprec, angle_tolerance, cache);
+  if (symmetry != NULL && symmetry->size > 0) {
     hall_number = iterative_search_hall_number(origin_shift,
 					       conv_lattice,
 					       candidates,
 					       num_candidates,
 					       primitive,
 					       symmetry,
-					       symprec);
+					       symprec,
+					       angle_tolerance);
   }
   sym_free_symmetry(symmetry);
 
@@ -357,7 +856,8 @@ static int iterative_search_hall_number(double origin_shift[3],
 					const int num_candidates,
 					SPGCONST Cell * primitive,
 					SPGCONST Symmetry * symmetry,
-					const double symprec)
+					const double symprec,
+					const double angle_tolerance)
 {
   int i, attempt, hall_number=0;
   double tolerance;
@@ -365,7 +865,9 @@ static int iterative_search_hall_number(double origin_shift[3],
 
   debug_print("iterative_search_hall_number:\n");
 
-  sym_reduced = sym_alloc_symmetry(symmetry->size);
+  if ((sym_reduced = sym_alloc_symmetry(symmetry->size)) == NULL) {
+    return 0;
+  }
   for (i = 0; i < symmetry->size; i++) {
     mat_copy_matrix_i3(sym_reduced->rot[i], symmetry->rot[i]);
     mat_copy_vector_d3(sym_reduced->trans[i], symmetry->trans[i]);
@@ -380,7 +882,7 @@ static int iterative_search_hall_number(double origin_shift[3],
 				     primitive->lattice,
 				     sym_reduced,
 				     symprec);
-    if (hall_number > 0) {
+    if (hall_number > 0 || mem_is_failed()) {
       break;
     }
 
@@ -389,7 +891,13 @@ static int iterative_search_hall_number(double origin_shift[3],
 
     sym_free_symmetry(sym_reduced);
     tolerance *= REDUCE_RATE;
-    sym_reduced = sym_reduce_operation(primitive, symmetry, tolerance);
+    sym_reduced = sym_reduce_operation(primitive,
+				       symmetry,
+				       tolerance,
+				       angle_tolerance);
+    if (sym_reduced == NULL) {
+      return 0;
+    }
   }
 
 #ifdef SPGWARNING
@@ -403,10 +911,12 @@ static int iterative_search_hall_number(double origin_shift[3],
   return hall_number;
 }
 
+/* If candidates is NULL, the space groups of the point group found */
+/* are tried. */
 static int search_hall_number(double origin_shift[3],
 			      double conv_lattice[3][3],
 			      const int candidates[],
-			      const int num_candidates,
+			      int num_candidates,
 			      SPGCONST double primitive_lattice[3][3],
 			      SPGCONST Symmetry * symmetry,
 			      const double symprec)
@@ -424,11 +934,18 @@ static int search_hall_number(double origin_shift[3],
 					primitive_lattice,
 					symmetry,
 					symprec);
+  if (conv_symmetry == NULL) {
+    return 0;
+  }
   if (conv_symmetry->size == 0) {
     hall_number = 0;
     goto ret;
   }
 
+  if (candidates == NULL) {
+    candidates = get_hall_candidates(&num_candidates, pointgroup.number);
+  }
+
   for (i = 0; i < num_candidates; i++) {
     hall_number = candidates[i];
     if (match_hall_symbol_db(origin_shift,
@@ -447,6 +964,18 @@ static int search_hall_number(double origin_shift[3],
   return hall_number;
 }
 
+static const int * get_hall_candidates(int *num_candidates,
+				       const int pointgroup_number)
+{
+  if (pointgroup_number < 1 || pointgroup_number > 32) {
+    *num_candidates = 0;
+    return NULL;
+  }
+
+  *num_candidates = hall_candidates[pointgroup_number].num_candidates;
+  return hall_candidates[pointgroup_number].candidates;
+}
+
 static Symmetry * get_symmetry_settings(double conv_lattice[3][3],
 					Pointgroup *pointgroup,
 					Centering *centering,
@@ -481,7 +1010,11 @@ static Symmetry * get_symmetry_settings(double conv_lattice[3][3],
   	niggli_cell[i * 3 + j] = conv_lattice[i][j];
       }
     }
-    niggli_reduce(niggli_cell, symprec * symprec);
+    if (! niggli_reduce(niggli_cell, symprec * symprec)) {
+      conv_symmetry = sym_alloc_symmetry(0);
+      *centering = NO_CENTER;
+      goto ret;
+    }
     for (i = 0; i < 3; i++) {
       for (j = 0; j < 3; j++) {
   	smallest_lattice[i][j] = niggli_cell[i * 3 + j];
@@ -608,6 +1141,9 @@ static int match_hall_symbol_db(double origin_shift[3],
 	changed_symmetry = get_conventional_symmetry(transform_mat,
 						     NO_CENTER,
 						     symmetry);
+	if (changed_symmetry == NULL) {
+	  return 0;
+	}
 	is_found = match_hall_symbol_db_ortho(origin_shift,
 					      changed_lattice,
 					      hall_number,
@@ -652,6 +1188,9 @@ static int match_hall_symbol_db(double origin_shift[3],
 	  get_conventional_symmetry(change_of_basis_501,
 				    NO_CENTER,
 				    symmetry);
+	if (changed_symmetry == NULL) {
+	  return 0;
+	}
 	is_found = hal_match_hall_symbol_db(origin_shift,
 					    changed_lattice,
 					    hall_number,
@@ -682,6 +1221,9 @@ static int match_hall_symbol_db(double origin_shift[3],
 	    get_conventional_symmetry(hR_to_hP,
 				      R_CENTER,
 				      symmetry);
+	  if (changed_symmetry == NULL) {
+	    return 0;
+	  }
 	  is_found = hal_match_hall_symbol_db(origin_shift,
 					      changed_lattice,
 					      hall_number,
@@ -752,6 +1294,9 @@ static int match_hall_symbol_db_monocli(double origin_shift[3],
       get_conventional_symmetry(change_of_basis_monocli[i],
 				NO_CENTER,
 				symmetry);
+    if (changed_symmetry == NULL) {
+      return 0;
+    }
     is_found = hal_match_hall_symbol_db(origin_shift,
 					changed_lattice,
 					hall_number,
@@ -822,6 +1367,9 @@ static int match_hall_symbol_db_ortho(double origin_shift[3],
     changed_symmetry = get_conventional_symmetry(change_of_basis_ortho[i],
 						 NO_CENTER,
 						 symmetry);
+    if (changed_symmetry == NULL) {
+      return 0;
+    }
 
     is_found = hal_match_hall_symbol_db(origin_shift,
 					changed_lattice,
@@ -850,24 +1398,29 @@ static Symmetry * get_conventional_symmetry(SPGCONST double transform_mat[3][3],
 
   size = primitive_sym->size;
 
+  /* Other centerings are not added, as NO_CENTER. */
   switch (centering) {
   case FACE:
-    symmetry = sym_alloc_symmetry(size * 4);
+    multi = 4;
     break;
   case R_CENTER:
-    symmetry = sym_alloc_symmetry(size * 3);
+    multi = 3;
     break;
   case BODY:
   case A_FACE:
   case B_FACE:
   case C_FACE:
-    symmetry = sym_alloc_symmetry(size * 2);
+    multi = 2;
     break;
   default:
-    symmetry = sym_alloc_symmetry(size);
+    multi = 1;
     break;
   }
 
+  if ((symmetry = sym_alloc_symmetry(size * multi)) == NULL) {
+    return NULL;
+  }
+
   for (i = 0; i < size; i++) {
     mat_cast_matrix_3i_to_3d(primitive_sym_rot_d3, primitive_sym->rot[i]);
 
@@ -887,15 +1440,12 @@ static Symmetry * get_conventional_symmetry(SPGCONST double transform_mat[3][3],
 				  primitive_sym->trans[i]);
   }
 
-  multi = 1;
-
-  if (centering != NO_CENTER) {
-    if (centering != FACE && centering != R_CENTER) {
-      for (i = 0; i < 3; i++) {	shift[0][i] = 0.5; } /* BASE */
+  if (multi > 1) {
+    if (multi == 2) {
+      for (i = 0; i < 3; i++) {	shift[0][i] = 0.5; } /* BODY */
       if (centering == A_FACE) { shift[0][0] = 0; }
       if (centering == B_FACE) { shift[0][1] = 0; }
       if (centering == C_FACE) { shift[0][2] = 0; }
-      multi = 2;
     }
 
     if (centering == R_CENTER) {
@@ -905,7 +1455,6 @@ static Symmetry * get_conventional_symmetry(SPGCONST double transform_mat[3][3],
       shift[1][0] = 1. / 3;
       shift[1][1] = 2. / 3;
       shift[1][2] = 2. / 3;
-      multi = 3;
     }
     
     if (centering == FACE) {
@@ -918,7 +1467,6 @@ static Symmetry * get_conventional_symmetry(SPGCONST double transform_mat[3][3],
       shift[2][0] = 0.5;
       shift[2][1] = 0.5;
       shift[2][2] = 0;
-      multi = 4;
     }
 
     for (i = 0; i < multi - 1; i++) {
@@ -26,8 +26,27 @@ typedef struct {
 
 Primitive * spa_get_spacegroup(Spacegroup * spacegroup,
 			       SPGCONST Cell * cell,
-			       const double symprec);
+			       const double symprec,
+			       const double angle_tolerance);
+Primitive * spa_get_spacegroup_of_supercell(Spacegroup * spacegroup,
+					    SPGCONST Cell * cell,
+					    SPGCONST Cell * primitive_cell,
+					    SPGCONST int supercell_matrix[3][3],
+					    const double symprec,
+					    const double angle_tolerance);
+int spa_get_symprec_spectrum(double symprecs[],
+			     int numbers[],
+			     const int max_size,
+			     SPGCONST Cell * cell,
+			     const double symprec_min,
+			     const double symprec_max,
+			     const double angle_tolerance);
 Spacegroup spa_get_spacegroup_with_hall_number(SPGCONST Cell * primitive,
 					       const int hall_number,
-					       const double symprec);
+					       const double symprec,
+					       const double angle_tolerance);
+Spacegroup spa_get_spacegroup_with_symmetry(SPGCONST Cell * primitive,
+					    SPGCONST Symmetry * symmetry,
+					    const double symprec,
+					    const double angle_tolerance);
 #endif
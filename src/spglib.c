@@ -9,6 +9,8 @@
 #include "kpoint.h"
 #include "lattice.h"
 #include "mathfunc.h"
+#include "mem.h"
+#include "overlap.h"
 #include "pointgroup.h"
 #include "spglib.h"
 #include "primitive.h"
@@ -20,22 +22,87 @@
 #include "tetrahedron_method.h"
 
 #define REDUCE_RATE 0.95
+/* The permutation table of a dataset grows as the square of the */
+/* number of atoms of a supercell and is not made beyond this size. */
+#define MAX_PERMUTATION_TABLE_SIZE 4194304
+
+struct _SpglibContext {
+  Cell *cell;
+  Primitive *primitive;
+  Spacegroup spacegroup;
+  SpglibDataset *dataset;
+  OverlapChecker *checker;
+  double symprec;
+};
+
+/* The context of the last frame, and the operations of its */
+/* primitive cell with the permutations of the primitive atoms, */
+/* which are verified for the next frame. */
+struct _SpglibTracker {
+  SpglibContext *context;
+  Symmetry *symmetry;
+  int *permutations;
+  int supercell_matrix[3][3];
+  int full_search_interval;
+  int num_tracked_frames;
+  double symprec;
+  double angle_tolerance;
+};
+
+/* Error of the last call in this thread */
+static SPG_THREAD_LOCAL SpglibError spglib_error_code = SPGLIB_SUCCESS;
+
+static char *error_message[] = {
+  "no error",
+  "memory could not be allocated",
+  "spacegroup search failed",
+  "symmetry operation search failed",
+  "primitive cell search failed",
+  "cell standardization failed",
+  "lattice reduction failed",
+  "too small array size"
+};
 
 /*---------*/
 /* general */
 /*---------*/
+static void clear_error(void);
+static void set_error(const SpglibError error);
+static SpglibDataset * alloc_dataset(void);
 static SpglibDataset * get_dataset(SPGCONST double lattice[3][3],
 				   SPGCONST double position[][3],
 				   const int types[],
 				   const int num_atom,
 				   const int hall_number,
-				   const double symprec);
-static void set_dataset(SpglibDataset * dataset,
-			SPGCONST Cell * cell,
-			SPGCONST Cell * primitive,
-			SPGCONST Spacegroup * spacegroup,
-			const int * mapping_table,
-			const double tolerance);
+				   const double symprec,
+				   const double angle_tolerance);
+static SpglibDataset *
+get_dataset_of_supercell(SPGCONST double lattice[3][3],
+			 SPGCONST double position[][3],
+			 const int types[],
+			 const int num_atom,
+			 SPGCONST int supercell_matrix[3][3],
+			 SPGCONST double primitive_lattice[3][3],
+			 SPGCONST double primitive_position[][3],
+			 const int primitive_types[],
+			 const int num_primitive_atom,
+			 const double symprec,
+			 const double angle_tolerance);
+static int set_dataset(SpglibDataset * dataset,
+		       SPGCONST Cell * cell,
+		       SPGCONST Cell * primitive,
+		       SPGCONST Spacegroup * spacegroup,
+		       const int * mapping_table,
+		       const double tolerance);
+static int get_datasets_batch(SpglibDataset *datasets[],
+			      const int num_structures,
+			      SPGCONST double lattices[][3][3],
+			      SPGCONST double positions[][3],
+			      const int types[],
+			      const int offsets[],
+			      const double symprec,
+			      const double angle_tolerance);
+static int compare_num_atoms(const void *a, const void *b);
 static int get_symmetry_from_dataset(int rotation[][3][3],
 				     double translation[][3],
 				     const int max_size,
@@ -43,7 +110,8 @@ static int get_symmetry_from_dataset(int rotation[][3][3],
 				     SPGCONST double position[][3],
 				     const int types[],
 				     const int num_atom,
-				     const double symprec);
+				     const double symprec,
+				     const double angle_tolerance);
 static int get_symmetry_with_collinear_spin(int rotation[][3][3],
 					    double translation[][3],
 					    int equivalent_atoms[],
@@ -53,12 +121,50 @@ static int get_symmetry_with_collinear_spin(int rotation[][3][3],
 					    const int types[],
 					    const double spins[],
 					    const int num_atom,
-					    const double symprec);
+					    const double symprec,
+					    const double angle_tolerance);
+static int get_symmetry_with_magmoms(int rotation[][3][3],
+				     double translation[][3],
+				     int time_reversals[],
+				     int equivalent_atoms[],
+				     const int max_size,
+				     SPGCONST double lattice[3][3],
+				     SPGCONST double position[][3],
+				     const int types[],
+				     SPGCONST double magmoms[][3],
+				     const int is_time_reversal,
+				     const int num_atom,
+				     const double symprec,
+				     const double angle_tolerance);
+static int set_collinear_operations(int rotation[][3][3],
+				    double translation[][3],
+				    int equivalent_atoms[],
+				    const int max_size,
+				    SPGCONST Symmetry * sym_nonspin,
+				    const int * permutations,
+				    SPGCONST Cell * cell,
+				    const double spins[],
+				    const double symprec);
+static int set_operations_with_magmoms(int rotation[][3][3],
+				       double translation[][3],
+				       int time_reversals[],
+				       int equivalent_atoms[],
+				       const int max_size,
+				       SPGCONST Symmetry * sym_nonspin,
+				       const int * permutations,
+				       SPGCONST Cell * cell,
+				       SPGCONST double magmoms[][3],
+				       const int is_time_reversal,
+				       const double symprec);
 static int get_multiplicity(SPGCONST double lattice[3][3],
 			    SPGCONST double position[][3],
 			    const int types[],
 			    const int num_atom,
-			    const double symprec);
+			    const double symprec,
+			    const double angle_tolerance);
+static int get_smallest_lattice(double smallest_lattice[3][3],
+				SPGCONST double lattice[3][3],
+				const double symprec);
 static int find_primitive(double lattice[3][3],
 			  double position[][3],
 			  int types[],
@@ -69,17 +175,124 @@ static int get_international(char symbol[11],
 			     SPGCONST double position[][3],
 			     const int types[],
 			     const int num_atom,
-			     const double symprec);
+			     const double symprec,
+			     const double angle_tolerance);
 static int get_schoenflies(char symbol[10],
 			   SPGCONST double lattice[3][3],
 			   SPGCONST double position[][3],
 			   const int types[], const int num_atom,
-			   const double symprec);
+			   const double symprec,
+			   const double angle_tolerance);
+static int get_symprec_spectrum(double symprecs[],
+				int spacegroup_numbers[],
+				const int max_size,
+				SPGCONST double lattice[3][3],
+				SPGCONST double position[][3],
+				const int types[],
+				const int num_atom,
+				const double symprec_min,
+				const double symprec_max,
+				const double angle_tolerance);
 static int refine_cell(double lattice[3][3],
 		       double position[][3],
 		       int types[],
 		       const int num_atom,
-		       const double symprec);
+		       const double symprec,
+		       const double angle_tolerance);
+
+/*---------*/
+/* context */
+/*---------*/
+static SpglibContext * alloc_context(SPGCONST double lattice[3][3],
+				     SPGCONST double position[][3],
+				     const int types[],
+				     const int num_atom,
+				     const double symprec,
+				     const double angle_tolerance);
+static void free_context(SpglibContext *context);
+static SpglibDataset * get_context_dataset(SpglibContext *context);
+static int get_context_symmetry(int rotation[][3][3],
+				double translation[][3],
+				const int max_size,
+				SpglibContext *context);
+static int
+get_context_symmetry_with_collinear_spin(int rotation[][3][3],
+					 double translation[][3],
+					 int equivalent_atoms[],
+					 const int max_size,
+					 SpglibContext *context,
+					 const double spins[]);
+static int get_context_symmetry_with_magmoms(int rotation[][3][3],
+					     double translation[][3],
+					     int time_reversals[],
+					     int equivalent_atoms[],
+					     const int max_size,
+					     SpglibContext *context,
+					     SPGCONST double magmoms[][3],
+					     const int is_time_reversal);
+static int get_context_perturbed_symmetry(int rotation[][3][3],
+					  double translation[][3],
+					  const int max_size,
+					  SpglibContext *context,
+					  const int moved_atoms[],
+					  SPGCONST double moved_positions[][3],
+					  const int num_moved_atoms);
+static int get_context_refined_cell(double lattice[3][3],
+				    double position[][3],
+				    int types[],
+				    SpglibContext *context);
+static int get_context_ir_reciprocal_mesh(int grid_address[][3],
+					  int map[],
+					  const int mesh[3],
+					  const int is_shift[3],
+					  const int is_time_reversal,
+					  SpglibContext *context);
+static int
+get_context_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					  int map[],
+					  const int mesh[3],
+					  const int shift[3],
+					  const int shift_denominator,
+					  const int is_time_reversal,
+					  SpglibContext *context);
+static int
+get_context_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					   int map[],
+					   SPGCONST int grid_matrix[3][3],
+					   const int is_shift[3],
+					   const int is_time_reversal,
+					   SpglibContext *context);
+static SpglibIrMesh * get_context_ir_mesh(const int mesh[3],
+					  const int is_shift[3],
+					  const int is_time_reversal,
+					  SpglibContext *context);
+static SpglibIrMeshIterator *
+get_context_ir_mesh_iterator(const int mesh[3],
+			     const int is_shift[3],
+			     const int is_time_reversal,
+			     SpglibContext *context);
+
+/*---------*/
+/* tracker */
+/*---------*/
+static SpglibTracker * alloc_tracker(const double symprec,
+				     const double angle_tolerance,
+				     const int full_search_interval);
+static void free_tracker(SpglibTracker *tracker);
+static int push_tracker_frame(SpglibTracker *tracker,
+			      SPGCONST double lattice[3][3],
+			      SPGCONST double position[][3],
+			      const int types[],
+			      const int num_atom);
+static int is_tracked_frame(SPGCONST SpglibTracker *tracker,
+			    const int types[],
+			    const int num_atom);
+static SpglibContext * get_tracked_context(SpglibTracker *tracker,
+					   SPGCONST double lattice[3][3],
+					   SPGCONST double position[][3],
+					   const int types[],
+					   const int num_atom);
+static int set_tracker_symmetry(SpglibTracker *tracker);
 
 /*---------*/
 /* kpoints */
@@ -93,7 +306,50 @@ static int get_ir_reciprocal_mesh(int grid_address[][3],
 				  SPGCONST double position[][3],
 				  const int types[],
 				  const int num_atom,
-				  const double symprec);
+				  const double symprec,
+				  const double angle_tolerance);
+static int get_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					     int map[],
+					     const int mesh[3],
+					     const int shift[3],
+					     const int shift_denominator,
+					     const int is_time_reversal,
+					     SPGCONST double lattice[3][3],
+					     SPGCONST double position[][3],
+					     const int types[],
+					     const int num_atom,
+					     const double symprec,
+					     const double angle_tolerance);
+static int get_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					      int map[],
+					      SPGCONST int grid_matrix[3][3],
+					      const int is_shift[3],
+					      const int is_time_reversal,
+					      SPGCONST double lattice[3][3],
+					      SPGCONST double position[][3],
+					      const int types[],
+					      const int num_atom,
+					      const double symprec,
+					      const double angle_tolerance);
+static SpglibIrMesh * get_ir_mesh(const int mesh[3],
+				  const int is_shift[3],
+				  const int is_time_reversal,
+				  SPGCONST double lattice[3][3],
+				  SPGCONST double position[][3],
+				  const int types[],
+				  const int num_atom,
+				  const double symprec,
+				  const double angle_tolerance);
+static SpglibIrMeshIterator *
+get_ir_mesh_iterator(const int mesh[3],
+		     const int is_shift[3],
+		     const int is_time_reversal,
+		     SPGCONST double lattice[3][3],
+		     SPGCONST double position[][3],
+		     const int types[],
+		     const int num_atom,
+		     const double symprec,
+		     const double angle_tolerance);
 
 static int get_stabilized_reciprocal_mesh(int grid_address[][3],
 					  int map[],
@@ -127,14 +383,13 @@ SpglibDataset * spg_get_dataset(SPGCONST double lattice[3][3],
 				const int num_atom,
 				const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return get_dataset(lattice,
 		     position,
 		     types,
 		     num_atom,
 		     0,
-		     symprec);
+		     symprec,
+		     -1.0);
 }
 
 SpglibDataset * spgat_get_dataset(SPGCONST double lattice[3][3],
@@ -144,14 +399,13 @@ SpglibDataset * spgat_get_dataset(SPGCONST double lattice[3][3],
 				  const double symprec,
 				  const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
-
   return get_dataset(lattice,
 		     position,
 		     types,
 		     num_atom,
 		     0,
-		     symprec);
+		     symprec,
+		     angle_tolerance);
 }
 
 SpglibDataset * spg_get_dataset_with_hall_number(SPGCONST double lattice[3][3],
@@ -161,14 +415,13 @@ SpglibDataset * spg_get_dataset_with_hall_number(SPGCONST double lattice[3][3],
 						 const int hall_number,
 						 const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return get_dataset(lattice,
 		     position,
 		     types,
 		     num_atom,
 		     hall_number,
-		     symprec);
+		     symprec,
+		     -1.0);
 }
 
 SpglibDataset *
@@ -180,41 +433,92 @@ spgat_get_dataset_with_hall_number(SPGCONST double lattice[3][3],
 				   const double symprec,
 				   const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
-
   return get_dataset(lattice,
 		     position,
 		     types,
 		     num_atom,
 		     hall_number,
-		     symprec);
+		     symprec,
+		     angle_tolerance);
+}
+
+SpglibDataset *
+spg_get_dataset_of_supercell(SPGCONST double lattice[3][3],
+			     SPGCONST double position[][3],
+			     const int types[],
+			     const int num_atom,
+			     SPGCONST int supercell_matrix[3][3],
+			     SPGCONST double primitive_lattice[3][3],
+			     SPGCONST double primitive_position[][3],
+			     const int primitive_types[],
+			     const int num_primitive_atom,
+			     const double symprec)
+{
+  return get_dataset_of_supercell(lattice,
+				  position,
+				  types,
+				  num_atom,
+				  supercell_matrix,
+				  primitive_lattice,
+				  primitive_position,
+				  primitive_types,
+				  num_primitive_atom,
+				  symprec,
+				  -1.0);
+}
+
+SpglibDataset *
+spgat_get_dataset_of_supercell(SPGCONST double lattice[3][3],
+			       SPGCONST double position[][3],
+			       const int types[],
+			       const int num_atom,
+			       SPGCONST int supercell_matrix[3][3],
+			       SPGCONST double primitive_lattice[3][3],
+			       SPGCONST double primitive_position[][3],
+			       const int primitive_types[],
+			       const int num_primitive_atom,
+			       const double symprec,
+			       const double angle_tolerance)
+{
+  return get_dataset_of_supercell(lattice,
+				  position,
+				  types,
+				  num_atom,
+				  supercell_matrix,
+				  primitive_lattice,
+				  primitive_position,
+				  primitive_types,
+				  num_primitive_atom,
+				  symprec,
+				  angle_tolerance);
 }
 
+/* A partially filled dataset is also freed. */
 void spg_free_dataset(SpglibDataset *dataset)
 {
-  if (dataset->n_operations > 0) {
-    free(dataset->rotations);
-    dataset->rotations = NULL;
-    free(dataset->translations);
-    dataset->translations = NULL;
-    dataset->n_operations = 0;
+  if (dataset == NULL) {
+    return;
   }
 
-  if (dataset->n_atoms > 0) {
-    free(dataset->wyckoffs);
-    dataset->wyckoffs = NULL;
-    free(dataset->equivalent_atoms);
-    dataset->equivalent_atoms = NULL;
-    dataset->n_atoms = 0;
-  }
+  mem_free(dataset->rotations);
+  dataset->rotations = NULL;
+  mem_free(dataset->translations);
+  dataset->translations = NULL;
+  dataset->n_operations = 0;
 
-  if (dataset->n_brv_atoms > 0) {
-    free(dataset->brv_positions);
-    dataset->brv_positions = NULL;
-    free(dataset->brv_types);
-    dataset->brv_types = NULL;
-    dataset->n_brv_atoms = 0;
-  }
+  mem_free(dataset->wyckoffs);
+  dataset->wyckoffs = NULL;
+  mem_free(dataset->equivalent_atoms);
+  dataset->equivalent_atoms = NULL;
+  mem_free(dataset->permutations);
+  dataset->permutations = NULL;
+  dataset->n_atoms = 0;
+
+  mem_free(dataset->brv_positions);
+  dataset->brv_positions = NULL;
+  mem_free(dataset->brv_types);
+  dataset->brv_types = NULL;
+  dataset->n_brv_atoms = 0;
 
   dataset->spacegroup_number = 0;
   dataset->hall_number = 0;
@@ -222,10 +526,47 @@ void spg_free_dataset(SpglibDataset *dataset)
   strcpy(dataset->hall_symbol, "");
   strcpy(dataset->setting, "");
   
-  free(dataset);
+  mem_free(dataset);
   dataset = NULL;
 }
 
+int spg_get_datasets_batch(SpglibDataset *datasets[],
+			   const int num_structures,
+			   SPGCONST double lattices[][3][3],
+			   SPGCONST double positions[][3],
+			   const int types[],
+			   const int offsets[],
+			   const double symprec)
+{
+  return get_datasets_batch(datasets,
+			    num_structures,
+			    lattices,
+			    positions,
+			    types,
+			    offsets,
+			    symprec,
+			    -1.0);
+}
+
+int spgat_get_datasets_batch(SpglibDataset *datasets[],
+			     const int num_structures,
+			     SPGCONST double lattices[][3][3],
+			     SPGCONST double positions[][3],
+			     const int types[],
+			     const int offsets[],
+			     const double symprec,
+			     const double angle_tolerance)
+{
+  return get_datasets_batch(datasets,
+			    num_structures,
+			    lattices,
+			    positions,
+			    types,
+			    offsets,
+			    symprec,
+			    angle_tolerance);
+}
+
 int spg_get_symmetry(int rotation[][3][3],
 		     double translation[][3],
 		     const int max_size,
@@ -235,8 +576,6 @@ int spg_get_symmetry(int rotation[][3][3],
 		     const int num_atom,
 		     const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return get_symmetry_from_dataset(rotation,
 				   translation,
 				   max_size,
@@ -244,7 +583,8 @@ int spg_get_symmetry(int rotation[][3][3],
 				   position,
 				   types,
 				   num_atom,
-				   symprec);
+				   symprec,
+				   -1.0);
 }
 
 int spgat_get_symmetry(int rotation[][3][3],
@@ -257,8 +597,6 @@ int spgat_get_symmetry(int rotation[][3][3],
 		       const double symprec,
 		       const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
-
   return get_symmetry_from_dataset(rotation,
 				   translation,
 				   max_size,
@@ -266,7 +604,8 @@ int spgat_get_symmetry(int rotation[][3][3],
 				   position,
 				   types,
 				   num_atom,
-				   symprec);
+				   symprec,
+				   angle_tolerance);
 }
 
 int spg_get_symmetry_with_collinear_spin(int rotation[][3][3],
@@ -280,8 +619,6 @@ int spg_get_symmetry_with_collinear_spin(int rotation[][3][3],
 					 const int num_atom,
 					 const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return get_symmetry_with_collinear_spin(rotation,
 					  translation,
 					  equivalent_atoms,
@@ -291,7 +628,8 @@ int spg_get_symmetry_with_collinear_spin(int rotation[][3][3],
 					  types,
 					  spins,
 					  num_atom,
-					  symprec);
+					  symprec,
+					  -1.0);
 }
 
 int spgat_get_symmetry_with_collinear_spin(int rotation[][3][3],
@@ -306,8 +644,6 @@ int spgat_get_symmetry_with_collinear_spin(int rotation[][3][3],
 					   const double symprec,
 					   const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
-
   return get_symmetry_with_collinear_spin(rotation,
 					  translation,
 					  equivalent_atoms,
@@ -317,7 +653,65 @@ int spgat_get_symmetry_with_collinear_spin(int rotation[][3][3],
 					  types,
 					  spins,
 					  num_atom,
-					  symprec);
+					  symprec,
+					  angle_tolerance);
+}
+
+int spg_get_symmetry_with_magmoms(int rotation[][3][3],
+				  double translation[][3],
+				  int time_reversals[],
+				  int equivalent_atoms[],
+				  const int max_size,
+				  SPGCONST double lattice[3][3],
+				  SPGCONST double position[][3],
+				  const int types[],
+				  SPGCONST double magmoms[][3],
+				  const int is_time_reversal,
+				  const int num_atom,
+				  const double symprec)
+{
+  return get_symmetry_with_magmoms(rotation,
+				   translation,
+				   time_reversals,
+				   equivalent_atoms,
+				   max_size,
+				   lattice,
+				   position,
+				   types,
+				   magmoms,
+				   is_time_reversal,
+				   num_atom,
+				   symprec,
+				   -1.0);
+}
+
+int spgat_get_symmetry_with_magmoms(int rotation[][3][3],
+				    double translation[][3],
+				    int time_reversals[],
+				    int equivalent_atoms[],
+				    const int max_size,
+				    SPGCONST double lattice[3][3],
+				    SPGCONST double position[][3],
+				    const int types[],
+				    SPGCONST double magmoms[][3],
+				    const int is_time_reversal,
+				    const int num_atom,
+				    const double symprec,
+				    const double angle_tolerance)
+{
+  return get_symmetry_with_magmoms(rotation,
+				   translation,
+				   time_reversals,
+				   equivalent_atoms,
+				   max_size,
+				   lattice,
+				   position,
+				   types,
+				   magmoms,
+				   is_time_reversal,
+				   num_atom,
+				   symprec,
+				   angle_tolerance);
 }
 
 int spg_get_multiplicity(SPGCONST double lattice[3][3],
@@ -326,13 +720,12 @@ int spg_get_multiplicity(SPGCONST double lattice[3][3],
 			 const int num_atom,
 			 const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return get_multiplicity(lattice,
 			  position,
 			  types,
 			  num_atom,
-			  symprec);
+			  symprec,
+			  -1.0);
 }
 
 int spgat_get_multiplicity(SPGCONST double lattice[3][3],
@@ -342,20 +735,19 @@ int spgat_get_multiplicity(SPGCONST double lattice[3][3],
 			   const double symprec,
 			   const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
-
   return get_multiplicity(lattice,
 			  position,
 			  types,
 			  num_atom,
-			  symprec);
+			  symprec,
+			  angle_tolerance);
 }
 
 int spg_get_smallest_lattice(double smallest_lattice[3][3],
 			     SPGCONST double lattice[3][3],
 			     const double symprec)
 {
-  return lat_smallest_lattice_vector(smallest_lattice, lattice, symprec);
+  return get_smallest_lattice(smallest_lattice, lattice, symprec);
 }
 
 int spg_find_primitive(double lattice[3][3],
@@ -364,8 +756,6 @@ int spg_find_primitive(double lattice[3][3],
 		       const int num_atom,
 		       const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return find_primitive(lattice,
 			position,
 			types,
@@ -380,7 +770,7 @@ int spgat_find_primitive(double lattice[3][3],
 			 const double symprec,
 			 const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
+  (void)angle_tolerance;
 
   return find_primitive(lattice,
 			position,
@@ -396,14 +786,13 @@ int spg_get_international(char symbol[11],
 			  const int num_atom,
 			  const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return get_international(symbol,
 			   lattice,
 			   position,
 			   types,
 			   num_atom,
-			   symprec);
+			   symprec,
+			   -1.0);
 }
 
 int spgat_get_international(char symbol[11],
@@ -414,14 +803,13 @@ int spgat_get_international(char symbol[11],
 			    const double symprec,
 			    const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
-
   return get_international(symbol,
 			   lattice,
 			   position,
 			   types,
 			   num_atom,
-			   symprec);
+			   symprec,
+			   angle_tolerance);
 }
 
 int spg_get_schoenflies(char symbol[10],
@@ -431,14 +819,13 @@ int spg_get_schoenflies(char symbol[10],
 			const int num_atom,
 			const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return get_schoenflies(symbol,
 			 lattice,
 			 position,
 			 types,
 			 num_atom,
-			 symprec);
+			 symprec,
+			 -1.0);
 }
 
 int spgat_get_schoenflies(char symbol[10],
@@ -449,14 +836,58 @@ int spgat_get_schoenflies(char symbol[10],
 			  const double symprec,
 			  const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
-
   return get_schoenflies(symbol,
 			 lattice,
 			 position,
 			 types,
 			 num_atom,
-			 symprec);
+			 symprec,
+			 angle_tolerance);
+}
+
+int spg_get_symprec_spectrum(double symprecs[],
+			     int spacegroup_numbers[],
+			     const int max_size,
+			     SPGCONST double lattice[3][3],
+			     SPGCONST double position[][3],
+			     const int types[],
+			     const int num_atom,
+			     const double symprec_min,
+			     const double symprec_max)
+{
+  return get_symprec_spectrum(symprecs,
+			      spacegroup_numbers,
+			      max_size,
+			      lattice,
+			      position,
+			      types,
+			      num_atom,
+			      symprec_min,
+			      symprec_max,
+			      -1.0);
+}
+
+int spgat_get_symprec_spectrum(double symprecs[],
+			       int spacegroup_numbers[],
+			       const int max_size,
+			       SPGCONST double lattice[3][3],
+			       SPGCONST double position[][3],
+			       const int types[],
+			       const int num_atom,
+			       const double symprec_min,
+			       const double symprec_max,
+			       const double angle_tolerance)
+{
+  return get_symprec_spectrum(symprecs,
+			      spacegroup_numbers,
+			      max_size,
+			      lattice,
+			      position,
+			      types,
+			      num_atom,
+			      symprec_min,
+			      symprec_max,
+			      angle_tolerance);
 }
 
 int spg_get_pointgroup(char symbol[6],
@@ -489,7 +920,13 @@ int spg_get_symmetry_from_database(int rotations[192][3][3],
   int i, size;
   Symmetry *symmetry;
 
-  symmetry = spgdb_get_spacegroup_operations(hall_number);
+  clear_error();
+
+  if ((symmetry = spgdb_get_spacegroup_operations(hall_number)) == NULL) {
+    set_error(SPGERR_SPACEGROUP_SEARCH_FAILED);
+    return 0;
+  }
+
   for (i = 0; i < symmetry->size; i++) {
     mat_copy_matrix_i3(rotations[i], symmetry->rot[i]);
     mat_copy_vector_d3(translations[i], symmetry->trans[i]);
@@ -523,13 +960,12 @@ int spg_refine_cell(double lattice[3][3],
 		    const int num_atom,
 		    const double symprec)
 {
-  sym_set_angle_tolerance(-1.0);
-
   return refine_cell(lattice,
 		     position,
 		     types,
 		     num_atom,
-		     symprec);
+		     symprec,
+		     -1.0);
 }
 
 int spgat_refine_cell(double lattice[3][3],
@@ -539,94 +975,535 @@ int spgat_refine_cell(double lattice[3][3],
 		      const double symprec,
 		      const double angle_tolerance)
 {
-  sym_set_angle_tolerance(angle_tolerance);
-
   return refine_cell(lattice,
 		     position,
 		     types,
 		     num_atom,
-		     symprec);
+		     symprec,
+		     angle_tolerance);
+}
+
+SpglibError spg_get_error_code(void)
+{
+  return spglib_error_code;
+}
+
+char * spg_get_error_message(SpglibError error)
+{
+  if (error < SPGLIB_SUCCESS || error > SPGERR_ARRAY_SIZE_SHORTAGE) {
+    return "unknown error";
+  }
+
+  return error_message[error];
 }
 
 /*---------*/
-/* kpoints */
+/* context */
 /*---------*/
-int spg_get_grid_point(const int grid_address[3],
-		       const int mesh[3])
+SpglibContext * spg_alloc_context(SPGCONST double lattice[3][3],
+				  SPGCONST double position[][3],
+				  const int types[],
+				  const int num_atom,
+				  const double symprec)
 {
-  return kpt_get_grid_point(grid_address, mesh);
+  return alloc_context(lattice,
+		       position,
+		       types,
+		       num_atom,
+		       symprec,
+		       -1.0);
 }
 
-int spg_get_ir_reciprocal_mesh(int grid_address[][3],
-			       int map[],
-			       const int mesh[3],
-			       const int is_shift[3],
-			       const int is_time_reversal,
-			       SPGCONST double lattice[3][3],
-			       SPGCONST double position[][3],
-			       const int types[],
-			       const int num_atom,
-			       const double symprec)
+SpglibContext * spgat_alloc_context(SPGCONST double lattice[3][3],
+				    SPGCONST double position[][3],
+				    const int types[],
+				    const int num_atom,
+				    const double symprec,
+				    const double angle_tolerance)
 {
-  sym_set_angle_tolerance(-1.0);
+  return alloc_context(lattice,
+		       position,
+		       types,
+		       num_atom,
+		       symprec,
+		       angle_tolerance);
+}
 
-  return get_ir_reciprocal_mesh(grid_address,
-				map,
-				mesh,
-				is_shift,
-				is_time_reversal,
-				lattice,
-				position,
-				types,
-				num_atom,
-				symprec);
+void spg_free_context(SpglibContext *context)
+{
+  free_context(context);
 }
 
-int spg_get_stabilized_reciprocal_mesh(int grid_address[][3],
+const SpglibDataset * spg_context_get_dataset(SpglibContext *context)
+{
+  return get_context_dataset(context);
+}
+
+int spg_context_get_symmetry(int rotation[][3][3],
+			     double translation[][3],
+			     const int max_size,
+			     SpglibContext *context)
+{
+  return get_context_symmetry(rotation,
+			      translation,
+			      max_size,
+			      context);
+}
+
+int spg_context_get_symmetry_with_collinear_spin(int rotation[][3][3],
+						 double translation[][3],
+						 int equivalent_atoms[],
+						 const int max_size,
+						 SpglibContext *context,
+						 const double spins[])
+{
+  return get_context_symmetry_with_collinear_spin(rotation,
+						  translation,
+						  equivalent_atoms,
+						  max_size,
+						  context,
+						  spins);
+}
+
+int spg_get_symmetry_of_perturbed(int rotation[][3][3],
+				  double translation[][3],
+				  const int max_size,
+				  SpglibContext *parent,
+				  const int moved_atoms[],
+				  SPGCONST double moved_positions[][3],
+				  const int num_moved_atoms)
+{
+  return get_context_perturbed_symmetry(rotation,
+					translation,
+					max_size,
+					parent,
+					moved_atoms,
+					moved_positions,
+					num_moved_atoms);
+}
+
+int spg_context_get_international(char symbol[11],
+				  SpglibContext *context)
+{
+  clear_error();
+
+  if (context->spacegroup.number > 0) {
+    strcpy(symbol, context->spacegroup.international_short);
+  } else {
+    set_error(SPGERR_SPACEGROUP_SEARCH_FAILED);
+  }
+
+  return context->spacegroup.number;
+}
+
+int spg_context_get_schoenflies(char symbol[10],
+				SpglibContext *context)
+{
+  clear_error();
+
+  if (context->spacegroup.number > 0) {
+    strcpy(symbol, context->spacegroup.schoenflies);
+  } else {
+    set_error(SPGERR_SPACEGROUP_SEARCH_FAILED);
+  }
+
+  return context->spacegroup.number;
+}
+
+int spg_context_refine_cell(double lattice[3][3],
+			    double position[][3],
+			    int types[],
+			    SpglibContext *context)
+{
+  return get_context_refined_cell(lattice,
+				  position,
+				  types,
+				  context);
+}
+
+int spg_context_get_ir_reciprocal_mesh(int grid_address[][3],
 				       int map[],
 				       const int mesh[3],
 				       const int is_shift[3],
 				       const int is_time_reversal,
-				       const int num_rot,
-				       SPGCONST int rotations[][3][3],
-				       const int num_q,
-				       SPGCONST double qpoints[][3])
+				       SpglibContext *context)
 {
-  return get_stabilized_reciprocal_mesh(grid_address,
+  return get_context_ir_reciprocal_mesh(grid_address,
 					map,
 					mesh,
 					is_shift,
 					is_time_reversal,
-					num_rot,
-					rotations,
-					num_q,
-					qpoints);
+					context);
 }
 
-void spg_get_grid_points_by_rotations(int rot_grid_points[],
-				      const int address_orig[3],
-				      const int num_rot,
-				      SPGCONST int rot_reciprocal[][3][3],
-				      const int mesh[3],
-				      const int is_shift[3])
+int
+spg_context_get_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					      int map[],
+					      const int mesh[3],
+					      const int shift[3],
+					      const int shift_denominator,
+					      const int is_time_reversal,
+					      SpglibContext *context)
 {
-  int i;
-  MatINT *rot;
+  return get_context_ir_reciprocal_mesh_with_shift(grid_address,
+						   map,
+						   mesh,
+						   shift,
+						   shift_denominator,
+						   is_time_reversal,
+						   context);
+}
 
-  rot = mat_alloc_MatINT(num_rot);
-  for (i = 0; i < num_rot; i++) {
-    mat_copy_matrix_i3(rot->mat[i], rot_reciprocal[i]);
-  }
-  kpt_get_grid_points_by_rotations(rot_grid_points,
-				   address_orig,
-				   rot,
-				   mesh,
-				   is_shift);
-  mat_free_MatINT(rot);
+int
+spg_context_get_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					       int map[],
+					       SPGCONST int grid_matrix[3][3],
+					       const int is_shift[3],
+					       const int is_time_reversal,
+					       SpglibContext *context)
+{
+  return get_context_ir_generalized_reciprocal_mesh(grid_address,
+						    map,
+						    grid_matrix,
+						    is_shift,
+						    is_time_reversal,
+						    context);
 }
 
-void spg_get_BZ_grid_points_by_rotations(int rot_grid_points[],
-					 const int address_orig[3],
+SpglibIrMesh * spg_context_get_ir_mesh(const int mesh[3],
+				       const int is_shift[3],
+				       const int is_time_reversal,
+				       SpglibContext *context)
+{
+  return get_context_ir_mesh(mesh, is_shift, is_time_reversal, context);
+}
+
+SpglibIrMeshIterator *
+spg_context_alloc_ir_mesh_iterator(const int mesh[3],
+				   const int is_shift[3],
+				   const int is_time_reversal,
+				   SpglibContext *context)
+{
+  return get_context_ir_mesh_iterator(mesh,
+				      is_shift,
+				      is_time_reversal,
+				      context);
+}
+
+/*---------*/
+/* tracker */
+/*---------*/
+SpglibTracker * spg_alloc_tracker(const double symprec,
+				  const int full_search_interval)
+{
+  return alloc_tracker(symprec, -1.0, full_search_interval);
+}
+
+SpglibTracker * spgat_alloc_tracker(const double symprec,
+				    const double angle_tolerance,
+				    const int full_search_interval)
+{
+  return alloc_tracker(symprec, angle_tolerance, full_search_interval);
+}
+
+void spg_free_tracker(SpglibTracker *tracker)
+{
+  free_tracker(tracker);
+}
+
+int spg_tracker_push_frame(SpglibTracker *tracker,
+			   SPGCONST double lattice[3][3],
+			   SPGCONST double position[][3],
+			   const int types[],
+			   const int num_atom)
+{
+  return push_tracker_frame(tracker,
+			    lattice,
+			    position,
+			    types,
+			    num_atom);
+}
+
+const SpglibDataset * spg_tracker_get_dataset(SpglibTracker *tracker)
+{
+  if (tracker->context == NULL) {
+    set_error(SPGERR_SPACEGROUP_SEARCH_FAILED);
+    return NULL;
+  }
+  return get_context_dataset(tracker->context);
+}
+
+/*-------*/
+/* arena */
+/*-------*/
+SpglibArena * spg_alloc_arena(const int block_size)
+{
+  SpglibArena *arena;
+
+  clear_error();
+
+  if ((arena = mem_alloc_arena(block_size > 0 ? block_size : 0)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  }
+
+  return arena;
+}
+
+void spg_free_arena(SpglibArena *arena)
+{
+  mem_free_arena(arena);
+}
+
+void spg_reset_arena(SpglibArena *arena)
+{
+  mem_reset_arena(arena);
+}
+
+void spg_set_arena(SpglibArena *arena)
+{
+  mem_set_arena(arena);
+}
+
+/*---------*/
+/* kpoints */
+/*---------*/
+int spg_get_grid_point(const int grid_address[3],
+		       const int mesh[3])
+{
+  return kpt_get_grid_point(grid_address, mesh);
+}
+
+int spg_get_ir_reciprocal_mesh(int grid_address[][3],
+			       int map[],
+			       const int mesh[3],
+			       const int is_shift[3],
+			       const int is_time_reversal,
+			       SPGCONST double lattice[3][3],
+			       SPGCONST double position[][3],
+			       const int types[],
+			       const int num_atom,
+			       const double symprec)
+{
+  return get_ir_reciprocal_mesh(grid_address,
+				map,
+				mesh,
+				is_shift,
+				is_time_reversal,
+				lattice,
+				position,
+				types,
+				num_atom,
+				symprec,
+				-1.0);
+}
+
+int spg_get_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					  int map[],
+					  const int mesh[3],
+					  const int shift[3],
+					  const int shift_denominator,
+					  const int is_time_reversal,
+					  SPGCONST double lattice[3][3],
+					  SPGCONST double position[][3],
+					  const int types[],
+					  const int num_atom,
+					  const double symprec)
+{
+  return get_ir_reciprocal_mesh_with_shift(grid_address,
+					   map,
+					   mesh,
+					   shift,
+					   shift_denominator,
+					   is_time_reversal,
+					   lattice,
+					   position,
+					   types,
+					   num_atom,
+					   symprec,
+					   -1.0);
+}
+
+int spg_get_generalized_mesh(int mesh[3],
+			     int shift[3],
+			     int transformation[3][3],
+			     SPGCONST int grid_matrix[3][3],
+			     const int is_shift[3])
+{
+  return kpt_get_generalized_mesh(mesh,
+				  shift,
+				  transformation,
+				  grid_matrix,
+				  is_shift);
+}
+
+int spg_get_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					   int map[],
+					   SPGCONST int grid_matrix[3][3],
+					   const int is_shift[3],
+					   const int is_time_reversal,
+					   SPGCONST double lattice[3][3],
+					   SPGCONST double position[][3],
+					   const int types[],
+					   const int num_atom,
+					   const double symprec)
+{
+  return get_ir_generalized_reciprocal_mesh(grid_address,
+					    map,
+					    grid_matrix,
+					    is_shift,
+					    is_time_reversal,
+					    lattice,
+					    position,
+					    types,
+					    num_atom,
+					    symprec,
+					    -1.0);
+}
+
+SpglibIrMesh * spg_get_ir_mesh(const int mesh[3],
+			       const int is_shift[3],
+			       const int is_time_reversal,
+			       SPGCONST double lattice[3][3],
+			       SPGCONST double position[][3],
+			       const int types[],
+			       const int num_atom,
+			       const double symprec)
+{
+  return get_ir_mesh(mesh,
+		     is_shift,
+		     is_time_reversal,
+		     lattice,
+		     position,
+		     types,
+		     num_atom,
+		     symprec,
+		     -1.0);
+}
+
+int spg_get_ir_mesh_grid_point(const SpglibIrMesh *ir_mesh,
+			       const int grid_point)
+{
+  MatINT rot_reciprocal;
+
+  if (grid_point < 0 ||
+      grid_point >= ir_mesh->mesh[0] * ir_mesh->mesh[1] * ir_mesh->mesh[2]) {
+    return -1;
+  }
+
+  rot_reciprocal.size = ir_mesh->n_rotations;
+  rot_reciprocal.mat = ir_mesh->rotations;
+  return kpt_get_ir_grid_point(grid_point,
+			       ir_mesh->mesh,
+			       ir_mesh->is_shift,
+			       &rot_reciprocal);
+}
+
+void spg_free_ir_mesh(SpglibIrMesh *ir_mesh)
+{
+  if (ir_mesh == NULL) {
+    return;
+  }
+
+  mem_free(ir_mesh->rotations);
+  ir_mesh->rotations = NULL;
+  mem_free(ir_mesh->ir_grid_address);
+  ir_mesh->ir_grid_address = NULL;
+  mem_free(ir_mesh->weights);
+  ir_mesh->weights = NULL;
+  mem_free(ir_mesh->ir_grid_points);
+  ir_mesh->ir_grid_points = NULL;
+  mem_free(ir_mesh);
+}
+
+SpglibIrMeshIterator * spg_alloc_ir_mesh_iterator(const int mesh[3],
+						  const int is_shift[3],
+						  const int is_time_reversal,
+						  SPGCONST double lattice[3][3],
+						  SPGCONST double position[][3],
+						  const int types[],
+						  const int num_atom,
+						  const double symprec)
+{
+  return get_ir_mesh_iterator(mesh,
+			      is_shift,
+			      is_time_reversal,
+			      lattice,
+			      position,
+			      types,
+			      num_atom,
+			      symprec,
+			      -1.0);
+}
+
+int spg_get_next_ir_grid_points(int ir_grid_points[],
+				int weights[],
+				int ir_grid_address[][3],
+				const int max_size,
+				SpglibIrMeshIterator *iterator)
+{
+  return kpt_get_next_ir_grid_points(ir_grid_points,
+				     weights,
+				     ir_grid_address,
+				     max_size,
+				     iterator);
+}
+
+void spg_free_ir_mesh_iterator(SpglibIrMeshIterator *iterator)
+{
+  kpt_free_ir_grid_point_iterator(iterator);
+}
+
+int spg_get_stabilized_reciprocal_mesh(int grid_address[][3],
+				       int map[],
+				       const int mesh[3],
+				       const int is_shift[3],
+				       const int is_time_reversal,
+				       const int num_rot,
+				       SPGCONST int rotations[][3][3],
+				       const int num_q,
+				       SPGCONST double qpoints[][3])
+{
+  return get_stabilized_reciprocal_mesh(grid_address,
+					map,
+					mesh,
+					is_shift,
+					is_time_reversal,
+					num_rot,
+					rotations,
+					num_q,
+					qpoints);
+}
+
+void spg_get_grid_points_by_rotations(int rot_grid_points[],
+				      const int address_orig[3],
+				      const int num_rot,
+				      SPGCONST int rot_reciprocal[][3][3],
+				      const int mesh[3],
+				      const int is_shift[3])
+{
+  int i;
+  MatINT *rot;
+
+  clear_error();
+
+  if ((rot = mat_alloc_MatINT(num_rot)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return;
+  }
+
+  for (i = 0; i < num_rot; i++) {
+    mat_copy_matrix_i3(rot->mat[i], rot_reciprocal[i]);
+  }
+  kpt_get_grid_points_by_rotations(rot_grid_points,
+				   address_orig,
+				   rot,
+				   mesh,
+				   is_shift);
+  mat_free_MatINT(rot);
+}
+
+void spg_get_BZ_grid_points_by_rotations(int rot_grid_points[],
+					 const int address_orig[3],
 					 const int num_rot,
 					 SPGCONST int rot_reciprocal[][3][3],
 					 const int mesh[3],
@@ -636,7 +1513,13 @@ void spg_get_BZ_grid_points_by_rotations(int rot_grid_points[],
   int i;
   MatINT *rot;
 
-  rot = mat_alloc_MatINT(num_rot);
+  clear_error();
+
+  if ((rot = mat_alloc_MatINT(num_rot)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return;
+  }
+
   for (i = 0; i < num_rot; i++) {
     mat_copy_matrix_i3(rot->mat[i], rot_reciprocal[i]);
   }
@@ -664,6 +1547,21 @@ int spg_relocate_BZ_grid_address(int bz_grid_address[][3],
 				      is_shift);
 }
 
+int spg_relocate_BZ_generalized_grid_address(int bz_grid_address[][3],
+					     int bz_map[],
+					     SPGCONST int grid_address[][3],
+					     SPGCONST int grid_matrix[3][3],
+					     SPGCONST double rec_lattice[3][3],
+					     const int is_shift[3])
+{
+  return kpt_relocate_BZ_generalized_grid_address(bz_grid_address,
+						  bz_map,
+						  grid_address,
+						  grid_matrix,
+						  rec_lattice,
+						  is_shift);
+}
+
 int spg_get_triplets_reciprocal_mesh_at_q(int map_triplets[],
 					  int map_q[],
 					  int grid_address[][3],
@@ -767,21 +1665,33 @@ spg_get_tetrahedra_integration_weight_at_omegas
 /*---------*/
 /* general */
 /*---------*/
-static SpglibDataset * get_dataset(SPGCONST double lattice[3][3],
-				   SPGCONST double position[][3],
-				   const int types[],
-				   const int num_atom,
-				   const int hall_number,
-				   const double symprec)
+static void clear_error(void)
+{
+  spglib_error_code = SPGLIB_SUCCESS;
+  mem_clear_failure();
+}
+
+/* Allocation failure recorded by mem_malloc takes precedence. */
+static void set_error(const SpglibError error)
+{
+  if (mem_is_failed()) {
+    spglib_error_code = SPGERR_MEMORY_ALLOCATION_FAILED;
+  } else {
+    spglib_error_code = error;
+  }
+}
+
+static SpglibDataset * alloc_dataset(void)
 {
-  Spacegroup spacegroup;
-  SpacegroupType spacegroup_type;
   SpglibDataset *dataset;
-  Cell *cell;
-  Primitive *primitive;
 
-  dataset = (SpglibDataset*) malloc(sizeof(SpglibDataset));
+  if ((dataset = (SpglibDataset*) mem_malloc(sizeof(SpglibDataset)))
+      == NULL) {
+    return NULL;
+  }
+
   dataset->spacegroup_number = 0;
+  dataset->hall_number = 0;
   strcpy(dataset->international_symbol, "");
   strcpy(dataset->hall_symbol, "");
   strcpy(dataset->setting, "");
@@ -797,52 +1707,147 @@ static SpglibDataset * get_dataset(SPGCONST double lattice[3][3],
   dataset->n_brv_atoms = 0;
   dataset->brv_positions = NULL;
   dataset->brv_types = NULL;
+  dataset->permutations = NULL;
 
-  cell = cel_alloc_cell(num_atom);
-  cel_set_cell(cell, lattice, position, types);
+  return dataset;
+}
 
-  primitive = spa_get_spacegroup(&spacegroup, cell, symprec);
-
-  if (spacegroup.number > 0) {
-    if (hall_number > 0) {
-      spacegroup_type = spgdb_get_spacegroup_type(hall_number);
-      if (spacegroup.number == spacegroup_type.number) {
-	spacegroup = spa_get_spacegroup_with_hall_number(primitive->cell,
-							 hall_number,
-							 primitive->tolerance);
-      } else {
-	spacegroup.number = 0;
-      }
+static SpglibDataset * get_dataset(SPGCONST double lattice[3][3],
+				   SPGCONST double position[][3],
+				   const int types[],
+				   const int num_atom,
+				   const int hall_number,
+				   const double symprec,
+				   const double angle_tolerance)
+{
+  SpacegroupType spacegroup_type;
+  SpglibDataset *dataset;
+  SpglibContext *context;
+
+  clear_error();
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return NULL;
+  }
+
+  if (context->spacegroup.number > 0 && hall_number > 0) {
+    spacegroup_type = spgdb_get_spacegroup_type(hall_number);
+    if (context->spacegroup.number == spacegroup_type.number) {
+      context->spacegroup =
+	spa_get_spacegroup_with_hall_number(context->primitive->cell,
+					    hall_number,
+					    context->primitive->tolerance,
+					    angle_tolerance);
+    } else {
+      context->spacegroup.number = 0;
     }
-    if (spacegroup.number > 0) {
-      set_dataset(dataset,
-		  cell,
-		  primitive->cell,
-		  &spacegroup,
-		  primitive->mapping_table,
-		  primitive->tolerance);
+    if (mem_is_failed()) {
+      set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+      free_context(context);
+      return NULL;
     }
   }
-  
-  prm_free_primitive(primitive);
-  cel_free_cell(cell);
 
+  /* The dataset is taken over from the context. */
+  dataset = get_context_dataset(context);
+  context->dataset = NULL;
+  free_context(context);
+
+  return dataset;
+}
+
+/* The context is made with the primitive cell given as a hint. */
+static SpglibDataset *
+get_dataset_of_supercell(SPGCONST double lattice[3][3],
+			 SPGCONST double position[][3],
+			 const int types[],
+			 const int num_atom,
+			 SPGCONST int supercell_matrix[3][3],
+			 SPGCONST double primitive_lattice[3][3],
+			 SPGCONST double primitive_position[][3],
+			 const int primitive_types[],
+			 const int num_primitive_atom,
+			 const double symprec,
+			 const double angle_tolerance)
+{
+  SpglibDataset *dataset;
+  SpglibContext *context;
+  Cell *primitive_cell;
+
+  clear_error();
+
+  primitive_cell = NULL;
+
+  if ((context = (SpglibContext*) mem_malloc(sizeof(SpglibContext)))
+      == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return NULL;
+  }
+  context->symprec = symprec;
+  context->dataset = NULL;
+  context->primitive = NULL;
+  context->checker = NULL;
+  if ((context->cell = cel_alloc_cell(num_atom)) == NULL) {
+    goto err;
+  }
+  cel_set_cell(context->cell, lattice, position, types);
+  if ((primitive_cell = cel_alloc_cell(num_primitive_atom)) == NULL) {
+    goto err;
+  }
+  cel_set_cell(primitive_cell,
+	       primitive_lattice,
+	       primitive_position,
+	       primitive_types);
+
+  if ((context->primitive =
+       spa_get_spacegroup_of_supercell(&(context->spacegroup),
+				       context->cell,
+				       primitive_cell,
+				       supercell_matrix,
+				       symprec,
+				       angle_tolerance)) == NULL) {
+    goto err;
+  }
+  cel_free_cell(primitive_cell);
+  primitive_cell = NULL;
+
+  /* The dataset is taken over from the context. */
+  dataset = get_context_dataset(context);
+  context->dataset = NULL;
+  free_context(context);
 
   return dataset;
+
+ err:
+  set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  cel_free_cell(primitive_cell);
+  free_context(context);
+  return NULL;
 }
 
-static void set_dataset(SpglibDataset * dataset,
-			SPGCONST Cell * cell,
-			SPGCONST Cell * primitive,
-			SPGCONST Spacegroup * spacegroup,
-			const int * mapping_table,
-			const double tolerance)
+/* 0 is returned if memory could not be allocated. Then the dataset */
+/* may be partially filled and has to be freed by spg_free_dataset. */
+static int set_dataset(SpglibDataset * dataset,
+		       SPGCONST Cell * cell,
+		       SPGCONST Cell * primitive,
+		       SPGCONST Spacegroup * spacegroup,
+		       const int * mapping_table,
+		       const double tolerance)
 {
-  int i;
+  int i, succeeded, is_found;
   double inv_mat[3][3];
   Cell *bravais;
   Symmetry *symmetry;
 
+  succeeded = 0;
+  bravais = NULL;
+  symmetry = NULL;
+
   /* Spacegroup type, transformation matrix, origin shift */
   dataset->n_atoms = cell->size;
   dataset->spacegroup_number = spacegroup->number;
@@ -857,44 +1862,194 @@ static void set_dataset(SpglibDataset * dataset,
   mat_copy_vector_d3(dataset->origin_shift, spacegroup->origin_shift);
 
   /* Symmetry operations */
-  symmetry = ref_get_refined_symmetry_operations(cell,
-						 primitive,
-						 spacegroup,
-						 tolerance);
+  if ((symmetry = ref_get_refined_symmetry_operations(cell,
+						      primitive,
+						      spacegroup,
+						      tolerance)) == NULL) {
+    goto ret;
+  }
   dataset->n_operations = symmetry->size;
   dataset->rotations =
-    (int (*)[3][3])malloc(sizeof(int[3][3]) * dataset->n_operations);
+    (int (*)[3][3])mem_malloc(sizeof(int[3][3]) * dataset->n_operations);
   dataset->translations =
-    (double (*)[3])malloc(sizeof(double[3]) * dataset->n_operations);
+    (double (*)[3])mem_malloc(sizeof(double[3]) * dataset->n_operations);
+  if (dataset->rotations == NULL || dataset->translations == NULL) {
+    goto ret;
+  }
   for (i = 0; i < symmetry->size; i++) {
     mat_copy_matrix_i3(dataset->rotations[i], symmetry->rot[i]);
     mat_copy_vector_d3(dataset->translations[i], symmetry->trans[i]);
   }
 
-  /* Wyckoff positions */
-  dataset->wyckoffs = (int*) malloc(sizeof(int) * dataset->n_atoms); 
-  dataset->equivalent_atoms = (int*) malloc(sizeof(int) * dataset->n_atoms);
-  bravais = ref_get_Wyckoff_positions(dataset->wyckoffs, 
-				      dataset->equivalent_atoms,
-				      primitive,
+  /* Permutations of atoms by the operations. Refined operations can */
+  /* move an atom up to about twice the tolerance from its image. */
+  if (dataset->n_atoms > 0 && dataset->n_operations <=
+      MAX_PERMUTATION_TABLE_SIZE / dataset->n_atoms) {
+    if ((dataset->permutations = (int*)
+	 mem_malloc(sizeof(int) * dataset->n_operations * dataset->n_atoms))
+	== NULL) {
+      goto ret;
+    }
+    if ((is_found = sym_get_permutations(dataset->permutations,
+					 cell,
+					 symmetry,
+					 tolerance)) == 0) {
+      is_found = sym_get_permutations(dataset->permutations,
 				      cell,
-				      spacegroup,
 				      symmetry,
-				      mapping_table,
-				      tolerance);
-  dataset->n_brv_atoms = bravais->size;
-  mat_copy_matrix_d3(dataset->brv_lattice, bravais->lattice);
-  dataset->brv_positions =
-    (double (*)[3])malloc(sizeof(double[3]) * dataset->n_brv_atoms);
-  dataset->brv_types =
-    (int*)malloc(sizeof(int) * dataset->n_brv_atoms);
-  for (i = 0; i < dataset->n_brv_atoms; i++) {
-    mat_copy_vector_d3(dataset->brv_positions[i], bravais->position[i]);
-    dataset->brv_types[i] = bravais->types[i];
-  }
-  
+				      tolerance * 2);
+    }
+    if (is_found < 0) {
+      goto ret;
+    }
+  }
+
+  /* Wyckoff positions */
+  dataset->wyckoffs = (int*) mem_malloc(sizeof(int) * dataset->n_atoms);
+  dataset->equivalent_atoms =
+    (int*) mem_malloc(sizeof(int) * dataset->n_atoms);
+  if (dataset->wyckoffs == NULL || dataset->equivalent_atoms == NULL) {
+    goto ret;
+  }
+  if ((bravais = ref_get_Wyckoff_positions(dataset->wyckoffs,
+					   dataset->equivalent_atoms,
+					   primitive,
+					   cell,
+					   spacegroup,
+					   symmetry,
+					   dataset->permutations,
+					   mapping_table,
+					   tolerance)) == NULL) {
+    goto ret;
+  }
+  dataset->n_brv_atoms = bravais->size;
+  mat_copy_matrix_d3(dataset->brv_lattice, bravais->lattice);
+  dataset->brv_positions =
+    (double (*)[3])mem_malloc(sizeof(double[3]) * dataset->n_brv_atoms);
+  dataset->brv_types =
+    (int*)mem_malloc(sizeof(int) * dataset->n_brv_atoms);
+  if (dataset->brv_positions == NULL || dataset->brv_types == NULL) {
+    goto ret;
+  }
+  for (i = 0; i < dataset->n_brv_atoms; i++) {
+    mat_copy_vector_d3(dataset->brv_positions[i], bravais->position[i]);
+    dataset->brv_types[i] = bravais->types[i];
+  }
+
+  succeeded = 1;
+
+ ret:
   cel_free_cell(bravais);
   sym_free_symmetry(symmetry);
+
+  return succeeded;
+}
+
+/* Structures are handed out to threads one by one, largest first, */
+/* so that a few large structures do not leave the other threads idle */
+/* at the end. */
+static int get_datasets_batch(SpglibDataset *datasets[],
+			      const int num_structures,
+			      SPGCONST double lattices[][3][3],
+			      SPGCONST double positions[][3],
+			      const int types[],
+			      const int offsets[],
+			      const double symprec,
+			      const double angle_tolerance)
+{
+  int i, j, num_found, is_allocated;
+  int (*order)[2];
+  MemArena *arena, *thread_arena;
+
+  clear_error();
+
+  if (num_structures < 1) {
+    return 0;
+  }
+
+  /* Datasets made by a thread may be freed by another, so all the */
+  /* datasets are taken from the heap. The arena of each thread is */
+  /* unset during the call and set again at the end. */
+  arena = mem_get_arena();
+  mem_set_arena(NULL);
+
+  if ((order = (int (*)[2]) mem_malloc(sizeof(int[2]) * num_structures))
+      == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    for (i = 0; i < num_structures; i++) {
+      datasets[i] = NULL;
+    }
+    mem_set_arena(arena);
+    return 0;
+  }
+
+  for (i = 0; i < num_structures; i++) {
+    order[i][0] = offsets[i + 1] - offsets[i];
+    order[i][1] = i;
+  }
+  qsort(order, num_structures, sizeof(int[2]), compare_num_atoms);
+
+  num_found = 0;
+#pragma omp parallel private(j, thread_arena)
+  {
+    thread_arena = mem_get_arena();
+    mem_set_arena(NULL);
+#pragma omp for schedule(dynamic) reduction(+:num_found)
+    for (i = 0; i < num_structures; i++) {
+      j = order[i][1];
+      datasets[j] = get_dataset(lattices[j],
+				positions + offsets[j],
+				types + offsets[j],
+				offsets[j + 1] - offsets[j],
+				0,
+				symprec,
+				angle_tolerance);
+      if (datasets[j] != NULL) {
+	if (datasets[j]->spacegroup_number > 0) {
+	  num_found++;
+	}
+      }
+    }
+    mem_set_arena(thread_arena);
+  }
+
+  mem_free(order);
+  order = NULL;
+  mem_set_arena(arena);
+
+  /* Each thread has its own error code. That of the calling thread */
+  /* is set from the results. */
+  clear_error();
+  is_allocated = 1;
+  for (i = 0; i < num_structures; i++) {
+    if (datasets[i] == NULL) {
+      is_allocated = 0;
+    }
+  }
+  if (! is_allocated) {
+    spglib_error_code = SPGERR_MEMORY_ALLOCATION_FAILED;
+  } else if (num_found < num_structures) {
+    spglib_error_code = SPGERR_SPACEGROUP_SEARCH_FAILED;
+  }
+
+  return num_found;
+}
+
+/* Descending order of number of atoms */
+static int compare_num_atoms(const void *a, const void *b)
+{
+  const int *ia, *ib;
+
+  ia = (const int*)a;
+  ib = (const int*)b;
+
+  if (ia[0] > ib[0]) {
+    return -1;
+  }
+  if (ia[0] < ib[0]) {
+    return 1;
+  }
+  return ia[1] - ib[1];
 }
 
 static int get_symmetry_from_dataset(int rotation[][3][3],
@@ -904,38 +2059,32 @@ static int get_symmetry_from_dataset(int rotation[][3][3],
 				     SPGCONST double position[][3],
 				     const int types[],
 				     const int num_atom,
-				     const double symprec)
+				     const double symprec,
+				     const double angle_tolerance)
 {
-  int i, num_sym;
-  SpglibDataset *dataset;
-
-  dataset = get_dataset(lattice,
-			position,
-			types,
-			num_atom,
-			0,
-			symprec);
-  
-  if (dataset->n_operations > max_size) {
-    fprintf(stderr,
-	    "spglib: Indicated max size(=%d) is less than number ", max_size);
-    fprintf(stderr,
-	    "spglib: of symmetry operations(=%d).\n", dataset->n_operations);
-    num_sym = 0;
-    goto ret;
+  int num_sym;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
   }
 
-  num_sym = dataset->n_operations;
-  for (i = 0; i < num_sym; i++) {
-    mat_copy_matrix_i3(rotation[i], dataset->rotations[i]);
-    mat_copy_vector_d3(translation[i], dataset->translations[i]);
-  }
-  
- ret:
-  spg_free_dataset(dataset);
+  num_sym = get_context_symmetry(rotation,
+				 translation,
+				 max_size,
+				 context);
+  free_context(context);
+
   return num_sym;
 }
 
+/* The operations are those spg_get_symmetry finds at the same */
+/* tolerance, of which the signs of the spins are checked. */
 static int get_symmetry_with_collinear_spin(int rotation[][3][3],
 					    double translation[][3],
 					    int equivalent_atoms[],
@@ -945,41 +2094,103 @@ static int get_symmetry_with_collinear_spin(int rotation[][3][3],
 					    const int types[],
 					    const double spins[],
 					    const int num_atom,
-					    const double symprec)
+					    const double symprec,
+					    const double angle_tolerance)
 {
-  int i, size;
-  Symmetry *symmetry, *sym_nonspin;
-  Cell *cell;
-  SpglibDataset *dataset;
+  int size;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
+  }
 
-  cell = cel_alloc_cell(num_atom);
-  cel_set_cell(cell, lattice, position, types);
+  size = get_context_symmetry_with_collinear_spin(rotation,
+						  translation,
+						  equivalent_atoms,
+						  max_size,
+						  context,
+						  spins);
+  free_context(context);
 
-  dataset = get_dataset(lattice,
-			position,
-			types,
-			num_atom,
-			0,
-			symprec);
+  return size;
+}
 
-  sym_nonspin = sym_alloc_symmetry(dataset->n_operations);
-  for (i = 0; i < dataset->n_operations; i++) {
-    mat_copy_matrix_i3(sym_nonspin->rot[i], dataset->rotations[i]);
-    mat_copy_vector_d3(sym_nonspin->trans[i], dataset->translations[i]);
+/* Same as get_symmetry_with_collinear_spin, and the moments are */
+/* rotated as axial vectors. */
+static int get_symmetry_with_magmoms(int rotation[][3][3],
+				     double translation[][3],
+				     int time_reversals[],
+				     int equivalent_atoms[],
+				     const int max_size,
+				     SPGCONST double lattice[3][3],
+				     SPGCONST double position[][3],
+				     const int types[],
+				     SPGCONST double magmoms[][3],
+				     const int is_time_reversal,
+				     const int num_atom,
+				     const double symprec,
+				     const double angle_tolerance)
+{
+  int size;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
   }
-  spg_free_dataset(dataset);
+
+  size = get_context_symmetry_with_magmoms(rotation,
+					   translation,
+					   time_reversals,
+					   equivalent_atoms,
+					   max_size,
+					   context,
+					   magmoms,
+					   is_time_reversal);
+  free_context(context);
+
+  return size;
+}
+
+/* 0 is returned if it failed, of which reason is set as the error. */
+static int set_collinear_operations(int rotation[][3][3],
+				    double translation[][3],
+				    int equivalent_atoms[],
+				    const int max_size,
+				    SPGCONST Symmetry * sym_nonspin,
+				    const int * permutations,
+				    SPGCONST Cell * cell,
+				    const double spins[],
+				    const double symprec)
+{
+  int i, size;
+  Symmetry *symmetry;
 
   symmetry = spn_get_collinear_operations(equivalent_atoms,
 					  sym_nonspin,
+					  permutations,
 					  cell,
 					  spins,
 					  symprec);
-  sym_free_symmetry(sym_nonspin);
-  
+  if (symmetry == NULL) {
+    set_error(SPGERR_SYMMETRY_OPERATION_SEARCH_FAILED);
+    return 0;
+  }
+
   if (symmetry->size > max_size) {
     fprintf(stderr, "spglib: Indicated max size(=%d) is less than number ",
 	    max_size);
     fprintf(stderr, "spglib: of symmetry operations(=%d).\n", symmetry->size);
+    set_error(SPGERR_ARRAY_SIZE_SHORTAGE);
     sym_free_symmetry(symmetry);
     return 0;
   }
@@ -990,9 +2201,68 @@ static int get_symmetry_with_collinear_spin(int rotation[][3][3],
   }
 
   size = symmetry->size;
+  sym_free_symmetry(symmetry);
 
-  cel_free_cell(cell);
+  return size;
+}
+
+/* 0 is returned if it failed, of which reason is set as the error. */
+static int set_operations_with_magmoms(int rotation[][3][3],
+				       double translation[][3],
+				       int time_reversals[],
+				       int equivalent_atoms[],
+				       const int max_size,
+				       SPGCONST Symmetry * sym_nonspin,
+				       const int * permutations,
+				       SPGCONST Cell * cell,
+				       SPGCONST double magmoms[][3],
+				       const int is_time_reversal,
+				       const double symprec)
+{
+  int i, size;
+  int *reversals;
+  Symmetry *symmetry;
+
+  size = 0;
+
+  if ((reversals = (int*) mem_malloc(sizeof(int) * sym_nonspin->size))
+      == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
+
+  if ((symmetry = spn_get_operations_with_magmoms(equivalent_atoms,
+						  reversals,
+						  sym_nonspin,
+						  permutations,
+						  cell,
+						  magmoms,
+						  is_time_reversal,
+						  symprec)) == NULL) {
+    set_error(SPGERR_SYMMETRY_OPERATION_SEARCH_FAILED);
+    goto ret;
+  }
+
+  if (symmetry->size > max_size) {
+    fprintf(stderr, "spglib: Indicated max size(=%d) is less than number ",
+	    max_size);
+    fprintf(stderr, "spglib: of symmetry operations(=%d).\n", symmetry->size);
+    set_error(SPGERR_ARRAY_SIZE_SHORTAGE);
+    goto ret;
+  }
+
+  for (i = 0; i < symmetry->size; i++) {
+    mat_copy_matrix_i3(rotation[i], symmetry->rot[i]);
+    mat_copy_vector_d3(translation[i], symmetry->trans[i]);
+    time_reversals[i] = reversals[i];
+  }
+  size = symmetry->size;
+
+ ret:
   sym_free_symmetry(symmetry);
+  symmetry = NULL;
+  mem_free(reversals);
+  reversals = NULL;
 
   return size;
 }
@@ -1001,23 +2271,44 @@ static int get_multiplicity(SPGCONST double lattice[3][3],
 			    SPGCONST double position[][3],
 			    const int types[],
 			    const int num_atom,
-			    const double symprec)
+			    const double symprec,
+			    const double angle_tolerance)
 {
   int size;
-  SpglibDataset *dataset;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
+  }
 
-  dataset = get_dataset(lattice,
-			position,
-			types,
-			num_atom,
-			0,
-			symprec);
-  size = dataset->n_operations;
-  spg_free_dataset(dataset);
+  size = 0;
+  if (get_context_dataset(context) != NULL) {
+    size = context->dataset->n_operations;
+  }
+  free_context(context);
 
   return size;
 }
 
+static int get_smallest_lattice(double smallest_lattice[3][3],
+				SPGCONST double lattice[3][3],
+				const double symprec)
+{
+  clear_error();
+
+  if (lat_smallest_lattice_vector(smallest_lattice, lattice, symprec)) {
+    return 1;
+  }
+
+  set_error(SPGERR_LATTICE_REDUCTION_FAILED);
+  return 0;
+}
+
 static int find_primitive(double lattice[3][3],
 			  double position[][3],
 			  int types[],
@@ -1027,12 +2318,24 @@ static int find_primitive(double lattice[3][3],
   int i, num_prim_atom=0;
   Cell *cell, *primitive;
 
-  cell = cel_alloc_cell(num_atom);
+  clear_error();
+
+  if ((cell = cel_alloc_cell(num_atom)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
   cel_set_cell(cell, lattice, position, types);
 
   /* find primitive cell */
-  primitive = prm_get_primitive_cell(cell, symprec);
-  if (primitive->size == cell->size) { /* Already primitive */
+  if ((primitive = prm_get_primitive_cell(cell, symprec)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    cel_free_cell(cell);
+    return 0;
+  }
+
+  if (primitive->size == 0) {
+    set_error(SPGERR_PRIMITIVE_CELL_SEARCH_FAILED);
+  } else if (primitive->size == cell->size) { /* Already primitive */
     num_prim_atom = 0;
   } else { /* Primitive cell was found. */
     num_prim_atom = primitive->size;
@@ -1056,24 +2359,25 @@ static int get_international(char symbol[11],
 			     SPGCONST double position[][3],
 			     const int types[],
 			     const int num_atom,
-			     const double symprec)
+			     const double symprec,
+			     const double angle_tolerance)
 {
-  Cell *cell;
-  Primitive *primitive;
-  Spacegroup spacegroup;
-
-  cell = cel_alloc_cell(num_atom);
-  cel_set_cell(cell, lattice, position, types);
-
-  primitive = spa_get_spacegroup(&spacegroup, cell, symprec);
-  prm_free_primitive(primitive);
-  if (spacegroup.number > 0) {
-    strcpy(symbol, spacegroup.international_short);
+  int number;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
   }
 
-  cel_free_cell(cell);
+  number = spg_context_get_international(symbol, context);
+  free_context(context);
 
-  return spacegroup.number;
+  return number;
 }
 
 static int get_schoenflies(char symbol[10],
@@ -1081,98 +2385,1074 @@ static int get_schoenflies(char symbol[10],
 			   SPGCONST double position[][3],
 			   const int types[],
 			   const int num_atom,
-			   const double symprec)
+			   const double symprec,
+			   const double angle_tolerance)
 {
+  int number;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
+  }
+
+  number = spg_context_get_schoenflies(symbol, context);
+  free_context(context);
+
+  return number;
+}
+
+static int get_symprec_spectrum(double symprecs[],
+				int spacegroup_numbers[],
+				const int max_size,
+				SPGCONST double lattice[3][3],
+				SPGCONST double position[][3],
+				const int types[],
+				const int num_atom,
+				const double symprec_min,
+				const double symprec_max,
+				const double angle_tolerance)
+{
+  int num_ranges;
   Cell *cell;
-  Primitive *primitive;
-  Spacegroup spacegroup;
 
-  cell = cel_alloc_cell(num_atom);
-  cel_set_cell(cell, lattice, position, types);
+  clear_error();
+
+  if (symprec_min <= 0 || symprec_min > symprec_max) {
+    set_error(SPGERR_SPACEGROUP_SEARCH_FAILED);
+    return 0;
+  }
 
-  primitive = spa_get_spacegroup(&spacegroup, cell, symprec);
-  prm_free_primitive(primitive);
-  if (spacegroup.number > 0) {
-    strcpy(symbol, spacegroup.schoenflies);
+  if ((cell = cel_alloc_cell(num_atom)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
   }
+  cel_set_cell(cell, lattice, position, types);
 
+  num_ranges = spa_get_symprec_spectrum(symprecs,
+					spacegroup_numbers,
+					max_size,
+					cell,
+					symprec_min,
+					symprec_max,
+					angle_tolerance);
   cel_free_cell(cell);
 
-  return spacegroup.number;
+  if (num_ranges == 0) {
+    set_error(SPGERR_ARRAY_SIZE_SHORTAGE);
+  }
+
+  return num_ranges;
 }
 
 static int refine_cell(double lattice[3][3],
 		       double position[][3],
 		       int types[],
 		       const int num_atom,
-		       const double symprec)
+		       const double symprec,
+		       const double angle_tolerance)
 {
-  int i, n_brv_atoms;
-  SpglibDataset *dataset;
-
-  dataset = get_dataset(lattice,
-			position,
-			types,
-			num_atom,
-			0,
-			symprec);
-
-  n_brv_atoms = dataset->n_brv_atoms;
-  if (dataset->n_brv_atoms > 0) {
-    mat_copy_matrix_d3(lattice, dataset->brv_lattice);
-    for (i = 0; i < dataset->n_brv_atoms; i++) {
-      types[i] = dataset->brv_types[i];
-      mat_copy_vector_d3(position[i], dataset->brv_positions[i]);
-    }
+  int n_brv_atoms;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
   }
 
-  spg_free_dataset(dataset);
-  
+  n_brv_atoms = get_context_refined_cell(lattice,
+					 position,
+					 types,
+					 context);
+  free_context(context);
+
   return n_brv_atoms;
 }
 
-
 /*---------*/
-/* kpoints */
+/* context */
 /*---------*/
-static int get_ir_reciprocal_mesh(int grid_address[][3],
-				  int map[],
-				  const int mesh[3],
-				  const int is_shift[3],
-				  const int is_time_reversal,
-				  SPGCONST double lattice[3][3],
-				  SPGCONST double position[][3],
-				  const int types[],
-				  const int num_atom,
-				  const double symprec)
+static SpglibContext * alloc_context(SPGCONST double lattice[3][3],
+				     SPGCONST double position[][3],
+				     const int types[],
+				     const int num_atom,
+				     const double symprec,
+				     const double angle_tolerance)
 {
-  SpglibDataset *dataset;
-  int num_ir, i;
-  MatINT *rotations;
+  SpglibContext *context;
 
-  dataset = get_dataset(lattice,
-			position,
-			types,
-			num_atom,
-			0,
-			symprec);
-  rotations = mat_alloc_MatINT(dataset->n_operations);
-  for (i = 0; i < dataset->n_operations; i++) {
-    mat_copy_matrix_i3(rotations->mat[i], dataset->rotations[i]);
+  clear_error();
+
+  if ((context = (SpglibContext*) mem_malloc(sizeof(SpglibContext)))
+      == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return NULL;
   }
-  num_ir = kpt_get_irreducible_reciprocal_mesh(grid_address,
-					       map,
-					       mesh,
-					       is_shift,
-					       is_time_reversal,
-					       rotations);
-  mat_free_MatINT(rotations);
-  spg_free_dataset(dataset);
-  return num_ir;
+
+  context->symprec = symprec;
+  context->dataset = NULL;
+  context->primitive = NULL;
+  context->checker = NULL;
+  if ((context->cell = cel_alloc_cell(num_atom)) == NULL) {
+    goto err;
+  }
+  cel_set_cell(context->cell, lattice, position, types);
+  if ((context->primitive = spa_get_spacegroup(&(context->spacegroup),
+					       context->cell,
+					       symprec,
+					       angle_tolerance)) == NULL) {
+    goto err;
+  }
+
+  /* The context is kept even if the space group is not found. */
+  if (context->spacegroup.number == 0) {
+    set_error(SPGERR_SPACEGROUP_SEARCH_FAILED);
+  }
+
+  return context;
+
+ err:
+  set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  free_context(context);
+  return NULL;
 }
 
-static int get_stabilized_reciprocal_mesh(int grid_address[][3],
-					  int map[],
+static void free_context(SpglibContext *context)
+{
+  if (context == NULL) {
+    return;
+  }
+
+  if (context->dataset != NULL) {
+    spg_free_dataset(context->dataset);
+    context->dataset = NULL;
+  }
+  prm_free_primitive(context->primitive);
+  context->primitive = NULL;
+  ovl_overlap_checker_free(context->checker);
+  context->checker = NULL;
+  cel_free_cell(context->cell);
+  context->cell = NULL;
+  mem_free(context);
+  context = NULL;
+}
+
+/* The dataset is made at the first request. */
+static SpglibDataset * get_context_dataset(SpglibContext *context)
+{
+  clear_error();
+
+  if (context->dataset == NULL) {
+    if ((context->dataset = alloc_dataset()) == NULL) {
+      set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+      return NULL;
+    }
+
+    if (context->spacegroup.number > 0) {
+      if (! set_dataset(context->dataset,
+			context->cell,
+			context->primitive->cell,
+			&(context->spacegroup),
+			context->primitive->mapping_table,
+			context->primitive->tolerance)) {
+	set_error(SPGERR_CELL_STANDARDIZATION_FAILED);
+	spg_free_dataset(context->dataset);
+	context->dataset = NULL;
+	return NULL;
+      }
+    }
+  }
+
+  if (context->dataset->spacegroup_number == 0) {
+    set_error(SPGERR_SPACEGROUP_SEARCH_FAILED);
+  }
+
+  return context->dataset;
+}
+
+static int get_context_symmetry(int rotation[][3][3],
+				double translation[][3],
+				const int max_size,
+				SpglibContext *context)
+{
+  int i;
+  SpglibDataset *dataset;
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return 0;
+  }
+
+  if (dataset->n_operations > max_size) {
+    fprintf(stderr,
+	    "spglib: Indicated max size(=%d) is less than number ", max_size);
+    fprintf(stderr,
+	    "spglib: of symmetry operations(=%d).\n", dataset->n_operations);
+    set_error(SPGERR_ARRAY_SIZE_SHORTAGE);
+    return 0;
+  }
+
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(rotation[i], dataset->rotations[i]);
+    mat_copy_vector_d3(translation[i], dataset->translations[i]);
+  }
+
+  return dataset->n_operations;
+}
+
+static int
+get_context_symmetry_with_collinear_spin(int rotation[][3][3],
+					 double translation[][3],
+					 int equivalent_atoms[],
+					 const int max_size,
+					 SpglibContext *context,
+					 const double spins[])
+{
+  int i, size;
+  Symmetry *sym_nonspin;
+  SpglibDataset *dataset;
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return 0;
+  }
+
+  if ((sym_nonspin = sym_alloc_symmetry(dataset->n_operations)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(sym_nonspin->rot[i], dataset->rotations[i]);
+    mat_copy_vector_d3(sym_nonspin->trans[i], dataset->translations[i]);
+  }
+
+  size = set_collinear_operations(rotation,
+				  translation,
+				  equivalent_atoms,
+				  max_size,
+				  sym_nonspin,
+				  dataset->permutations,
+				  context->cell,
+				  spins,
+				  context->symprec);
+  sym_free_symmetry(sym_nonspin);
+
+  return size;
+}
+
+static int get_context_symmetry_with_magmoms(int rotation[][3][3],
+					     double translation[][3],
+					     int time_reversals[],
+					     int equivalent_atoms[],
+					     const int max_size,
+					     SpglibContext *context,
+					     SPGCONST double magmoms[][3],
+					     const int is_time_reversal)
+{
+  int i, size;
+  Symmetry *sym_nonspin;
+  SpglibDataset *dataset;
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return 0;
+  }
+
+  if ((sym_nonspin = sym_alloc_symmetry(dataset->n_operations)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(sym_nonspin->rot[i], dataset->rotations[i]);
+    mat_copy_vector_d3(sym_nonspin->trans[i], dataset->translations[i]);
+  }
+
+  size = set_operations_with_magmoms(rotation,
+				     translation,
+				     time_reversals,
+				     equivalent_atoms,
+				     max_size,
+				     sym_nonspin,
+				     dataset->permutations,
+				     context->cell,
+				     magmoms,
+				     is_time_reversal,
+				     context->symprec);
+  sym_free_symmetry(sym_nonspin);
+
+  return size;
+}
+
+/* The checker of the structure of the context is made at the first */
+/* request and kept for the following perturbations. */
+static int get_context_perturbed_symmetry(int rotation[][3][3],
+					  double translation[][3],
+					  const int max_size,
+					  SpglibContext *context,
+					  const int moved_atoms[],
+					  SPGCONST double moved_positions[][3],
+					  const int num_moved_atoms)
+{
+  int i, size;
+  Symmetry *symmetry, *sym_parent;
+  SpglibDataset *dataset;
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return 0;
+  }
+
+  for (i = 0; i < num_moved_atoms; i++) {
+    if (moved_atoms[i] < 0 || moved_atoms[i] >= context->cell->size) {
+      set_error(SPGERR_SYMMETRY_OPERATION_SEARCH_FAILED);
+      return 0;
+    }
+  }
+
+  if (context->checker == NULL) {
+    if ((context->checker =
+	 ovl_overlap_checker_init(context->cell, context->symprec * 2))
+	== NULL) {
+      set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+      return 0;
+    }
+  }
+
+  if ((sym_parent = sym_alloc_symmetry(dataset->n_operations)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(sym_parent->rot[i], dataset->rotations[i]);
+    mat_copy_vector_d3(sym_parent->trans[i], dataset->translations[i]);
+  }
+
+  symmetry = sym_get_perturbed_operation(context->checker,
+					 sym_parent,
+					 moved_atoms,
+					 moved_positions,
+					 num_moved_atoms,
+					 context->symprec);
+  sym_free_symmetry(sym_parent);
+
+  if (symmetry == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
+
+  if (symmetry->size > max_size) {
+    fprintf(stderr, "spglib: Indicated max size(=%d) is less than number ",
+	    max_size);
+    fprintf(stderr, "spglib: of symmetry operations(=%d).\n", symmetry->size);
+    set_error(SPGERR_ARRAY_SIZE_SHORTAGE);
+    sym_free_symmetry(symmetry);
+    return 0;
+  }
+
+  for (i = 0; i < symmetry->size; i++) {
+    mat_copy_matrix_i3(rotation[i], symmetry->rot[i]);
+    mat_copy_vector_d3(translation[i], symmetry->trans[i]);
+  }
+
+  size = symmetry->size;
+  sym_free_symmetry(symmetry);
+
+  return size;
+}
+
+static int get_context_refined_cell(double lattice[3][3],
+				    double position[][3],
+				    int types[],
+				    SpglibContext *context)
+{
+  int i;
+  SpglibDataset *dataset;
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return 0;
+  }
+
+  if (dataset->n_brv_atoms > 0) {
+    mat_copy_matrix_d3(lattice, dataset->brv_lattice);
+    for (i = 0; i < dataset->n_brv_atoms; i++) {
+      types[i] = dataset->brv_types[i];
+      mat_copy_vector_d3(position[i], dataset->brv_positions[i]);
+    }
+  }
+
+  return dataset->n_brv_atoms;
+}
+
+static int get_context_ir_reciprocal_mesh(int grid_address[][3],
+					  int map[],
+					  const int mesh[3],
+					  const int is_shift[3],
+					  const int is_time_reversal,
+					  SpglibContext *context)
+{
+  int i, num_ir;
+  MatINT *rotations;
+  SpglibDataset *dataset;
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return 0;
+  }
+
+  if ((rotations = mat_alloc_MatINT(dataset->n_operations)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(rotations->mat[i], dataset->rotations[i]);
+  }
+  num_ir = kpt_get_irreducible_reciprocal_mesh(grid_address,
+					       map,
+					       mesh,
+					       is_shift,
+					       is_time_reversal,
+					       rotations);
+  mat_free_MatINT(rotations);
+
+  if (num_ir == 0) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  }
+
+  return num_ir;
+}
+
+static int
+get_context_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					  int map[],
+					  const int mesh[3],
+					  const int shift[3],
+					  const int shift_denominator,
+					  const int is_time_reversal,
+					  SpglibContext *context)
+{
+  int i, num_ir;
+  MatINT *rotations;
+  SpglibDataset *dataset;
+
+  if (shift_denominator < 1) {
+    return 0;
+  }
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return 0;
+  }
+
+  if ((rotations = mat_alloc_MatINT(dataset->n_operations)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(rotations->mat[i], dataset->rotations[i]);
+  }
+  num_ir = kpt_get_irreducible_reciprocal_mesh_with_shift(grid_address,
+							  map,
+							  mesh,
+							  shift,
+							  shift_denominator,
+							  is_time_reversal,
+							  rotations);
+  mat_free_MatINT(rotations);
+
+  if (num_ir == 0) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  }
+
+  return num_ir;
+}
+
+static int
+get_context_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					   int map[],
+					   SPGCONST int grid_matrix[3][3],
+					   const int is_shift[3],
+					   const int is_time_reversal,
+					   SpglibContext *context)
+{
+  int i, num_ir;
+  MatINT *rotations;
+  SpglibDataset *dataset;
+
+  if (mat_get_determinant_i3(grid_matrix) == 0) {
+    return 0;
+  }
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return 0;
+  }
+
+  if ((rotations = mat_alloc_MatINT(dataset->n_operations)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(rotations->mat[i], dataset->rotations[i]);
+  }
+  num_ir = kpt_get_ir_generalized_reciprocal_mesh(grid_address,
+						  map,
+						  grid_matrix,
+						  is_shift,
+						  is_time_reversal,
+						  rotations);
+  mat_free_MatINT(rotations);
+
+  if (num_ir == 0) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  }
+
+  return num_ir;
+}
+
+/* NULL is returned on failure. */
+static SpglibIrMesh * get_context_ir_mesh(const int mesh[3],
+					  const int is_shift[3],
+					  const int is_time_reversal,
+					  SpglibContext *context)
+{
+  int i;
+  MatINT *rotations;
+  IrGridPoints *ir_grid_points;
+  SpglibDataset *dataset;
+  SpglibIrMesh *ir_mesh;
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return NULL;
+  }
+
+  if ((rotations = mat_alloc_MatINT(dataset->n_operations)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return NULL;
+  }
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(rotations->mat[i], dataset->rotations[i]);
+  }
+  ir_grid_points = kpt_get_ir_grid_points(mesh,
+					  is_shift,
+					  is_time_reversal,
+					  rotations);
+  mat_free_MatINT(rotations);
+  rotations = NULL;
+  if (ir_grid_points == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return NULL;
+  }
+
+  if ((ir_mesh = (SpglibIrMesh*) mem_malloc(sizeof(SpglibIrMesh))) == NULL) {
+    kpt_free_ir_grid_points(ir_grid_points);
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return NULL;
+  }
+
+  /* Arrays are handed over to ir_mesh. */
+  for (i = 0; i < 3; i++) {
+    ir_mesh->mesh[i] = mesh[i];
+    ir_mesh->is_shift[i] = is_shift[i];
+  }
+  ir_mesh->n_ir_grid_points = ir_grid_points->size;
+  ir_mesh->ir_grid_points = ir_grid_points->grid_points;
+  ir_mesh->weights = ir_grid_points->weights;
+  ir_mesh->ir_grid_address = ir_grid_points->grid_address;
+  ir_mesh->n_rotations = ir_grid_points->rot_reciprocal->size;
+  ir_mesh->rotations = ir_grid_points->rot_reciprocal->mat;
+  ir_grid_points->grid_points = NULL;
+  ir_grid_points->weights = NULL;
+  ir_grid_points->grid_address = NULL;
+  ir_grid_points->rot_reciprocal->size = 0;
+  ir_grid_points->rot_reciprocal->mat = NULL;
+  kpt_free_ir_grid_points(ir_grid_points);
+
+  return ir_mesh;
+}
+
+/* NULL is returned on failure. */
+static SpglibIrMeshIterator *
+get_context_ir_mesh_iterator(const int mesh[3],
+			     const int is_shift[3],
+			     const int is_time_reversal,
+			     SpglibContext *context)
+{
+  int i;
+  MatINT *rotations;
+  SpglibDataset *dataset;
+  SpglibIrMeshIterator *iterator;
+
+  if ((dataset = get_context_dataset(context)) == NULL) {
+    return NULL;
+  }
+
+  if ((rotations = mat_alloc_MatINT(dataset->n_operations)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return NULL;
+  }
+  for (i = 0; i < dataset->n_operations; i++) {
+    mat_copy_matrix_i3(rotations->mat[i], dataset->rotations[i]);
+  }
+  iterator = kpt_alloc_ir_grid_point_iterator(mesh,
+					      is_shift,
+					      is_time_reversal,
+					      rotations);
+  mat_free_MatINT(rotations);
+  rotations = NULL;
+  if (iterator == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  }
+
+  return iterator;
+}
+
+/*---------*/
+/* tracker */
+/*---------*/
+static SpglibTracker * alloc_tracker(const double symprec,
+				     const double angle_tolerance,
+				     const int full_search_interval)
+{
+  SpglibTracker *tracker;
+
+  clear_error();
+
+  if ((tracker = (SpglibTracker*) mem_malloc(sizeof(SpglibTracker)))
+      == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return NULL;
+  }
+
+  tracker->context = NULL;
+  tracker->symmetry = NULL;
+  tracker->permutations = NULL;
+  tracker->full_search_interval = full_search_interval;
+  tracker->num_tracked_frames = 0;
+  tracker->symprec = symprec;
+  tracker->angle_tolerance = angle_tolerance;
+
+  return tracker;
+}
+
+static void free_tracker(SpglibTracker *tracker)
+{
+  if (tracker == NULL) {
+    return;
+  }
+
+  free_context(tracker->context);
+  tracker->context = NULL;
+  sym_free_symmetry(tracker->symmetry);
+  tracker->symmetry = NULL;
+  mem_free(tracker->permutations);
+  tracker->permutations = NULL;
+  mem_free(tracker);
+  tracker = NULL;
+}
+
+/* The frame is searched from scratch only if the symmetry of the */
+/* previous frame is not verified for it. */
+static int push_tracker_frame(SpglibTracker *tracker,
+			      SPGCONST double lattice[3][3],
+			      SPGCONST double position[][3],
+			      const int types[],
+			      const int num_atom)
+{
+  SpglibContext *context;
+  SpglibDataset *dataset;
+
+  clear_error();
+
+  context = NULL;
+  if (is_tracked_frame(tracker, types, num_atom)) {
+    context = get_tracked_context(tracker,
+				  lattice,
+				  position,
+				  types,
+				  num_atom);
+    if (context == NULL && mem_is_failed()) {
+      set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+      return 0;
+    }
+  }
+
+  if (context == NULL) {
+    if ((context = alloc_context(lattice,
+				 position,
+				 types,
+				 num_atom,
+				 tracker->symprec,
+				 tracker->angle_tolerance)) == NULL) {
+      return 0;
+    }
+    free_context(tracker->context);
+    tracker->context = context;
+    tracker->num_tracked_frames = 0;
+    /* Nothing is tracked if every frame is searched from scratch. */
+    if (tracker->full_search_interval != 1 &&
+	(! set_tracker_symmetry(tracker))) {
+      set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+      return 0;
+    }
+  } else {
+    free_context(tracker->context);
+    tracker->context = context;
+    tracker->num_tracked_frames++;
+  }
+
+  if ((dataset = get_context_dataset(tracker->context)) == NULL) {
+    return 0;
+  }
+
+  return dataset->spacegroup_number;
+}
+
+static int is_tracked_frame(SPGCONST SpglibTracker *tracker,
+			    const int types[],
+			    const int num_atom)
+{
+  int i;
+
+  if (tracker->context == NULL || tracker->symmetry == NULL) {
+    return 0;
+  }
+  if (tracker->full_search_interval > 0 &&
+      tracker->num_tracked_frames + 1 >= tracker->full_search_interval) {
+    return 0;
+  }
+  if (tracker->context->cell->size != num_atom) {
+    return 0;
+  }
+  for (i = 0; i < num_atom; i++) {
+    if (tracker->context->cell->types[i] != types[i]) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* The primitive cell and its operations of the previous frame are */
+/* verified for the frame with the atoms mapped as before. Then only */
+/* the Hall symbol is searched. NULL is returned if this fails or */
+/* memory could not be allocated, which is told by mem_is_failed. */
+static SpglibContext * get_tracked_context(SpglibTracker *tracker,
+					   SPGCONST double lattice[3][3],
+					   SPGCONST double position[][3],
+					   const int types[],
+					   const int num_atom)
+{
+  SpglibContext *context;
+  SPGCONST Primitive *previous;
+  Symmetry *symmetry;
+
+  symmetry = NULL;
+  previous = tracker->context->primitive;
+
+  if ((context = (SpglibContext*) mem_malloc(sizeof(SpglibContext)))
+      == NULL) {
+    return NULL;
+  }
+  context->symprec = tracker->symprec;
+  context->dataset = NULL;
+  context->primitive = NULL;
+  context->checker = NULL;
+  if ((context->cell = cel_alloc_cell(num_atom)) == NULL) {
+    goto fail;
+  }
+  cel_set_cell(context->cell, lattice, position, types);
+
+  if ((context->primitive =
+       prm_get_primitive_with_mapping_table(context->cell,
+					    tracker->supercell_matrix,
+					    previous->mapping_table,
+					    previous->cell->size,
+					    previous->tolerance)) == NULL) {
+    goto fail;
+  }
+  if (context->primitive->cell->size == 0) {
+    goto fail;
+  }
+
+  if ((symmetry = sym_get_tracked_operation(context->primitive->cell,
+					    tracker->symmetry,
+					    tracker->permutations,
+					    context->primitive->tolerance,
+					    tracker->angle_tolerance)) == NULL) {
+    goto fail;
+  }
+  if (symmetry->size == 0) {
+    goto fail;
+  }
+
+  context->spacegroup =
+    spa_get_spacegroup_with_symmetry(context->primitive->cell,
+				     symmetry,
+				     context->primitive->tolerance,
+				     tracker->angle_tolerance);
+  if (context->spacegroup.number == 0) {
+    goto fail;
+  }
+
+  /* The translations follow the frame. */
+  sym_free_symmetry(tracker->symmetry);
+  tracker->symmetry = symmetry;
+
+  return context;
+
+ fail:
+  sym_free_symmetry(symmetry);
+  free_context(context);
+  return NULL;
+}
+
+/* The operations of the primitive cell of the frame searched from */
+/* scratch and the permutations of the primitive atoms by them are */
+/* kept. The operations are not taken from the dataset, which has */
+/* only those of the input lattice. Nothing is tracked if the space */
+/* group is not found. */
+/* 0 is returned if memory could not be allocated. */
+static int set_tracker_symmetry(SpglibTracker *tracker)
+{
+  int i, j, ratio, is_found;
+  double inv_lat[3][3], mat[3][3];
+  SpglibContext *context;
+  Cell *primitive_cell;
+
+  sym_free_symmetry(tracker->symmetry);
+  tracker->symmetry = NULL;
+  mem_free(tracker->permutations);
+  tracker->permutations = NULL;
+
+  context = tracker->context;
+  if (context->spacegroup.number == 0) {
+    return 1;
+  }
+  primitive_cell = context->primitive->cell;
+
+  /* lattice = primitive lattice * supercell_matrix */
+  mat_inverse_matrix_d3(inv_lat, primitive_cell->lattice, 0);
+  mat_multiply_matrix_d3(mat, inv_lat, context->cell->lattice);
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      tracker->supercell_matrix[i][j] = mat_Nint(mat[i][j]);
+    }
+  }
+  ratio = mat_get_determinant_i3(tracker->supercell_matrix);
+  if (ratio < 0) {
+    ratio = -ratio;
+  }
+  if (ratio * primitive_cell->size != context->cell->size) {
+    return 1;
+  }
+
+  if ((tracker->symmetry =
+       sym_get_operation(primitive_cell,
+			 context->primitive->tolerance,
+			 tracker->angle_tolerance,
+			 NULL)) == NULL) {
+    return 0;
+  }
+  if (tracker->symmetry->size == 0) {
+    is_found = 0;
+    goto not_tracked;
+  }
+
+  if ((tracker->permutations = (int*)
+       mem_malloc(sizeof(int) * tracker->symmetry->size *
+		  primitive_cell->size)) == NULL) {
+    is_found = -1;
+    goto not_tracked;
+  }
+  is_found = sym_get_permutations(tracker->permutations,
+				  primitive_cell,
+				  tracker->symmetry,
+				  context->primitive->tolerance);
+  if (is_found > 0) {
+    return 1;
+  }
+
+ not_tracked:
+  sym_free_symmetry(tracker->symmetry);
+  tracker->symmetry = NULL;
+  mem_free(tracker->permutations);
+  tracker->permutations = NULL;
+  return is_found > -1;
+}
+
+/*---------*/
+/* kpoints */
+/*---------*/
+static int get_ir_reciprocal_mesh(int grid_address[][3],
+				  int map[],
+				  const int mesh[3],
+				  const int is_shift[3],
+				  const int is_time_reversal,
+				  SPGCONST double lattice[3][3],
+				  SPGCONST double position[][3],
+				  const int types[],
+				  const int num_atom,
+				  const double symprec,
+				  const double angle_tolerance)
+{
+  int num_ir;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
+  }
+
+  num_ir = get_context_ir_reciprocal_mesh(grid_address,
+					  map,
+					  mesh,
+					  is_shift,
+					  is_time_reversal,
+					  context);
+  free_context(context);
+
+  return num_ir;
+}
+
+static int get_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					     int map[],
+					     const int mesh[3],
+					     const int shift[3],
+					     const int shift_denominator,
+					     const int is_time_reversal,
+					     SPGCONST double lattice[3][3],
+					     SPGCONST double position[][3],
+					     const int types[],
+					     const int num_atom,
+					     const double symprec,
+					     const double angle_tolerance)
+{
+  int num_ir;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
+  }
+
+  num_ir = get_context_ir_reciprocal_mesh_with_shift(grid_address,
+						     map,
+						     mesh,
+						     shift,
+						     shift_denominator,
+						     is_time_reversal,
+						     context);
+  free_context(context);
+
+  return num_ir;
+}
+
+static int get_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					      int map[],
+					      SPGCONST int grid_matrix[3][3],
+					      const int is_shift[3],
+					      const int is_time_reversal,
+					      SPGCONST double lattice[3][3],
+					      SPGCONST double position[][3],
+					      const int types[],
+					      const int num_atom,
+					      const double symprec,
+					      const double angle_tolerance)
+{
+  int num_ir;
+  SpglibContext *context;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return 0;
+  }
+
+  num_ir = get_context_ir_generalized_reciprocal_mesh(grid_address,
+						      map,
+						      grid_matrix,
+						      is_shift,
+						      is_time_reversal,
+						      context);
+  free_context(context);
+
+  return num_ir;
+}
+
+static SpglibIrMesh * get_ir_mesh(const int mesh[3],
+				  const int is_shift[3],
+				  const int is_time_reversal,
+				  SPGCONST double lattice[3][3],
+				  SPGCONST double position[][3],
+				  const int types[],
+				  const int num_atom,
+				  const double symprec,
+				  const double angle_tolerance)
+{
+  SpglibContext *context;
+  SpglibIrMesh *ir_mesh;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return NULL;
+  }
+
+  ir_mesh = get_context_ir_mesh(mesh, is_shift, is_time_reversal, context);
+  free_context(context);
+
+  return ir_mesh;
+}
+
+static SpglibIrMeshIterator *
+get_ir_mesh_iterator(const int mesh[3],
+		     const int is_shift[3],
+		     const int is_time_reversal,
+		     SPGCONST double lattice[3][3],
+		     SPGCONST double position[][3],
+		     const int types[],
+		     const int num_atom,
+		     const double symprec,
+		     const double angle_tolerance)
+{
+  SpglibContext *context;
+  SpglibIrMeshIterator *iterator;
+
+  if ((context = alloc_context(lattice,
+			       position,
+			       types,
+			       num_atom,
+			       symprec,
+			       angle_tolerance)) == NULL) {
+    return NULL;
+  }
+
+  iterator = get_context_ir_mesh_iterator(mesh,
+					  is_shift,
+					  is_time_reversal,
+					  context);
+  free_context(context);
+
+  return iterator;
+}
+
+static int get_stabilized_reciprocal_mesh(int grid_address[][3],
+					  int map[],
 					  const int mesh[3],
 					  const int is_shift[3],
 					  const int is_time_reversal,
@@ -1184,7 +3464,12 @@ static int get_stabilized_reciprocal_mesh(int grid_address[][3],
   MatINT *rot_real;
   int i, num_ir;
   
-  rot_real = mat_alloc_MatINT(num_rot);
+  clear_error();
+
+  if ((rot_real = mat_alloc_MatINT(num_rot)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
   for (i = 0; i < num_rot; i++) {
     mat_copy_matrix_i3(rot_real->mat[i], rotations[i]);
   }
@@ -1200,6 +3485,10 @@ static int get_stabilized_reciprocal_mesh(int grid_address[][3],
 
   mat_free_MatINT(rot_real);
 
+  if (num_ir == 0) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  }
+
   return num_ir;
 }
 
@@ -1215,7 +3504,12 @@ static int get_triplets_reciprocal_mesh_at_q(int map_triplets[],
   MatINT *rot_real;
   int i, num_ir;
   
-  rot_real = mat_alloc_MatINT(num_rot);
+  clear_error();
+
+  if ((rot_real = mat_alloc_MatINT(num_rot)) == NULL) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+    return 0;
+  }
   for (i = 0; i < num_rot; i++) {
     mat_copy_matrix_i3(rot_real->mat[i], rotations[i]);
   }
@@ -1230,6 +3524,10 @@ static int get_triplets_reciprocal_mesh_at_q(int map_triplets[],
 
   mat_free_MatINT(rot_real);
 
+  if (num_ir == 0) {
+    set_error(SPGERR_MEMORY_ALLOCATION_FAILED);
+  }
+
   return num_ir;
 }
 
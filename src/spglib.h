@@ -77,6 +77,8 @@ typedef struct {
   double brv_lattice[3][3];
   int *brv_types;
   double (*brv_positions)[3];
+  int *permutations; /* Atom onto which atom j is moved by operation i */
+                     /* is permutations[i * n_atoms + j]. */
 } SpglibDataset;
 
 typedef struct {
@@ -88,6 +90,26 @@ typedef struct {
   char international_short[11];
 } SpglibSpacegroupType;
 
+/* Error of the last call of a spglib function in the calling thread */
+typedef enum {
+  SPGLIB_SUCCESS = 0,
+  SPGERR_MEMORY_ALLOCATION_FAILED,
+  SPGERR_SPACEGROUP_SEARCH_FAILED,
+  SPGERR_SYMMETRY_OPERATION_SEARCH_FAILED,
+  SPGERR_PRIMITIVE_CELL_SEARCH_FAILED,
+  SPGERR_CELL_STANDARDIZATION_FAILED,
+  SPGERR_LATTICE_REDUCTION_FAILED,
+  SPGERR_ARRAY_SIZE_SHORTAGE
+} SpglibError;
+
+/* Spglib does not terminate the process on failure. Functions */
+/* returning a pointer return NULL when memory could not be */
+/* allocated and the others return 0. The reason is obtained by */
+/* ``spg_get_error_code`` right after the failed call. Each thread */
+/* has its own error code. */
+SpglibError spg_get_error_code(void);
+char * spg_get_error_message(SpglibError error);
+
 SpglibDataset * spg_get_dataset(SPGCONST double lattice[3][3],
 				SPGCONST double position[][3],
 				const int types[],
@@ -119,8 +141,67 @@ spgat_get_dataset_with_hall_number(SPGCONST double lattice[3][3],
 				   const double symprec,
 				   const double angle_tolerance);
 
+/* Same as spg_get_dataset for a supercell of a known primitive cell, */
+/* whose lattice is ``primitive_lattice * supercell_matrix``. */
+/* The primitive cell is verified in O(num_atom) and used instead of */
+/* being searched. If it does not match within ``symprec``, the */
+/* primitive cell is searched as usual. */
+SpglibDataset *
+spg_get_dataset_of_supercell(SPGCONST double lattice[3][3],
+			     SPGCONST double position[][3],
+			     const int types[],
+			     const int num_atom,
+			     SPGCONST int supercell_matrix[3][3],
+			     SPGCONST double primitive_lattice[3][3],
+			     SPGCONST double primitive_position[][3],
+			     const int primitive_types[],
+			     const int num_primitive_atom,
+			     const double symprec);
+
+SpglibDataset *
+spgat_get_dataset_of_supercell(SPGCONST double lattice[3][3],
+			       SPGCONST double position[][3],
+			       const int types[],
+			       const int num_atom,
+			       SPGCONST int supercell_matrix[3][3],
+			       SPGCONST double primitive_lattice[3][3],
+			       SPGCONST double primitive_position[][3],
+			       const int primitive_types[],
+			       const int num_primitive_atom,
+			       const double symprec,
+			       const double angle_tolerance);
+
 void spg_free_dataset(SpglibDataset *dataset);
 
+/* Datasets of many crystal structures are obtained at once. */
+/* Atoms of all structures are concatenated in ``positions`` and */
+/* ``types``, and atoms of the i-th structure with the lattice */
+/* ``lattices[i]`` are those from ``offsets[i]`` to */
+/* ``offsets[i + 1] - 1``, i.e., ``offsets`` has ``num_structures + 1`` */
+/* elements. ``datasets[i]`` has to be freed by ``spg_free_dataset``. */
+/* It is NULL if memory could not be allocated. The structures are */
+/* shared among threads when spglib is compiled with OpenMP. The */
+/* datasets are always taken from the heap: the arena of each thread */
+/* is cleared during the call, as by ``spg_set_arena(NULL)``, and set */
+/* again before returning. The number of structures whose space */
+/* groups were found is returned. */
+int spg_get_datasets_batch(SpglibDataset *datasets[],
+			   const int num_structures,
+			   SPGCONST double lattices[][3][3],
+			   SPGCONST double positions[][3],
+			   const int types[],
+			   const int offsets[],
+			   const double symprec);
+
+int spgat_get_datasets_batch(SpglibDataset *datasets[],
+			     const int num_structures,
+			     SPGCONST double lattices[][3][3],
+			     SPGCONST double positions[][3],
+			     const int types[],
+			     const int offsets[],
+			     const double symprec,
+			     const double angle_tolerance);
+
 /* Find symmetry operations. The operations are stored in */
 /* ``rotatiion`` and ``translation``. The number of operations is */
 /* return as the return value. Rotations and translations are */
@@ -170,6 +251,38 @@ int spgat_get_symmetry_with_collinear_spin(int rotation[][3][3],
 					   const double symprec,
 					   const double angle_tolerance);
 
+/* Find symmetry operations with magnetic moments on atoms, given */
+/* as magmoms[i] in Cartesian coordinates. A moment is moved as an */
+/* axial vector, det(R) R m. If is_time_reversal, operations */
+/* reversing all the moments are also found, for which */
+/* time_reversals[i] is set to 1. */
+int spg_get_symmetry_with_magmoms(int rotation[][3][3],
+				  double translation[][3],
+				  int time_reversals[],
+				  int equivalent_atoms[],
+				  const int max_size,
+				  SPGCONST double lattice[3][3],
+				  SPGCONST double position[][3],
+				  const int types[],
+				  SPGCONST double magmoms[][3],
+				  const int is_time_reversal,
+				  const int num_atom,
+				  const double symprec);
+
+int spgat_get_symmetry_with_magmoms(int rotation[][3][3],
+				    double translation[][3],
+				    int time_reversals[],
+				    int equivalent_atoms[],
+				    const int max_size,
+				    SPGCONST double lattice[3][3],
+				    SPGCONST double position[][3],
+				    const int types[],
+				    SPGCONST double magmoms[][3],
+				    const int is_time_reversal,
+				    const int num_atom,
+				    const double symprec,
+				    const double angle_tolerance);
+
 /* Return exact number of symmetry operations. This function may */
 /* be used in advance to allocate memoery space for symmetry */
 /* operations. */
@@ -202,6 +315,8 @@ int spg_find_primitive(double lattice[3][3],
 		       const int num_atom,
 		       const double symprec);
 
+/* ``angle_tolerance`` is ignored since the primitive cell is found */
+/* only from pure translations. */
 int spgat_find_primitive(double lattice[3][3],
 			 double position[][3],
 			 int types[],
@@ -243,6 +358,32 @@ int spgat_get_schoenflies(char symbol[10],
 			  const double symprec,
 			  const double angle_tolerance);
 
+/* Space groups found with symprec in [symprec_min, symprec_max] */
+/* in one call. ``spacegroup_numbers[i]`` is found for symprec in */
+/* (``symprecs[i-1]``, ``symprecs[i]``], where ``symprecs[-1]`` is */
+/* read as symprec_min. The number of ranges is returned. */
+/* 0 is returned when it fails. */
+int spg_get_symprec_spectrum(double symprecs[],
+			     int spacegroup_numbers[],
+			     const int max_size,
+			     SPGCONST double lattice[3][3],
+			     SPGCONST double position[][3],
+			     const int types[],
+			     const int num_atom,
+			     const double symprec_min,
+			     const double symprec_max);
+
+int spgat_get_symprec_spectrum(double symprecs[],
+			       int spacegroup_numbers[],
+			       const int max_size,
+			       SPGCONST double lattice[3][3],
+			       SPGCONST double position[][3],
+			       const int types[],
+			       const int num_atom,
+			       const double symprec_min,
+			       const double symprec_max,
+			       const double angle_tolerance);
+
 /* Point group symbol is obtained from the rotation part of */
 /* symmetry operations */
 int spg_get_pointgroup(char symbol[6],
@@ -280,6 +421,142 @@ int spgat_refine_cell(double lattice[3][3],
 		      const double angle_tolerance);
 
 
+/*---------*/
+/* context */
+/*---------*/
+
+/* A context keeps the results of symmetry search of one crystal */
+/* structure, i.e., the primitive cell, the space group and the */
+/* dataset, so that several queries on the same structure do not */
+/* repeat the search. NULL is returned when memory allocation */
+/* fails. The context has to be freed by ``spg_free_context``. */
+typedef struct _SpglibContext SpglibContext;
+
+SpglibContext * spg_alloc_context(SPGCONST double lattice[3][3],
+				  SPGCONST double position[][3],
+				  const int types[],
+				  const int num_atom,
+				  const double symprec);
+
+SpglibContext * spgat_alloc_context(SPGCONST double lattice[3][3],
+				    SPGCONST double position[][3],
+				    const int types[],
+				    const int num_atom,
+				    const double symprec,
+				    const double angle_tolerance);
+
+void spg_free_context(SpglibContext *context);
+
+/* The dataset is owned by the context. Do not free it. */
+const SpglibDataset * spg_context_get_dataset(SpglibContext *context);
+
+int spg_context_get_symmetry(int rotation[][3][3],
+			     double translation[][3],
+			     const int max_size,
+			     SpglibContext *context);
+
+int spg_context_get_symmetry_with_collinear_spin(int rotation[][3][3],
+						 double translation[][3],
+						 int equivalent_atoms[],
+						 const int max_size,
+						 SpglibContext *context,
+						 const double spins[]);
+
+/* Symmetry operations of the structure of ``parent`` that remain */
+/* when the atoms ``moved_atoms[i]`` are moved to */
+/* ``moved_positions[i]``, e.g., by a displacement for phonons. Only */
+/* the operations of ``parent`` are tested, at the moved atoms and */
+/* the atoms mapped onto their original positions. */
+int spg_get_symmetry_of_perturbed(int rotation[][3][3],
+				  double translation[][3],
+				  const int max_size,
+				  SpglibContext *parent,
+				  const int moved_atoms[],
+				  SPGCONST double moved_positions[][3],
+				  const int num_moved_atoms);
+
+int spg_context_get_international(char symbol[11],
+				  SpglibContext *context);
+
+int spg_context_get_schoenflies(char symbol[10],
+				SpglibContext *context);
+
+/* Arrays are required to have 4 times larger memory space than */
+/* number of atoms of the structure of the context. */
+int spg_context_refine_cell(double lattice[3][3],
+			    double position[][3],
+			    int types[],
+			    SpglibContext *context);
+
+int spg_context_get_ir_reciprocal_mesh(int grid_address[][3],
+				       int map[],
+				       const int mesh[3],
+				       const int is_shift[3],
+				       const int is_time_reversal,
+				       SpglibContext *context);
+
+
+/*---------*/
+/* tracker */
+/*---------*/
+
+/* A tracker follows the symmetry of a sequence of similar crystal */
+/* structures, e.g., frames of molecular dynamics. The primitive */
+/* cell and symmetry operations of the previous frame are verified */
+/* for the next frame with the atoms mapped as before, and searched */
+/* from scratch only if this fails, or at every */
+/* ``full_search_interval``-th frame to find symmetry that is gained */
+/* (never if 0). Frames have to keep the order of atoms and their */
+/* types, since the atom i of the next frame is taken to be an image */
+/* of the same atom of the primitive cell as the atom i of the */
+/* previous frame. NULL is returned when memory allocation fails. */
+/* The tracker has to be freed by ``spg_free_tracker``. */
+typedef struct _SpglibTracker SpglibTracker;
+
+SpglibTracker * spg_alloc_tracker(const double symprec,
+				  const int full_search_interval);
+
+SpglibTracker * spgat_alloc_tracker(const double symprec,
+				    const double angle_tolerance,
+				    const int full_search_interval);
+
+void spg_free_tracker(SpglibTracker *tracker);
+
+/* The space group number of the frame is returned, or 0 if it is */
+/* not found. */
+int spg_tracker_push_frame(SpglibTracker *tracker,
+			   SPGCONST double lattice[3][3],
+			   SPGCONST double position[][3],
+			   const int types[],
+			   const int num_atom);
+
+/* The dataset of the last frame is owned by the tracker. Do not */
+/* free it. */
+const SpglibDataset * spg_tracker_get_dataset(SpglibTracker *tracker);
+
+
+/*-------*/
+/* arena */
+/*-------*/
+
+/* An arena is a memory pool grown by blocks of ``block_size`` bytes */
+/* (64 KiB if 0). While an arena is set by ``spg_set_arena`` in a */
+/* thread, all memory spglib allocates in the thread, including */
+/* returned datasets and contexts, is taken from the arena instead */
+/* of the heap, and ``spg_reset_arena`` releases all of it at once. */
+/* Datasets and contexts taken from the arena must not be used after */
+/* the reset. Queries on a context from an arena have to be made */
+/* while the arena is set, since the context allocates what it finds */
+/* at the first query. ``spg_set_arena(NULL)`` switches back to the */
+/* heap. An arena must not be set in two threads at the same time. */
+typedef struct _MemArena SpglibArena;
+
+SpglibArena * spg_alloc_arena(const int block_size);
+void spg_free_arena(SpglibArena *arena);
+void spg_reset_arena(SpglibArena *arena);
+void spg_set_arena(SpglibArena *arena);
+
+
 /*---------*/
 /* kpoints */
 /*---------*/
@@ -323,6 +600,137 @@ int spg_get_ir_reciprocal_mesh(int grid_address[][3],
 			       const int num_atom,
 			       const double symprec);
 
+/* The mesh of ``spg_get_ir_reciprocal_mesh`` is shifted by a rational */
+/* fraction of one mesh, i.e., a q-point in fractional coordinates is */
+/* given as ((address + shift / shift_denominator) / mesh), where */
+/* ``shift[i]`` is taken modulo ``shift_denominator``. Only the */
+/* rotations that map the shifted mesh onto itself are used. With */
+/* ``shift_denominator`` = 2, the results are those of */
+/* ``spg_get_ir_reciprocal_mesh`` if the mesh keeps the symmetry. */
+/* 0 is returned on failure or if ``shift_denominator`` < 1. */
+int spg_get_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					  int map[],
+					  const int mesh[3],
+					  const int shift[3],
+					  const int shift_denominator,
+					  const int is_time_reversal,
+					  SPGCONST double lattice[3][3],
+					  SPGCONST double position[][3],
+					  const int types[],
+					  const int num_atom,
+					  const double symprec);
+int
+spg_context_get_ir_reciprocal_mesh_with_shift(int grid_address[][3],
+					      int map[],
+					      const int mesh[3],
+					      const int shift[3],
+					      const int shift_denominator,
+					      const int is_time_reversal,
+					      SpglibContext *context);
+
+/* A generalized regular grid of q-points in fractional coordinates */
+/* is given by q = grid_matrix^-1 (n + is_shift / 2) for integers n, */
+/* where ``grid_matrix`` is a non-singular integer matrix and each */
+/* element of ``is_shift`` is 0 or 1. It has |det(grid_matrix)| grid */
+/* points. Through the Smith normal form of ``grid_matrix``, the grid */
+/* is a uniform mesh in a basis transformed by ``transformation``: */
+/* q = transformation ((address * 2 + shift) / (mesh * 2)). */
+/* ``mesh``, ``shift`` and ``transformation`` are stored and 1 is */
+/* returned, or 0 if ``grid_matrix`` is singular. Grid addresses of */
+/* the generalized functions are given in this basis, and */
+/* ``spg_get_grid_point`` with ``mesh`` gives their grid point indices. */
+int spg_get_generalized_mesh(int mesh[3],
+			     int shift[3],
+			     int transformation[3][3],
+			     SPGCONST int grid_matrix[3][3],
+			     const int is_shift[3]);
+
+/* Irreducible grid points of a generalized regular grid are searched */
+/* as by ``spg_get_ir_reciprocal_mesh``. ``grid_address`` and ``map`` */
+/* have |det(grid_matrix)| elements. Rotations that do not keep the */
+/* grid are not used. 0 is returned on failure. */
+int spg_get_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					   int map[],
+					   SPGCONST int grid_matrix[3][3],
+					   const int is_shift[3],
+					   const int is_time_reversal,
+					   SPGCONST double lattice[3][3],
+					   SPGCONST double position[][3],
+					   const int types[],
+					   const int num_atom,
+					   const double symprec);
+int
+spg_context_get_ir_generalized_reciprocal_mesh(int grid_address[][3],
+					       int map[],
+					       SPGCONST int grid_matrix[3][3],
+					       const int is_shift[3],
+					       const int is_time_reversal,
+					       SpglibContext *context);
+
+/* Irreducible grid points are found without arrays of prod(mesh). */
+/* Their grid point indices, numbers of grid points mapped to them */
+/* and grid addresses are stored in ascending order of the indices. */
+/* Rotations that do not keep the mesh are not used. The others are */
+/* kept, so that ``spg_get_ir_mesh_grid_point`` gives the irreducible */
+/* grid point of any grid point. If the mesh keeps the symmetry, */
+/* these are the same as ``map`` of spg_get_ir_reciprocal_mesh. NULL */
+/* is returned on failure, and -1 for a grid point out of the mesh. */
+typedef struct {
+  int mesh[3];
+  int is_shift[3];
+  int n_ir_grid_points;
+  int *ir_grid_points;
+  int *weights;
+  int (*ir_grid_address)[3];
+  int n_rotations; /* Rotations in reciprocal space */
+  int (*rotations)[3][3];
+} SpglibIrMesh;
+
+SpglibIrMesh * spg_get_ir_mesh(const int mesh[3],
+			       const int is_shift[3],
+			       const int is_time_reversal,
+			       SPGCONST double lattice[3][3],
+			       SPGCONST double position[][3],
+			       const int types[],
+			       const int num_atom,
+			       const double symprec);
+SpglibIrMesh * spg_context_get_ir_mesh(const int mesh[3],
+				       const int is_shift[3],
+				       const int is_time_reversal,
+				       SpglibContext *context);
+int spg_get_ir_mesh_grid_point(const SpglibIrMesh *ir_mesh,
+			       const int grid_point);
+void spg_free_ir_mesh(SpglibIrMesh *ir_mesh);
+
+/* Irreducible grid points are iterated slab by slab along the */
+/* slowest axis of the mesh, so that memory of only one slab is */
+/* used. Each call of ``spg_get_next_ir_grid_points`` stores up to */
+/* ``max_size`` following irreducible grid points, their weights and */
+/* grid addresses in ascending order, and returns their number, */
+/* which is 0 after the last one. The results are the same as those */
+/* of ``spg_get_ir_mesh``. NULL is returned on failure. */
+typedef struct _IrGridPointIterator SpglibIrMeshIterator;
+
+SpglibIrMeshIterator * spg_alloc_ir_mesh_iterator(const int mesh[3],
+						  const int is_shift[3],
+						  const int is_time_reversal,
+						  SPGCONST double lattice[3][3],
+						  SPGCONST double position[][3],
+						  const int types[],
+						  const int num_atom,
+						  const double symprec);
+SpglibIrMeshIterator *
+spg_context_alloc_ir_mesh_iterator(const int mesh[3],
+				   const int is_shift[3],
+				   const int is_time_reversal,
+				   SpglibContext *context);
+int spg_get_next_ir_grid_points(int ir_grid_points[],
+				int weights[],
+				int ir_grid_address[][3],
+				const int max_size,
+				SpglibIrMeshIterator *iterator);
+void spg_free_ir_mesh_iterator(SpglibIrMeshIterator *iterator);
+
 /* The irreducible k-points are searched from unique k-point mesh */
 /* grids from real space lattice vectors and rotation matrices of */
 /* symmetry operations in real space with stabilizers. The */
@@ -388,6 +796,19 @@ int spg_relocate_BZ_grid_address(int bz_grid_address[][3],
 				 SPGCONST double rec_lattice[3][3],
 				 const int is_shift[3]);
 
+/* Grid addresses of a generalized regular grid given by */
+/* ``spg_get_ir_generalized_reciprocal_mesh`` are relocated inside */
+/* Brillouin zone as by ``spg_relocate_BZ_grid_address``, where */
+/* ``mesh`` is that of ``spg_get_generalized_mesh``. It is assumed */
+/* that bz_grid_address[prod(mesh) * 8][3] and bz_map[prod(mesh) * 8]. */
+/* 0 is returned if ``grid_matrix`` is singular. */
+int spg_relocate_BZ_generalized_grid_address(int bz_grid_address[][3],
+					     int bz_map[],
+					     SPGCONST int grid_address[][3],
+					     SPGCONST int grid_matrix[3][3],
+					     SPGCONST double rec_lattice[3][3],
+					     const int is_shift[3]);
+
 /* Irreducible triplets of k-points are searched under conservation of */
 /* :math:``\mathbf{k}_1 + \mathbf{k}_2 + \mathbf{k}_3 = \mathbf{G}``. */
 /* Memory spaces of grid_address[prod(mesh)][3], map_triplets[prod(mesh)] */
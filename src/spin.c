@@ -3,201 +3,743 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "mathfunc.h"
+#include "mem.h"
+#include "overlap.h"
 #include "symmetry.h"
 #include "cell.h"
 
-static Symmetry * get_collinear_operations(SPGCONST Symmetry *sym_nonspin,
-					   SPGCONST Cell *cell,
-					   const double spins[],
-					   const double symprec);
-static void set_equivalent_atoms(int * equiv_atoms,
-				 SPGCONST Symmetry *symmetry,
-				 SPGCONST Cell * cell,
+typedef struct {
+  int type;
+  double magnitude;
+  int index;
+} MagneticKey;
+
+/* Either spins or magmoms is given. The moments may be reversed by */
+/* operations only if is_time_reversal. */
+typedef struct {
+  const double *spins;
+  SPGCONST double (*magmoms)[3];
+  int is_time_reversal;
+} Moments;
+
+static Symmetry * get_operations(int equiv_atoms[],
+				 int time_reversals[],
+				 SPGCONST Symmetry *sym_nonspin,
+				 const int permutations[],
+				 SPGCONST Cell *cell,
+				 const Moments *moments,
 				 const double symprec);
-static int * get_mapping_table(SPGCONST Symmetry *symmetry,
-			       SPGCONST Cell * cell,
-			       const double symprec);
+static int * get_magnetic_types(const int types[],
+				const Moments *moments,
+				const int num_atom,
+				const double symprec);
+static int set_signs(int signs[],
+		     int generators[],
+		     SPGCONST Symmetry *sym_nonspin,
+		     const int permutations[],
+		     const OverlapChecker *checker,
+		     SPGCONST Cell *cell,
+		     const Moments *moments,
+		     const int magnetic_types[],
+		     const int check_order[],
+		     const double symprec);
+static int get_sign(int *preimage,
+		    const int operation_index,
+		    SPGCONST Symmetry *sym_nonspin,
+		    const int permutations[],
+		    const OverlapChecker *checker,
+		    SPGCONST Cell *cell,
+		    const Moments *moments,
+		    const int magnetic_types[],
+		    const int check_order[],
+		    const double symprec);
+static void set_equivalent_atoms(int equiv_atoms[],
+				 const int generators[],
+				 const int num_generators,
+				 SPGCONST Symmetry *sym_nonspin,
+				 const int permutations[],
+				 const OverlapChecker *checker,
+				 SPGCONST Cell *cell);
+static int is_moved_moment(const Moments *moments,
+			   SPGCONST double rot_cart[3][3],
+			   const int atom_index,
+			   const int image_index,
+			   const int sign,
+			   const double symprec);
+static double get_magnitude(const Moments *moments, const int atom_index);
+static int get_root(int parents[], int atom_index);
+static int * get_check_order(const Moments *moments,
+			     const int num_atom,
+			     const double symprec);
+static int compare_magnetic_key(const void *a, const void *b);
 
+/* permutations[i * cell->size + j] is the atom onto which the atom j */
+/* is moved by the i-th operation of sym_nonspin, or -1. If it is */
+/* NULL, atoms are searched within symprec. */
+/* NULL is returned if memory could not be allocated. */
 Symmetry * spn_get_collinear_operations(int equiv_atoms[],
 					SPGCONST Symmetry *sym_nonspin,
+					const int permutations[],
 					SPGCONST Cell *cell,
 					const double spins[],
 					const double symprec)
 {
-  Symmetry *symmetry;
+  Moments moments;
 
-  symmetry = get_collinear_operations(sym_nonspin,
-				      cell,
-				      spins,
-				      symprec);
-  set_equivalent_atoms(equiv_atoms,
-		       symmetry,
-		       cell,
-		       symprec);
+  moments.spins = spins;
+  moments.magmoms = NULL;
+  moments.is_time_reversal = 1;
 
-  return symmetry;
+  return get_operations(equiv_atoms,
+			NULL,
+			sym_nonspin,
+			permutations,
+			cell,
+			&moments,
+			symprec);
 }
 
-static Symmetry * get_collinear_operations(SPGCONST Symmetry *sym_nonspin,
+/* Magnetic moments are given in Cartesian coordinates and rotated */
+/* as axial vectors. time_reversals[i] is set to 1 if the i-th */
+/* operation kept reverses the moments, which is allowed only if */
+/* is_time_reversal, and to 0 otherwise. It has to have the size of */
+/* sym_nonspin. */
+/* NULL is returned if memory could not be allocated. */
+Symmetry * spn_get_operations_with_magmoms(int equiv_atoms[],
+					   int time_reversals[],
+					   SPGCONST Symmetry *sym_nonspin,
+					   const int permutations[],
 					   SPGCONST Cell *cell,
-					   const double spins[],
+					   SPGCONST double magmoms[][3],
+					   const int is_time_reversal,
 					   const double symprec)
 {
+  Moments moments;
+
+  moments.spins = NULL;
+  moments.magmoms = magmoms;
+  moments.is_time_reversal = is_time_reversal;
+
+  return get_operations(equiv_atoms,
+			time_reversals,
+			sym_nonspin,
+			permutations,
+			cell,
+			&moments,
+			symprec);
+}
+
+/* time_reversals may be NULL. */
+static Symmetry * get_operations(int equiv_atoms[],
+				 int time_reversals[],
+				 SPGCONST Symmetry *sym_nonspin,
+				 const int permutations[],
+				 SPGCONST Cell *cell,
+				 const Moments *moments,
+				 const double symprec)
+{
+  int i, num_sym, num_generators;
+  int *signs, *generators, *magnetic_types, *check_order;
   Symmetry *symmetry;
-  int i, j, k, sign, is_found, num_sym;
-  double pos[3];
-  MatINT * rot;
-  VecDBL * trans;
+  OverlapChecker *checker;
 
-  rot = mat_alloc_MatINT(sym_nonspin->size);
-  trans = mat_alloc_VecDBL(sym_nonspin->size);
-  num_sym = 0;
-  
-  for (i = 0; i < sym_nonspin->size; i++) {
-    sign = 0; /* Set sign as undetermined */
-    is_found = 1;
-    for (j = 0; j < cell->size; j++) {
-      mat_multiply_matrix_vector_id3(pos, sym_nonspin->rot[i], cell->position[j]);
-      for (k = 0; k < 3; k++) {
-	pos[k] += sym_nonspin->trans[i][k];
-      }
-      for (k = 0; k < cell->size; k++) {
-	if (cel_is_overlap(cell->position[k],
-			   pos,
-			   cell->lattice,
-			   symprec)) {
-	  if (sign == 0) {
-	    if (mat_Dabs(spins[j] - spins[k]) < symprec) {
-	      sign = 1;
-	      break;
-	    }
-	    if (mat_Dabs(spins[j] + spins[k]) < symprec) {
-	      sign = -1;
-	      break;
-	    }
-	    is_found = 0;
-	    break;
-	  } else {
-	    if (mat_Dabs(spins[j] - spins[k] * sign) < symprec) {
-	      break;
-	    } else {
-	      is_found = 0;
-	      break;
-	    }
-	  }
-	}
-      }
-      if (! is_found) {
+  symmetry = NULL;
+  checker = NULL;
+  generators = NULL;
+  magnetic_types = NULL;
+  check_order = NULL;
+
+  if ((signs = (int*) mem_malloc(sizeof(int) *
+				 (sym_nonspin->size > 0 ?
+				  sym_nonspin->size : 1))) == NULL) {
+    goto ret;
+  }
+  if ((generators = (int*) mem_malloc(sizeof(int) *
+				      (sym_nonspin->size > 0 ?
+				       sym_nonspin->size : 1))) == NULL) {
+    goto ret;
+  }
+  if ((magnetic_types = get_magnetic_types(cell->types,
+					   moments,
+					   cell->size,
+					   symprec)) == NULL) {
+    goto ret;
+  }
+  if ((check_order = get_check_order(moments, cell->size, symprec)) == NULL) {
+    goto ret;
+  }
+
+  /* Atoms are searched if an operation does not move them one-to-one. */
+  if (permutations != NULL) {
+    for (i = 0; i < sym_nonspin->size; i++) {
+      if (cell->size > 0 && permutations[i * cell->size] < 0) {
+	permutations = NULL;
 	break;
       }
     }
-    if (is_found) {
-      mat_copy_matrix_i3(rot->mat[num_sym], sym_nonspin->rot[i]);
-      mat_copy_vector_d3(trans->vec[num_sym], sym_nonspin->trans[i]);
-      num_sym++;
+  }
+  if (permutations == NULL) {
+    if ((checker = ovl_overlap_checker_init(cell, symprec)) == NULL) {
+      goto ret;
     }
   }
 
-  symmetry = sym_alloc_symmetry(num_sym);
-  for (i = 0; i < num_sym; i++) {
-    mat_copy_matrix_i3(symmetry->rot[i], rot->mat[ i ]);
-    mat_copy_vector_d3(symmetry->trans[i], trans->vec[ i ]);
+  if ((num_generators = set_signs(signs,
+				  generators,
+				  sym_nonspin,
+				  permutations,
+				  checker,
+				  cell,
+				  moments,
+				  magnetic_types,
+				  check_order,
+				  symprec)) < 0) {
+    goto ret;
   }
 
-  mat_free_MatINT(rot);
-  mat_free_VecDBL(trans);
+  num_sym = 0;
+  for (i = 0; i < sym_nonspin->size; i++) {
+    if (signs[i] != 0) {
+      num_sym++;
+    }
+  }
+  if ((symmetry = sym_alloc_symmetry(num_sym)) == NULL) {
+    goto ret;
+  }
+  num_sym = 0;
+  for (i = 0; i < sym_nonspin->size; i++) {
+    if (signs[i] != 0) {
+      mat_copy_matrix_i3(symmetry->rot[num_sym], sym_nonspin->rot[i]);
+      mat_copy_vector_d3(symmetry->trans[num_sym], sym_nonspin->trans[i]);
+      if (time_reversals != NULL) {
+	time_reversals[num_sym] = (signs[i] < 0);
+      }
+      num_sym++;
+    }
+  }
+
+  set_equivalent_atoms(equiv_atoms,
+		       generators,
+		       num_generators,
+		       sym_nonspin,
+		       permutations,
+		       checker,
+		       cell);
+
+ ret:
+  ovl_overlap_checker_free(checker);
+  checker = NULL;
+  mem_free(check_order);
+  check_order = NULL;
+  mem_free(magnetic_types);
+  magnetic_types = NULL;
+  mem_free(generators);
+  generators = NULL;
+  mem_free(signs);
+  signs = NULL;
 
   return symmetry;
 }
 
-static void set_equivalent_atoms(int * equiv_atoms,
-				 SPGCONST Symmetry *symmetry,
-				 SPGCONST Cell * cell,
-				 const double symprec)
+/* Atoms are labelled 0, 1, ... by their types and the magnitudes of */
+/* their moments, where magnitudes closer than symprec are chained */
+/* into one label. No operation moves an atom onto an atom of another */
+/* label while keeping the moments. */
+/* NULL is returned if memory could not be allocated. */
+static int * get_magnetic_types(const int types[],
+				const Moments *moments,
+				const int num_atom,
+				const double symprec)
 {
-  int i, j, k, is_found;
-  double pos[3];
-  int *mapping_table;
+  int i, num_types;
+  int *magnetic_types;
+  MagneticKey *keys;
 
-  mapping_table = get_mapping_table(symmetry, cell, symprec);
-  
+  if ((magnetic_types = (int*) mem_malloc(sizeof(int) *
+					  (num_atom > 0 ? num_atom : 1)))
+      == NULL) {
+    return NULL;
+  }
+  if ((keys = (MagneticKey*) mem_malloc(sizeof(MagneticKey) *
+					(num_atom > 0 ? num_atom : 1)))
+      == NULL) {
+    mem_free(magnetic_types);
+    return NULL;
+  }
+
+  for (i = 0; i < num_atom; i++) {
+    keys[i].type = types[i];
+    keys[i].magnitude = get_magnitude(moments, i);
+    keys[i].index = i;
+  }
+  qsort(keys, num_atom, sizeof(MagneticKey), compare_magnetic_key);
+
+  num_types = 0;
+  for (i = 0; i < num_atom; i++) {
+    if (i > 0 &&
+	(keys[i].type != keys[i - 1].type ||
+	 keys[i].magnitude - keys[i - 1].magnitude >= symprec)) {
+      num_types++;
+    }
+    magnetic_types[keys[i].index] = num_types;
+  }
+
+  mem_free(keys);
+  keys = NULL;
+
+  return magnetic_types;
+}
+
+/* signs[i] is set to 1 or -1 if the i-th operation of sym_nonspin */
+/* moves the moments onto the same or reversed moments, and to 0 if it */
+/* breaks them. The operations form a group, so only a few of them */
+/* are checked atom by atom: a pure translation is known by the atom */
+/* onto which it moves the first atom and the pure translations kept */
+/* are closed under the product, and the operations of a rotation */
+/* differ from the first one kept by pure translations. Those checked */
+/* are set to generators. */
+/* The number of generators is returned, or -1 if memory could not */
+/* be allocated. */
+static int set_signs(int signs[],
+		     int generators[],
+		     SPGCONST Symmetry *sym_nonspin,
+		     const int permutations[],
+		     const OverlapChecker *checker,
+		     SPGCONST Cell *cell,
+		     const Moments *moments,
+		     const int magnetic_types[],
+		     const int check_order[],
+		     const double symprec)
+{
+  int i, j, k, l, m, num_queue, num_rot, num_generators, preimage;
+  int *first_images, *translation_of_image, *queue;
+  int *rot_ops, *kept_ops, *preimages;
+  SPGCONST int I[3][3] = {{ 1, 0, 0},
+			  { 0, 1, 0},
+			  { 0, 0, 1}};
+
+  num_generators = -1;
+  translation_of_image = NULL;
+  queue = NULL;
+  rot_ops = NULL;
+  kept_ops = NULL;
+  preimages = NULL;
+
+  for (i = 0; i < sym_nonspin->size; i++) {
+    signs[i] = 0;
+  }
+  if (cell->size == 0) {
+    for (i = 0; i < sym_nonspin->size; i++) {
+      signs[i] = 1;
+    }
+    return 0;
+  }
+
+  if ((first_images = (int*) mem_malloc(sizeof(int) *
+					(sym_nonspin->size > 0 ?
+					 sym_nonspin->size : 1))) == NULL) {
+    goto ret;
+  }
+  if ((translation_of_image = (int*) mem_malloc(sizeof(int) * cell->size))
+      == NULL) {
+    goto ret;
+  }
+  if ((queue = (int*) mem_malloc(sizeof(int) *
+				 (sym_nonspin->size > 0 ?
+				  sym_nonspin->size : 1))) == NULL) {
+    goto ret;
+  }
+  if ((rot_ops = (int*) mem_malloc(sizeof(int) *
+				   (sym_nonspin->size > 0 ?
+				    sym_nonspin->size : 1))) == NULL) {
+    goto ret;
+  }
+  if ((kept_ops = (int*) mem_malloc(sizeof(int) *
+				    (sym_nonspin->size > 0 ?
+				     sym_nonspin->size : 1))) == NULL) {
+    goto ret;
+  }
+  if ((preimages = (int*) mem_malloc(sizeof(int) *
+				     (sym_nonspin->size > 0 ?
+				      sym_nonspin->size : 1))) == NULL) {
+    goto ret;
+  }
+
+  /* Pure translations */
   for (i = 0; i < cell->size; i++) {
-    if (mapping_table[i] != i) {
+    translation_of_image[i] = -1;
+  }
+  for (i = 0; i < sym_nonspin->size; i++) {
+    first_images[i] = -1;
+    if (! mat_check_identity_matrix_i3(sym_nonspin->rot[i], I)) {
+      continue;
+    }
+    m = sym_get_image_atom(permutations, checker, cell, sym_nonspin, i, 0);
+    first_images[i] = m;
+    if (m > -1 && translation_of_image[m] < 0) {
+      translation_of_image[m] = i;
+    }
+  }
+
+  num_generators = 0;
+  for (i = 0; i < sym_nonspin->size; i++) {
+    if (! mat_check_identity_matrix_i3(sym_nonspin->rot[i], I)) {
+      continue;
+    }
+    m = first_images[i];
+    if (signs[i] != 0 || (m > -1 && translation_of_image[m] != i)) {
+      continue;
+    }
+    if ((signs[i] = get_sign(&preimage,
+			     i,
+			     sym_nonspin,
+			     permutations,
+			     checker,
+			     cell,
+			     moments,
+			     magnetic_types,
+			     check_order,
+			     symprec)) == 0) {
       continue;
     }
-    is_found = 0;
-    for (j = 0; j < symmetry->size; j++) {
-      mat_multiply_matrix_vector_id3(pos,
-				     symmetry->rot[j],
-				     cell->position[i]);
-      for (k = 0; k < 3; k++) {
-	pos[k] += symmetry->trans[j][k];
+    generators[num_generators] = i;
+    num_generators++;
+
+    /* Products of the pure translations kept and the generators */
+    num_queue = 0;
+    for (j = 0; j < cell->size; j++) {
+      if ((k = translation_of_image[j]) > -1 && signs[k] != 0) {
+	queue[num_queue] = k;
+	num_queue++;
       }
-      for (k = 0; k < cell->size; k++) {
-	if (cel_is_overlap(pos, cell->position[k], cell->lattice, symprec)) {
-	  if (mapping_table[k] < i) {
-	    equiv_atoms[i] = equiv_atoms[mapping_table[k]];
-	    is_found = 1;
-	    break;
-	  }
+    }
+    for (j = 0; j < num_queue; j++) {
+      for (k = 0; k < num_generators; k++) {
+	m = sym_get_image_atom(permutations,
+			       checker,
+			       cell,
+			       sym_nonspin,
+			       generators[k],
+			       first_images[queue[j]]);
+	if (m < 0 || (l = translation_of_image[m]) < 0 || signs[l] != 0) {
+	  continue;
 	}
+	signs[l] = signs[generators[k]] * signs[queue[j]];
+	queue[num_queue] = l;
+	num_queue++;
       }
-      if (is_found) {
+    }
+  }
+
+  for (i = 0; i < sym_nonspin->size; i++) {
+    if ((m = first_images[i]) > -1 && translation_of_image[m] != i) {
+      signs[i] = signs[translation_of_image[m]];
+    }
+  }
+
+  /* Other operations by their rotations */
+  num_rot = 0;
+  for (i = 0; i < sym_nonspin->size; i++) {
+    if (mat_check_identity_matrix_i3(sym_nonspin->rot[i], I)) {
+      continue;
+    }
+    for (j = 0; j < num_rot; j++) {
+      if (mat_check_identity_matrix_i3(sym_nonspin->rot[rot_ops[j]],
+				       sym_nonspin->rot[i])) {
 	break;
       }
     }
-    if (!is_found) {
-      equiv_atoms[i] = i;
+    if (j == num_rot) {
+      rot_ops[num_rot] = i;
+      kept_ops[num_rot] = -1;
+      num_rot++;
+    }
+
+    /* i = translation(l) * kept_ops[j] */
+    if ((k = kept_ops[j]) > -1 && preimages[j] > -1) {
+      m = sym_get_image_atom(permutations,
+			     checker,
+			     cell,
+			     sym_nonspin,
+			     i,
+			     preimages[j]);
+      if (m > -1 && (l = translation_of_image[m]) > -1) {
+	signs[i] = signs[k] * signs[l];
+	continue;
+      }
+    }
+
+    signs[i] = get_sign(&preimage,
+			i,
+			sym_nonspin,
+			permutations,
+			checker,
+			cell,
+			moments,
+			magnetic_types,
+			check_order,
+			symprec);
+    if (signs[i] != 0 && kept_ops[j] < 0) {
+      kept_ops[j] = i;
+      preimages[j] = preimage;
+      generators[num_generators] = i;
+      num_generators++;
+    }
+  }
+
+ ret:
+  mem_free(preimages);
+  preimages = NULL;
+  mem_free(kept_ops);
+  kept_ops = NULL;
+  mem_free(rot_ops);
+  rot_ops = NULL;
+  mem_free(queue);
+  queue = NULL;
+  mem_free(translation_of_image);
+  translation_of_image = NULL;
+  mem_free(first_images);
+  first_images = NULL;
+
+  return num_generators;
+}
+
+/* 1 or -1 is returned if the operation moves the moments onto the */
+/* same or reversed moments, and 0 otherwise. An atom moved onto an */
+/* atom of another magnetic type is rejected before the moments are */
+/* compared. Atoms not found are skipped. Non-magnetic atoms do not */
+/* tell the sign. The atom moved onto the first atom is set to */
+/* preimage, or -1 if not found. */
+static int get_sign(int *preimage,
+		    const int operation_index,
+		    SPGCONST Symmetry *sym_nonspin,
+		    const int permutations[],
+		    const OverlapChecker *checker,
+		    SPGCONST Cell *cell,
+		    const Moments *moments,
+		    const int magnetic_types[],
+		    const int check_order[],
+		    const double symprec)
+{
+  int i, j, k, sign;
+  double inv_lat[3][3], rot_cart[3][3];
+
+  /* Axial vectors are rotated by det(R) R in Cartesian coordinates. */
+  if (moments->magmoms != NULL) {
+    mat_inverse_matrix_d3(inv_lat, cell->lattice, 0);
+    mat_multiply_matrix_id3(rot_cart,
+			    sym_nonspin->rot[operation_index],
+			    inv_lat);
+    mat_multiply_matrix_d3(rot_cart, cell->lattice, rot_cart);
+    if (mat_get_determinant_i3(sym_nonspin->rot[operation_index]) < 0) {
+      for (i = 0; i < 3; i++) {
+	for (j = 0; j < 3; j++) {
+	  rot_cart[i][j] = -rot_cart[i][j];
+	}
+      }
     }
   }
 
+  sign = 0; /* Set sign as undetermined */
+  *preimage = -1;
   for (i = 0; i < cell->size; i++) {
-    if (mapping_table[i] == i) {
+    j = check_order[i];
+    if ((k = sym_get_image_atom(permutations,
+				checker,
+				cell,
+				sym_nonspin,
+				operation_index,
+				j)) < 0) {
       continue;
     }
-    equiv_atoms[i] = equiv_atoms[mapping_table[i]];
+    if (k == 0) {
+      *preimage = j;
+    }
+    if (magnetic_types[j] != magnetic_types[k]) {
+      return 0;
+    }
+    if (sign == 0 && get_magnitude(moments, j) >= symprec) {
+      if (is_moved_moment(moments, rot_cart, j, k, 1, symprec)) {
+	sign = 1;
+	continue;
+      }
+      if (moments->is_time_reversal &&
+	  is_moved_moment(moments, rot_cart, j, k, -1, symprec)) {
+	sign = -1;
+	continue;
+      }
+      return 0;
+    }
+    if (! is_moved_moment(moments,
+			  rot_cart,
+			  j,
+			  k,
+			  sign == 0 ? 1 : sign,
+			  symprec)) {
+      return 0;
+    }
   }
+
+  return sign == 0 ? 1 : sign;
 }
 
-static int * get_mapping_table(SPGCONST Symmetry *symmetry,
-			       SPGCONST Cell * cell,
-			       const double symprec)
+/* Whether the moment of the image atom is sign times the moment of */
+/* the atom rotated by rot_cart, which is not used for spins. */
+static int is_moved_moment(const Moments *moments,
+			   SPGCONST double rot_cart[3][3],
+			   const int atom_index,
+			   const int image_index,
+			   const int sign,
+			   const double symprec)
 {
-  int i, j, k, is_found;
-  double pos[3];
-  int *mapping_table;
-  SPGCONST int I[3][3] = {{ 1, 0, 0},
-			  { 0, 1, 0},
-			  { 0, 0, 1}};
+  int i;
+  double diff[3];
+
+  if (moments->spins != NULL) {
+    return mat_Dabs(moments->spins[atom_index] -
+		    moments->spins[image_index] * sign) < symprec;
+  }
 
-  mapping_table = (int*) malloc(sizeof(int) * cell->size);
+  mat_multiply_matrix_vector_d3(diff, rot_cart, moments->magmoms[atom_index]);
+  for (i = 0; i < 3; i++) {
+    diff[i] = moments->magmoms[image_index][i] - diff[i] * sign;
+  }
+  return mat_norm_squared_d3(diff) < symprec * symprec;
+}
+
+static double get_magnitude(const Moments *moments, const int atom_index)
+{
+  if (moments->spins != NULL) {
+    return mat_Dabs(moments->spins[atom_index]);
+  }
+  return sqrt(mat_norm_squared_d3(moments->magmoms[atom_index]));
+}
+
+/* Atoms are equivalent if they are joined by the generators. */
+static void set_equivalent_atoms(int equiv_atoms[],
+				 const int generators[],
+				 const int num_generators,
+				 SPGCONST Symmetry *sym_nonspin,
+				 const int permutations[],
+				 const OverlapChecker *checker,
+				 SPGCONST Cell *cell)
+{
+  int i, j, k, root_j, root_k;
 
   for (i = 0; i < cell->size; i++) {
-    is_found = 0;
-    for (j = 0; j < symmetry->size; j++) {
-      if (mat_check_identity_matrix_i3(symmetry->rot[j], I)) {
-	for (k = 0; k < 3; k++) {
-	  pos[k] = cell->position[i][k] + symmetry->trans[j][k];
-	}
-	for (k = 0; k < cell->size; k++) {
-	  if (cel_is_overlap(pos, cell->position[k], cell->lattice, symprec)) {
-	    if (k < i) {
-	      mapping_table[i] = mapping_table[k];
-	      is_found = 1;
-	      break;
-	    }
-	  }
-	}
+    equiv_atoms[i] = i;
+  }
+
+  for (i = 0; i < num_generators; i++) {
+    for (j = 0; j < cell->size; j++) {
+      if ((k = sym_get_image_atom(permutations,
+				  checker,
+				  cell,
+				  sym_nonspin,
+				  generators[i],
+				  j)) < 0) {
+	continue;
       }
-      if (is_found) {
+      root_j = get_root(equiv_atoms, j);
+      root_k = get_root(equiv_atoms, k);
+      if (root_j < root_k) {
+	equiv_atoms[root_k] = root_j;
+      } else {
+	equiv_atoms[root_j] = root_k;
+      }
+    }
+  }
+
+  /* Each atom points to an atom of smaller index, or to itself. */
+  for (i = 0; i < cell->size; i++) {
+    equiv_atoms[i] = equiv_atoms[equiv_atoms[i]];
+  }
+}
+
+static int get_root(int parents[], int atom_index)
+{
+  while (parents[atom_index] != atom_index) {
+    parents[atom_index] = parents[parents[atom_index]];
+    atom_index = parents[atom_index];
+  }
+  return atom_index;
+}
+
+/* Atoms of the rarest moments come first, so that an operation */
+/* breaking the moments is told after a few atoms. Vector moments are */
+/* told apart by their projections on an axis of no symmetry. */
+/* NULL is returned if memory could not be allocated. */
+static int * get_check_order(const Moments *moments,
+			     const int num_atom,
+			     const double symprec)
+{
+  int i, j, k;
+  int *check_order;
+  MagneticKey *keys;
+
+  if ((check_order = (int*) mem_malloc(sizeof(int) *
+				       (num_atom > 0 ? num_atom : 1)))
+      == NULL) {
+    return NULL;
+  }
+  if ((keys = (MagneticKey*) mem_malloc(sizeof(MagneticKey) *
+					(num_atom > 0 ? num_atom : 1)))
+      == NULL) {
+    mem_free(check_order);
+    return NULL;
+  }
+
+  for (i = 0; i < num_atom; i++) {
+    keys[i].type = 0;
+    if (moments->spins != NULL) {
+      keys[i].magnitude = moments->spins[i];
+    } else {
+      keys[i].magnitude = (moments->magmoms[i][0] * 0.6 +
+			   moments->magmoms[i][1] * 0.48 +
+			   moments->magmoms[i][2] * 0.64);
+    }
+    keys[i].index = i;
+  }
+  qsort(keys, num_atom, sizeof(MagneticKey), compare_magnetic_key);
+
+  /* Numbers of atoms of the chained moments are sorted as the types. */
+  for (i = 0; i < num_atom; i = j) {
+    for (j = i + 1; j < num_atom; j++) {
+      if (keys[j].magnitude - keys[j - 1].magnitude >= symprec) {
 	break;
       }
     }
-    if (!is_found) {
-      mapping_table[i] = i;
+    for (k = i; k < j; k++) {
+      keys[k].type = j - i;
+      keys[k].magnitude = 0;
     }
   }
+  qsort(keys, num_atom, sizeof(MagneticKey), compare_magnetic_key);
 
-  return mapping_table;
+  for (i = 0; i < num_atom; i++) {
+    check_order[i] = keys[i].index;
+  }
+
+  mem_free(keys);
+  keys = NULL;
+
+  return check_order;
+}
+
+static int compare_magnetic_key(const void *a, const void *b)
+{
+  const MagneticKey *key_a, *key_b;
+
+  key_a = (const MagneticKey*) a;
+  key_b = (const MagneticKey*) b;
+
+  if (key_a->type != key_b->type) {
+    return key_a->type < key_b->type ? -1 : 1;
+  }
+  if (key_a->magnitude != key_b->magnitude) {
+    return key_a->magnitude < key_b->magnitude ? -1 : 1;
+  }
+  return key_a->index - key_b->index;
 }
@@ -10,8 +10,17 @@
 
 Symmetry * spn_get_collinear_operations(int equiv_atoms[],
 					SPGCONST Symmetry *sym_nonspin,
+					const int permutations[],
 					SPGCONST Cell *cell,
 					const double spins[],
 					const double symprec);
+Symmetry * spn_get_operations_with_magmoms(int equiv_atoms[],
+					   int time_reversals[],
+					   SPGCONST Symmetry *sym_nonspin,
+					   const int permutations[],
+					   SPGCONST Cell *cell,
+					   SPGCONST double magmoms[][3],
+					   const int is_time_reversal,
+					   const double symprec);
 
 #endif
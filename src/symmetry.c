@@ -8,17 +8,67 @@
 #include "debug.h"
 #include "lattice.h"
 #include "mathfunc.h"
+#include "mem.h"
+#include "overlap.h"
 #include "pointgroup.h"
 #include "primitive.h"
 #include "symmetry.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "debug.h"
-#define NUM_ATOMS_CRITERION_FOR_OPENMP 1000
+/* Number of operations checked serially to estimate the total work */
+#define NUM_PROBED_OPERATIONS 16
+/* Threads are started when the estimated work is larger than */
+/* this times the cost of a parallel region. */
+#define PARALLEL_WORK_RATIO 4
+/* Time in seconds to start and join a thread of a parallel region */
+/* with a dynamically scheduled loop. The cost of a region is taken */
+/* as this times the number of threads, not measured at run time, */
+/* so that no state is shared between calls. */
+#define PARALLEL_OVERHEAD_PER_THREAD 2e-6
+/* Number of checked pure translations whose atom mappings are kept */
+#define MAX_NUM_GENERATORS 32
+/* Pure translations are derived while the bound of their distances */
+/* is below this times symprec. */
+#define CLOSURE_TOLERANCE_RATIO 0.5
 #define REDUCE_RATE 0.95
 #define PI 3.14159265358979323846
-/* Tolerance of angle between lattice vectors in degrees */
-/* Negative value invokes converter from symprec. */
-static double angle_tolerance = -1.0; 
+#define NUM_CACHED_CELLS 4
+#define NUM_CACHED_ROTATIONS 48
+
+/* Translations x_j - R x_min to the atoms j of the type of */
+/* min_atom_index and the squared distances below which they are */
+/* symmetry operations with R. Translations never accepted are left out. */
+/* Where is_bound is set, distance is only an upper bound. */
+typedef struct {
+  int rot[3][3];
+  VecDBL *trans;
+  double *distance;
+  int *is_bound;
+} CachedRotation;
+
+/* The checker is built with the largest tolerance requested, so that */
+/* it serves every smaller one. */
+typedef struct {
+  Cell *cell;
+  OverlapChecker *checker;
+  int min_atom_index;
+  int num_rot;
+  CachedRotation rot[NUM_CACHED_ROTATIONS];
+} CachedCell;
+
+struct _SymmetryCache {
+  CachedCell *cells[NUM_CACHED_CELLS];
+  int next;
+};
+
+typedef struct {
+  double length;
+  int index;
+} TranslationKey;
 
 static int relative_axes[][3] = {
   { 1, 0, 0},
@@ -55,26 +105,84 @@ static int identity[3][3] = {{1, 0, 0},
 
 static int get_index_with_least_atoms(const Cell *cell);
 static VecDBL * get_translation(SPGCONST int rot[3][3],
-				SPGCONST Cell *cell,
-				const double symprec,
-				const int is_identity);
+				const OverlapChecker *checker);
+static int get_translations(VecDBL * trans[],
+			    SPGCONST int (*rot)[3][3],
+			    const int num_rot,
+			    const OverlapChecker *checker);
+static VecDBL * get_candidates(SPGCONST Cell * cell,
+			       SPGCONST int (*rot)[3][3],
+			       const int num_rot,
+			       const int min_atom_index);
+static int check_operations(double distance[],
+			    int is_bound[],
+			    const OverlapChecker *checker,
+			    SPGCONST int (*rot)[3][3],
+			    SPGCONST double (*vec)[3],
+			    const int num_rot,
+			    const int num_candidates,
+			    const int min_atom_index,
+			    const int is_distance);
+static double check_operation(const OverlapChecker *checker,
+			      SPGCONST int rot[3][3],
+			      const double vec[3],
+			      const int is_distance,
+			      int hint[]);
+static int check_pure_translations(double distance[],
+				   int is_bound[],
+				   const OverlapChecker *checker,
+				   SPGCONST double (*vec)[3],
+				   const int num_candidates,
+				   const int min_atom_index,
+				   const int is_distance);
+static int compare_translation_key(const void *a, const void *b);
 static Symmetry * get_operations(SPGCONST Cell * cell,
-				 const double symprec);
+				 const double symprec,
+				 const double angle_tolerance,
+				 SymmetryCache * cache);
 static Symmetry * reduce_operation(SPGCONST Cell * cell,
 				   SPGCONST Symmetry * symmetry,
+				   const double symprec,
+				   const double angle_tolerance);
+static int is_perturbed_operation(int atoms[],
+				  int preimages[],
+				  double distances[],
+				  const OverlapChecker * checker,
+				  SPGCONST int rot[3][3],
+				  const double trans[3],
+				  const int moved[],
+				  SPGCONST double moved_position[][3],
+				  const int num_moved,
+				  const double symprec);
+static int has_perturbed_overlap(int atoms[],
+				 double distances[],
+				 const OverlapChecker * checker,
+				 const double pos[3],
+				 const int atom_index,
+				 const int moved[],
+				 SPGCONST double moved_position[][3],
+				 const int num_moved,
+				 const double symprec);
+static int is_moved(const int atom_index,
+		    const int moved[],
+		    const int num_moved);
+static int set_tracked_translation(double trans[3],
+				   SPGCONST Cell * cell,
+				   SPGCONST int rot[3][3],
+				   const double trans_orig[3],
+				   const int permutation[],
 				   const double symprec);
-static void search_translation_part(int lat_point_atoms[],
-				    SPGCONST Cell * cell,
-				    SPGCONST int rot[3][3],
-				    const int min_atom_index,
-				    const double origin[3],
-				    const double symprec,
-				    const int is_identity);
-static int is_overlap_all_atoms(const double test_trans[3],
-				SPGCONST int rot[3][3],
-				SPGCONST Cell * cell,
-				const double symprec,
-				const int is_identity);
+static int is_tracked_translation(SPGCONST Cell * cell,
+				  SPGCONST int rot[3][3],
+				  const double trans[3],
+				  const int permutation[],
+				  const double symprec);
+static int set_permutation(int permutation[],
+			   int is_mapped[],
+			   const OverlapChecker *checker,
+			   SPGCONST int rot[3][3],
+			   const double trans[3],
+			   const int is_identity);
 static PointSymmetry
 transform_pointsymmetry(SPGCONST PointSymmetry * point_sym_prim,
 			SPGCONST double new_lattice[3][3],
@@ -82,7 +190,32 @@ transform_pointsymmetry(SPGCONST PointSymmetry * point_sym_prim,
 static Symmetry *
 get_space_group_operations(SPGCONST PointSymmetry *lattice_sym,
 			   SPGCONST Cell *primitive,
-			   const double symprec);
+			   const double symprec,
+			   SymmetryCache * cache);
+static CachedCell * get_cached_cell(SymmetryCache * cache,
+				    SPGCONST Cell * cell,
+				    const double symprec);
+static CachedCell * alloc_cached_cell(SPGCONST Cell * cell,
+				      const double symprec);
+static void free_cached_cell(CachedCell * cached);
+static int is_same_cell(SPGCONST Cell * a, SPGCONST Cell * b);
+static VecDBL * get_cached_translation(CachedCell * cached,
+				       SPGCONST int rot[3][3],
+				       const double symprec);
+static CachedRotation * get_cached_rotation(CachedCell * cached,
+					    SPGCONST int rot[3][3],
+					    CachedRotation * tmp_rot);
+static int add_cached_rotations(CachedCell * cached,
+				SPGCONST int (*rot)[3][3],
+				const int num_rot);
+static int set_cached_rotations(CachedRotation cached_rot[],
+				const CachedCell * cached,
+				SPGCONST int (*rot)[3][3],
+				const int num_rot);
+static void free_cached_rotation(CachedRotation * cached_rot);
+static void refine_cached_distances(CachedRotation * cached_rot,
+				    const CachedCell * cached,
+				    const double symprec2);
 static Symmetry * recover_operations_original(SPGCONST Symmetry *symmetry,
 					      const VecDBL * pure_trans,
 					      SPGCONST Cell *cell,
@@ -90,54 +223,79 @@ static Symmetry * recover_operations_original(SPGCONST Symmetry *symmetry,
 static void set_axes(int axes[3][3],
 		     const int a1, const int a2, const int a3);
 static PointSymmetry get_lattice_symmetry(SPGCONST Cell *cell,
-					  const double symprec);
+					  const double symprec,
+					  const double angle_tolerance);
 static int is_identity_metric(SPGCONST double metric_rotated[3][3],
 			      SPGCONST double metric_orig[3][3],
-			      const double symprec);
+			      const double symprec,
+			      const double angle_tolerance);
 static double get_angle(SPGCONST double metric[3][3],
 			const int i,
 			const int j);
-
+static int get_lattice_tolerances(double tolerances[],
+				  SPGCONST Cell *cell,
+				  const double symprec,
+				  const double angle_tolerance);
+static double get_metric_tolerance(SPGCONST double metric_rotated[3][3],
+				   SPGCONST double metric_orig[3][3],
+				   const double angle_tolerance);
+
+/* NULL is returned if memory could not be allocated. */
 Symmetry * sym_alloc_symmetry(const int size)
 {
   Symmetry *symmetry;
 
-  symmetry = (Symmetry*) malloc(sizeof(Symmetry));
+  if ((symmetry = (Symmetry*) mem_malloc(sizeof(Symmetry))) == NULL) {
+    return NULL;
+  }
   symmetry->size = size;
+  symmetry->rot = NULL;
+  symmetry->trans = NULL;
   if (size > 0) {
     if ((symmetry->rot =
-	 (int (*)[3][3]) malloc(sizeof(int[3][3]) * size)) == NULL) {
-      warning_print("spglib: Memory could not be allocated ");
-      warning_print("(line %d, %s).\n", __LINE__, __FILE__);
-      exit(1);
+	 (int (*)[3][3]) mem_malloc(sizeof(int[3][3]) * size)) == NULL) {
+      goto err;
     }
     if ((symmetry->trans =
-	 (double (*)[3]) malloc(sizeof(double[3]) * size)) == NULL) {
-      warning_print("spglib: Memory could not be allocated ");
-      warning_print("(line %d, %s).\n", __LINE__, __FILE__);
-      exit(1);
+	 (double (*)[3]) mem_malloc(sizeof(double[3]) * size)) == NULL) {
+      goto err;
     } 
   }
   return symmetry;
+
+ err:
+  mem_free(symmetry->rot);
+  symmetry->rot = NULL;
+  mem_free(symmetry);
+  symmetry = NULL;
+  return NULL;
 }
 
 void sym_free_symmetry(Symmetry *symmetry)
 {
+  if (symmetry == NULL) {
+    return;
+  }
   if (symmetry->size > 0) {
-    free(symmetry->rot);
+    mem_free(symmetry->rot);
     symmetry->rot = NULL;
-    free(symmetry->trans);
+    mem_free(symmetry->trans);
     symmetry->trans = NULL;
   }
-  free(symmetry);
+  mem_free(symmetry);
   symmetry = NULL;
 }
 
+/* Tolerance of angle between lattice vectors is given in degrees. */
+/* Negative value of angle_tolerance invokes converter from symprec. */
+/* cache may be NULL. */
 Symmetry * sym_get_operation(SPGCONST Cell *cell,
-			     const double symprec) {
+			     const double symprec,
+			     const double angle_tolerance,
+			     SymmetryCache * cache) {
   Symmetry *symmetry;
   
-  symmetry = get_operations(cell, symprec);
+  symmetry = get_operations(cell, symprec, angle_tolerance, cache);
 
   return symmetry;
 }
@@ -145,9 +303,275 @@ Symmetry * sym_get_operation(SPGCONST Cell *cell,
 /* Number of operations may be reduced with smaller symprec. */
 Symmetry * sym_reduce_operation(SPGCONST Cell * cell,
 				SPGCONST Symmetry * symmetry,
-				const double symprec)
+				const double symprec,
+				const double angle_tolerance)
+{
+  return reduce_operation(cell, symmetry, symprec, angle_tolerance);
+}
+
+/* Operations of symmetry of checker->cell which remain when the */
+/* atoms moved[i] are moved to moved_position[i]. checker has to be */
+/* made with twice symprec. An operation can only be broken at the */
+/* moved atoms and at the atoms mapped onto their original positions, */
+/* so only these are checked, which costs O(symmetry->size * */
+/* num_moved) instead of searching operations again. */
+/* NULL is returned if memory could not be allocated. */
+Symmetry * sym_get_perturbed_operation(const OverlapChecker * checker,
+				       SPGCONST Symmetry * symmetry,
+				       const int moved[],
+				       SPGCONST double moved_position[][3],
+				       const int num_moved,
+				       const double symprec)
+{
+  int i, num_sym;
+  int *atoms, *preimages, *is_kept;
+  double *distances;
+  Symmetry *perturbed;
+
+  perturbed = NULL;
+  atoms = (int*) mem_malloc(sizeof(int) * checker->cell->size);
+  preimages = (int*) mem_malloc(sizeof(int) * checker->cell->size);
+  distances = (double*) mem_malloc(sizeof(double) * checker->cell->size);
+  is_kept = (int*) mem_malloc(sizeof(int) * symmetry->size);
+  if (atoms == NULL || preimages == NULL || distances == NULL ||
+      is_kept == NULL) {
+    goto ret;
+  }
+
+  num_sym = 0;
+  for (i = 0; i < symmetry->size; i++) {
+    is_kept[i] = is_perturbed_operation(atoms,
+					preimages,
+					distances,
+					checker,
+					symmetry->rot[i],
+					symmetry->trans[i],
+					moved,
+					moved_position,
+					num_moved,
+					symprec);
+    num_sym += is_kept[i];
+  }
+
+  if ((perturbed = sym_alloc_symmetry(num_sym)) == NULL) {
+    goto ret;
+  }
+  num_sym = 0;
+  for (i = 0; i < symmetry->size; i++) {
+    if (is_kept[i]) {
+      mat_copy_matrix_i3(perturbed->rot[num_sym], symmetry->rot[i]);
+      mat_copy_vector_d3(perturbed->trans[num_sym], symmetry->trans[i]);
+      num_sym++;
+    }
+  }
+
+ ret:
+  mem_free(is_kept);
+  mem_free(distances);
+  mem_free(preimages);
+  mem_free(atoms);
+  return perturbed;
+}
+
+/* permutations[k * cell->size + i] is set to the atom onto which */
+/* the atom i is moved by the k-th operation of symmetry. If the atoms */
+/* are not moved one-to-one onto atoms within symprec, the row of the */
+/* operation is filled with -1 and 0 is returned. */
+/* Atoms are searched only for the pure translations and for the first */
+/* operation of each rotation. The other rows are composed as */
+/* (R|t) = (E|t-t0)(R|t0), so a supercell costs O(symmetry->size * */
+/* cell->size) mostly in copying integers. */
+/* -1 is returned if memory could not be allocated. */
+int sym_get_permutations(int permutations[],
+			 SPGCONST Cell * cell,
+			 SPGCONST Symmetry * symmetry,
+			 const double symprec)
+{
+  int i, j, k, r, num_rot, is_found, is_composed;
+  int *row, *first_row, *is_mapped, *translation_of_image, *first_ops;
+  double pos[3];
+  OverlapChecker *checker;
+
+  if (cell->size == 0) {
+    return 1;
+  }
+
+  is_found = -1;
+  checker = NULL;
+  translation_of_image = NULL;
+  first_ops = NULL;
+
+  if ((is_mapped = (int*) mem_malloc(sizeof(int) * cell->size)) == NULL) {
+    goto ret;
+  }
+  if ((translation_of_image = (int*) mem_malloc(sizeof(int) * cell->size))
+      == NULL) {
+    goto ret;
+  }
+  if ((first_ops = (int*) mem_malloc(sizeof(int) *
+				     (symmetry->size > 0 ?
+				      symmetry->size : 1))) == NULL) {
+    goto ret;
+  }
+  if ((checker = ovl_overlap_checker_init(cell, symprec)) == NULL) {
+    goto ret;
+  }
+
+  is_found = 1;
+
+  /* Pure translations are told by the image of the first atom. */
+  for (i = 0; i < cell->size; i++) {
+    translation_of_image[i] = -1;
+  }
+  for (k = 0; k < symmetry->size; k++) {
+    if (! mat_check_identity_matrix_i3(symmetry->rot[k], identity)) {
+      continue;
+    }
+    row = permutations + k * cell->size;
+    if (set_permutation(row, is_mapped, checker, identity,
+			symmetry->trans[k], 1)) {
+      if (translation_of_image[row[0]] < 0) {
+	translation_of_image[row[0]] = k;
+      }
+    } else {
+      is_found = 0;
+    }
+  }
+
+  num_rot = 0;
+  for (k = 0; k < symmetry->size; k++) {
+    if (mat_check_identity_matrix_i3(symmetry->rot[k], identity)) {
+      continue;
+    }
+    row = permutations + k * cell->size;
+
+    is_composed = 0;
+    for (r = 0; r < num_rot; r++) {
+      if (mat_check_identity_matrix_i3(symmetry->rot[first_ops[r]],
+				       symmetry->rot[k])) {
+	break;
+      }
+    }
+    if (r < num_rot) {
+      first_row = permutations + first_ops[r] * cell->size;
+      for (j = 0; j < 3; j++) {
+	pos[j] = cell->position[0][j] +
+	  symmetry->trans[k][j] - symmetry->trans[first_ops[r]][j];
+      }
+      j = ovl_search_overlap_atom(checker, pos, 0);
+      if (j > -1 && translation_of_image[j] > -1) {
+	j = translation_of_image[j];
+	for (i = 0; i < cell->size; i++) {
+	  row[i] = permutations[j * cell->size + first_row[i]];
+	}
+	is_composed = 1;
+      }
+    }
+
+    if (! is_composed) {
+      if (set_permutation(row, is_mapped, checker, symmetry->rot[k],
+			  symmetry->trans[k], 0)) {
+	if (r == num_rot) {
+	  first_ops[num_rot] = k;
+	  num_rot++;
+	}
+      } else {
+	is_found = 0;
+      }
+    }
+  }
+
+ ret:
+  ovl_overlap_checker_free(checker);
+  checker = NULL;
+  mem_free(first_ops);
+  first_ops = NULL;
+  mem_free(translation_of_image);
+  translation_of_image = NULL;
+  mem_free(is_mapped);
+  is_mapped = NULL;
+
+  return is_found;
+}
+
+/* Atom onto which atom_index is moved by the operation_index-th */
+/* operation of symmetry. It is looked up in permutations given by */
+/* sym_get_permutations, or searched by checker if permutations is */
+/* NULL. -1 is returned if it is not found. */
+int sym_get_image_atom(const int permutations[],
+		       const OverlapChecker * checker,
+		       SPGCONST Cell * cell,
+		       const Symmetry * symmetry,
+		       const int operation_index,
+		       const int atom_index)
+{
+  int i;
+  double pos[3];
+
+  if (permutations != NULL) {
+    return permutations[operation_index * cell->size + atom_index];
+  }
+
+  mat_multiply_matrix_vector_id3(pos,
+				 symmetry->rot[operation_index],
+				 cell->position[atom_index]);
+  for (i = 0; i < 3; i++) {
+    pos[i] += symmetry->trans[operation_index][i];
+  }
+
+  return ovl_search_overlap_atom(checker, pos, atom_index);
+}
+
+/* Operations of symmetry of a previous cell, whose permutations */
+/* were given by sym_get_permutations, are verified for cell, e.g., */
+/* the next frame of molecular dynamics. Each atom only has to be */
+/* compared with the atom given by the permutation, so this costs */
+/* O(symmetry->size * cell->size) without searching atoms. The */
+/* translations are set again from the positions of cell. */
+/* symmetry->size = 0 is returned if any operation is broken. */
+/* NULL is returned if memory could not be allocated. */
+Symmetry * sym_get_tracked_operation(SPGCONST Cell * cell,
+				     SPGCONST Symmetry * symmetry,
+				     const int permutations[],
+				     const double symprec,
+				     const double angle_tolerance)
 {
-  return reduce_operation(cell, symmetry, symprec);
+  int i;
+  double lattice[3][3], metric[3][3], metric_orig[3][3];
+  Symmetry *tracked;
+
+  if ((tracked = sym_alloc_symmetry(symmetry->size)) == NULL) {
+    return NULL;
+  }
+
+  mat_get_metric(metric_orig, cell->lattice);
+
+  for (i = 0; i < symmetry->size; i++) {
+    mat_multiply_matrix_di3(lattice, cell->lattice, symmetry->rot[i]);
+    mat_get_metric(metric, lattice);
+    if (! is_identity_metric(metric,
+			     metric_orig,
+			     symprec,
+			     angle_tolerance)) {
+      goto broken;
+    }
+
+    mat_copy_matrix_i3(tracked->rot[i], symmetry->rot[i]);
+    if (! set_tracked_translation(tracked->trans[i],
+				  cell,
+				  symmetry->rot[i],
+				  symmetry->trans[i],
+				  permutations + i * cell->size,
+				  symprec)) {
+      goto broken;
+    }
+  }
+
+  return tracked;
+
+ broken:
+  sym_free_symmetry(tracked);
+  return sym_alloc_symmetry(0);
 }
 
 int sym_get_multiplicity(SPGCONST Cell *cell,
@@ -155,20 +579,46 @@ int sym_get_multiplicity(SPGCONST Cell *cell,
 {
   int multi;
   VecDBL * trans;
+  OverlapChecker *checker;
 
-  trans = get_translation(identity, cell, symprec, 1);
+  if ((checker = ovl_overlap_checker_init(cell, symprec)) == NULL) {
+    return 0;
+  }
+  trans = get_translation(identity, checker);
+  ovl_overlap_checker_free(checker);
+  if (trans == NULL) {
+    return 0;
+  }
   multi = trans->size;
   mat_free_VecDBL(trans);
   return multi;
 }
 
+/* cache may be NULL. */
 VecDBL * sym_get_pure_translation(SPGCONST Cell *cell,
-				  const double symprec)
+				  const double symprec,
+				  SymmetryCache * cache)
 {
   int multi;
   VecDBL * pure_trans;
+  OverlapChecker *checker;
+  CachedCell *cached;
 
-  pure_trans = get_translation(identity, cell, symprec, 1);
+  if (cache == NULL) {
+    if ((checker = ovl_overlap_checker_init(cell, symprec)) == NULL) {
+      return NULL;
+    }
+    pure_trans = get_translation(identity, checker);
+    ovl_overlap_checker_free(checker);
+  } else {
+    if ((cached = get_cached_cell(cache, cell, symprec)) == NULL) {
+      return NULL;
+    }
+    pure_trans = get_cached_translation(cached, identity, symprec);
+  }
+  if (pure_trans == NULL) {
+    return NULL;
+  }
   multi = pure_trans->size;
   if ((cell->size / multi) * multi == cell->size) {
     debug_print("sym_get_pure_translation: pure_trans->size = %d\n", multi);
@@ -186,40 +636,166 @@ VecDBL * sym_reduce_pure_translation(SPGCONST Cell * cell,
 				     const double symprec)
 {
   int i, multi;
-  Symmetry *symmetry, *symmetry_reduced;
+  int *is_found;
   VecDBL * pure_trans_reduced;
+  OverlapChecker *checker;
   
-  multi = pure_trans->size;
-  symmetry = sym_alloc_symmetry(multi);
-  for (i = 0; i < multi; i++) {
-    mat_copy_matrix_i3(symmetry->rot[i], identity);
-    mat_copy_vector_d3(symmetry->trans[i], pure_trans->vec[i]);
+  if ((is_found = (int*) mem_malloc(sizeof(int) * pure_trans->size))
+      == NULL) {
+    return NULL;
   }
+  if ((checker = ovl_overlap_checker_init(cell, symprec)) == NULL) {
+    mem_free(is_found);
+    is_found = NULL;
+    return NULL;
+  }
+  multi = 0;
+  for (i = 0; i < pure_trans->size; i++) {
+    is_found[i] = ovl_check_total_overlap(checker,
+					  pure_trans->vec[i],
+					  identity,
+					  1);
+    multi += is_found[i];
+  }
+  ovl_overlap_checker_free(checker);
 
-  symmetry_reduced = reduce_operation(cell, symmetry, symprec);
-  sym_free_symmetry(symmetry);
-
-  multi = symmetry_reduced->size;
-  pure_trans_reduced = mat_alloc_VecDBL(multi);
-  
-  for (i = 0; i < multi; i++) {
-    mat_copy_vector_d3(pure_trans_reduced->vec[i], symmetry_reduced->trans[i]);
+  if ((pure_trans_reduced = mat_alloc_VecDBL(multi)) == NULL) {
+    mem_free(is_found);
+    is_found = NULL;
+    return NULL;
   }
-  sym_free_symmetry(symmetry_reduced);
-  
+  multi = 0;
+  for (i = 0; i < pure_trans->size; i++) {
+    if (is_found[i]) {
+      mat_copy_vector_d3(pure_trans_reduced->vec[multi], pure_trans->vec[i]);
+      multi++;
+    }
+  }
+  mem_free(is_found);
+  is_found = NULL;
+
   return pure_trans_reduced;
 }
 
-void sym_set_angle_tolerance(double tolerance)
+/* NULL is returned if memory could not be allocated. */
+SymmetryCache * sym_alloc_cache(void)
+{
+  int i;
+  SymmetryCache *cache;
+
+  if ((cache = (SymmetryCache*) mem_malloc(sizeof(SymmetryCache))) == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < NUM_CACHED_CELLS; i++) {
+    cache->cells[i] = NULL;
+  }
+  cache->next = 0;
+
+  return cache;
+}
+
+void sym_free_cache(SymmetryCache *cache)
 {
-  angle_tolerance = tolerance;
+  int i;
+
+  if (cache == NULL) {
+    return;
+  }
+  for (i = 0; i < NUM_CACHED_CELLS; i++) {
+    free_cached_cell(cache->cells[i]);
+    cache->cells[i] = NULL;
+  }
+  mem_free(cache);
+  cache = NULL;
 }
 
-double sym_get_angle_tolerance(void)
+/* Tolerances, up to symprec, at which a rotation starts to be a */
+/* lattice symmetry of the cell, or a translation found for a */
+/* lattice symmetry starts to map every atom onto an atom of the same */
+/* type. Symmetry operations of the cell change only at these */
+/* tolerances. They are not sorted and may be repeated. */
+/* tolerances needs 48 * (cell->size + 1) elements. */
+/* The number of tolerances is returned. */
+/* -1 is returned if memory could not be allocated. */
+int sym_get_critical_tolerances(double tolerances[],
+				SPGCONST Cell *cell,
+				const double symprec,
+				const double angle_tolerance,
+				SymmetryCache * cache)
 {
-  return angle_tolerance;
+  int i, j, num_tol;
+  PointSymmetry lattice_sym;
+  CachedCell *cached;
+  CachedRotation *cached_rot;
+  CachedRotation tmp_rot;
+
+  lattice_sym = get_lattice_symmetry(cell, symprec, angle_tolerance);
+
+  if ((cached = get_cached_cell(cache, cell, symprec)) == NULL) {
+    return -1;
+  }
+
+  if (! add_cached_rotations(cached, lattice_sym.rot, lattice_sym.size)) {
+    return -1;
+  }
+
+  num_tol = get_lattice_tolerances(tolerances,
+				   cell,
+				   symprec,
+				   angle_tolerance);
+  for (i = 0; i < lattice_sym.size; i++) {
+    if ((cached_rot = get_cached_rotation(cached,
+					  lattice_sym.rot[i],
+					  &tmp_rot)) == NULL) {
+      return -1;
+    }
+    refine_cached_distances(cached_rot, cached, 0);
+    for (j = 0; j < cached_rot->trans->size; j++) {
+      tolerances[num_tol] = sqrt(cached_rot->distance[j]);
+      num_tol++;
+    }
+    if (cached_rot == &tmp_rot) {
+      free_cached_rotation(&tmp_rot);
+    }
+  }
+
+  return num_tol;
 }
 
+/* Tolerances, up to symprec, at which a pure translation starts to */
+/* map every atom onto an atom of the same type. Pure translations */
+/* change only at these tolerances. They are not sorted. */
+/* tolerances needs cell->size elements. */
+/* The number of tolerances is returned. */
+/* -1 is returned if memory could not be allocated. */
+int sym_get_pure_translation_tolerances(double tolerances[],
+					SPGCONST Cell *cell,
+					const double symprec,
+					SymmetryCache * cache)
+{
+  int i, num_tol;
+  CachedCell *cached;
+  CachedRotation *cached_rot;
+  CachedRotation tmp_rot;
+
+  if ((cached = get_cached_cell(cache, cell, symprec)) == NULL) {
+    return -1;
+  }
+  if ((cached_rot = get_cached_rotation(cached, identity, &tmp_rot)) == NULL) {
+    return -1;
+  }
+
+  refine_cached_distances(cached_rot, cached, 0);
+  num_tol = cached_rot->trans->size;
+  for (i = 0; i < num_tol; i++) {
+    tolerances[i] = sqrt(cached_rot->distance[i]);
+  }
+  if (cached_rot == &tmp_rot) {
+    free_cached_rotation(&tmp_rot);
+  }
+
+  return num_tol;
+}
 
 /* 1) A primitive cell of the input cell is searched. */
 /* 2) Pointgroup operations of the primitive cell are obtained. */
@@ -232,7 +808,9 @@ double sym_get_angle_tolerance(void)
 /*    transformed to those of original input cells, if the input cell */
 /*    was not a primitive cell. */
 static Symmetry * get_operations(SPGCONST Cell *cell,
-				 const double symprec)
+				 const double symprec,
+				 const double angle_tolerance,
+				 SymmetryCache * cache)
 {
   int i, j, attempt;
   double tolerance;
@@ -244,13 +822,15 @@ static Symmetry * get_operations(SPGCONST Cell *cell,
 
   symmetry_orig = NULL;
 
-  lattice_sym = get_lattice_symmetry(cell, symprec);
+  lattice_sym = get_lattice_symmetry(cell, symprec, angle_tolerance);
   if (lattice_sym.size == 0) {
     debug_print("get_lattice_symmetry failed.\n");
     goto end;
   }
 
-  primitive = prm_get_primitive(cell, symprec);
+  if ((primitive = prm_get_primitive(cell, symprec, cache)) == NULL) {
+    return NULL;
+  }
   if (primitive->cell->size == 0) {
     goto deallocate_and_end;
   }
@@ -263,9 +843,13 @@ static Symmetry * get_operations(SPGCONST Cell *cell,
   }
 
   
-  symmetry = get_space_group_operations(&lattice_sym,
-					primitive->cell,
-					symprec);
+  if ((symmetry = get_space_group_operations(&lattice_sym,
+					     primitive->cell,
+					     symprec,
+					     cache)) == NULL) {
+    prm_free_primitive(primitive);
+    return NULL;
+  }
   if (symmetry->size > 48) {
     tolerance = symprec;
     for (attempt = 0; attempt < 100; attempt++) {
@@ -274,9 +858,14 @@ static Symmetry * get_operations(SPGCONST Cell *cell,
       warning_print("tolerance is reduced to %f\n", tolerance);
       symmetry_reduced = reduce_operation(primitive->cell,
 					  symmetry,
-					  tolerance);
+					  tolerance,
+					  angle_tolerance);
       sym_free_symmetry(symmetry);
       symmetry = symmetry_reduced;
+      if (symmetry_reduced == NULL) {
+	prm_free_primitive(primitive);
+	return NULL;
+      }
       if (symmetry_reduced->size > 48) {
 	;
       } else {
@@ -290,6 +879,10 @@ static Symmetry * get_operations(SPGCONST Cell *cell,
 					      cell,
 					      primitive->cell);
   sym_free_symmetry(symmetry);
+  if (symmetry_orig == NULL) {
+    prm_free_primitive(primitive);
+    return NULL;
+  }
 
   for (i = 0; i < symmetry_orig->size; i++) {
     for (j = 0; j < 3; j++) {
@@ -309,30 +902,36 @@ static Symmetry * get_operations(SPGCONST Cell *cell,
 
 static Symmetry * reduce_operation(SPGCONST Cell * cell,
 				   SPGCONST Symmetry * symmetry,
-				   const double symprec)
+				   const double symprec,
+				   const double angle_tolerance)
 {
   int i, j, num_sym;
   Symmetry * sym_reduced;
   PointSymmetry point_symmetry;
   MatINT *rot;
   VecDBL *trans;
+  OverlapChecker *checker;
 
   debug_print("reduce_operation:\n");
 
-  point_symmetry = get_lattice_symmetry(cell, symprec);
+  point_symmetry = get_lattice_symmetry(cell, symprec, angle_tolerance);
+  checker = ovl_overlap_checker_init(cell, symprec);
   rot = mat_alloc_MatINT(symmetry->size);
   trans = mat_alloc_VecDBL(symmetry->size);
+  sym_reduced = NULL;
+  if (checker == NULL || rot == NULL || trans == NULL) {
+    goto ret;
+  }
 
   num_sym = 0;
   for (i = 0; i < point_symmetry.size; i++) {
     for (j = 0; j < symmetry->size; j++) {
       if (mat_check_identity_matrix_i3(point_symmetry.rot[i],
 				       symmetry->rot[j])) {
-	if (is_overlap_all_atoms(symmetry->trans[j],
-				 symmetry->rot[j],
-				 cell,
-				 symprec,
-				 0)) {
+	if (ovl_check_total_overlap(checker,
+				    symmetry->trans[j],
+				    symmetry->rot[j],
+				    0)) {
 	  mat_copy_matrix_i3(rot->mat[num_sym], symmetry->rot[j]);
 	  mat_copy_vector_d3(trans->vec[num_sym], symmetry->trans[j]);
 	  num_sym++;
@@ -341,206 +940,531 @@ static Symmetry * reduce_operation(SPGCONST Cell * cell,
     }
   }
 
-  sym_reduced = sym_alloc_symmetry(num_sym);
+  if ((sym_reduced = sym_alloc_symmetry(num_sym)) == NULL) {
+    goto ret;
+  }
   for (i = 0; i < num_sym; i++) {
     mat_copy_matrix_i3(sym_reduced->rot[i], rot->mat[i]);
     mat_copy_vector_d3(sym_reduced->trans[i], trans->vec[i]);
   }
 
+  debug_print("  num_sym %d -> %d\n", symmetry->size, num_sym);
+
+ ret:
   mat_free_MatINT(rot);
   mat_free_VecDBL(trans);
-
-  debug_print("  num_sym %d -> %d\n", symmetry->size, num_sym);
+  ovl_overlap_checker_free(checker);
 
   return sym_reduced;
 }
 
-/* Look for the translations which satisfy the input symmetry operation. */
-/* This function is heaviest in this code. */
+/* NULL is returned if memory could not be allocated. */
 static VecDBL * get_translation(SPGCONST int rot[3][3],
-				SPGCONST Cell *cell,
-				const double symprec,
-				const int is_identity)
+				const OverlapChecker *checker)
 {
-  int i, j, min_atom_index, num_trans = 0;
-  int *is_found;
-  double origin[3];
+  int rots[1][3][3];
   VecDBL *trans;
 
-#ifdef _OPENMP
-  int num_min_type_atoms;
-  int *min_type_atoms;
-  double vec[3];
-#endif
-
-  is_found = (int*) malloc(sizeof(int)*cell->size);
-  for (i = 0; i < cell->size; i++) {
-    is_found[i] = 0;
+  mat_copy_matrix_i3(rots[0], rot);
+  if (! get_translations(&trans, rots, 1, checker)) {
+    return NULL;
   }
 
-  /* Look for the atom index with least number of atoms within same type */
-  min_atom_index = get_index_with_least_atoms(cell);
+  return trans;
+}
 
-  /* Set min_atom_index as the origin to measure the distance between atoms. */
-  mat_multiply_matrix_vector_id3(origin, rot, cell->position[min_atom_index]);
+/* Look for the translations which satisfy each of the rotations. */
+/* This function is heaviest in this code. */
+/* 0 is returned if memory could not be allocated. */
+static int get_translations(VecDBL * trans[],
+			    SPGCONST int (*rot)[3][3],
+			    const int num_rot,
+			    const OverlapChecker *checker)
+{
+  int i, j, k, min_atom_index, num_candidates, num_trans;
+  double *distance;
+  VecDBL *vec;
 
-#ifdef _OPENMP
-  if (cell->size < NUM_ATOMS_CRITERION_FOR_OPENMP) {
-    search_translation_part(is_found,
-			    cell,
-			    rot,
-			    min_atom_index,
-			    origin,
-			    symprec,
-			    is_identity);
-  } else {
-    /* Collect indices of atoms with the type where the minimum number */
-    /* of atoms belong. */
-    min_type_atoms = (int*) malloc(sizeof(int)*cell->size);
-    num_min_type_atoms = 0;
-    for (i = 0; i < cell->size; i++) {
-      if (cell->types[i] == cell->types[min_atom_index]) {
-	min_type_atoms[num_min_type_atoms] = i;
-	num_min_type_atoms++;
-      }
-    }
-#pragma omp parallel for private(j, vec)
-    for (i = 0; i < num_min_type_atoms; i++) {
-      for (j = 0; j < 3; j++) {
-	vec[j] = cell->position[min_type_atoms[i]][j] - origin[j];
-      }
-      if (is_overlap_all_atoms(vec,
-			       rot,
-			       cell,
-			       symprec,
-			       is_identity)) {
-	is_found[min_type_atoms[i]] = 1;
-      }
-    }
+  for (i = 0; i < num_rot; i++) {
+    trans[i] = NULL;
+  }
+  if (num_rot < 1) {
+    return 1;
+  }
 
-    free(min_type_atoms);
+  distance = NULL;
+  vec = NULL;
+
+  /* Look for the atom index with least number of atoms within same type */
+  if ((min_atom_index = get_index_with_least_atoms(checker->cell)) < 0) {
+    goto err;
+  }
+  if ((vec = get_candidates(checker->cell, rot, num_rot, min_atom_index))
+      == NULL) {
+    goto err;
+  }
+  num_candidates = vec->size / num_rot;
+  if ((distance = (double*) mem_malloc(sizeof(double) * (vec->size + 1)))
+      == NULL) {
+    goto err;
   }
-#else
-  search_translation_part(is_found,
-			  cell,
-			  rot,
-			  min_atom_index,
-			  origin,
-			  symprec,
-			  is_identity);
-#endif
 
-  
-  for (i = 0; i < cell->size; i++) {
-    num_trans += is_found[i];
+  if (! check_operations(distance,
+			 NULL,
+			 checker,
+			 rot,
+			 vec->vec,
+			 num_rot,
+			 num_candidates,
+			 min_atom_index,
+			 0)) {
+    goto err;
   }
-  trans = mat_alloc_VecDBL(num_trans);
-  num_trans = 0;
-  for (i = 0; i < cell->size; i++) {
-    if (is_found[i]) {
-      for (j = 0; j < 3; j++) {
-	trans->vec[num_trans][j] = cell->position[i][j] - origin[j];
+
+  for (i = 0; i < num_rot; i++) {
+    num_trans = 0;
+    for (j = 0; j < num_candidates; j++) {
+      if (distance[i * num_candidates + j] > -1) {
+	num_trans++;
+      }
+    }
+    if ((trans[i] = mat_alloc_VecDBL(num_trans)) == NULL) {
+      goto err;
+    }
+    num_trans = 0;
+    for (j = 0; j < num_candidates; j++) {
+      k = i * num_candidates + j;
+      if (distance[k] > -1) {
+	mat_copy_vector_d3(trans[i]->vec[num_trans], vec->vec[k]);
+	num_trans++;
       }
-      num_trans++;
     }
   }
 
-  free(is_found);
-  is_found = NULL;
-  
-  return trans;
-}
-
-static void search_translation_part(int lat_point_atoms[],
-				    SPGCONST Cell * cell,
-				    SPGCONST int rot[3][3],
-				    const int min_atom_index,
-				    const double origin[3],
-				    const double symprec,
-				    const int is_identity)
-{
-  int i, j;
-  double vec[3];
+  mem_free(distance);
+  distance = NULL;
+  mat_free_VecDBL(vec);
+  vec = NULL;
 
-  for (i = 0; i < cell->size; i++) {
-    if (cell->types[i] != cell->types[min_atom_index]) {
-      continue;
-    }
+  return 1;
 
-    for (j = 0; j < 3; j++) {
-      vec[j] = cell->position[i][j] - origin[j];
-    }
-    if (is_overlap_all_atoms(vec,
-			     rot,
-			     cell,
-			     symprec,
-			     is_identity)) {
-      lat_point_atoms[i] = 1;
-    }
+ err:
+  for (i = 0; i < num_rot; i++) {
+    mat_free_VecDBL(trans[i]);
+    trans[i] = NULL;
   }
+  mem_free(distance);
+  distance = NULL;
+  mat_free_VecDBL(vec);
+  vec = NULL;
+  return 0;
 }
 
-static int is_overlap_all_atoms(const double trans[3],
-				SPGCONST int rot[3][3],
-				SPGCONST Cell * cell,
-				const double symprec,
-				const int is_identity)
+/* Translations x_j - R x_min to the atoms j of the type of */
+/* min_atom_index, in the order of j, for each rotation in turn. */
+/* NULL is returned if memory could not be allocated. */
+static VecDBL * get_candidates(SPGCONST Cell * cell,
+			       SPGCONST int (*rot)[3][3],
+			       const int num_rot,
+			       const int min_atom_index)
 {
-  int i, j, k, is_found;
-  double symprec2;
-  double pos_rot[3], d[3];
+  int i, j, k, num_candidates;
+  double origin[3];
+  VecDBL *vec;
 
-  symprec2 = symprec*symprec;
-  
+  num_candidates = 0;
   for (i = 0; i < cell->size; i++) {
-    if (is_identity) { /* Identity matrix is treated as special for speed. */
-      for (j = 0; j < 3; j++) {
-	pos_rot[j] = cell->position[i][j] + trans[j];
-      }
-    } else {
-      mat_multiply_matrix_vector_id3(pos_rot,
-				     rot,
-				     cell->position[i]);
-      for (j = 0; j < 3; j++) {
-	pos_rot[j] += trans[j];
-      }
+    if (cell->types[i] == cell->types[min_atom_index]) {
+      num_candidates++;
     }
+  }
+
+  if ((vec = mat_alloc_VecDBL(num_rot * num_candidates)) == NULL) {
+    return NULL;
+  }
 
-    is_found = 0;
+  num_candidates = 0;
+  for (i = 0; i < num_rot; i++) {
+    /* Set min_atom_index as the origin to measure the distance */
+    /* between atoms. */
+    mat_multiply_matrix_vector_id3(origin,
+				   rot[i],
+				   cell->position[min_atom_index]);
     for (j = 0; j < cell->size; j++) {
-      if (cell->types[i] == cell->types[j]) {
-	/* here cel_is_overlap can be used, but for the tuning */
-	/* purpose, write it again */
+      if (cell->types[j] == cell->types[min_atom_index]) {
 	for (k = 0; k < 3; k++) {
-	  d[k] = pos_rot[k] - cell->position[j][k];
-	  d[k] -= mat_Nint(d[k]);
-	}
-	mat_multiply_matrix_vector_d3(d, cell->lattice, d);
-	if (d[0]*d[0]+d[1]*d[1]+d[2]*d[2] < symprec2) {
-	  is_found = 1;
-	  break;
+	  vec->vec[num_candidates][k] = cell->position[j][k] - origin[k];
 	}
+	num_candidates++;
       }
     }
-
-    if (! is_found) {
-      goto not_found;
-    }
   }
 
-  return 1;  /* found */
-
- not_found:
-  return 0;
+  return vec;
 }
 
-static int get_index_with_least_atoms(const Cell *cell)
+/* Operation k made of rot[k / num_candidates] and vec[k] is checked */
+/* and distance[k] is set to the overlap distance or, unless */
+/* is_distance, to 0 if all atoms overlap, and to -1 otherwise. */
+/* Pure translations are found by check_pure_translations, where */
+/* is_bound is set (it may be NULL unless is_distance). All the other */
+/* operations form one loop which is shared by threads dynamically. */
+/* Whether threads are worth starting is decided from the time taken */
+/* by the first operations, checked serially. */
+/* 0 is returned if memory could not be allocated. */
+static int check_operations(double distance[],
+			    int is_bound[],
+			    const OverlapChecker *checker,
+			    SPGCONST int (*rot)[3][3],
+			    SPGCONST double (*vec)[3],
+			    const int num_rot,
+			    const int num_candidates,
+			    const int min_atom_index,
+			    const int is_distance)
 {
-  int i, j, min, min_index;
-  int *mapping;
-  mapping = (int *) malloc(sizeof(int) * cell->size);
-  
-  for (i = 0; i < cell->size; i++) {
+  int i, k, num_operations, num_probed, pure_rot;
+  int hint[OVL_NUM_HINTS];
+
+#ifdef _OPENMP
+  int j, chunk;
+  double work;
+#endif
+
+  num_operations = num_rot * num_candidates;
+  for (i = 0; i < num_operations; i++) {
+    if (is_bound != NULL) {
+      is_bound[i] = 0;
+    }
+  }
+
+  pure_rot = -1;
+  for (i = 0; i < num_rot; i++) {
+    if (mat_check_identity_matrix_i3(rot[i], identity)) {
+      pure_rot = i;
+      break;
+    }
+  }
+  if (pure_rot > -1) {
+    if (! check_pure_translations(distance + pure_rot * num_candidates,
+				  is_bound == NULL ? NULL :
+				  is_bound + pure_rot * num_candidates,
+				  checker,
+				  vec + pure_rot * num_candidates,
+				  num_candidates,
+				  min_atom_index,
+				  is_distance)) {
+      return 0;
+    }
+    /* Operation i of the loop below is k = i, or i + num_candidates */
+    /* after the pure translations. */
+    num_operations -= num_candidates;
+  }
+
+  for (i = 0; i < OVL_NUM_HINTS; i++) {
+    hint[i] = -1;
+  }
+
+#ifdef _OPENMP
+  if (omp_in_parallel() || omp_get_max_threads() < 2) {
+    num_probed = num_operations;
+  } else {
+    num_probed = num_operations < NUM_PROBED_OPERATIONS ?
+      num_operations : NUM_PROBED_OPERATIONS;
+  }
+  work = omp_get_wtime();
+#else
+  num_probed = num_operations;
+#endif
+
+  for (i = 0; i < num_probed; i++) {
+    k = (pure_rot < 0 || i < pure_rot * num_candidates) ?
+      i : i + num_candidates;
+    distance[k] = check_operation(checker,
+				  rot[k / num_candidates],
+				  vec[k],
+				  is_distance,
+				  hint);
+  }
+
+#ifdef _OPENMP
+  if (num_probed == num_operations) {
+    return 1;
+  }
+
+  /* Serial time estimated for the rest */
+  work = (omp_get_wtime() - work) / num_probed *
+    (num_operations - num_probed);
+
+  if (work < PARALLEL_WORK_RATIO * PARALLEL_OVERHEAD_PER_THREAD *
+      omp_get_max_threads()) {
+    for (i = num_probed; i < num_operations; i++) {
+      k = (pure_rot < 0 || i < pure_rot * num_candidates) ?
+	i : i + num_candidates;
+      distance[k] = check_operation(checker,
+				    rot[k / num_candidates],
+				    vec[k],
+				    is_distance,
+				    hint);
+    }
+    return 1;
+  }
+
+  chunk = (num_operations - num_probed) / (omp_get_max_threads() * 16);
+  if (chunk < 1) {
+    chunk = 1;
+  }
+
+  /* Each thread keeps its own hint. */
+#pragma omp parallel private(j, k, hint)
+  {
+    for (j = 0; j < OVL_NUM_HINTS; j++) {
+      hint[j] = -1;
+    }
+#pragma omp for schedule(dynamic, chunk)
+    for (i = num_probed; i < num_operations; i++) {
+      k = (pure_rot < 0 || i < pure_rot * num_candidates) ?
+	i : i + num_candidates;
+      distance[k] = check_operation(checker,
+				    rot[k / num_candidates],
+				    vec[k],
+				    is_distance,
+				    hint);
+    }
+  }
+#endif
+
+  return 1;
+}
+
+static double check_operation(const OverlapChecker *checker,
+			      SPGCONST int rot[3][3],
+			      const double vec[3],
+			      const int is_distance,
+			      int hint[])
+{
+  if (is_distance) {
+    return ovl_get_overlap_distance(checker, vec, rot, 0, hint);
+  }
+
+  if (ovl_check_total_overlap_with_hint(checker, vec, rot, 0, hint)) {
+    return 0;
+  } else {
+    return -1;
+  }
+}
+
+/* Pure translations x_j - x_min form a group. Let t1 and t2 be */
+/* accepted with largest distances e1 and e2, and m2 be the mapping of */
+/* atoms by t2. By the triangle inequality, the candidate to the atom */
+/* m2(j1), where x_j1 = x_min + t1, is accepted with a largest distance */
+/* not larger than e1 + 2 * e2. While this bound is well below */
+/* symprec, such candidates are accepted without being checked, and */
+/* the square of the bound is set to distance with is_bound. */
+/* Candidates are checked from the shortest, so that a few of them */
+/* generate the others, e.g., three for a supercell. */
+/* 0 is returned if memory could not be allocated. */
+static int check_pure_translations(double distance[],
+				   int is_bound[],
+				   const OverlapChecker *checker,
+				   SPGCONST double (*vec)[3],
+				   const int num_candidates,
+				   const int min_atom_index,
+				   const int is_distance)
+{
+  int i, j, k, c, num_generators, num_accepted, num_extended, is_closed;
+  int is_found;
+  int hint[OVL_NUM_HINTS];
+  int *candidate_index, *candidate_atom, *accepted, *status;
+  int *mapping[MAX_NUM_GENERATORS];
+  double dist, max_bound;
+  double d[3];
+  double generator_bound[MAX_NUM_GENERATORS];
+  double *bound;
+  TranslationKey *key;
+  SPGCONST Cell *cell;
+
+  cell = checker->cell;
+  is_found = 0;
+  num_generators = 0;
+  candidate_index = (int*) mem_malloc(sizeof(int) * cell->size);
+  candidate_atom = (int*) mem_malloc(sizeof(int) * (num_candidates + 1));
+  accepted = (int*) mem_malloc(sizeof(int) * (num_candidates + 1));
+  status = (int*) mem_malloc(sizeof(int) * (num_candidates + 1));
+  bound = (double*) mem_malloc(sizeof(double) * (num_candidates + 1));
+  key = (TranslationKey*) mem_malloc(sizeof(TranslationKey) *
+				     (num_candidates + 1));
+  if (candidate_index == NULL || candidate_atom == NULL || accepted == NULL ||
+      status == NULL || bound == NULL || key == NULL) {
+    goto ret;
+  }
+
+  /* Derived translations have to stay within the search window. */
+  is_closed = 1;
+  for (i = 0; i < 3; i++) {
+    if (checker->width[i] >= 1) {
+      is_closed = 0;
+    }
+  }
+  max_bound = checker->symprec * CLOSURE_TOLERANCE_RATIO;
+
+  k = 0;
+  for (i = 0; i < cell->size; i++) {
+    candidate_index[i] = -1;
+    if (cell->types[i] == cell->types[min_atom_index] &&
+	k < num_candidates) {
+      candidate_index[i] = k;
+      candidate_atom[k] = i;
+      k++;
+    }
+  }
+
+  for (i = 0; i < num_candidates; i++) {
+    for (j = 0; j < 3; j++) {
+      d[j] = vec[i][j] - mat_Nint(vec[i][j]);
+    }
+    mat_multiply_matrix_vector_d3(d, cell->lattice, d);
+    key[i].length = mat_norm_squared_d3(d);
+    key[i].index = i;
+    status[i] = 0;
+  }
+  qsort(key, num_candidates, sizeof(TranslationKey), compare_translation_key);
+
+  for (i = 0; i < OVL_NUM_HINTS; i++) {
+    hint[i] = -1;
+  }
+
+  num_accepted = 0;
+  num_extended = 0;
+  for (i = 0; i < num_candidates; i++) {
+    k = key[i].index;
+    if (status[k] != 0) {
+      continue;
+    }
+
+    if (is_closed && num_generators < MAX_NUM_GENERATORS) {
+      if ((mapping[num_generators] =
+	   (int*) mem_malloc(sizeof(int) * cell->size)) == NULL) {
+	goto ret;
+      }
+      dist = ovl_get_overlap_mapping(mapping[num_generators],
+				     checker,
+				     vec[k],
+				     identity,
+				     1,
+				     hint);
+    } else {
+      dist = ovl_get_overlap_distance(checker, vec[k], identity, 1, hint);
+    }
+
+    if (dist < 0) {
+      status[k] = -1;
+      distance[k] = -1;
+      if (is_closed && num_generators < MAX_NUM_GENERATORS) {
+	mem_free(mapping[num_generators]);
+	mapping[num_generators] = NULL;
+      }
+      continue;
+    }
+
+    status[k] = 1;
+    distance[k] = is_distance ? dist : 0;
+    accepted[num_accepted] = k;
+    bound[num_accepted] = sqrt(dist);
+    num_accepted++;
+
+    if (! is_closed) {
+      continue;
+    }
+
+    /* The new generator is applied to the translations so far, */
+    /* and all generators to the translations found from now. */
+    if (num_generators < MAX_NUM_GENERATORS) {
+      generator_bound[num_generators] = sqrt(dist);
+      num_generators++;
+      for (j = 0; j < num_extended; j++) {
+	c = candidate_index[mapping[num_generators - 1]
+			    [candidate_atom[accepted[j]]]];
+	dist = bound[j] + 2 * generator_bound[num_generators - 1];
+	if (c > -1 && status[c] == 0 && dist < max_bound) {
+	  status[c] = 1;
+	  distance[c] = is_distance ? dist * dist : 0;
+	  if (is_bound != NULL) {
+	    is_bound[c] = 1;
+	  }
+	  accepted[num_accepted] = c;
+	  bound[num_accepted] = dist;
+	  num_accepted++;
+	}
+      }
+    }
+    for (; num_extended < num_accepted; num_extended++) {
+      for (j = 0; j < num_generators; j++) {
+	c = candidate_index[mapping[j][candidate_atom[accepted[num_extended]]]];
+	dist = bound[num_extended] + 2 * generator_bound[j];
+	if (c > -1 && status[c] == 0 && dist < max_bound) {
+	  status[c] = 1;
+	  distance[c] = is_distance ? dist * dist : 0;
+	  if (is_bound != NULL) {
+	    is_bound[c] = 1;
+	  }
+	  accepted[num_accepted] = c;
+	  bound[num_accepted] = dist;
+	  num_accepted++;
+	}
+      }
+    }
+  }
+
+  debug_print("check_pure_translations: %d accepted, %d generators\n",
+	      num_accepted, num_generators);
+  is_found = 1;
+
+ ret:
+  for (i = 0; i < num_generators; i++) {
+    mem_free(mapping[i]);
+    mapping[i] = NULL;
+  }
+  mem_free(key);
+  key = NULL;
+  mem_free(bound);
+  bound = NULL;
+  mem_free(status);
+  status = NULL;
+  mem_free(accepted);
+  accepted = NULL;
+  mem_free(candidate_atom);
+  candidate_atom = NULL;
+  mem_free(candidate_index);
+  candidate_index = NULL;
+  return is_found;
+}
+
+static int compare_translation_key(const void *a, const void *b)
+{
+  const TranslationKey *ka, *kb;
+
+  ka = (const TranslationKey*) a;
+  kb = (const TranslationKey*) b;
+
+  if (ka->length < kb->length) {
+    return -1;
+  }
+  if (ka->length > kb->length) {
+    return 1;
+  }
+  return ka->index - kb->index;
+}
+
+/* -1 is returned if memory could not be allocated. */
+static int get_index_with_least_atoms(const Cell *cell)
+{
+  int i, j, min, min_index;
+  int *mapping;
+  if ((mapping = (int *) mem_malloc(sizeof(int) * cell->size)) == NULL) {
+    return -1;
+  }
+  
+  for (i = 0; i < cell->size; i++) {
     mapping[i] = 0;
   }
   
@@ -562,7 +1486,7 @@ static int get_index_with_least_atoms(const Cell *cell)
     }
   }
 
-  free(mapping);
+  mem_free(mapping);
   mapping = NULL;
 
   return min_index;
@@ -571,22 +1495,66 @@ static int get_index_with_least_atoms(const Cell *cell)
 static Symmetry *
 get_space_group_operations(SPGCONST PointSymmetry *lattice_sym,
 			   SPGCONST Cell *cell,
-			   const double symprec)
+			   const double symprec,
+			   SymmetryCache * cache)
 {
   int i, j, num_sym, total_num_sym;
   VecDBL **trans;
   Symmetry *symmetry;
+  OverlapChecker *checker;
+  CachedCell *cached;
 
   debug_print("get_space_group_operations:\n");
   
-  trans = (VecDBL**) malloc(sizeof(VecDBL*) * lattice_sym->size);
+  symmetry = NULL;
+  checker = NULL;
+  cached = NULL;
+  if (cache == NULL) {
+    if ((checker = ovl_overlap_checker_init(cell, symprec)) == NULL) {
+      return NULL;
+    }
+  } else {
+    if ((cached = get_cached_cell(cache, cell, symprec)) == NULL) {
+      return NULL;
+    }
+  }
+  if ((trans = (VecDBL**) mem_malloc(sizeof(VecDBL*) * lattice_sym->size))
+      == NULL) {
+    ovl_overlap_checker_free(checker);
+    return NULL;
+  }
   total_num_sym = 0;
+  if (cache == NULL) {
+    if (! get_translations(trans,
+			   lattice_sym->rot,
+			   lattice_sym->size,
+			   checker)) {
+      total_num_sym = -1;
+    }
+  } else {
+    if (! add_cached_rotations(cached, lattice_sym->rot, lattice_sym->size)) {
+      total_num_sym = -1;
+    }
+    for (i = 0; i < lattice_sym->size; i++) {
+      trans[i] = total_num_sym < 0 ? NULL :
+	get_cached_translation(cached, lattice_sym->rot[i], symprec);
+    }
+  }
   for (i = 0; i < lattice_sym->size; i++) {
-    trans[i] = get_translation(lattice_sym->rot[i], cell, symprec, 0);
-    total_num_sym += trans[i]->size;
+    if (trans[i] == NULL) {
+      total_num_sym = -1;
+    } else if (total_num_sym > -1) {
+      total_num_sym += trans[i]->size;
+    }
   }
+  ovl_overlap_checker_free(checker);
 
-  symmetry = sym_alloc_symmetry(total_num_sym);
+  if (total_num_sym < 0) {
+    goto ret;
+  }
+  if ((symmetry = sym_alloc_symmetry(total_num_sym)) == NULL) {
+    goto ret;
+  }
   num_sym = 0;
   for (i = 0; i < lattice_sym->size; i++) {
     for (j = 0; j < trans[i]->size; j++) {
@@ -596,15 +1564,370 @@ get_space_group_operations(SPGCONST PointSymmetry *lattice_sym,
     num_sym += trans[i]->size;
   }
 
+ ret:
   for (i = 0; i < lattice_sym->size; i++) {
     mat_free_VecDBL(trans[i]);
   }
-  free(trans);
+  mem_free(trans);
   trans = NULL;
 
   return symmetry;
 }
 
+/* An entry built with a tolerance not smaller than symprec is reused. */
+/* Otherwise the oldest entry is replaced. */
+/* NULL is returned if memory could not be allocated. */
+static CachedCell * get_cached_cell(SymmetryCache * cache,
+				    SPGCONST Cell * cell,
+				    const double symprec)
+{
+  int i;
+  CachedCell *cached;
+
+  for (i = 0; i < NUM_CACHED_CELLS; i++) {
+    cached = cache->cells[i];
+    if (cached != NULL &&
+	cached->checker->symprec >= symprec &&
+	is_same_cell(cached->cell, cell)) {
+      return cached;
+    }
+  }
+
+  if ((cached = alloc_cached_cell(cell, symprec)) == NULL) {
+    return NULL;
+  }
+  free_cached_cell(cache->cells[cache->next]);
+  cache->cells[cache->next] = cached;
+  cache->next = (cache->next + 1) % NUM_CACHED_CELLS;
+
+  return cached;
+}
+
+/* NULL is returned if memory could not be allocated. */
+static CachedCell * alloc_cached_cell(SPGCONST Cell * cell,
+				      const double symprec)
+{
+  CachedCell *cached;
+
+  if ((cached = (CachedCell*) mem_malloc(sizeof(CachedCell))) == NULL) {
+    return NULL;
+  }
+  cached->checker = NULL;
+  cached->num_rot = 0;
+  if ((cached->cell = cel_copy_cell(cell)) == NULL) {
+    goto err;
+  }
+  if ((cached->min_atom_index = get_index_with_least_atoms(cell)) < 0) {
+    goto err;
+  }
+  if ((cached->checker = ovl_overlap_checker_init(cached->cell, symprec))
+      == NULL) {
+    goto err;
+  }
+
+  return cached;
+
+ err:
+  free_cached_cell(cached);
+  return NULL;
+}
+
+static void free_cached_cell(CachedCell * cached)
+{
+  int i;
+
+  if (cached == NULL) {
+    return;
+  }
+  for (i = 0; i < cached->num_rot; i++) {
+    free_cached_rotation(&cached->rot[i]);
+  }
+  ovl_overlap_checker_free(cached->checker);
+  cached->checker = NULL;
+  cel_free_cell(cached->cell);
+  cached->cell = NULL;
+  mem_free(cached);
+  cached = NULL;
+}
+
+static int is_same_cell(SPGCONST Cell * a, SPGCONST Cell * b)
+{
+  int i, j;
+
+  if (a->size != b->size) {
+    return 0;
+  }
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      if (a->lattice[i][j] != b->lattice[i][j]) {
+	return 0;
+      }
+    }
+  }
+  for (i = 0; i < a->size; i++) {
+    if (a->types[i] != b->types[i]) {
+      return 0;
+    }
+    for (j = 0; j < 3; j++) {
+      if (a->position[i][j] != b->position[i][j]) {
+	return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+/* Same translations in the same order as get_translation with */
+/* a checker of symprec. */
+/* NULL is returned if memory could not be allocated. */
+static VecDBL * get_cached_translation(CachedCell * cached,
+				       SPGCONST int rot[3][3],
+				       const double symprec)
+{
+  int i, num_trans;
+  double symprec2;
+  VecDBL *trans;
+  CachedRotation *cached_rot;
+  CachedRotation tmp_rot;
+
+  if ((cached_rot = get_cached_rotation(cached, rot, &tmp_rot)) == NULL) {
+    return NULL;
+  }
+
+  symprec2 = symprec * symprec;
+  refine_cached_distances(cached_rot, cached, symprec2);
+  num_trans = 0;
+  for (i = 0; i < cached_rot->trans->size; i++) {
+    if (cached_rot->distance[i] < symprec2) {
+      num_trans++;
+    }
+  }
+
+  if ((trans = mat_alloc_VecDBL(num_trans)) != NULL) {
+    num_trans = 0;
+    for (i = 0; i < cached_rot->trans->size; i++) {
+      if (cached_rot->distance[i] < symprec2) {
+	mat_copy_vector_d3(trans->vec[num_trans], cached_rot->trans->vec[i]);
+	num_trans++;
+      }
+    }
+  }
+
+  if (cached_rot == &tmp_rot) {
+    free_cached_rotation(&tmp_rot);
+  }
+
+  return trans;
+}
+
+/* When the table is full, the rotation is set to tmp_rot, which */
+/* has to be freed by the caller. */
+/* NULL is returned if memory could not be allocated. */
+static CachedRotation * get_cached_rotation(CachedCell * cached,
+					    SPGCONST int rot[3][3],
+					    CachedRotation * tmp_rot)
+{
+  int i;
+  int rots[1][3][3];
+  CachedRotation *cached_rot;
+
+  for (i = 0; i < cached->num_rot; i++) {
+    if (mat_check_identity_matrix_i3(cached->rot[i].rot, rot)) {
+      return &cached->rot[i];
+    }
+  }
+
+  if (cached->num_rot < NUM_CACHED_ROTATIONS) {
+    cached_rot = &cached->rot[cached->num_rot];
+  } else {
+    cached_rot = tmp_rot;
+  }
+  mat_copy_matrix_i3(rots[0], rot);
+  if (! set_cached_rotations(cached_rot, cached, rots, 1)) {
+    return NULL;
+  }
+  if (cached_rot != tmp_rot) {
+    cached->num_rot++;
+  }
+
+  return cached_rot;
+}
+
+/* Rotations missing in the table are computed together, as many as */
+/* fit, so that all their candidates are checked in one loop. */
+/* 0 is returned if memory could not be allocated. */
+static int add_cached_rotations(CachedCell * cached,
+				SPGCONST int (*rot)[3][3],
+				const int num_rot)
+{
+  int i, j, num_new;
+  int new_rot[NUM_CACHED_ROTATIONS][3][3];
+
+  num_new = 0;
+  for (i = 0; i < num_rot; i++) {
+    if (cached->num_rot + num_new == NUM_CACHED_ROTATIONS) {
+      break;
+    }
+    for (j = 0; j < cached->num_rot; j++) {
+      if (mat_check_identity_matrix_i3(cached->rot[j].rot, rot[i])) {
+	break;
+      }
+    }
+    if (j < cached->num_rot) {
+      continue;
+    }
+    for (j = 0; j < num_new; j++) {
+      if (mat_check_identity_matrix_i3(new_rot[j], rot[i])) {
+	break;
+      }
+    }
+    if (j < num_new) {
+      continue;
+    }
+    mat_copy_matrix_i3(new_rot[num_new], rot[i]);
+    num_new++;
+  }
+
+  if (! set_cached_rotations(cached->rot + cached->num_rot,
+			     cached,
+			     new_rot,
+			     num_new)) {
+    return 0;
+  }
+  cached->num_rot += num_new;
+
+  return 1;
+}
+
+/* 0 is returned if memory could not be allocated. */
+static int set_cached_rotations(CachedRotation cached_rot[],
+				const CachedCell * cached,
+				SPGCONST int (*rot)[3][3],
+				const int num_rot)
+{
+  int i, j, k, num_trans, num_candidates;
+  int *is_bound;
+  double *distance;
+  VecDBL *vec;
+
+  for (i = 0; i < num_rot; i++) {
+    mat_copy_matrix_i3(cached_rot[i].rot, rot[i]);
+    cached_rot[i].trans = NULL;
+    cached_rot[i].distance = NULL;
+    cached_rot[i].is_bound = NULL;
+  }
+  if (num_rot < 1) {
+    return 1;
+  }
+
+  distance = NULL;
+  is_bound = NULL;
+  if ((vec = get_candidates(cached->cell, rot, num_rot, cached->min_atom_index))
+      == NULL) {
+    goto err;
+  }
+  num_candidates = vec->size / num_rot;
+  distance = (double*) mem_malloc(sizeof(double) * (vec->size + 1));
+  is_bound = (int*) mem_malloc(sizeof(int) * (vec->size + 1));
+  if (distance == NULL || is_bound == NULL) {
+    goto err;
+  }
+
+  if (! check_operations(distance,
+			 is_bound,
+			 cached->checker,
+			 rot,
+			 vec->vec,
+			 num_rot,
+			 num_candidates,
+			 cached->min_atom_index,
+			 1)) {
+    goto err;
+  }
+
+  for (i = 0; i < num_rot; i++) {
+    num_trans = 0;
+    for (j = 0; j < num_candidates; j++) {
+      if (distance[i * num_candidates + j] > -1) {
+	num_trans++;
+      }
+    }
+    cached_rot[i].trans = mat_alloc_VecDBL(num_trans);
+    cached_rot[i].distance =
+      (double*) mem_malloc(sizeof(double) * (num_trans + 1));
+    cached_rot[i].is_bound = (int*) mem_malloc(sizeof(int) * (num_trans + 1));
+    if (cached_rot[i].trans == NULL ||
+	cached_rot[i].distance == NULL ||
+	cached_rot[i].is_bound == NULL) {
+      goto err;
+    }
+    num_trans = 0;
+    for (j = 0; j < num_candidates; j++) {
+      k = i * num_candidates + j;
+      if (distance[k] > -1) {
+	mat_copy_vector_d3(cached_rot[i].trans->vec[num_trans], vec->vec[k]);
+	cached_rot[i].distance[num_trans] = distance[k];
+	cached_rot[i].is_bound[num_trans] = is_bound[k];
+	num_trans++;
+      }
+    }
+  }
+
+  mem_free(is_bound);
+  is_bound = NULL;
+  mem_free(distance);
+  distance = NULL;
+  mat_free_VecDBL(vec);
+  vec = NULL;
+
+  return 1;
+
+ err:
+  for (i = 0; i < num_rot; i++) {
+    free_cached_rotation(&cached_rot[i]);
+  }
+  mem_free(is_bound);
+  is_bound = NULL;
+  mem_free(distance);
+  distance = NULL;
+  mat_free_VecDBL(vec);
+  vec = NULL;
+  return 0;
+}
+
+static void free_cached_rotation(CachedRotation * cached_rot)
+{
+  mat_free_VecDBL(cached_rot->trans);
+  cached_rot->trans = NULL;
+  mem_free(cached_rot->distance);
+  cached_rot->distance = NULL;
+  mem_free(cached_rot->is_bound);
+  cached_rot->is_bound = NULL;
+}
+
+/* Distances only bounded from above and not below symprec2 are */
+/* replaced by the distances. */
+static void refine_cached_distances(CachedRotation * cached_rot,
+				    const CachedCell * cached,
+				    const double symprec2)
+{
+  int i;
+
+  for (i = 0; i < cached_rot->trans->size; i++) {
+    if (cached_rot->is_bound[i] && cached_rot->distance[i] >= symprec2) {
+      cached_rot->distance[i] =
+	ovl_get_overlap_distance(cached->checker,
+				 cached_rot->trans->vec[i],
+				 cached_rot->rot,
+				 mat_check_identity_matrix_i3(cached_rot->rot,
+							      identity),
+				 NULL);
+      cached_rot->is_bound[i] = 0;
+    }
+  }
+}
+
 static Symmetry * recover_operations_original(SPGCONST Symmetry *symmetry,
 					      const VecDBL * pure_trans,
 					      SPGCONST Cell *cell,
@@ -617,8 +1940,13 @@ static Symmetry * recover_operations_original(SPGCONST Symmetry *symmetry,
   debug_print("recover_operations_original:\n");
 
   multi = pure_trans->size;
-  sym_tmp = sym_alloc_symmetry(symmetry->size);
-  symmetry_orig = sym_alloc_symmetry(symmetry->size * multi);
+  if ((sym_tmp = sym_alloc_symmetry(symmetry->size)) == NULL) {
+    return NULL;
+  }
+  if ((symmetry_orig = sym_alloc_symmetry(symmetry->size * multi)) == NULL) {
+    sym_free_symmetry(sym_tmp);
+    return NULL;
+  }
 
   mat_inverse_matrix_d3(inv_prim_lat, primitive->lattice, 0);
   mat_multiply_matrix_d3(trans_mat, inv_prim_lat, cell->lattice);
@@ -656,7 +1984,8 @@ static Symmetry * recover_operations_original(SPGCONST Symmetry *symmetry,
 }
 
 static PointSymmetry get_lattice_symmetry(SPGCONST Cell *cell,
-					  const double symprec)
+					  const double symprec,
+					  const double angle_tolerance)
 {
   int i, j, k, num_sym;
   int axes[3][3];
@@ -686,17 +2015,19 @@ static PointSymmetry get_lattice_symmetry(SPGCONST Cell *cell,
 	mat_multiply_matrix_di3(lattice, min_lattice, axes);
 	mat_get_metric(metric, lattice);
 	
-	if (is_identity_metric(metric, metric_orig, symprec)) {
+	if (is_identity_metric(metric,
+			       metric_orig,
+			       symprec,
+			       angle_tolerance)) {
+	  if (num_sym == 48) {
+	    warning_print("spglib: Too many lattice symmetries was found.\n");
+	    warning_print("        Tolerance may be too large ");
+	    warning_print("(line %d, %s).\n", __LINE__, __FILE__);
+	    goto err;
+	  }
 	  mat_copy_matrix_i3(lattice_sym.rot[num_sym], axes);
 	  num_sym++;
 	}
-	  
-	if (num_sym > 48) {
-	  warning_print("spglib: Too many lattice symmetries was found.\n");
-	  warning_print("        Tolerance may be too large ");
-	  warning_print("(line %d, %s).\n", __LINE__, __FILE__);
-	  goto err;
-	}
       }
     }
   }
@@ -713,7 +2044,8 @@ static PointSymmetry get_lattice_symmetry(SPGCONST Cell *cell,
 
 static int is_identity_metric(SPGCONST double metric_rotated[3][3],
 			      SPGCONST double metric_orig[3][3],
-			      const double symprec)
+			      const double symprec,
+			      const double angle_tolerance)
 {
   int i, j, k;
   int elem_sets[3][2] = {{0, 1},
@@ -763,6 +2095,100 @@ static int is_identity_metric(SPGCONST double metric_rotated[3][3],
   return 0;
 }
 
+/* Tolerances at which the rotations found by get_lattice_symmetry */
+/* start to be accepted. With angle_tolerance > 0, only the lengths */
+/* depend on symprec. */
+static int get_lattice_tolerances(double tolerances[],
+				  SPGCONST Cell *cell,
+				  const double symprec,
+				  const double angle_tolerance)
+{
+  int i, j, k, num_tol;
+  int axes[3][3];
+  double lattice[3][3], min_lattice[3][3];
+  double metric[3][3], metric_orig[3][3];
+
+  if (! lat_smallest_lattice_vector(min_lattice,
+				    cell->lattice,
+				    symprec)) {
+    return 0;
+  }
+
+  mat_get_metric(metric_orig, min_lattice);
+
+  num_tol = 0;
+  for (i = 0; i < 26; i++) {
+    for (j = 0; j < 26; j++) {
+      for (k = 0; k < 26; k++) {
+	set_axes(axes, i, j, k);
+	if (! ((mat_get_determinant_i3(axes) == 1) ||
+	       (mat_get_determinant_i3(axes) == -1))) {
+	  continue;
+	}
+	mat_multiply_matrix_di3(lattice, min_lattice, axes);
+	mat_get_metric(metric, lattice);
+
+	if (num_tol < 48 &&
+	    is_identity_metric(metric,
+			       metric_orig,
+			       symprec,
+			       angle_tolerance)) {
+	  tolerances[num_tol] = get_metric_tolerance(metric,
+						     metric_orig,
+						     angle_tolerance);
+	  num_tol++;
+	}
+      }
+    }
+  }
+
+  return num_tol;
+}
+
+/* Smallest symprec with which is_identity_metric accepts the */
+/* metrics, as far as its conditions depend on symprec. */
+static double get_metric_tolerance(SPGCONST double metric_rotated[3][3],
+				   SPGCONST double metric_orig[3][3],
+				   const double angle_tolerance)
+{
+  int i, j, k;
+  int elem_sets[3][2] = {{0, 1},
+			 {0, 2},
+			 {1, 2}};
+  double cos1, cos2, x, length_ave2, sin_dtheta2, tolerance;
+  double length_orig[3], length_rot[3];
+
+  tolerance = 0;
+  for (i = 0; i < 3; i++) {
+    length_orig[i] = sqrt(metric_orig[i][i]);
+    length_rot[i] = sqrt(metric_rotated[i][i]);
+    if (mat_Dabs(length_orig[i] - length_rot[i]) > tolerance) {
+      tolerance = mat_Dabs(length_orig[i] - length_rot[i]);
+    }
+  }
+
+  if (angle_tolerance > 0) {
+    return tolerance;
+  }
+
+  for (i = 0; i < 3; i++) {
+    j = elem_sets[i][0];
+    k = elem_sets[i][1];
+    cos1 = metric_orig[j][k] / length_orig[j] / length_orig[k];
+    cos2 = metric_rotated[j][k] / length_rot[j] / length_rot[k];
+    x = cos1 * cos2 + sqrt(1 - cos1 * cos1) * sqrt(1 - cos2 * cos2);
+    sin_dtheta2 = 1 - x * x;
+    length_ave2 = ((length_orig[j] + length_rot[j]) *
+		   (length_orig[k] + length_rot[k])) / 4;
+    if (sin_dtheta2 > 1e-12 &&
+	sqrt(sin_dtheta2 * length_ave2) > tolerance) {
+      tolerance = sqrt(sin_dtheta2 * length_ave2);
+    }
+  }
+
+  return tolerance;
+}
+
 static double get_angle(SPGCONST double metric[3][3],
 			const int i,
 			const int j)
@@ -828,3 +2254,237 @@ static void set_axes(int axes[3][3],
   for (i = 0; i < 3; i++) {axes[i][1] = relative_axes[a2][i]; }
   for (i = 0; i < 3; i++) {axes[i][2] = relative_axes[a3][i]; }
 }
+
+/* The moved atoms have to be mapped onto atoms. So do the atoms */
+/* mapped onto the original positions of the moved atoms, which are */
+/* searched within twice symprec not to miss them by the distortion */
+/* of rot. The other atoms are mapped as they are without perturbation. */
+static int is_perturbed_operation(int atoms[],
+				  int preimages[],
+				  double distances[],
+				  const OverlapChecker * checker,
+				  SPGCONST int rot[3][3],
+				  const double trans[3],
+				  const int moved[],
+				  SPGCONST double moved_position[][3],
+				  const int num_moved,
+				  const double symprec)
+{
+  int i, j, k, num_found;
+  double pos[3], diff[3], inv_rot[3][3], rot_d[3][3];
+
+  for (i = 0; i < num_moved; i++) {
+    mat_multiply_matrix_vector_id3(pos, rot, moved_position[i]);
+    for (j = 0; j < 3; j++) {
+      pos[j] += trans[j];
+    }
+    if (! has_perturbed_overlap(atoms,
+				distances,
+				checker,
+				pos,
+				moved[i],
+				moved,
+				moved_position,
+				num_moved,
+				symprec)) {
+      return 0;
+    }
+  }
+
+  mat_cast_matrix_3i_to_3d(rot_d, rot);
+  if (! mat_inverse_matrix_d3(inv_rot, rot_d, 0)) {
+    return 0;
+  }
+
+  for (i = 0; i < num_moved; i++) {
+    for (j = 0; j < 3; j++) {
+      diff[j] = checker->cell->position[moved[i]][j] - trans[j];
+    }
+    mat_multiply_matrix_vector_d3(pos, inv_rot, diff);
+    num_found = ovl_get_overlap_atoms(preimages,
+				      NULL,
+				      checker->cell->size,
+				      checker,
+				      pos,
+				      moved[i]);
+    for (j = 0; j < num_found; j++) {
+      if (is_moved(preimages[j], moved, num_moved)) {
+	continue;
+      }
+      mat_multiply_matrix_vector_id3(pos,
+				     rot,
+				     checker->cell->position[preimages[j]]);
+      for (k = 0; k < 3; k++) {
+	pos[k] += trans[k];
+      }
+      if (! has_perturbed_overlap(atoms,
+				  distances,
+				  checker,
+				  pos,
+				  preimages[j],
+				  moved,
+				  moved_position,
+				  num_moved,
+				  symprec)) {
+	return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+/* Atoms not moved are looked up by the checker and the moved ones */
+/* one by one. */
+static int has_perturbed_overlap(int atoms[],
+				 double distances[],
+				 const OverlapChecker * checker,
+				 const double pos[3],
+				 const int atom_index,
+				 const int moved[],
+				 SPGCONST double moved_position[][3],
+				 const int num_moved,
+				 const double symprec)
+{
+  int i, num_found;
+  SPGCONST Cell *cell;
+
+  cell = checker->cell;
+
+  num_found = ovl_get_overlap_atoms(atoms,
+				    distances,
+				    cell->size,
+				    checker,
+				    pos,
+				    atom_index);
+  for (i = 0; i < num_found; i++) {
+    if (distances[i] < symprec * symprec &&
+	! is_moved(atoms[i], moved, num_moved)) {
+      return 1;
+    }
+  }
+
+  for (i = 0; i < num_moved; i++) {
+    if (cell->types[moved[i]] == cell->types[atom_index] &&
+	cel_is_overlap(moved_position[i], pos, cell->lattice, symprec)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int is_moved(const int atom_index,
+		    const int moved[],
+		    const int num_moved)
+{
+  int i;
+
+  for (i = 0; i < num_moved; i++) {
+    if (moved[i] == atom_index) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* The translation is kept if it still moves the atoms onto their */
+/* images by permutation, otherwise it is set to the average of the */
+/* translations doing so, taken near trans_orig. */
+static int set_tracked_translation(double trans[3],
+				   SPGCONST Cell * cell,
+				   SPGCONST int rot[3][3],
+				   const double trans_orig[3],
+				   const int permutation[],
+				   const double symprec)
+{
+  int i, j;
+  double diff[3];
+
+  mat_copy_vector_d3(trans, trans_orig);
+  if (is_tracked_translation(cell, rot, trans, permutation, symprec)) {
+    return 1;
+  }
+
+  for (i = 0; i < 3; i++) {
+    diff[i] = 0;
+  }
+  for (i = 0; i < cell->size; i++) {
+    mat_multiply_matrix_vector_id3(trans, rot, cell->position[i]);
+    for (j = 0; j < 3; j++) {
+      trans[j] = cell->position[permutation[i]][j] - trans[j] - trans_orig[j];
+      diff[j] += trans[j] - mat_Nint(trans[j]);
+    }
+  }
+  for (i = 0; i < 3; i++) {
+    trans[i] = trans_orig[i] + diff[i] / cell->size;
+    trans[i] -= mat_Nint(trans[i]);
+  }
+
+  return is_tracked_translation(cell, rot, trans, permutation, symprec);
+}
+
+static int is_tracked_translation(SPGCONST Cell * cell,
+				  SPGCONST int rot[3][3],
+				  const double trans[3],
+				  const int permutation[],
+				  const double symprec)
+{
+  int i, j;
+  double pos[3];
+
+  for (i = 0; i < cell->size; i++) {
+    mat_multiply_matrix_vector_id3(pos, rot, cell->position[i]);
+    for (j = 0; j < 3; j++) {
+      pos[j] += trans[j];
+    }
+    if (! cel_is_overlap(pos,
+			 cell->position[permutation[i]],
+			 cell->lattice,
+			 symprec)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* 0 is returned and permutation is filled with -1 unless the atoms */
+/* are moved one-to-one onto atoms. is_mapped is a work array of the */
+/* size of the cell. */
+static int set_permutation(int permutation[],
+			   int is_mapped[],
+			   const OverlapChecker *checker,
+			   SPGCONST int rot[3][3],
+			   const double trans[3],
+			   const int is_identity)
+{
+  int i, size;
+
+  size = checker->cell->size;
+
+  if (ovl_get_overlap_mapping(permutation,
+			      checker,
+			      trans,
+			      rot,
+			      is_identity,
+			      NULL) > -1) {
+    for (i = 0; i < size; i++) {
+      is_mapped[i] = 0;
+    }
+    for (i = 0; i < size; i++) {
+      if (is_mapped[permutation[i]]) {
+	break;
+      }
+      is_mapped[permutation[i]] = 1;
+    }
+    if (i == size) {
+      return 1;
+    }
+  }
+
+  for (i = 0; i < size; i++) {
+    permutation[i] = -1;
+  }
+  return 0;
+}
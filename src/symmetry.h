@@ -6,6 +6,7 @@
 
 #include "cell.h"
 #include "mathfunc.h"
+#include "overlap.h"
 
 typedef struct {
   int size;
@@ -18,21 +19,60 @@ typedef struct {
   int size;
 } PointSymmetry;
 
+/* Candidate translations of a few cells and the tolerances at which */
+/* they become symmetry operations. Searches repeated on the same */
+/* cell with smaller tolerances only filter these. */
+typedef struct _SymmetryCache SymmetryCache;
+
 Symmetry * sym_alloc_symmetry( const int size );
 void sym_free_symmetry( Symmetry * symmetry );
 int sym_get_multiplicity( SPGCONST Cell * cell,
 			  const double symprec );
 Symmetry * sym_get_operation( SPGCONST Cell * cell,
-			      const double symprec );
+			      const double symprec,
+			      const double angle_tolerance,
+			      SymmetryCache * cache );
 Symmetry * sym_reduce_operation( SPGCONST Cell * cell,
 				 SPGCONST Symmetry * symmetry,
-				 const double symprec );
+				 const double symprec,
+				 const double angle_tolerance );
+Symmetry * sym_get_perturbed_operation( const OverlapChecker * checker,
+				       SPGCONST Symmetry * symmetry,
+				       const int moved[],
+				       SPGCONST double moved_position[][3],
+				       const int num_moved,
+				       const double symprec );
+int sym_get_permutations( int permutations[],
+			  SPGCONST Cell * cell,
+			  SPGCONST Symmetry * symmetry,
+			  const double symprec );
+int sym_get_image_atom( const int permutations[],
+			const OverlapChecker * checker,
+			SPGCONST Cell * cell,
+			const Symmetry * symmetry,
+			const int operation_index,
+			const int atom_index );
+Symmetry * sym_get_tracked_operation( SPGCONST Cell * cell,
+				      SPGCONST Symmetry * symmetry,
+				      const int permutations[],
+				      const double symprec,
+				      const double angle_tolerance );
 VecDBL * sym_get_pure_translation( SPGCONST Cell *cell,
-				   const double symprec );
+				   const double symprec,
+				   SymmetryCache * cache );
 VecDBL * sym_reduce_pure_translation( SPGCONST Cell * cell,
 				      const VecDBL * pure_trans,
 				      const double symprec );
-void sym_set_angle_tolerance(double tolerance);
-double sym_get_angle_tolerance(void);
+int sym_get_critical_tolerances( double tolerances[],
+				 SPGCONST Cell * cell,
+				 const double symprec,
+				 const double angle_tolerance,
+				 SymmetryCache * cache );
+int sym_get_pure_translation_tolerances( double tolerances[],
+					 SPGCONST Cell * cell,
+					 const double symprec,
+					 SymmetryCache * cache );
+SymmetryCache * sym_alloc_cache( void );
+void sym_free_cache( SymmetryCache * cache );
 
 #endif
@@ -0,0 +1,3467 @@
+/* Checks of spglib functions against brute-force enumeration and */
+/* against the plain functions on the same structures. Structures */
+/* are read from POSCAR files given as arguments, e.g. */
+/* % test_spglib data/cubic/POSCAR-225 data/hexagonal/POSCAR-194 */
+/* 0 is returned if all the checks pass. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "spglib.h"
+#include "cell.h"
+#include "mem.h"
+#include "overlap.h"
+#include "primitive.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define SYMPREC 1e-5
+#define MAP_TOLERANCE 1e-3
+#define MAX_NUM_ROT 96
+#define NUM_THREADS 4
+
+typedef struct {
+  char *name;
+  double lattice[3][3];
+  double (*position)[3];
+  int *types;
+  int num_atom;
+  int size;
+  int (*rotation)[3][3];
+  double (*translation)[3];
+} Structure;
+
+/* Work of a thread of check_threads. The expected results are those */
+/* of the same calls made serially. */
+typedef struct {
+  const Structure *st;
+  double lattice[3][3];
+  double angle_tolerance;
+  int repeat;
+  int num_failed;
+  SpglibDataset *expected;
+  int (*rotation)[3][3];
+  double (*translation)[3];
+  int size;
+} ThreadWork;
+
+static int check_context(Structure *st);
+static int check_batch(Structure *st);
+static int check_errors(Structure *st);
+static int check_allocation_failure(void);
+static int check_arena(Structure *st);
+static int check_symprec_spectrum(Structure *st);
+static int check_supercell(Structure *st);
+static int check_perturbed(Structure *st);
+static int check_tracker(Structure *st);
+static int check_permutations(Structure *st);
+static int check_permutation_rows(void);
+static int check_collinear_spin(Structure *st);
+static int check_magmoms(Structure *st);
+static int check_ir_reciprocal_mesh(Structure *st);
+static int check_ir_mesh(Structure *st);
+static int check_ir_mesh_iterator(Structure *st);
+static int check_generalized_mesh(Structure *st);
+static int check_ir_mesh_with_shift(Structure *st);
+static int check_noisy_supercell(Structure *st);
+static int check_noisy_primitive(Structure *st);
+static int check_distance_kernels(Structure *st);
+static int check_threads(Structure *st);
+#ifdef HAVE_PTHREAD
+static void * run_thread_work(void *arg);
+#endif
+static int read_poscar(Structure *st, const char *filename);
+static void free_structure(Structure *st);
+static int compare_datasets(const char *name,
+			    const SpglibDataset *dataset,
+			    const SpglibDataset *expected);
+static int compare_symmetry(const char *name,
+			    const SpglibDataset *dataset,
+			    const SpglibDataset *expected);
+static int compare_operations(const char *name,
+			      SPGCONST int rotation[][3][3],
+			      SPGCONST double translation[][3],
+			      const int size,
+			      SPGCONST int expected_rotation[][3][3],
+			      SPGCONST double expected_translation[][3],
+			      const int expected_size);
+static int find_operation(SPGCONST int rotations[][3][3],
+			  SPGCONST double translations[][3],
+			  const int size,
+			  SPGCONST int rotation[3][3],
+			  const double translation[3]);
+static int compare_permutations(const char *name,
+				const SpglibDataset *dataset,
+				SPGCONST double lattice[3][3],
+				SPGCONST double position[][3],
+				const int types[],
+				const int num_atom);
+static int get_nearest_atom(SPGCONST double lattice[3][3],
+			    SPGCONST double position[][3],
+			    const int types[],
+			    const int num_atom,
+			    const double pos[3],
+			    const int type);
+static int check_subgroup(const char *name,
+			  SPGCONST int rotation[][3][3],
+			  SPGCONST double translation[][3],
+			  const int size,
+			  SPGCONST int group_rotation[][3][3],
+			  SPGCONST double group_translation[][3],
+			  const int group_size);
+static int get_time_reversal(SPGCONST double lattice[3][3],
+			     SPGCONST double position[][3],
+			     const int types[],
+			     SPGCONST double magmoms[][3],
+			     const int num_atom,
+			     SPGCONST int rotation[3][3],
+			     const double translation[3]);
+static int get_orbit_map(int map[],
+			 SPGCONST int grid_address[][3],
+			 const int mesh[3],
+			 const int shift[3],
+			 const int shift_denominator,
+			 SPGCONST int transformation[3][3],
+			 SPGCONST int rotations[][3][3],
+			 const int num_rot,
+			 const int is_time_reversal);
+static int get_rotated_grid_point(SPGCONST int rotation[3][3],
+				  const int address[3],
+				  const int mesh[3],
+				  const int shift[3],
+				  const int shift_denominator,
+				  SPGCONST int transformation[3][3]);
+static int check_BZ_grid_address(const char *name,
+				 SPGCONST int bz_grid_address[][3],
+				 const int bz_map[],
+				 const int num_bz,
+				 const int mesh[3],
+				 const int shift[3],
+				 SPGCONST int transformation[3][3],
+				 SPGCONST double rec_lattice[3][3],
+				 const double tolerance);
+static double get_q_norm_squared(const int address[3],
+				 const int mesh[3],
+				 const int shift[3],
+				 SPGCONST int transformation[3][3],
+				 SPGCONST double rec_lattice[3][3],
+				 const int lattice_point[3]);
+static int get_ir_grid_points(int ir_grid_points[],
+			      int weights[],
+			      const int map[],
+			      const int num_grid);
+static void set_noisy_positions(double (*position)[3],
+				const Structure *st,
+				const double amplitude,
+				const unsigned int seed);
+static int get_pure_translations(double (*translation)[3],
+				 SPGCONST Cell *cell,
+				 const double symprec);
+static int check_trimmed_cell(const char *name,
+			      SPGCONST Cell *cell,
+			      const Primitive *primitive);
+static int is_integer_vector(const double v[3], const double tolerance);
+static int inverse_matrix_d3(double m[3][3], SPGCONST double a[3][3]);
+
+int main(int argc, char *argv[])
+{
+  int i, num_failed;
+  Structure st;
+
+  num_failed = check_allocation_failure();
+  num_failed += check_permutation_rows();
+
+  for (i = 1; i < argc; i++) {
+    if (! read_poscar(&st, argv[i])) {
+      printf("%s: could not be read\n", argv[i]);
+      num_failed++;
+      continue;
+    }
+    num_failed += check_context(&st);
+    num_failed += check_batch(&st);
+    num_failed += check_errors(&st);
+    num_failed += check_arena(&st);
+    num_failed += check_symprec_spectrum(&st);
+    num_failed += check_supercell(&st);
+    num_failed += check_perturbed(&st);
+    num_failed += check_tracker(&st);
+    num_failed += check_permutations(&st);
+    num_failed += check_collinear_spin(&st);
+    num_failed += check_magmoms(&st);
+    num_failed += check_ir_reciprocal_mesh(&st);
+    num_failed += check_ir_mesh(&st);
+    num_failed += check_ir_mesh_iterator(&st);
+    num_failed += check_generalized_mesh(&st);
+    num_failed += check_ir_mesh_with_shift(&st);
+    num_failed += check_noisy_supercell(&st);
+    num_failed += check_noisy_primitive(&st);
+    num_failed += check_distance_kernels(&st);
+    num_failed += check_threads(&st);
+    free_structure(&st);
+  }
+
+  printf("%d structures checked, %d failed\n", argc - 1, num_failed);
+
+  return num_failed > 0;
+}
+
+/* Queries on a context give the same as the plain functions. */
+static int check_context(Structure *st)
+{
+  int i, num_failed, number, number_context, size, num_ir, num_ir_context;
+  int num_atom_refined, num_atom_context;
+  int mesh[3] = {6, 6, 4};
+  int is_shift[3] = {1, 1, 0};
+  int *map, *map_context, *types_refined, *types_context;
+  int (*rotation)[3][3];
+  int (*grid_address)[3], (*address_context)[3];
+  double (*translation)[3], (*position_refined)[3], (*position_context)[3];
+  double lattice_refined[3][3], lattice_context[3][3];
+  char symbol[11], symbol_context[11];
+  SpglibContext *context;
+  SpglibDataset *dataset;
+
+  num_failed = 0;
+  if ((context = spg_alloc_context(st->lattice,
+				   st->position,
+				   st->types,
+				   st->num_atom,
+				   SYMPREC)) == NULL) {
+    printf("%s: spg_alloc_context failed\n", st->name);
+    return 1;
+  }
+
+  dataset = spg_get_dataset(st->lattice,
+			    st->position,
+			    st->types,
+			    st->num_atom,
+			    SYMPREC);
+  num_failed += compare_datasets(st->name,
+				 spg_context_get_dataset(context),
+				 dataset);
+  spg_free_dataset(dataset);
+
+  rotation = (int (*)[3][3]) malloc(sizeof(int[3][3]) * st->size);
+  translation = (double (*)[3]) malloc(sizeof(double[3]) * st->size);
+  size = spg_context_get_symmetry(rotation, translation, st->size, context);
+  if (size != st->size ||
+      memcmp(rotation, st->rotation, sizeof(int[3][3]) * size) != 0) {
+    printf("%s: spg_context_get_symmetry differs from spg_get_symmetry\n",
+	   st->name);
+    num_failed++;
+  } else {
+    for (i = 0; i < size; i++) {
+      if (fabs(translation[i][0] - st->translation[i][0]) > 1e-10 ||
+	  fabs(translation[i][1] - st->translation[i][1]) > 1e-10 ||
+	  fabs(translation[i][2] - st->translation[i][2]) > 1e-10) {
+	printf("%s: translation %d of spg_context_get_symmetry\n",
+	       st->name, i);
+	num_failed++;
+	break;
+      }
+    }
+  }
+  free(translation);
+  free(rotation);
+
+  number = spg_get_international(symbol,
+				 st->lattice,
+				 st->position,
+				 st->types,
+				 st->num_atom,
+				 SYMPREC);
+  number_context = spg_context_get_international(symbol_context, context);
+  if (number != number_context || strcmp(symbol, symbol_context) != 0) {
+    printf("%s: spg_context_get_international %s (%s)\n",
+	   st->name, symbol_context, symbol);
+    num_failed++;
+  }
+
+  position_refined = (double (*)[3]) malloc(sizeof(double[3]) *
+					    st->num_atom * 4);
+  position_context = (double (*)[3]) malloc(sizeof(double[3]) *
+					    st->num_atom * 4);
+  types_refined = (int*) malloc(sizeof(int) * st->num_atom * 4);
+  types_context = (int*) malloc(sizeof(int) * st->num_atom * 4);
+  memcpy(lattice_refined, st->lattice, sizeof(double[3][3]));
+  memcpy(position_refined, st->position, sizeof(double[3]) * st->num_atom);
+  memcpy(types_refined, st->types, sizeof(int) * st->num_atom);
+  num_atom_refined = spg_refine_cell(lattice_refined,
+				     position_refined,
+				     types_refined,
+				     st->num_atom,
+				     SYMPREC);
+  num_atom_context = spg_context_refine_cell(lattice_context,
+					     position_context,
+					     types_context,
+					     context);
+  if (num_atom_refined != num_atom_context ||
+      memcmp(types_refined, types_context,
+	     sizeof(int) * num_atom_refined) != 0 ||
+      memcmp(lattice_refined, lattice_context, sizeof(double[3][3])) != 0 ||
+      memcmp(position_refined, position_context,
+	     sizeof(double[3]) * num_atom_refined) != 0) {
+    printf("%s: spg_context_refine_cell differs from spg_refine_cell\n",
+	   st->name);
+    num_failed++;
+  }
+  free(types_context);
+  free(types_refined);
+  free(position_context);
+  free(position_refined);
+
+  grid_address = (int (*)[3]) malloc(sizeof(int[3]) * 144);
+  address_context = (int (*)[3]) malloc(sizeof(int[3]) * 144);
+  map = (int*) malloc(sizeof(int) * 144);
+  map_context = (int*) malloc(sizeof(int) * 144);
+  num_ir = spg_get_ir_reciprocal_mesh(grid_address,
+				      map,
+				      mesh,
+				      is_shift,
+				      1,
+				      st->lattice,
+				      st->position,
+				      st->types,
+				      st->num_atom,
+				      SYMPREC);
+  num_ir_context = spg_context_get_ir_reciprocal_mesh(address_context,
+						      map_context,
+						      mesh,
+						      is_shift,
+						      1,
+						      context);
+  if (num_ir != num_ir_context ||
+      memcmp(map, map_context, sizeof(int) * 144) != 0 ||
+      memcmp(grid_address, address_context, sizeof(int[3]) * 144) != 0) {
+    printf("%s: spg_context_get_ir_reciprocal_mesh differs from "
+	   "spg_get_ir_reciprocal_mesh\n", st->name);
+    num_failed++;
+  }
+  free(map_context);
+  free(map);
+  free(address_context);
+  free(grid_address);
+
+  spg_free_context(context);
+
+  return num_failed;
+}
+
+/* Each dataset of a batch is that of spg_get_dataset. The batch has */
+/* the structure, the structure with a shifted origin and the atoms */
+/* in reversed order, and the structure again. It runs on */
+/* NUM_THREADS threads with OpenMP while an arena is set, which is */
+/* set again after the batch and reset before the datasets are used. */
+static int check_batch(Structure *st)
+{
+  int i, j, k, num_found, num_failed;
+  int offsets[4];
+  int *types;
+  double lattices[3][3][3];
+  double (*positions)[3];
+  char name[100];
+  SpglibDataset *datasets[3];
+  SpglibDataset *dataset;
+  SpglibArena *arena;
+#ifdef _OPENMP
+  int max_threads;
+#endif
+
+  if ((arena = spg_alloc_arena(4096)) == NULL) {
+    printf("%s: spg_alloc_arena failed\n", st->name);
+    return 1;
+  }
+
+  num_failed = 0;
+  positions = (double (*)[3]) malloc(sizeof(double[3]) * st->num_atom * 3);
+  types = (int*) malloc(sizeof(int) * st->num_atom * 3);
+  for (i = 0; i < 3; i++) {
+    memcpy(lattices[i], st->lattice, sizeof(double[3][3]));
+    offsets[i] = st->num_atom * i;
+    for (j = 0; j < st->num_atom; j++) {
+      k = (i == 1) ? st->num_atom - 1 - j : j;
+      positions[offsets[i] + j][0] = st->position[k][0] + (i == 1) * 0.1;
+      positions[offsets[i] + j][1] = st->position[k][1] + (i == 1) * 0.2;
+      positions[offsets[i] + j][2] = st->position[k][2] + (i == 1) * 0.3;
+      types[offsets[i] + j] = st->types[k];
+    }
+  }
+  offsets[3] = st->num_atom * 3;
+
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+  omp_set_num_threads(NUM_THREADS);
+#endif
+  spg_set_arena(arena);
+  num_found = spg_get_datasets_batch(datasets,
+				     3,
+				     lattices,
+				     positions,
+				     types,
+				     offsets,
+				     SYMPREC);
+  if (mem_get_arena() != arena) {
+    printf("%s: arena is not set after spg_get_datasets_batch\n",
+	   st->name);
+    num_failed++;
+  }
+  spg_set_arena(NULL);
+  spg_reset_arena(arena);
+#ifdef _OPENMP
+  omp_set_num_threads(max_threads);
+#endif
+  if (num_found != 3) {
+    printf("%s: %d datasets found by spg_get_datasets_batch\n",
+	   st->name, num_found);
+    num_failed++;
+  }
+
+  for (i = 0; i < 3; i++) {
+    sprintf(name, "%s: batch structure %d", st->name, i);
+    dataset = spg_get_dataset(lattices[i],
+			      positions + offsets[i],
+			      types + offsets[i],
+			      st->num_atom,
+			      SYMPREC);
+    num_failed += compare_datasets(name, datasets[i], dataset);
+    spg_free_dataset(dataset);
+    spg_free_dataset(datasets[i]);
+  }
+
+  free(types);
+  free(positions);
+  spg_free_arena(arena);
+
+  return num_failed;
+}
+
+/* A failed call leaves its error code, and the next call of */
+/* spg_get_dataset on the structure succeeds with the same dataset. */
+static int check_errors(Structure *st)
+{
+  int num_failed;
+  double singular[3][3], smallest[3][3];
+  SpglibDataset *dataset, *dataset_after;
+
+  num_failed = 0;
+  dataset = spg_get_dataset(st->lattice,
+			    st->position,
+			    st->types,
+			    st->num_atom,
+			    SYMPREC);
+  if (spg_get_error_code() != SPGLIB_SUCCESS) {
+    printf("%s: spg_get_dataset: %s\n",
+	   st->name, spg_get_error_message(spg_get_error_code()));
+    num_failed++;
+  }
+
+  /* The third basis vector is the sum of the others. */
+  memcpy(singular, st->lattice, sizeof(double[3][3]));
+  singular[0][2] = singular[0][0] + singular[0][1];
+  singular[1][2] = singular[1][0] + singular[1][1];
+  singular[2][2] = singular[2][0] + singular[2][1];
+  if (spg_get_smallest_lattice(smallest, singular, SYMPREC) ||
+      spg_get_error_code() != SPGERR_LATTICE_REDUCTION_FAILED) {
+    printf("%s: lattice reduction of a singular lattice: %s\n",
+	   st->name, spg_get_error_message(spg_get_error_code()));
+    num_failed++;
+  }
+
+  dataset_after = spg_get_dataset(st->lattice,
+				  st->position,
+				  st->types,
+				  st->num_atom,
+				  SYMPREC);
+  if (spg_get_error_code() != SPGLIB_SUCCESS) {
+    printf("%s: spg_get_dataset after a failure: %s\n",
+	   st->name, spg_get_error_message(spg_get_error_code()));
+    num_failed++;
+  }
+  num_failed += compare_datasets(st->name, dataset_after, dataset);
+  spg_free_dataset(dataset_after);
+  spg_free_dataset(dataset);
+
+  return num_failed;
+}
+
+/* The n-th allocation of spg_get_dataset, spg_refine_cell and */
+/* spg_get_ir_reciprocal_mesh for a 2x2x2 supercell of rutile is */
+/* made to fail, for n = 1, 2, ... until a call makes fewer than n */
+/* allocations, with memory from the heap and from an arena. Each */
+/* call fails with SPGERR_MEMORY_ALLOCATION_FAILED or gives the same */
+/* as without the failure, and leaks nothing. */
+static int check_allocation_failure(void)
+{
+  int i, j, k, l, n, a, f, num_failed, num_allocations, is_reached, is_done;
+  int num_atom, num_refined, num_refined_expected, num_ir, num_ir_expected;
+  int mesh[3] = {4, 4, 4};
+  int is_shift[3] = {0, 0, 0};
+  int types[48], types_refined[192], types_expected[192];
+  int map[64], map_expected[64];
+  int grid_address[64][3];
+  double lattice[3][3] = {{8, 0, 0}, {0, 8, 0}, {0, 0, 6}};
+  double lattice_refined[3][3], lattice_expected[3][3];
+  double position[48][3], position_refined[192][3], position_expected[192][3];
+  double rutile[6][3] = {{0, 0, 0},
+			 {0.5, 0.5, 0.5},
+			 {0.3, 0.3, 0},
+			 {0.7, 0.7, 0},
+			 {0.2, 0.8, 0.5},
+			 {0.8, 0.2, 0.5}};
+  const char *names[3] = {"spg_get_dataset",
+			  "spg_refine_cell",
+			  "spg_get_ir_reciprocal_mesh"};
+  char name[100];
+  SpglibArena *arena;
+  SpglibDataset *dataset, *dataset_expected;
+  SpglibError error;
+
+  n = 0;
+  for (i = 0; i < 2; i++) {
+    for (j = 0; j < 2; j++) {
+      for (k = 0; k < 2; k++) {
+	for (l = 0; l < 6; l++) {
+	  position[n][0] = (rutile[l][0] + i) / 2;
+	  position[n][1] = (rutile[l][1] + j) / 2;
+	  position[n][2] = (rutile[l][2] + k) / 2;
+	  types[n] = (l < 2) ? 1 : 2;
+	  n++;
+	}
+      }
+    }
+  }
+  num_atom = n;
+
+  num_failed = 0;
+  dataset_expected = spg_get_dataset(lattice, position, types, num_atom,
+				     SYMPREC);
+  memcpy(lattice_expected, lattice, sizeof(double[3][3]));
+  memcpy(position_expected, position, sizeof(double[3]) * num_atom);
+  memcpy(types_expected, types, sizeof(int) * num_atom);
+  num_refined_expected = spg_refine_cell(lattice_expected,
+					 position_expected,
+					 types_expected,
+					 num_atom,
+					 SYMPREC);
+  num_ir_expected = spg_get_ir_reciprocal_mesh(grid_address,
+					       map_expected,
+					       mesh,
+					       is_shift,
+					       1,
+					       lattice,
+					       position,
+					       types,
+					       num_atom,
+					       SYMPREC);
+  if (dataset_expected == NULL ||
+      dataset_expected->spacegroup_number != 136 ||
+      num_refined_expected != 6 ||
+      num_ir_expected == 0) {
+    printf("rutile 2x2x2: dataset, refined cell or ir mesh not found\n");
+    spg_free_dataset(dataset_expected);
+    return 1;
+  }
+
+  if ((arena = spg_alloc_arena(4096)) == NULL) {
+    printf("rutile 2x2x2: spg_alloc_arena failed\n");
+    spg_free_dataset(dataset_expected);
+    return 1;
+  }
+
+  for (a = 0; a < 2; a++) {
+    spg_set_arena(a ? arena : NULL);
+    for (f = 0; f < 3; f++) {
+      for (n = 1; ; n++) {
+	sprintf(name, "rutile 2x2x2: %s with allocation %d failing%s",
+		names[f], n, a ? " in an arena" : "");
+	num_allocations = mem_get_num_allocations();
+	mem_set_allocation_countdown(n);
+	is_done = 0;
+	switch (f) {
+	case 0:
+	  dataset = spg_get_dataset(lattice, position, types, num_atom,
+				    SYMPREC);
+	  error = spg_get_error_code();
+	  if (dataset != NULL) {
+	    is_done = 1;
+	    num_failed += compare_datasets(name, dataset, dataset_expected);
+	  }
+	  spg_free_dataset(dataset);
+	  break;
+	case 1:
+	  memcpy(lattice_refined, lattice, sizeof(double[3][3]));
+	  memcpy(position_refined, position, sizeof(double[3]) * num_atom);
+	  memcpy(types_refined, types, sizeof(int) * num_atom);
+	  num_refined = spg_refine_cell(lattice_refined,
+					position_refined,
+					types_refined,
+					num_atom,
+					SYMPREC);
+	  error = spg_get_error_code();
+	  if (num_refined > 0) {
+	    is_done = 1;
+	    if (num_refined != num_refined_expected ||
+		memcmp(lattice_refined, lattice_expected,
+		       sizeof(double[3][3])) != 0 ||
+		memcmp(position_refined, position_expected,
+		       sizeof(double[3]) * num_refined) != 0 ||
+		memcmp(types_refined, types_expected,
+		       sizeof(int) * num_refined) != 0) {
+	      printf("%s: refined cell differs\n", name);
+	      num_failed++;
+	    }
+	  }
+	  break;
+	default:
+	  num_ir = spg_get_ir_reciprocal_mesh(grid_address,
+					      map,
+					      mesh,
+					      is_shift,
+					      1,
+					      lattice,
+					      position,
+					      types,
+					      num_atom,
+					      SYMPREC);
+	  error = spg_get_error_code();
+	  if (num_ir > 0) {
+	    is_done = 1;
+	    if (num_ir != num_ir_expected ||
+		memcmp(map, map_expected, sizeof(int) * 64) != 0) {
+	      printf("%s: ir mesh differs\n", name);
+	      num_failed++;
+	    }
+	  }
+	  break;
+	}
+	is_reached = (mem_get_allocation_countdown() == 0);
+	mem_set_allocation_countdown(0);
+	spg_reset_arena(arena);
+
+	if (! is_done && (! is_reached ||
+			  error != SPGERR_MEMORY_ALLOCATION_FAILED)) {
+	  printf("%s: %s\n", name, spg_get_error_message(error));
+	  num_failed++;
+	}
+	if (mem_get_num_allocations() != num_allocations) {
+	  printf("%s: %d allocations leaked\n",
+		 name, mem_get_num_allocations() - num_allocations);
+	  num_failed++;
+	}
+	if (! is_reached) {
+	  break;
+	}
+      }
+    }
+  }
+  spg_set_arena(NULL);
+  spg_free_arena(arena);
+
+  spg_free_dataset(dataset_expected);
+
+  return num_failed;
+}
+
+/* Datasets and contexts taken from an arena are those from the */
+/* heap, also after the arena is reset and used again. */
+static int check_arena(Structure *st)
+{
+  int i, num_failed;
+  char name[100];
+  SpglibArena *arena;
+  SpglibContext *context;
+  const SpglibDataset *context_dataset;
+  SpglibDataset *dataset, *dataset_arena;
+
+  if ((arena = spg_alloc_arena(4096)) == NULL) {
+    printf("%s: spg_alloc_arena failed\n", st->name);
+    return 1;
+  }
+
+  num_failed = 0;
+  dataset = spg_get_dataset(st->lattice,
+			    st->position,
+			    st->types,
+			    st->num_atom,
+			    SYMPREC);
+  for (i = 0; i < 2; i++) {
+    sprintf(name, "%s: arena used %d times", st->name, i + 1);
+    spg_set_arena(arena);
+    dataset_arena = spg_get_dataset(st->lattice,
+				    st->position,
+				    st->types,
+				    st->num_atom,
+				    SYMPREC);
+    context_dataset = NULL;
+    if ((context = spg_alloc_context(st->lattice,
+				     st->position,
+				     st->types,
+				     st->num_atom,
+				     SYMPREC)) != NULL) {
+      context_dataset = spg_context_get_dataset(context);
+    }
+    spg_set_arena(NULL);
+
+    num_failed += compare_datasets(name, dataset_arena, dataset);
+    num_failed += compare_datasets(name, context_dataset, dataset);
+    spg_reset_arena(arena);
+  }
+  spg_free_dataset(dataset);
+  spg_free_arena(arena);
+
+  return num_failed;
+}
+
+/* The space group of each range is that found directly with symprec */
+/* in the range. */
+static int check_symprec_spectrum(Structure *st)
+{
+  int i, j, num_ranges, number, num_failed;
+  int spacegroup_numbers[100];
+  double symprecs[100];
+  double symprec, symprec_min, symprec_max;
+  char symbol[11];
+
+  num_failed = 0;
+  symprec_min = 1e-5;
+  symprec_max = 0.1;
+
+  num_ranges = spg_get_symprec_spectrum(symprecs,
+					spacegroup_numbers,
+					100,
+					st->lattice,
+					st->position,
+					st->types,
+					st->num_atom,
+					symprec_min,
+					symprec_max);
+  if (num_ranges < 1 ||
+      fabs(symprecs[num_ranges - 1] - symprec_max) > 1e-12) {
+    printf("%s: spg_get_symprec_spectrum failed\n", st->name);
+    return 1;
+  }
+
+  for (i = 0; i < 20; i++) {
+    symprec = symprec_min * pow(symprec_max / symprec_min, (i + 0.5) / 20);
+    for (j = 0; j < num_ranges; j++) {
+      if (symprec <= symprecs[j]) {
+	break;
+      }
+    }
+    number = spg_get_international(symbol,
+				   st->lattice,
+				   st->position,
+				   st->types,
+				   st->num_atom,
+				   symprec);
+    if (number != spacegroup_numbers[j]) {
+      printf("%s: space group %d at symprec %e (%d)\n",
+	     st->name, spacegroup_numbers[j], symprec, number);
+      num_failed++;
+    }
+  }
+
+  return num_failed;
+}
+
+/* spg_get_dataset_of_supercell of the 1x1x2 supercell with the */
+/* primitive cell found by spg_find_primitive gives the symmetry of */
+/* spg_get_dataset. So does a wrong primitive cell, which has to be */
+/* rejected. */
+static int check_supercell(Structure *st)
+{
+  int i, j, k, p, num_primitive_atom, num_failed;
+  int supercell_matrix[3][3];
+  int *types, *primitive_types;
+  double lattice[3][3], primitive_lattice[3][3], inv_primitive[3][3];
+  double (*position)[3], (*primitive_position)[3];
+  char name[100];
+  SpglibDataset *dataset, *dataset_supercell;
+
+  num_failed = 0;
+  position = (double (*)[3]) malloc(sizeof(double[3]) * st->num_atom * 2);
+  types = (int*) malloc(sizeof(int) * st->num_atom * 2);
+  primitive_position = (double (*)[3]) malloc(sizeof(double[3]) *
+					      st->num_atom);
+  primitive_types = (int*) malloc(sizeof(int) * st->num_atom);
+
+  memcpy(lattice, st->lattice, sizeof(double[3][3]));
+  for (i = 0; i < 3; i++) {
+    lattice[i][2] *= 2;
+  }
+  for (i = 0; i < 2; i++) {
+    for (j = 0; j < st->num_atom; j++) {
+      k = st->num_atom * i + j;
+      position[k][0] = st->position[j][0];
+      position[k][1] = st->position[j][1];
+      position[k][2] = (st->position[j][2] + i) / 2;
+      types[k] = st->types[j];
+    }
+  }
+
+  memcpy(primitive_lattice, st->lattice, sizeof(double[3][3]));
+  memcpy(primitive_position, st->position, sizeof(double[3]) * st->num_atom);
+  memcpy(primitive_types, st->types, sizeof(int) * st->num_atom);
+  num_primitive_atom = spg_find_primitive(primitive_lattice,
+					  primitive_position,
+					  primitive_types,
+					  st->num_atom,
+					  SYMPREC);
+  if (num_primitive_atom == 0 && spg_get_error_code() == SPGLIB_SUCCESS) {
+    num_primitive_atom = st->num_atom; /* Already primitive */
+  }
+  if (num_primitive_atom < 1 ||
+      ! inverse_matrix_d3(inv_primitive, primitive_lattice)) {
+    printf("%s: spg_find_primitive failed\n", st->name);
+    num_failed++;
+    goto ret;
+  }
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      supercell_matrix[i][j] = (int)floor(inv_primitive[i][0] * lattice[0][j] +
+					  inv_primitive[i][1] * lattice[1][j] +
+					  inv_primitive[i][2] * lattice[2][j] +
+					  0.5);
+    }
+  }
+
+  dataset = spg_get_dataset(lattice, position, types, st->num_atom * 2,
+			    SYMPREC);
+  for (p = 0; p < 2; p++) {
+    sprintf(name, "%s: 1x1x2 supercell with %s primitive cell",
+	    st->name, p ? "a wrong" : "the");
+    if (p == 1) { /* The first atom is moved away from its site. */
+      primitive_position[0][0] += 0.1;
+      primitive_position[0][1] += 0.2;
+    }
+    dataset_supercell = spg_get_dataset_of_supercell(lattice,
+						     position,
+						     types,
+						     st->num_atom * 2,
+						     supercell_matrix,
+						     primitive_lattice,
+						     primitive_position,
+						     primitive_types,
+						     num_primitive_atom,
+						     SYMPREC);
+    num_failed += compare_symmetry(name, dataset_supercell, dataset);
+    spg_free_dataset(dataset_supercell);
+  }
+  spg_free_dataset(dataset);
+
+ ret:
+  free(primitive_types);
+  free(primitive_position);
+  free(types);
+  free(position);
+
+  return num_failed;
+}
+
+/* spg_get_symmetry_of_perturbed gives the operations that */
+/* spg_get_symmetry finds for the structure with the atoms moved, */
+/* first one atom and then the first and the last atoms. */
+static int check_perturbed(Structure *st)
+{
+  int i, m, size, size_moved, num_moved, num_failed;
+  int moved_atoms[2];
+  int (*rotation)[3][3], (*rotation_moved)[3][3];
+  double moved_positions[2][3];
+  double (*translation)[3], (*translation_moved)[3], (*position)[3];
+  char name[100];
+  SpglibContext *context;
+
+  if ((context = spg_alloc_context(st->lattice,
+				   st->position,
+				   st->types,
+				   st->num_atom,
+				   SYMPREC)) == NULL) {
+    printf("%s: spg_alloc_context failed\n", st->name);
+    return 1;
+  }
+
+  num_failed = 0;
+  rotation = (int (*)[3][3]) malloc(sizeof(int[3][3]) * st->size);
+  translation = (double (*)[3]) malloc(sizeof(double[3]) * st->size);
+  position = (double (*)[3]) malloc(sizeof(double[3]) * st->num_atom);
+  moved_atoms[0] = 0;
+  moved_atoms[1] = st->num_atom - 1;
+
+  for (num_moved = 1; num_moved < (st->num_atom > 1 ? 3 : 2); num_moved++) {
+    sprintf(name, "%s: %d atoms moved", st->name, num_moved);
+    memcpy(position, st->position, sizeof(double[3]) * st->num_atom);
+    for (m = 0; m < num_moved; m++) {
+      for (i = 0; i < 3; i++) {
+	moved_positions[m][i] = (st->position[moved_atoms[m]][i] +
+				 0.01 * (i + 1) * (m ? -1 : 1));
+	position[moved_atoms[m]][i] = moved_positions[m][i];
+      }
+    }
+
+    size = spg_get_symmetry_of_perturbed(rotation,
+					 translation,
+					 st->size,
+					 context,
+					 moved_atoms,
+					 moved_positions,
+					 num_moved);
+
+    /* Moving atoms off their sites adds no operation. */
+    rotation_moved = (int (*)[3][3]) malloc(sizeof(int[3][3]) * st->size);
+    translation_moved = (double (*)[3]) malloc(sizeof(double[3]) * st->size);
+    size_moved = spg_get_symmetry(rotation_moved,
+				  translation_moved,
+				  st->size,
+				  st->lattice,
+				  position,
+				  st->types,
+				  st->num_atom,
+				  SYMPREC);
+    num_failed += compare_operations(name,
+				     rotation,
+				     translation,
+				     size,
+				     rotation_moved,
+				     translation_moved,
+				     size_moved);
+    free(translation_moved);
+    free(rotation_moved);
+  }
+
+  free(position);
+  free(translation);
+  free(rotation);
+  spg_free_context(context);
+
+  return num_failed;
+}
+
+/* Every frame pushed to a tracker has the symmetry spg_get_dataset */
+/* finds for it. The first atom moves away from its site in two */
+/* steps. With full search at every frame, it moves back at the end. */
+static int check_tracker(Structure *st)
+{
+  int i, f, t, number, num_failed;
+  int full_search_intervals[2] = {0, 1};
+  double steps[2][3] = {{0, 1, 2}, {0, 1, 0}};
+  double (*position)[3];
+  char name[100];
+  SpglibTracker *tracker;
+  SpglibDataset *dataset;
+
+  num_failed = 0;
+  position = (double (*)[3]) malloc(sizeof(double[3]) * st->num_atom);
+  memcpy(position, st->position, sizeof(double[3]) * st->num_atom);
+
+  for (t = 0; t < 2; t++) {
+    if ((tracker = spg_alloc_tracker(SYMPREC,
+				     full_search_intervals[t])) == NULL) {
+      printf("%s: spg_alloc_tracker failed\n", st->name);
+      num_failed++;
+      continue;
+    }
+    for (f = 0; f < 3; f++) {
+      sprintf(name, "%s: frame %d with full search interval %d",
+	      st->name, f, full_search_intervals[t]);
+      for (i = 0; i < 3; i++) {
+	position[0][i] = st->position[0][i] + 0.01 * (i + 1) * steps[t][f];
+      }
+      number = spg_tracker_push_frame(tracker,
+				      st->lattice,
+				      position,
+				      st->types,
+				      st->num_atom);
+      dataset = spg_get_dataset(st->lattice,
+				position,
+				st->types,
+				st->num_atom,
+				SYMPREC);
+      if (dataset == NULL || number != dataset->spacegroup_number) {
+	printf("%s: space group %d\n", name, number);
+	num_failed++;
+      } else {
+	num_failed += compare_symmetry(name,
+				       spg_tracker_get_dataset(tracker),
+				       dataset);
+      }
+      spg_free_dataset(dataset);
+    }
+    spg_free_tracker(tracker);
+  }
+
+  free(position);
+
+  return num_failed;
+}
+
+/* Each row of the permutation table of the dataset is the nearest */
+/* atoms to the atoms moved by the operation. */
+static int check_permutations(Structure *st)
+{
+  int i, num_failed;
+  SpglibDataset *dataset;
+
+  dataset = spg_get_dataset(st->lattice,
+			    st->position,
+			    st->types,
+			    st->num_atom,
+			    SYMPREC);
+  if (dataset == NULL || dataset->permutations == NULL) {
+    printf("%s: no permutation table\n", st->name);
+    spg_free_dataset(dataset);
+    return 1;
+  }
+
+  num_failed = 0;
+  for (i = 0; i < dataset->n_operations * dataset->n_atoms; i++) {
+    if (dataset->permutations[i] < 0) {
+      printf("%s: operation %d does not move atoms onto atoms\n",
+	     st->name, i / dataset->n_atoms);
+      num_failed++;
+      break;
+    }
+  }
+  num_failed += compare_permutations(st->name,
+				     dataset,
+				     st->lattice,
+				     st->position,
+				     st->types,
+				     st->num_atom);
+  spg_free_dataset(dataset);
+
+  return num_failed;
+}
+
+/* Two atoms 0.02 apart are one site at symprec 0.05, so the */
+/* operations of Pm-3m that swap them with each other's images move */
+/* both onto the same atom. Their rows are filled with -1. The table */
+/* of a 7x7x7 simple cubic supercell has 16464 x 343 elements, more */
+/* than the limit, and is not made. That of 6x6x6 is. */
+static int check_permutation_rows(void)
+{
+  int i, j, k, m, n, num_rows, num_failed;
+  int types[343];
+  double lattice[3][3] = {{4, 0, 0}, {0, 4, 0}, {0, 0, 4}};
+  double pair[3][3] = {{0, 0, 0}, {0.005, 0, 0}, {0.5, 0.5, 0.5}};
+  int pair_types[3] = {1, 1, 2};
+  double position[343][3];
+  SpglibDataset *dataset;
+
+  num_failed = 0;
+  dataset = spg_get_dataset(lattice, pair, pair_types, 3, 0.05);
+  if (dataset == NULL || dataset->permutations == NULL) {
+    printf("close pair: no permutation table\n");
+    num_failed++;
+  } else {
+    num_rows = 0;
+    for (i = 0; i < dataset->n_operations; i++) {
+      for (j = 0; j < 3; j++) {
+	if ((dataset->permutations[i * 3 + j] < 0) !=
+	    (dataset->permutations[i * 3] < 0)) {
+	  printf("close pair: row %d is partly -1\n", i);
+	  num_failed++;
+	  break;
+	}
+      }
+      num_rows += (dataset->permutations[i * 3] < 0);
+    }
+    if (num_rows == 0) {
+      printf("close pair: no row of -1\n");
+      num_failed++;
+    }
+    num_failed += compare_permutations("close pair",
+				       dataset,
+				       lattice,
+				       pair,
+				       pair_types,
+				       3);
+  }
+  spg_free_dataset(dataset);
+
+  for (m = 6; m < 8; m++) {
+    n = 0;
+    for (i = 0; i < m; i++) {
+      for (j = 0; j < m; j++) {
+	for (k = 0; k < m; k++) {
+	  position[n][0] = (double)i / m;
+	  position[n][1] = (double)j / m;
+	  position[n][2] = (double)k / m;
+	  types[n] = 1;
+	  n++;
+	}
+      }
+    }
+    for (i = 0; i < 3; i++) {
+      lattice[i][i] = 4 * m;
+    }
+    dataset = spg_get_dataset(lattice, position, types, n, SYMPREC);
+    if (dataset == NULL ||
+	dataset->n_operations != 48 * n ||
+	(dataset->permutations == NULL) != (m == 7)) {
+      printf("simple cubic %dx%dx%d: permutation table %s\n",
+	     m, m, m, (m == 7) ? "made" : "not made");
+      num_failed++;
+    }
+    spg_free_dataset(dataset);
+  }
+
+  return num_failed;
+}
+
+/* Ferromagnetic spins keep the operations of spg_get_symmetry. Spins */
+/* of 1, -1 and 0 in turn keep the same operations with and without */
+/* a context. With noise near symprec, the operations kept are among */
+/* those spg_get_symmetry finds for the noisy structure. */
+static int check_collinear_spin(Structure *st)
+{
+  int i, size, size_context, size_nonspin, max_size, num_failed;
+  int *equivalent_atoms;
+  int (*rotation)[3][3], (*rotation_context)[3][3];
+  double pattern[3] = {1, -1, 0};
+  double *spins;
+  double (*translation)[3], (*translation_context)[3], (*position)[3];
+  char name[100];
+  SpglibContext *context;
+
+  num_failed = 0;
+  max_size = MAX_NUM_ROT * st->num_atom;
+  spins = (double*) malloc(sizeof(double) * st->num_atom);
+  equivalent_atoms = (int*) malloc(sizeof(int) * st->num_atom);
+  position = (double (*)[3]) malloc(sizeof(double[3]) * st->num_atom);
+  rotation = (int (*)[3][3]) malloc(sizeof(int[3][3]) * max_size);
+  translation = (double (*)[3]) malloc(sizeof(double[3]) * max_size);
+  rotation_context = (int (*)[3][3]) malloc(sizeof(int[3][3]) * max_size);
+  translation_context = (double (*)[3]) malloc(sizeof(double[3]) * max_size);
+
+  sprintf(name, "%s: ferromagnetic", st->name);
+  for (i = 0; i < st->num_atom; i++) {
+    spins[i] = 1;
+  }
+  size = spg_get_symmetry_with_collinear_spin(rotation,
+					      translation,
+					      equivalent_atoms,
+					      max_size,
+					      st->lattice,
+					      st->position,
+					      st->types,
+					      spins,
+					      st->num_atom,
+					      SYMPREC);
+  num_failed += compare_operations(name,
+				   rotation,
+				   translation,
+				   size,
+				   st->rotation,
+				   st->translation,
+				   st->size);
+
+  sprintf(name, "%s: spins 1, -1, 0 with a context", st->name);
+  for (i = 0; i < st->num_atom; i++) {
+    spins[i] = pattern[i % 3];
+  }
+  size = spg_get_symmetry_with_collinear_spin(rotation,
+					      translation,
+					      equivalent_atoms,
+					      max_size,
+					      st->lattice,
+					      st->position,
+					      st->types,
+					      spins,
+					      st->num_atom,
+					      SYMPREC);
+  if ((context = spg_alloc_context(st->lattice,
+				   st->position,
+				   st->types,
+				   st->num_atom,
+				   SYMPREC)) == NULL) {
+    printf("%s: spg_alloc_context failed\n", st->name);
+    num_failed++;
+  } else {
+    size_context =
+      spg_context_get_symmetry_with_collinear_spin(rotation_context,
+						   translation_context,
+						   equivalent_atoms,
+						   max_size,
+						   context,
+						   spins);
+    num_failed += compare_operations(name,
+				     rotation,
+				     translation,
+				     size,
+				     rotation_context,
+				     translation_context,
+				     size_context);
+    spg_free_context(context);
+  }
+
+  sprintf(name, "%s: spins 1, -1, 0 with noise", st->name);
+  set_noisy_positions(position, st, 0.01, 1);
+  size = spg_get_symmetry_with_collinear_spin(rotation,
+					      translation,
+					      equivalent_atoms,
+					      max_size,
+					      st->lattice,
+					      position,
+					      st->types,
+					      spins,
+					      st->num_atom,
+					      0.05);
+  size_nonspin = spg_get_symmetry(rotation_context,
+				  translation_context,
+				  max_size,
+				  st->lattice,
+				  position,
+				  st->types,
+				  st->num_atom,
+				  0.05);
+  num_failed += check_subgroup(name,
+			       rotation,
+			       translation,
+			       size,
+			       rotation_context,
+			       translation_context,
+			       size_nonspin);
+
+  free(translation_context);
+  free(rotation_context);
+  free(translation);
+  free(rotation);
+  free(position);
+  free(equivalent_atoms);
+  free(spins);
+
+  return num_failed;
+}
+
+/* Zero moments keep the operations of spg_get_symmetry. Moments */
+/* along z of 1, -1 and 0 in turn are moved onto the reversed moments */
+/* by exactly the operations of time_reversals 1, and onto the same */
+/* moments by the others. Without time reversal, the operations of */
+/* time_reversals 0 are found. With noise near symprec, the operations */
+/* are among those spg_get_symmetry finds for the noisy structure. */
+static int check_magmoms(Structure *st)
+{
+  int i, size, size_kept, size_nonspin, max_size, num_failed;
+  int *time_reversals, *equivalent_atoms;
+  int (*rotation)[3][3], (*rotation_kept)[3][3];
+  double pattern[3] = {1, -1, 0};
+  double (*magmoms)[3], (*translation)[3], (*translation_kept)[3];
+  double (*position)[3];
+  char name[100];
+
+  num_failed = 0;
+  max_size = MAX_NUM_ROT * st->num_atom;
+  magmoms = (double (*)[3]) malloc(sizeof(double[3]) * st->num_atom);
+  equivalent_atoms = (int*) malloc(sizeof(int) * st->num_atom);
+  position = (double (*)[3]) malloc(sizeof(double[3]) * st->num_atom);
+  time_reversals = (int*) malloc(sizeof(int) * max_size);
+  rotation = (int (*)[3][3]) malloc(sizeof(int[3][3]) * max_size);
+  translation = (double (*)[3]) malloc(sizeof(double[3]) * max_size);
+  rotation_kept = (int (*)[3][3]) malloc(sizeof(int[3][3]) * max_size);
+  translation_kept = (double (*)[3]) malloc(sizeof(double[3]) * max_size);
+
+  sprintf(name, "%s: zero moments", st->name);
+  for (i = 0; i < st->num_atom; i++) {
+    magmoms[i][0] = 0;
+    magmoms[i][1] = 0;
+    magmoms[i][2] = 0;
+  }
+  size = spg_get_symmetry_with_magmoms(rotation,
+				       translation,
+				       time_reversals,
+				       equivalent_atoms,
+				       max_size,
+				       st->lattice,
+				       st->position,
+				       st->types,
+				       magmoms,
+				       1,
+				       st->num_atom,
+				       SYMPREC);
+  num_failed += compare_operations(name,
+				   rotation,
+				   translation,
+				   size,
+				   st->rotation,
+				   st->translation,
+				   st->size);
+  for (i = 0; i < size; i++) {
+    if (time_reversals[i] != 0) {
+      printf("%s: operation %d reverses the moments\n", name, i);
+      num_failed++;
+      break;
+    }
+  }
+
+  sprintf(name, "%s: moments 1, -1, 0 along z", st->name);
+  for (i = 0; i < st->num_atom; i++) {
+    magmoms[i][2] = pattern[i % 3];
+  }
+  size = spg_get_symmetry_with_magmoms(rotation,
+				       translation,
+				       time_reversals,
+				       equivalent_atoms,
+				       max_size,
+				       st->lattice,
+				       st->position,
+				       st->types,
+				       magmoms,
+				       1,
+				       st->num_atom,
+				       SYMPREC);
+  size_kept = 0;
+  for (i = 0; i < size; i++) {
+    if (time_reversals[i] != get_time_reversal(st->lattice,
+					       st->position,
+					       st->types,
+					       magmoms,
+					       st->num_atom,
+					       rotation[i],
+					       translation[i])) {
+      printf("%s: time reversal %d of operation %d\n",
+	     name, time_reversals[i], i);
+      num_failed++;
+      break;
+    }
+    if (time_reversals[i] == 0) {
+      memcpy(rotation_kept[size_kept], rotation[i], sizeof(int[3][3]));
+      memcpy(translation_kept[size_kept], translation[i], sizeof(double[3]));
+      size_kept++;
+    }
+  }
+
+  sprintf(name, "%s: moments 1, -1, 0 along z without time reversal",
+	  st->name);
+  size = spg_get_symmetry_with_magmoms(rotation,
+				       translation,
+				       time_reversals,
+				       equivalent_atoms,
+				       max_size,
+				       st->lattice,
+				       st->position,
+				       st->types,
+				       magmoms,
+				       0,
+				       st->num_atom,
+				       SYMPREC);
+  num_failed += compare_operations(name,
+				   rotation,
+				   translation,
+				   size,
+				   rotation_kept,
+				   translation_kept,
+				   size_kept);
+
+  sprintf(name, "%s: moments 1, -1, 0 along z with noise", st->name);
+  set_noisy_positions(position, st, 0.01, 1);
+  size = spg_get_symmetry_with_magmoms(rotation,
+				       translation,
+				       time_reversals,
+				       equivalent_atoms,
+				       max_size,
+				       st->lattice,
+				       position,
+				       st->types,
+				       magmoms,
+				       1,
+				       st->num_atom,
+				       0.05);
+  size_nonspin = spg_get_symmetry(rotation_kept,
+				  translation_kept,
+				  max_size,
+				  st->lattice,
+				  position,
+				  st->types,
+				  st->num_atom,
+				  0.05);
+  num_failed += check_subgroup(name,
+			       rotation,
+			       translation,
+			       size,
+			       rotation_kept,
+			       translation_kept,
+			       size_nonspin);
+
+  free(translation_kept);
+  free(rotation_kept);
+  free(translation);
+  free(rotation);
+  free(time_reversals);
+  free(position);
+  free(equivalent_atoms);
+  free(magmoms);
+
+  return num_failed;
+}
+
+/* On meshes keeping the symmetry, each grid point is mapped to the */
+/* smallest grid point of its orbit under the reciprocal rotations. */
+static int check_ir_reciprocal_mesh(Structure *st)
+{
+  int i, j, num_grid, num_ir, num_ir_expected, num_failed;
+  int mesh[3], is_shift[3];
+  int *map, *map_expected;
+  int (*grid_address)[3];
+  char name[100];
+  SPGCONST int identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+  num_failed = 0;
+  grid_address = (int (*)[3]) malloc(sizeof(int[3]) * 216);
+  map = (int*) malloc(sizeof(int) * 216);
+  map_expected = (int*) malloc(sizeof(int) * 216);
+
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 3; j++) {
+      mesh[j] = i < 2 ? 4 : 6;
+      is_shift[j] = i % 2;
+    }
+    num_grid = mesh[0] * mesh[1] * mesh[2];
+    sprintf(name, "%s: mesh %d %d %d, shift %d %d %d", st->name,
+	    mesh[0], mesh[1], mesh[2], is_shift[0], is_shift[1], is_shift[2]);
+    num_ir = spg_get_ir_reciprocal_mesh(grid_address,
+					map,
+					mesh,
+					is_shift,
+					1,
+					st->lattice,
+					st->position,
+					st->types,
+					st->num_atom,
+					SYMPREC);
+    for (j = 0; j < num_grid; j++) {
+      if (spg_get_grid_point(grid_address[j], mesh) != j) {
+	printf("%s: grid address of grid point %d\n", name, j);
+	num_failed++;
+	break;
+      }
+    }
+    if (j < num_grid) {
+      continue;
+    }
+
+    if (get_orbit_map(map_expected,
+		      grid_address,
+		      mesh,
+		      is_shift,
+		      2,
+		      identity,
+		      st->rotation,
+		      st->size,
+		      1) > 0) {
+      continue;
+    }
+
+    num_ir_expected = 0;
+    for (j = 0; j < num_grid; j++) {
+      if (map_expected[j] == j) {
+	num_ir_expected++;
+      }
+    }
+    if (num_ir != num_ir_expected ||
+	memcmp(map, map_expected, sizeof(int) * num_grid) != 0) {
+      printf("%s: %d irreducible grid points (%d)\n",
+	     name, num_ir, num_ir_expected);
+      num_failed++;
+    }
+  }
+
+  free(map_expected);
+  free(map);
+  free(grid_address);
+
+  return num_failed;
+}
+
+/* spg_get_ir_mesh gives the irreducible grid points of map, their */
+/* weights summing to prod(mesh) and their grid addresses, and */
+/* spg_get_ir_mesh_grid_point gives map. On meshes not keeping the */
+/* symmetry, e.g., half shifted hexagonal meshes, only the rotations */
+/* keeping the mesh are used, so that the irreducible grid points */
+/* differ from those of spg_get_ir_reciprocal_mesh. */
+static int check_ir_mesh(Structure *st)
+{
+  int i, j, num_grid, num_ir, num_dropped, weight_sum, num_failed;
+  int mesh[3], is_shift[3];
+  int *map, *map_expected, *ir_grid_points, *weights;
+  const int *map_ref;
+  int (*grid_address)[3];
+  char name[100];
+  SPGCONST int identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  SpglibIrMesh *ir_mesh;
+
+  num_failed = 0;
+  grid_address = (int (*)[3]) malloc(sizeof(int[3]) * 216);
+  map = (int*) malloc(sizeof(int) * 216);
+  map_expected = (int*) malloc(sizeof(int) * 216);
+  ir_grid_points = (int*) malloc(sizeof(int) * 216);
+  weights = (int*) malloc(sizeof(int) * 216);
+
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 3; j++) {
+      mesh[j] = i < 2 ? 4 : 6;
+      is_shift[j] = i % 2;
+    }
+    num_grid = mesh[0] * mesh[1] * mesh[2];
+    sprintf(name, "%s: mesh %d %d %d, shift %d %d %d", st->name,
+	    mesh[0], mesh[1], mesh[2], is_shift[0], is_shift[1], is_shift[2]);
+    spg_get_ir_reciprocal_mesh(grid_address,
+			       map,
+			       mesh,
+			       is_shift,
+			       1,
+			       st->lattice,
+			       st->position,
+			       st->types,
+			       st->num_atom,
+			       SYMPREC);
+    num_dropped = get_orbit_map(map_expected,
+				grid_address,
+				mesh,
+				is_shift,
+				2,
+				identity,
+				st->rotation,
+				st->size,
+				1);
+    map_ref = num_dropped > 0 ? map_expected : map;
+
+    if ((ir_mesh = spg_get_ir_mesh(mesh,
+				   is_shift,
+				   1,
+				   st->lattice,
+				   st->position,
+				   st->types,
+				   st->num_atom,
+				   SYMPREC)) == NULL) {
+      printf("%s: spg_get_ir_mesh failed\n", name);
+      num_failed++;
+      continue;
+    }
+
+    num_ir = get_ir_grid_points(ir_grid_points, weights, map_ref, num_grid);
+    weight_sum = 0;
+    for (j = 0; j < ir_mesh->n_ir_grid_points; j++) {
+      weight_sum += ir_mesh->weights[j];
+    }
+    if (ir_mesh->n_ir_grid_points != num_ir || weight_sum != num_grid ||
+	memcmp(ir_mesh->ir_grid_points, ir_grid_points,
+	       sizeof(int) * num_ir) != 0 ||
+	memcmp(ir_mesh->weights, weights, sizeof(int) * num_ir) != 0) {
+      printf("%s: spg_get_ir_mesh gives %d irreducible grid points (%d)\n",
+	     name, ir_mesh->n_ir_grid_points, num_ir);
+      num_failed++;
+    } else {
+      for (j = 0; j < num_ir; j++) {
+	if (memcmp(ir_mesh->ir_grid_address[j],
+		   grid_address[ir_grid_points[j]], sizeof(int[3])) != 0) {
+	  printf("%s: grid address of irreducible grid point %d\n",
+		 name, ir_grid_points[j]);
+	  num_failed++;
+	  break;
+	}
+      }
+    }
+
+    for (j = 0; j < num_grid; j++) {
+      if (spg_get_ir_mesh_grid_point(ir_mesh, j) != map_ref[j]) {
+	printf("%s: spg_get_ir_mesh_grid_point of %d\n", name, j);
+	num_failed++;
+	break;
+      }
+    }
+    if (spg_get_ir_mesh_grid_point(ir_mesh, -1) != -1 ||
+	spg_get_ir_mesh_grid_point(ir_mesh, num_grid) != -1) {
+      printf("%s: spg_get_ir_mesh_grid_point out of the mesh\n", name);
+      num_failed++;
+    }
+
+    if (num_dropped > 0 &&
+	num_ir == get_ir_grid_points(ir_grid_points, weights, map, num_grid)) {
+      printf("%s: spg_get_ir_mesh is spg_get_ir_reciprocal_mesh on a "
+	     "mesh not keeping the symmetry\n", name);
+      num_failed++;
+    }
+
+    spg_free_ir_mesh(ir_mesh);
+  }
+
+  free(weights);
+  free(ir_grid_points);
+  free(map_expected);
+  free(map);
+  free(grid_address);
+
+  return num_failed;
+}
+
+/* The irreducible grid points iterated in chunks of 7 and their */
+/* weights and grid addresses are those of map, as in check_ir_mesh. */
+static int check_ir_mesh_iterator(Structure *st)
+{
+  int i, j, num_grid, num_ir, num_next, num_iterated, num_failed;
+  int mesh[3], is_shift[3];
+  int *map, *map_expected, *ir_grid_points, *weights;
+  int *iterated_points, *iterated_weights;
+  const int *map_ref;
+  int (*grid_address)[3], (*iterated_address)[3];
+  char name[100];
+  SPGCONST int identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  SpglibIrMeshIterator *iterator;
+
+  num_failed = 0;
+  grid_address = (int (*)[3]) malloc(sizeof(int[3]) * 216);
+  map = (int*) malloc(sizeof(int) * 216);
+  map_expected = (int*) malloc(sizeof(int) * 216);
+  ir_grid_points = (int*) malloc(sizeof(int) * 216);
+  weights = (int*) malloc(sizeof(int) * 216);
+  /* Room for one more chunk after all the grid points */
+  iterated_points = (int*) malloc(sizeof(int) * (216 + 7));
+  iterated_weights = (int*) malloc(sizeof(int) * (216 + 7));
+  iterated_address = (int (*)[3]) malloc(sizeof(int[3]) * (216 + 7));
+
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 3; j++) {
+      mesh[j] = i < 2 ? 4 : 6;
+      is_shift[j] = i % 2;
+    }
+    num_grid = mesh[0] * mesh[1] * mesh[2];
+    sprintf(name, "%s: mesh %d %d %d, shift %d %d %d", st->name,
+	    mesh[0], mesh[1], mesh[2], is_shift[0], is_shift[1], is_shift[2]);
+    spg_get_ir_reciprocal_mesh(grid_address,
+			       map,
+			       mesh,
+			       is_shift,
+			       1,
+			       st->lattice,
+			       st->position,
+			       st->types,
+			       st->num_atom,
+			       SYMPREC);
+    if (get_orbit_map(map_expected,
+		      grid_address,
+		      mesh,
+		      is_shift,
+		      2,
+		      identity,
+		      st->rotation,
+		      st->size,
+		      1) > 0) {
+      map_ref = map_expected;
+    } else {
+      map_ref = map;
+    }
+    num_ir = get_ir_grid_points(ir_grid_points, weights, map_ref, num_grid);
+
+    if ((iterator = spg_alloc_ir_mesh_iterator(mesh,
+					       is_shift,
+					       1,
+					       st->lattice,
+					       st->position,
+					       st->types,
+					       st->num_atom,
+					       SYMPREC)) == NULL) {
+      printf("%s: spg_alloc_ir_mesh_iterator failed\n", name);
+      num_failed++;
+      continue;
+    }
+    num_iterated = 0;
+    while (num_iterated <= num_grid) {
+      num_next = spg_get_next_ir_grid_points(iterated_points + num_iterated,
+					     iterated_weights + num_iterated,
+					     iterated_address + num_iterated,
+					     7,
+					     iterator);
+      if (num_next == 0) {
+	break;
+      }
+      num_iterated += num_next;
+    }
+    spg_free_ir_mesh_iterator(iterator);
+
+    if (num_iterated != num_ir ||
+	memcmp(iterated_points, ir_grid_points, sizeof(int) * num_ir) != 0 ||
+	memcmp(iterated_weights, weights, sizeof(int) * num_ir) != 0) {
+      printf("%s: %d irreducible grid points iterated (%d)\n",
+	     name, num_iterated, num_ir);
+      num_failed++;
+      continue;
+    }
+    for (j = 0; j < num_ir; j++) {
+      if (memcmp(iterated_address[j],
+		 grid_address[ir_grid_points[j]], sizeof(int[3])) != 0) {
+	printf("%s: grid address of iterated grid point %d\n",
+	       name, ir_grid_points[j]);
+	num_failed++;
+	break;
+      }
+    }
+  }
+
+  free(iterated_address);
+  free(iterated_weights);
+  free(iterated_points);
+  free(weights);
+  free(ir_grid_points);
+  free(map_expected);
+  free(map);
+  free(grid_address);
+
+  return num_failed;
+}
+
+/* A diagonal grid_matrix gives the mesh of spg_get_ir_reciprocal_mesh */
+/* and its Brillouin zone. On the non-diagonal grids 3 (0 1 1, 1 0 1, */
+/* 1 1 0) and (2 1 0, 0 3 0, 0 0 4), of Smith normal forms */
+/* diag(3 3 6) and diag(1 2 12), unshifted and shifted by half, the */
+/* q-points are M^-1 (n + shift / 2), map is that of the orbits under */
+/* the rotations keeping the grid and the weights sum to |det M|. Their */
+/* grid addresses relocated in Brillouin zone are checked by brute */
+/* force. */
+static int check_generalized_mesh(Structure *st)
+{
+  int i, j, k, m, num_grid, num_ir, num_ir_g, num_bz, num_bz_g, num_failed;
+  int weight_sum;
+  int mesh[3], mesh_g[3], is_shift[3], shift[3], transformation[3][3];
+  int grid_matrix[3][3];
+  int *map, *map_g, *map_expected, *ir_grid_points, *weights;
+  int *bz_map, *bz_map_g;
+  const int *map_ref;
+  int (*grid_address)[3], (*grid_address_g)[3];
+  int (*bz_grid_address)[3], (*bz_grid_address_g)[3];
+  double rec_lattice[3][3], inv_lattice[3][3], inv_grid_matrix[3][3];
+  double microzone[3][3], q[3], diff[3], tolerance, length;
+  char name[100];
+  SPGCONST int identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  SPGCONST int grid_matrices[2][3][3] = {
+    {{0, 3, 3}, {3, 0, 3}, {3, 3, 0}},
+    {{2, 1, 0}, {0, 3, 0}, {0, 0, 4}},
+  };
+
+  num_failed = 0;
+  grid_address = (int (*)[3]) malloc(sizeof(int[3]) * 216);
+  grid_address_g = (int (*)[3]) malloc(sizeof(int[3]) * 216);
+  map = (int*) malloc(sizeof(int) * 216);
+  map_g = (int*) malloc(sizeof(int) * 216);
+  map_expected = (int*) malloc(sizeof(int) * 216);
+  ir_grid_points = (int*) malloc(sizeof(int) * 216);
+  weights = (int*) malloc(sizeof(int) * 216);
+  bz_grid_address = (int (*)[3]) malloc(sizeof(int[3]) * 216 * 8);
+  bz_grid_address_g = (int (*)[3]) malloc(sizeof(int[3]) * 216 * 8);
+  bz_map = (int*) malloc(sizeof(int) * 216 * 8);
+  bz_map_g = (int*) malloc(sizeof(int) * 216 * 8);
+
+  /* Columns of rec_lattice are the reciprocal basis vectors. */
+  inverse_matrix_d3(inv_lattice, st->lattice);
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      rec_lattice[i][j] = inv_lattice[j][i];
+    }
+  }
+
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 3; j++) {
+      mesh[j] = i < 2 ? 4 : 6;
+      is_shift[j] = i % 2;
+      for (k = 0; k < 3; k++) {
+	grid_matrix[j][k] = j == k ? mesh[j] : 0;
+      }
+    }
+    num_grid = mesh[0] * mesh[1] * mesh[2];
+    sprintf(name, "%s: grid matrix diag(%d %d %d), shift %d %d %d",
+	    st->name, mesh[0], mesh[1], mesh[2],
+	    is_shift[0], is_shift[1], is_shift[2]);
+
+    if (! spg_get_generalized_mesh(mesh_g,
+				   shift,
+				   transformation,
+				   grid_matrix,
+				   is_shift) ||
+	memcmp(mesh_g, mesh, sizeof(int[3])) != 0 ||
+	memcmp(shift, is_shift, sizeof(int[3])) != 0 ||
+	memcmp(transformation, identity, sizeof(int[3][3])) != 0) {
+      printf("%s: spg_get_generalized_mesh is not the mesh\n", name);
+      num_failed++;
+      continue;
+    }
+
+    num_ir = spg_get_ir_reciprocal_mesh(grid_address,
+					map,
+					mesh,
+					is_shift,
+					1,
+					st->lattice,
+					st->position,
+					st->types,
+					st->num_atom,
+					SYMPREC);
+    num_ir_g = spg_get_ir_generalized_reciprocal_mesh(grid_address_g,
+						      map_g,
+						      grid_matrix,
+						      is_shift,
+						      1,
+						      st->lattice,
+						      st->position,
+						      st->types,
+						      st->num_atom,
+						      SYMPREC);
+    if (get_orbit_map(map_expected,
+		      grid_address,
+		      mesh,
+		      is_shift,
+		      2,
+		      identity,
+		      st->rotation,
+		      st->size,
+		      1) > 0) {
+      map_ref = map_expected;
+      num_ir = get_ir_grid_points(ir_grid_points, weights, map_ref, num_grid);
+    } else {
+      map_ref = map;
+    }
+    if (num_ir_g != num_ir ||
+	memcmp(map_g, map_ref, sizeof(int) * num_grid) != 0 ||
+	memcmp(grid_address_g, grid_address,
+	       sizeof(int[3]) * num_grid) != 0) {
+      printf("%s: %d irreducible grid points (%d)\n", name, num_ir_g, num_ir);
+      num_failed++;
+    }
+
+    num_bz = spg_relocate_BZ_grid_address(bz_grid_address,
+					  bz_map,
+					  grid_address,
+					  mesh,
+					  rec_lattice,
+					  is_shift);
+    num_bz_g = spg_relocate_BZ_generalized_grid_address(bz_grid_address_g,
+							bz_map_g,
+							grid_address_g,
+							grid_matrix,
+							rec_lattice,
+							is_shift);
+    if (num_bz_g != num_bz ||
+	memcmp(bz_grid_address_g, bz_grid_address,
+	       sizeof(int[3]) * num_bz) != 0 ||
+	memcmp(bz_map_g, bz_map, sizeof(int) * num_grid * 8) != 0) {
+      printf("%s: %d grid points relocated in Brillouin zone (%d)\n",
+	     name, num_bz_g, num_bz);
+      num_failed++;
+    }
+  }
+
+  for (m = 0; m < 4; m++) {
+    for (i = 0; i < 3; i++) {
+      is_shift[i] = m % 2;
+    }
+    sprintf(name, "%s: grid matrix (%d %d %d, %d %d %d, %d %d %d), "
+	    "shift %d %d %d", st->name,
+	    grid_matrices[m / 2][0][0], grid_matrices[m / 2][0][1],
+	    grid_matrices[m / 2][0][2], grid_matrices[m / 2][1][0],
+	    grid_matrices[m / 2][1][1], grid_matrices[m / 2][1][2],
+	    grid_matrices[m / 2][2][0], grid_matrices[m / 2][2][1],
+	    grid_matrices[m / 2][2][2],
+	    is_shift[0], is_shift[1], is_shift[2]);
+    num_grid = m < 2 ? 54 : 24;
+    if (! spg_get_generalized_mesh(mesh,
+				   shift,
+				   transformation,
+				   grid_matrices[m / 2],
+				   is_shift) ||
+	mesh[0] * mesh[1] * mesh[2] != num_grid) {
+      printf("%s: spg_get_generalized_mesh failed\n", name);
+      num_failed++;
+      continue;
+    }
+
+    num_ir = spg_get_ir_generalized_reciprocal_mesh(grid_address,
+						    map,
+						    grid_matrices[m / 2],
+						    is_shift,
+						    1,
+						    st->lattice,
+						    st->position,
+						    st->types,
+						    st->num_atom,
+						    SYMPREC);
+    for (i = 0; i < num_grid; i++) {
+      for (j = 0; j < 3; j++) {
+	q[j] = 0;
+	for (k = 0; k < 3; k++) {
+	  q[j] += transformation[j][k] *
+	    (grid_address[i][k] + shift[k] * 0.5) / mesh[k];
+	}
+      }
+      for (j = 0; j < 3; j++) {
+	diff[j] = (grid_matrices[m / 2][j][0] * q[0] +
+		   grid_matrices[m / 2][j][1] * q[1] +
+		   grid_matrices[m / 2][j][2] * q[2] - is_shift[j] * 0.5);
+      }
+      if (spg_get_grid_point(grid_address[i], mesh) != i ||
+	  ! is_integer_vector(diff, 1e-8)) {
+	printf("%s: grid address of grid point %d\n", name, i);
+	num_failed++;
+	break;
+      }
+    }
+    if (i < num_grid) {
+      continue;
+    }
+
+    get_orbit_map(map_expected,
+		  grid_address,
+		  mesh,
+		  shift,
+		  2,
+		  transformation,
+		  st->rotation,
+		  st->size,
+		  1);
+    num_ir_g = get_ir_grid_points(ir_grid_points, weights, map, num_grid);
+    weight_sum = 0;
+    for (i = 0; i < num_ir_g; i++) {
+      weight_sum += weights[i];
+    }
+    if (num_ir != num_ir_g || weight_sum != num_grid ||
+	memcmp(map, map_expected, sizeof(int) * num_grid) != 0) {
+      printf("%s: %d irreducible grid points of weights summing to %d\n",
+	     name, num_ir, weight_sum);
+      num_failed++;
+    }
+
+    /* Tolerance of the search, 1% of the longest microzone vector */
+    for (i = 0; i < 3; i++) {
+      for (j = 0; j < 3; j++) {
+	microzone[i][j] = grid_matrices[m / 2][i][j];
+      }
+    }
+    inverse_matrix_d3(inv_grid_matrix, microzone);
+    tolerance = 0;
+    for (i = 0; i < 3; i++) {
+      length = 0;
+      for (j = 0; j < 3; j++) {
+	microzone[j][i] = (rec_lattice[j][0] * inv_grid_matrix[0][i] +
+			   rec_lattice[j][1] * inv_grid_matrix[1][i] +
+			   rec_lattice[j][2] * inv_grid_matrix[2][i]);
+	length += microzone[j][i] * microzone[j][i];
+      }
+      if (tolerance < length * 0.01) {
+	tolerance = length * 0.01;
+      }
+    }
+    num_bz = spg_relocate_BZ_generalized_grid_address(bz_grid_address,
+						      bz_map,
+						      grid_address,
+						      grid_matrices[m / 2],
+						      rec_lattice,
+						      is_shift);
+    num_failed += check_BZ_grid_address(name,
+					bz_grid_address,
+					bz_map,
+					num_bz,
+					mesh,
+					shift,
+					transformation,
+					rec_lattice,
+					tolerance);
+  }
+
+  free(bz_map_g);
+  free(bz_map);
+  free(bz_grid_address_g);
+  free(bz_grid_address);
+  free(weights);
+  free(ir_grid_points);
+  free(map_expected);
+  free(map_g);
+  free(map);
+  free(grid_address_g);
+  free(grid_address);
+
+  return num_failed;
+}
+
+/* With shift_denominator 2, the results are those of */
+/* spg_get_ir_reciprocal_mesh on meshes keeping the symmetry, and */
+/* differ on the others, e.g., half shifted hexagonal meshes. With */
+/* shift_denominator 4, map is that of the orbits under the rotations */
+/* keeping the mesh. */
+static int check_ir_mesh_with_shift(Structure *st)
+{
+  int i, j, num_grid, num_ir, num_ir_shift, num_dropped, num_failed;
+  int mesh[3], shift[3];
+  int *map, *map_shift, *map_expected, *ir_grid_points, *weights;
+  int (*grid_address)[3], (*grid_address_shift)[3];
+  char name[100];
+  SPGCONST int identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+
+  num_failed = 0;
+  grid_address = (int (*)[3]) malloc(sizeof(int[3]) * 216);
+  grid_address_shift = (int (*)[3]) malloc(sizeof(int[3]) * 216);
+  map = (int*) malloc(sizeof(int) * 216);
+  map_shift = (int*) malloc(sizeof(int) * 216);
+  map_expected = (int*) malloc(sizeof(int) * 216);
+  ir_grid_points = (int*) malloc(sizeof(int) * 216);
+  weights = (int*) malloc(sizeof(int) * 216);
+
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 3; j++) {
+      mesh[j] = i < 2 ? 4 : 6;
+      shift[j] = i % 2;
+    }
+    num_grid = mesh[0] * mesh[1] * mesh[2];
+    sprintf(name, "%s: mesh %d %d %d, shift %d/2 %d/2 %d/2", st->name,
+	    mesh[0], mesh[1], mesh[2], shift[0], shift[1], shift[2]);
+    num_ir = spg_get_ir_reciprocal_mesh(grid_address,
+					map,
+					mesh,
+					shift,
+					1,
+					st->lattice,
+					st->position,
+					st->types,
+					st->num_atom,
+					SYMPREC);
+    num_ir_shift = spg_get_ir_reciprocal_mesh_with_shift(grid_address_shift,
+							 map_shift,
+							 mesh,
+							 shift,
+							 2,
+							 1,
+							 st->lattice,
+							 st->position,
+							 st->types,
+							 st->num_atom,
+							 SYMPREC);
+    if (memcmp(grid_address_shift, grid_address,
+	       sizeof(int[3]) * num_grid) != 0) {
+      printf("%s: grid addresses differ from spg_get_ir_reciprocal_mesh\n",
+	     name);
+      num_failed++;
+      continue;
+    }
+    num_dropped = get_orbit_map(map_expected,
+				grid_address,
+				mesh,
+				shift,
+				2,
+				identity,
+				st->rotation,
+				st->size,
+				1);
+    if (num_dropped == 0 &&
+	(num_ir_shift != num_ir ||
+	 memcmp(map_shift, map, sizeof(int) * num_grid) != 0)) {
+      printf("%s: %d irreducible grid points (%d of "
+	     "spg_get_ir_reciprocal_mesh)\n", name, num_ir_shift, num_ir);
+      num_failed++;
+    }
+    if (num_dropped > 0 &&
+	(num_ir_shift == num_ir ||
+	 memcmp(map_shift, map_expected, sizeof(int) * num_grid) != 0)) {
+      printf("%s: %d irreducible grid points on a mesh not keeping the "
+	     "symmetry (%d of spg_get_ir_reciprocal_mesh)\n",
+	     name, num_ir_shift, num_ir);
+      num_failed++;
+    }
+  }
+
+  for (i = 0; i < 2; i++) {
+    for (j = 0; j < 3; j++) {
+      mesh[j] = i == 0 ? 4 : 6;
+      shift[j] = 1;
+    }
+    num_grid = mesh[0] * mesh[1] * mesh[2];
+    sprintf(name, "%s: mesh %d %d %d, shift 1/4 1/4 1/4", st->name,
+	    mesh[0], mesh[1], mesh[2]);
+    num_ir_shift = spg_get_ir_reciprocal_mesh_with_shift(grid_address_shift,
+							 map_shift,
+							 mesh,
+							 shift,
+							 4,
+							 1,
+							 st->lattice,
+							 st->position,
+							 st->types,
+							 st->num_atom,
+							 SYMPREC);
+    get_orbit_map(map_expected,
+		  grid_address_shift,
+		  mesh,
+		  shift,
+		  4,
+		  identity,
+		  st->rotation,
+		  st->size,
+		  1);
+    num_ir = get_ir_grid_points(ir_grid_points, weights, map_expected,
+				num_grid);
+    if (num_ir_shift != num_ir ||
+	memcmp(map_shift, map_expected, sizeof(int) * num_grid) != 0) {
+      printf("%s: %d irreducible grid points (%d)\n",
+	     name, num_ir_shift, num_ir);
+      num_failed++;
+    }
+  }
+
+  free(weights);
+  free(ir_grid_points);
+  free(map_expected);
+  free(map_shift);
+  free(map);
+  free(grid_address_shift);
+  free(grid_address);
+
+  return num_failed;
+}
+
+/* The atoms of the 4x4x4 supercell are moved at random by up to 0.3 */
+/* symprec. The operations of the dataset are those of the unit cell */
+/* combined with the 64 pure translations, and the space group is */
+/* that of the unit cell. */
+static int check_noisy_supercell(Structure *st)
+{
+  int i, j, k, n, size, num_failed;
+  int (*rotation)[3][3];
+  double length, amplitude;
+  double (*translation)[3], (*position)[3];
+  const double symprec = 1e-2;
+  char name[100];
+  Structure supercell;
+  SpglibDataset *dataset, *dataset_supercell;
+
+  num_failed = 0;
+  sprintf(name, "%s: noisy 4x4x4 supercell", st->name);
+  supercell.name = name;
+  supercell.num_atom = st->num_atom * 64;
+  supercell.size = 0;
+  supercell.rotation = NULL;
+  supercell.translation = NULL;
+  supercell.position = (double (*)[3]) malloc(sizeof(double[3]) *
+					      supercell.num_atom);
+  supercell.types = (int*) malloc(sizeof(int) * supercell.num_atom);
+  position = (double (*)[3]) malloc(sizeof(double[3]) * supercell.num_atom);
+  rotation = NULL;
+  translation = NULL;
+
+  length = 0;
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      supercell.lattice[i][j] = st->lattice[i][j] * 4;
+    }
+    length += sqrt(supercell.lattice[0][i] * supercell.lattice[0][i] +
+		   supercell.lattice[1][i] * supercell.lattice[1][i] +
+		   supercell.lattice[2][i] * supercell.lattice[2][i]);
+  }
+  for (n = 0; n < 64; n++) {
+    for (i = 0; i < st->num_atom; i++) {
+      k = st->num_atom * n + i;
+      supercell.position[k][0] = (st->position[i][0] + n / 16) / 4;
+      supercell.position[k][1] = (st->position[i][1] + (n / 4) % 4) / 4;
+      supercell.position[k][2] = (st->position[i][2] + n % 4) / 4;
+      supercell.types[k] = st->types[i];
+    }
+  }
+  /* Each coordinate moves an atom by at most amplitude * length. */
+  amplitude = symprec * 0.3 / length;
+  set_noisy_positions(position, &supercell, amplitude, 1);
+
+  dataset = spg_get_dataset(st->lattice,
+			    st->position,
+			    st->types,
+			    st->num_atom,
+			    symprec);
+  if (dataset == NULL) {
+    printf("%s: spg_get_dataset of the unit cell failed\n", name);
+    num_failed++;
+    goto ret;
+  }
+  rotation = (int (*)[3][3]) malloc(sizeof(int[3][3]) *
+				    dataset->n_operations * 64);
+  translation = (double (*)[3]) malloc(sizeof(double[3]) *
+				      dataset->n_operations * 64);
+  size = 0;
+  for (i = 0; i < dataset->n_operations; i++) {
+    for (n = 0; n < 64; n++) {
+      memcpy(rotation[size], dataset->rotations[i], sizeof(int[3][3]));
+      translation[size][0] = (dataset->translations[i][0] + n / 16) / 4;
+      translation[size][1] = (dataset->translations[i][1] + (n / 4) % 4) / 4;
+      translation[size][2] = (dataset->translations[i][2] + n % 4) / 4;
+      size++;
+    }
+  }
+
+  dataset_supercell = spg_get_dataset(supercell.lattice,
+				      position,
+				      supercell.types,
+				      supercell.num_atom,
+				      symprec);
+  if (dataset_supercell == NULL) {
+    printf("%s: spg_get_dataset failed\n", name);
+    num_failed++;
+  } else {
+    if (dataset_supercell->spacegroup_number != dataset->spacegroup_number) {
+      printf("%s: space group %d (%d)\n", name,
+	     dataset_supercell->spacegroup_number, dataset->spacegroup_number);
+      num_failed++;
+    }
+    num_failed += compare_operations(name,
+				     dataset_supercell->rotations,
+				     dataset_supercell->translations,
+				     dataset_supercell->n_operations,
+				     rotation,
+				     translation,
+				     size);
+    spg_free_dataset(dataset_supercell);
+  }
+  spg_free_dataset(dataset);
+
+ ret:
+  free(translation);
+  free(rotation);
+  free(position);
+  free(supercell.types);
+  free(supercell.position);
+
+  return num_failed;
+}
+
+/* Pure translations of a noisy 3x3x3 supercell are those found by */
+/* checking every candidate, and the atoms of the supercell are */
+/* grouped into the primitive cell as by comparing all pairs. Atoms */
+/* are moved by up to 0.05-0.3 symprec, so that the overlap distances */
+/* |t| of pure translations t are around symprec / 2, where a */
+/* translation t + g is accepted unchecked if |t| + 2|g| < symprec / 2. */
+static int check_noisy_primitive(Structure *st)
+{
+  int i, j, k, n, num_trans, num_failed;
+  double length;
+  double (*translation)[3];
+  const double symprec = 1e-2;
+  const double ratios[6] = {0.05, 0.1, 0.15, 0.3, 0.5, 0.7};
+  char name[100];
+  Structure supercell;
+  Cell *cell;
+  VecDBL *pure_trans;
+  Primitive *primitive;
+
+  num_failed = 0;
+  supercell.name = st->name;
+  supercell.num_atom = st->num_atom * 27;
+  supercell.position = (double (*)[3]) malloc(sizeof(double[3]) *
+					      supercell.num_atom);
+  supercell.types = (int*) malloc(sizeof(int) * supercell.num_atom);
+  translation = (double (*)[3]) malloc(sizeof(double[3]) *
+				       supercell.num_atom);
+  if ((cell = cel_alloc_cell(supercell.num_atom)) == NULL) {
+    printf("%s: cel_alloc_cell failed\n", st->name);
+    num_failed++;
+    goto ret;
+  }
+
+  length = 0;
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      supercell.lattice[i][j] = st->lattice[i][j] * 3;
+    }
+    length += sqrt(supercell.lattice[0][i] * supercell.lattice[0][i] +
+		   supercell.lattice[1][i] * supercell.lattice[1][i] +
+		   supercell.lattice[2][i] * supercell.lattice[2][i]);
+  }
+  for (n = 0; n < 27; n++) {
+    for (i = 0; i < st->num_atom; i++) {
+      k = st->num_atom * n + i;
+      supercell.position[k][0] = (st->position[i][0] + n / 9) / 3;
+      supercell.position[k][1] = (st->position[i][1] + (n / 3) % 3) / 3;
+      supercell.position[k][2] = (st->position[i][2] + n % 3) / 3;
+      supercell.types[k] = st->types[i];
+    }
+  }
+
+  for (k = 0; k < 6; k++) {
+    sprintf(name, "%s: 3x3x3 supercell with noise %g symprec",
+	    st->name, ratios[k]);
+    set_noisy_positions(cell->position,
+			&supercell,
+			symprec * ratios[k] / length,
+			k + 1);
+    memcpy(cell->lattice, supercell.lattice, sizeof(double[3][3]));
+    memcpy(cell->types, supercell.types, sizeof(int) * cell->size);
+
+    num_trans = get_pure_translations(translation, cell, symprec);
+    if ((pure_trans = sym_get_pure_translation(cell, symprec, NULL))
+	== NULL) {
+      printf("%s: sym_get_pure_translation failed\n", name);
+      num_failed++;
+      continue;
+    }
+    if (pure_trans->size != num_trans ||
+	memcmp(pure_trans->vec, translation,
+	       sizeof(double[3]) * num_trans) != 0) {
+      printf("%s: %d pure translations (%d)\n",
+	     name, pure_trans->size, num_trans);
+      num_failed++;
+    }
+    mat_free_VecDBL(pure_trans);
+
+    if ((primitive = prm_get_primitive(cell, symprec, NULL)) == NULL) {
+      printf("%s: prm_get_primitive failed\n", name);
+      num_failed++;
+      continue;
+    }
+    num_failed += check_trimmed_cell(name, cell, primitive);
+    prm_free_primitive(primitive);
+  }
+
+ ret:
+  cel_free_cell(cell);
+  free(translation);
+  free(supercell.types);
+  free(supercell.position);
+
+  return num_failed;
+}
+
+/* The distance kernels give the same distances and mappings as the */
+/* scalar kernel for a noisy 2x2x2 supercell, for the operations of */
+/* the supercell and for these operations with shifted translations. */
+/* Kernels not supported by the CPU are skipped. */
+static int check_distance_kernels(Structure *st)
+{
+  int i, j, n, m, num_atom, num_failed;
+  int *types, *mapping, *mapping_scalar;
+  double dist, dist_scalar, length;
+  double lattice[3][3];
+  double translation[3], shifts[3];
+  double (*position)[3];
+  const double symprec = 1e-1;
+  const OverlapKernel kernels[3] = {OVL_KERNEL_AUTO,
+				    OVL_KERNEL_AVX2,
+				    OVL_KERNEL_AVX512};
+  Cell *cell;
+  OverlapChecker *checker, *checker_scalar;
+  SpglibDataset *dataset;
+
+  num_failed = 0;
+  num_atom = st->num_atom * 8;
+  position = (double (*)[3]) malloc(sizeof(double[3]) * num_atom);
+  types = (int*) malloc(sizeof(int) * num_atom);
+  mapping = (int*) malloc(sizeof(int) * num_atom);
+  mapping_scalar = (int*) malloc(sizeof(int) * num_atom);
+  checker_scalar = NULL;
+  dataset = NULL;
+
+  length = 0;
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      lattice[i][j] = st->lattice[i][j] * 2;
+    }
+    length += sqrt(lattice[0][i] * lattice[0][i] +
+		   lattice[1][i] * lattice[1][i] +
+		   lattice[2][i] * lattice[2][i]);
+  }
+  /* A coordinate shifted by s moves an atom by at most s * length. */
+  for (n = 0; n < 8; n++) {
+    for (i = 0; i < st->num_atom; i++) {
+      j = st->num_atom * n + i;
+      position[j][0] = (st->position[i][0] + n / 4) / 2;
+      position[j][1] = (st->position[i][1] + (n / 2) % 2) / 2;
+      position[j][2] = (st->position[i][2] + n % 2) / 2;
+      position[j][0] += symprec * 0.3 / length * sin(j * 3);
+      position[j][1] += symprec * 0.3 / length * sin(j * 3 + 1);
+      position[j][2] += symprec * 0.3 / length * sin(j * 3 + 2);
+      types[j] = st->types[i];
+    }
+  }
+  shifts[0] = 0;
+  shifts[1] = symprec * 0.5 / length;
+  shifts[2] = symprec * 3 / length;
+
+  if ((cell = cel_alloc_cell(num_atom)) == NULL) {
+    printf("%s: cel_alloc_cell failed\n", st->name);
+    num_failed++;
+    goto ret;
+  }
+  cel_set_cell(cell, lattice, position, types);
+  checker_scalar = ovl_overlap_checker_init_with_kernel(cell,
+							symprec,
+							OVL_KERNEL_SCALAR);
+  dataset = spg_get_dataset(lattice, position, types, num_atom, symprec);
+  if (checker_scalar == NULL || dataset == NULL) {
+    printf("%s: scalar overlap checker or dataset of the supercell\n",
+	   st->name);
+    num_failed++;
+    goto ret;
+  }
+
+  for (m = 0; m < 3; m++) {
+    if ((checker = ovl_overlap_checker_init_with_kernel(cell,
+							symprec,
+							kernels[m]))
+	== NULL) {
+      continue;
+    }
+    for (i = 0; i < dataset->n_operations * 3; i++) {
+      for (j = 0; j < 3; j++) {
+	translation[j] = dataset->translations[i / 3][j] + shifts[i % 3];
+      }
+      dist_scalar = ovl_get_overlap_mapping(mapping_scalar,
+					    checker_scalar,
+					    translation,
+					    dataset->rotations[i / 3],
+					    0,
+					    NULL);
+      dist = ovl_get_overlap_mapping(mapping,
+				     checker,
+				     translation,
+				     dataset->rotations[i / 3],
+				     0,
+				     NULL);
+      if (dist != dist_scalar ||
+	  (dist > -1 &&
+	   memcmp(mapping, mapping_scalar, sizeof(int) * num_atom) != 0)) {
+	printf("%s: distance kernel %d differs from the scalar kernel "
+	       "for operation %d\n", st->name, kernels[m], i);
+	num_failed++;
+	break;
+      }
+    }
+    ovl_overlap_checker_free(checker);
+  }
+
+ ret:
+  spg_free_dataset(dataset);
+  ovl_overlap_checker_free(checker_scalar);
+  cel_free_cell(cell);
+  free(mapping_scalar);
+  free(mapping);
+  free(types);
+  free(position);
+
+  return num_failed;
+}
+
+/* spgat_get_dataset, spgat_get_symmetry and spgat_get_datasets_batch */
+/* called at once on several threads, each with its own angle */
+/* tolerance on a slightly sheared lattice, give the same results as */
+/* serial calls. */
+static int check_threads(Structure *st)
+{
+#ifdef HAVE_PTHREAD
+  int i, j, num_failed;
+  const double angle_tolerances[NUM_THREADS] = {-1, 0.5, 2, 5};
+  pthread_t threads[NUM_THREADS];
+  ThreadWork works[NUM_THREADS];
+
+  num_failed = 0;
+  for (i = 0; i < NUM_THREADS; i++) {
+    works[i].st = st;
+    memcpy(works[i].lattice, st->lattice, sizeof(double[3][3]));
+    for (j = 0; j < 3; j++) {
+      works[i].lattice[j][1] += st->lattice[j][0] * 0.01;
+    }
+    works[i].angle_tolerance = angle_tolerances[i];
+    works[i].repeat = 0;
+    works[i].num_failed = 0;
+    works[i].rotation = (int (*)[3][3]) malloc(sizeof(int[3][3]) *
+					      st->num_atom * 48);
+    works[i].translation = (double (*)[3]) malloc(sizeof(double[3]) *
+						  st->num_atom * 48);
+    works[i].expected = spgat_get_dataset(works[i].lattice,
+					  st->position,
+					  st->types,
+					  st->num_atom,
+					  SYMPREC,
+					  works[i].angle_tolerance);
+    works[i].size = spgat_get_symmetry(works[i].rotation,
+				       works[i].translation,
+				       st->num_atom * 48,
+				       works[i].lattice,
+				       st->position,
+				       st->types,
+				       st->num_atom,
+				       SYMPREC,
+				       works[i].angle_tolerance);
+  }
+
+  for (i = 0; i < NUM_THREADS; i++) {
+    works[i].repeat = 3;
+    if (pthread_create(&threads[i], NULL, run_thread_work, &works[i])) {
+      printf("%s: pthread_create failed\n", st->name);
+      works[i].repeat = 0;
+      works[i].num_failed = 1;
+    }
+  }
+  for (i = 0; i < NUM_THREADS; i++) {
+    if (works[i].repeat > 0) {
+      pthread_join(threads[i], NULL);
+    }
+    num_failed += works[i].num_failed;
+    spg_free_dataset(works[i].expected);
+    free(works[i].translation);
+    free(works[i].rotation);
+  }
+
+  return num_failed;
+#else
+  return 0;
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+static void * run_thread_work(void *arg)
+{
+  int i, j, size, num_atom;
+  int offsets[3];
+  int (*rotation)[3][3];
+  int *types;
+  double lattices[2][3][3];
+  double (*translation)[3];
+  double (*positions)[3];
+  char name[100];
+  ThreadWork *work;
+  SpglibDataset *dataset;
+  SpglibDataset *datasets[2];
+
+  work = (ThreadWork*) arg;
+  num_atom = work->st->num_atom;
+  sprintf(name, "%s: thread with angle tolerance %g",
+	  work->st->name, work->angle_tolerance);
+  rotation = (int (*)[3][3]) malloc(sizeof(int[3][3]) * num_atom * 48);
+  translation = (double (*)[3]) malloc(sizeof(double[3]) * num_atom * 48);
+  positions = (double (*)[3]) malloc(sizeof(double[3]) * num_atom * 2);
+  types = (int*) malloc(sizeof(int) * num_atom * 2);
+  for (i = 0; i < 2; i++) {
+    memcpy(lattices[i], work->lattice, sizeof(double[3][3]));
+    offsets[i] = num_atom * i;
+    memcpy(positions + offsets[i],
+	   work->st->position,
+	   sizeof(double[3]) * num_atom);
+    memcpy(types + offsets[i], work->st->types, sizeof(int) * num_atom);
+  }
+  offsets[2] = num_atom * 2;
+
+  for (i = 0; i < work->repeat; i++) {
+    dataset = spgat_get_dataset(work->lattice,
+				work->st->position,
+				work->st->types,
+				work->st->num_atom,
+				SYMPREC,
+				work->angle_tolerance);
+    work->num_failed += compare_datasets(name, dataset, work->expected);
+    spg_free_dataset(dataset);
+
+    size = spgat_get_symmetry(rotation,
+			      translation,
+			      work->st->num_atom * 48,
+			      work->lattice,
+			      work->st->position,
+			      work->st->types,
+			      work->st->num_atom,
+			      SYMPREC,
+			      work->angle_tolerance);
+    work->num_failed += compare_operations(name,
+					   rotation,
+					   translation,
+					   size,
+					   work->rotation,
+					   work->translation,
+					   work->size);
+
+    spgat_get_datasets_batch(datasets,
+			     2,
+			     lattices,
+			     positions,
+			     types,
+			     offsets,
+			     SYMPREC,
+			     work->angle_tolerance);
+    for (j = 0; j < 2; j++) {
+      work->num_failed += compare_datasets(name, datasets[j], work->expected);
+      spg_free_dataset(datasets[j]);
+    }
+  }
+
+  free(types);
+  free(positions);
+  free(translation);
+  free(rotation);
+
+  return NULL;
+}
+#endif
+
+/* Only files in the format of test/data are read. */
+static int read_poscar(Structure *st, const char *filename)
+{
+  int i, j, k, num_types, count, offset;
+  int counts[100];
+  double scale;
+  double vectors[3][3];
+  char line[1024];
+  char *p;
+  FILE *fp;
+
+  if ((fp = fopen(filename, "r")) == NULL) {
+    return 0;
+  }
+
+  st->name = (char*) malloc(strlen(filename) + 1);
+  strcpy(st->name, filename);
+  fgets(line, sizeof(line), fp);
+  fgets(line, sizeof(line), fp);
+  scale = atof(line);
+  for (i = 0; i < 3; i++) {
+    fgets(line, sizeof(line), fp);
+    sscanf(line, "%lf %lf %lf",
+	   &vectors[i][0], &vectors[i][1], &vectors[i][2]);
+  }
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      st->lattice[i][j] = vectors[j][i] * scale;
+    }
+  }
+
+  fgets(line, sizeof(line), fp);
+  num_types = 0;
+  st->num_atom = 0;
+  p = line;
+  while (num_types < 100 && sscanf(p, "%d%n", &count, &offset) == 1) {
+    counts[num_types] = count;
+    st->num_atom += count;
+    num_types++;
+    p += offset;
+  }
+  fgets(line, sizeof(line), fp);
+
+  st->position = (double (*)[3]) malloc(sizeof(double[3]) * st->num_atom);
+  st->types = (int*) malloc(sizeof(int) * st->num_atom);
+  k = 0;
+  for (i = 0; i < num_types; i++) {
+    for (j = 0; j < counts[i]; j++) {
+      fgets(line, sizeof(line), fp);
+      sscanf(line, "%lf %lf %lf",
+	     &st->position[k][0], &st->position[k][1], &st->position[k][2]);
+      st->types[k] = i + 1;
+      k++;
+    }
+  }
+  fclose(fp);
+
+  st->size = spg_get_multiplicity(st->lattice,
+				  st->position,
+				  st->types,
+				  st->num_atom,
+				  SYMPREC);
+  st->rotation = (int (*)[3][3]) malloc(sizeof(int[3][3]) * st->size);
+  st->translation = (double (*)[3]) malloc(sizeof(double[3]) * st->size);
+  spg_get_symmetry(st->rotation,
+		   st->translation,
+		   st->size,
+		   st->lattice,
+		   st->position,
+		   st->types,
+		   st->num_atom,
+		   SYMPREC);
+
+  return st->num_atom > 0 && st->size > 0;
+}
+
+static void free_structure(Structure *st)
+{
+  free(st->translation);
+  free(st->rotation);
+  free(st->types);
+  free(st->position);
+  free(st->name);
+}
+
+/* Space group, operations and atoms of the datasets are compared. */
+static int compare_datasets(const char *name,
+			    const SpglibDataset *dataset,
+			    const SpglibDataset *expected)
+{
+  int i;
+  double diff[3];
+
+  if (dataset == NULL || expected == NULL) {
+    printf("%s: no dataset\n", name);
+    return 1;
+  }
+
+  if (dataset->spacegroup_number != expected->spacegroup_number ||
+      dataset->hall_number != expected->hall_number ||
+      dataset->n_operations != expected->n_operations ||
+      dataset->n_atoms != expected->n_atoms) {
+    printf("%s: dataset of %s with %d operations (%s with %d)\n", name,
+	   dataset->international_symbol, dataset->n_operations,
+	   expected->international_symbol, expected->n_operations);
+    return 1;
+  }
+
+  if (memcmp(dataset->rotations, expected->rotations,
+	     sizeof(int[3][3]) * expected->n_operations) != 0) {
+    printf("%s: rotations of the datasets differ\n", name);
+    return 1;
+  }
+  for (i = 0; i < expected->n_operations; i++) {
+    diff[0] = dataset->translations[i][0] - expected->translations[i][0];
+    diff[1] = dataset->translations[i][1] - expected->translations[i][1];
+    diff[2] = dataset->translations[i][2] - expected->translations[i][2];
+    if (! is_integer_vector(diff, MAP_TOLERANCE)) {
+      printf("%s: translation %d of the datasets differs\n", name, i);
+      return 1;
+    }
+  }
+
+  if (memcmp(dataset->equivalent_atoms, expected->equivalent_atoms,
+	     sizeof(int) * expected->n_atoms) != 0 ||
+      memcmp(dataset->wyckoffs, expected->wyckoffs,
+	     sizeof(int) * expected->n_atoms) != 0) {
+    printf("%s: atoms of the datasets differ\n", name);
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Space group, the set of operations and the orbits of atoms of the */
+/* datasets are compared. Their order, the origin and Wyckoff letters */
+/* may differ. */
+static int compare_symmetry(const char *name,
+			    const SpglibDataset *dataset,
+			    const SpglibDataset *expected)
+{
+  int i, j;
+
+  if (dataset == NULL || expected == NULL) {
+    printf("%s: no dataset\n", name);
+    return 1;
+  }
+
+  if (dataset->spacegroup_number != expected->spacegroup_number ||
+      dataset->hall_number != expected->hall_number ||
+      dataset->n_operations != expected->n_operations ||
+      dataset->n_atoms != expected->n_atoms) {
+    printf("%s: dataset of %s with %d operations (%s with %d)\n", name,
+	   dataset->international_symbol, dataset->n_operations,
+	   expected->international_symbol, expected->n_operations);
+    return 1;
+  }
+
+  if (compare_operations(name,
+			 dataset->rotations,
+			 dataset->translations,
+			 dataset->n_operations,
+			 expected->rotations,
+			 expected->translations,
+			 expected->n_operations)) {
+    return 1;
+  }
+
+  for (i = 0; i < expected->n_atoms; i++) {
+    j = expected->equivalent_atoms[i];
+    if (dataset->equivalent_atoms[i] != dataset->equivalent_atoms[j]) {
+      printf("%s: atoms %d and %d are not equivalent\n", name, i, j);
+      return 1;
+    }
+    j = dataset->equivalent_atoms[i];
+    if (expected->equivalent_atoms[i] != expected->equivalent_atoms[j]) {
+      printf("%s: atoms %d and %d are equivalent\n", name, i, j);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* The sets of operations are compared regardless of their order. */
+static int compare_operations(const char *name,
+			      SPGCONST int rotation[][3][3],
+			      SPGCONST double translation[][3],
+			      const int size,
+			      SPGCONST int expected_rotation[][3][3],
+			      SPGCONST double expected_translation[][3],
+			      const int expected_size)
+{
+  int i;
+
+  if (size != expected_size) {
+    printf("%s: %d operations (%d)\n", name, size, expected_size);
+    return 1;
+  }
+
+  for (i = 0; i < expected_size; i++) {
+    if (find_operation(rotation, translation, size,
+		       expected_rotation[i], expected_translation[i]) < 0) {
+      printf("%s: operation %d is missing\n", name, i);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Index of the operation among the first size ones, or -1. */
+static int find_operation(SPGCONST int rotations[][3][3],
+			  SPGCONST double translations[][3],
+			  const int size,
+			  SPGCONST int rotation[3][3],
+			  const double translation[3])
+{
+  int i, j;
+  double diff[3];
+
+  for (i = 0; i < size; i++) {
+    if (memcmp(rotations[i], rotation, sizeof(int[3][3])) != 0) {
+      continue;
+    }
+    for (j = 0; j < 3; j++) {
+      diff[j] = translation[j] - translations[i][j];
+    }
+    if (is_integer_vector(diff, MAP_TOLERANCE)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/* Rows of the permutation table other than those of -1 are the */
+/* nearest atoms to the atoms moved by the operations. */
+static int compare_permutations(const char *name,
+				const SpglibDataset *dataset,
+				SPGCONST double lattice[3][3],
+				SPGCONST double position[][3],
+				const int types[],
+				const int num_atom)
+{
+  int i, j, k;
+  const int *row;
+  double pos[3];
+
+  for (i = 0; i < dataset->n_operations; i++) {
+    row = dataset->permutations + i * num_atom;
+    if (row[0] < 0) {
+      continue;
+    }
+    for (j = 0; j < num_atom; j++) {
+      for (k = 0; k < 3; k++) {
+	pos[k] = (dataset->rotations[i][k][0] * position[j][0] +
+		  dataset->rotations[i][k][1] * position[j][1] +
+		  dataset->rotations[i][k][2] * position[j][2] +
+		  dataset->translations[i][k]);
+      }
+      if (row[j] != get_nearest_atom(lattice,
+				     position,
+				     types,
+				     num_atom,
+				     pos,
+				     types[j])) {
+	printf("%s: atom %d is moved onto atom %d by operation %d\n",
+	       name, j, row[j], i);
+	return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Nearest atom of the type to pos, where the fractional difference */
+/* is taken within -1/2 and 1/2. */
+static int get_nearest_atom(SPGCONST double lattice[3][3],
+			    SPGCONST double position[][3],
+			    const int types[],
+			    const int num_atom,
+			    const double pos[3],
+			    const int type)
+{
+  int i, j, nearest;
+  double distance, min_distance;
+  double diff[3], cart[3];
+
+  nearest = -1;
+  min_distance = 0;
+  for (i = 0; i < num_atom; i++) {
+    if (types[i] != type) {
+      continue;
+    }
+    for (j = 0; j < 3; j++) {
+      diff[j] = pos[j] - position[i][j];
+      diff[j] -= floor(diff[j] + 0.5);
+    }
+    for (j = 0; j < 3; j++) {
+      cart[j] = (lattice[j][0] * diff[0] +
+		 lattice[j][1] * diff[1] +
+		 lattice[j][2] * diff[2]);
+    }
+    distance = cart[0] * cart[0] + cart[1] * cart[1] + cart[2] * cart[2];
+    if (nearest < 0 || distance < min_distance) {
+      nearest = i;
+      min_distance = distance;
+    }
+  }
+
+  return nearest;
+}
+
+/* Every operation is one of the group, and the identity is kept. */
+static int check_subgroup(const char *name,
+			  SPGCONST int rotation[][3][3],
+			  SPGCONST double translation[][3],
+			  const int size,
+			  SPGCONST int group_rotation[][3][3],
+			  SPGCONST double group_translation[][3],
+			  const int group_size)
+{
+  int i;
+  SPGCONST int identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  const double zero[3] = {0, 0, 0};
+
+  if (size < 1 || find_operation(rotation, translation, size,
+				 identity, zero) < 0) {
+    printf("%s: identity is missing in %d operations\n", name, size);
+    return 1;
+  }
+
+  for (i = 0; i < size; i++) {
+    if (find_operation(group_rotation, group_translation, group_size,
+		       rotation[i], translation[i]) < 0) {
+      printf("%s: operation %d is not of the group of %d operations\n",
+	     name, i, group_size);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* 0 if the operation moves the moments onto the same moments, 1 if */
+/* onto the reversed moments, and -1 otherwise. A moment is moved as */
+/* an axial vector, det(R) R m with R in Cartesian coordinates. */
+static int get_time_reversal(SPGCONST double lattice[3][3],
+			     SPGCONST double position[][3],
+			     const int types[],
+			     SPGCONST double magmoms[][3],
+			     const int num_atom,
+			     SPGCONST int rotation[3][3],
+			     const double translation[3])
+{
+  int i, j, k, det, is_same, is_reversed;
+  double inv_lattice[3][3], rot_lattice[3][3], rot_cart[3][3];
+  double pos[3], moment[3];
+
+  det = (rotation[0][0] * (rotation[1][1] * rotation[2][2] -
+			   rotation[1][2] * rotation[2][1]) +
+	 rotation[0][1] * (rotation[1][2] * rotation[2][0] -
+			   rotation[1][0] * rotation[2][2]) +
+	 rotation[0][2] * (rotation[1][0] * rotation[2][1] -
+			   rotation[1][1] * rotation[2][0]));
+  inverse_matrix_d3(inv_lattice, lattice);
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      rot_lattice[i][j] = (lattice[i][0] * rotation[0][j] +
+			   lattice[i][1] * rotation[1][j] +
+			   lattice[i][2] * rotation[2][j]);
+    }
+  }
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      rot_cart[i][j] = det * (rot_lattice[i][0] * inv_lattice[0][j] +
+			      rot_lattice[i][1] * inv_lattice[1][j] +
+			      rot_lattice[i][2] * inv_lattice[2][j]);
+    }
+  }
+
+  is_same = 1;
+  is_reversed = 1;
+  for (i = 0; i < num_atom; i++) {
+    for (j = 0; j < 3; j++) {
+      pos[j] = (rotation[j][0] * position[i][0] +
+		rotation[j][1] * position[i][1] +
+		rotation[j][2] * position[i][2] +
+		translation[j]);
+      moment[j] = (rot_cart[j][0] * magmoms[i][0] +
+		   rot_cart[j][1] * magmoms[i][1] +
+		   rot_cart[j][2] * magmoms[i][2]);
+    }
+    k = get_nearest_atom(lattice, position, types, num_atom, pos, types[i]);
+    for (j = 0; j < 3; j++) {
+      if (fabs(magmoms[k][j] - moment[j]) > MAP_TOLERANCE) {
+	is_same = 0;
+      }
+      if (fabs(magmoms[k][j] + moment[j]) > MAP_TOLERANCE) {
+	is_reversed = 0;
+      }
+    }
+  }
+
+  if (is_same) {
+    return 0;
+  }
+  return is_reversed ? 1 : -1;
+}
+
+/* Each grid point is mapped to the smallest grid point of its orbit */
+/* under the reciprocal rotations, i.e., the transposed rotations and */
+/* their negatives with time reversal, that keep the mesh. The number */
+/* of the rotations not keeping the mesh is returned. */
+static int get_orbit_map(int map[],
+			 SPGCONST int grid_address[][3],
+			 const int mesh[3],
+			 const int shift[3],
+			 const int shift_denominator,
+			 SPGCONST int transformation[3][3],
+			 SPGCONST int rotations[][3][3],
+			 const int num_rot,
+			 const int is_time_reversal)
+{
+  int i, j, k, num_grid, num_kept, num_dropped, grid_point;
+  int (*rot_reciprocal)[3][3];
+
+  num_grid = mesh[0] * mesh[1] * mesh[2];
+  rot_reciprocal = (int (*)[3][3]) malloc(sizeof(int[3][3]) * num_rot * 2);
+  num_kept = 0;
+  num_dropped = 0;
+  for (i = 0; i < num_rot * (is_time_reversal ? 2 : 1); i++) {
+    for (j = 0; j < 3; j++) {
+      for (k = 0; k < 3; k++) {
+	rot_reciprocal[num_kept][j][k] =
+	  rotations[i % num_rot][k][j] * (i < num_rot ? 1 : -1);
+      }
+    }
+    for (j = 0; j < num_grid; j++) {
+      if (get_rotated_grid_point(rot_reciprocal[num_kept],
+				 grid_address[j],
+				 mesh,
+				 shift,
+				 shift_denominator,
+				 transformation) < 0) {
+	break;
+      }
+    }
+    if (j < num_grid) {
+      num_dropped++;
+    } else {
+      num_kept++;
+    }
+  }
+
+  for (i = 0; i < num_grid; i++) {
+    map[i] = -1;
+  }
+  for (i = 0; i < num_grid; i++) {
+    if (map[i] > -1) {
+      continue;
+    }
+    map[i] = i;
+    for (j = 0; j < num_kept; j++) {
+      grid_point = get_rotated_grid_point(rot_reciprocal[j],
+					  grid_address[i],
+					  mesh,
+					  shift,
+					  shift_denominator,
+					  transformation);
+      if (map[grid_point] == -1) {
+	map[grid_point] = i;
+      }
+    }
+  }
+
+  free(rot_reciprocal);
+
+  return num_dropped;
+}
+
+/* Grid point of the q-point transformation (address + shift / */
+/* shift_denominator) / mesh moved by the rotation, or -1 if it is not */
+/* on the mesh. */
+static int get_rotated_grid_point(SPGCONST int rotation[3][3],
+				  const int address[3],
+				  const int mesh[3],
+				  const int shift[3],
+				  const int shift_denominator,
+				  SPGCONST int transformation[3][3])
+{
+  int i, j;
+  int address_rot[3];
+  double t[3][3], inv_t[3][3], q[3], q_rot[3], x;
+
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      t[i][j] = transformation[i][j];
+    }
+  }
+  inverse_matrix_d3(inv_t, t);
+  for (i = 0; i < 3; i++) {
+    q[i] = 0;
+    for (j = 0; j < 3; j++) {
+      q[i] += t[i][j] *
+	(address[j] + (double)shift[j] / shift_denominator) / mesh[j];
+    }
+  }
+  for (i = 0; i < 3; i++) {
+    q_rot[i] = 0;
+    for (j = 0; j < 3; j++) {
+      q_rot[i] += rotation[i][j] * q[j];
+    }
+  }
+  for (i = 0; i < 3; i++) {
+    x = (inv_t[i][0] * q_rot[0] + inv_t[i][1] * q_rot[1] +
+	 inv_t[i][2] * q_rot[2]) * mesh[i] -
+      (double)shift[i] / shift_denominator;
+    address_rot[i] = (int)floor(x + 0.5);
+    if (fabs(x - address_rot[i]) > 1e-8) {
+      return -1;
+    }
+  }
+
+  return spg_get_grid_point(address_rot, mesh);
+}
+
+/* The first prod(mesh) grid addresses relocated in Brillouin zone */
+/* are those of the grid points and nearest to Gamma among their */
+/* lattice translations by up to two reciprocal basis vectors. The */
+/* others are translations of them within tolerance as far. Each of */
+/* them has its own slot in bz_map. */
+static int check_BZ_grid_address(const char *name,
+				 SPGCONST int bz_grid_address[][3],
+				 const int bz_map[],
+				 const int num_bz,
+				 const int mesh[3],
+				 const int shift[3],
+				 SPGCONST int transformation[3][3],
+				 SPGCONST double rec_lattice[3][3],
+				 const double tolerance)
+{
+  int i, j, num_grid, grid_point, bz_grid_point;
+  int bz_mesh[3], lattice_point[3];
+  double norm;
+  const int zero[3] = {0, 0, 0};
+
+  num_grid = mesh[0] * mesh[1] * mesh[2];
+  if (num_bz < num_grid || num_bz > num_grid * 8) {
+    printf("%s: %d grid points relocated in Brillouin zone\n", name, num_bz);
+    return 1;
+  }
+
+  for (i = 0; i < 3; i++) {
+    bz_mesh[i] = mesh[i] * 2;
+  }
+  for (i = 0; i < num_bz; i++) {
+    grid_point = spg_get_grid_point(bz_grid_address[i], mesh);
+    if (i < num_grid && grid_point != i) {
+      printf("%s: grid point %d relocated to %d\n", name, i, grid_point);
+      return 1;
+    }
+    /* Another grid point in the same slot would have overwritten it. */
+    bz_grid_point = spg_get_grid_point(bz_grid_address[i], bz_mesh);
+    if (bz_map[bz_grid_point] != i) {
+      printf("%s: grid points %d and %d in slot %d of bz_map\n",
+	     name, i, bz_map[bz_grid_point], bz_grid_point);
+      return 1;
+    }
+    norm = get_q_norm_squared(bz_grid_address[i], mesh, shift,
+			      transformation, rec_lattice, zero);
+    if (i >= num_grid) {
+      if (norm > get_q_norm_squared(bz_grid_address[grid_point], mesh, shift,
+				    transformation, rec_lattice, zero) +
+	  tolerance) {
+	printf("%s: grid point %d on Brillouin zone surface\n", name, i);
+	return 1;
+      }
+      continue;
+    }
+    for (j = 0; j < 125; j++) {
+      lattice_point[0] = j / 25 - 2;
+      lattice_point[1] = (j / 5) % 5 - 2;
+      lattice_point[2] = j % 5 - 2;
+      if (norm > get_q_norm_squared(bz_grid_address[i], mesh, shift,
+				    transformation, rec_lattice,
+				    lattice_point) + 1e-10) {
+	printf("%s: grid point %d is not in Brillouin zone\n", name, i);
+	return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Squared length of transformation (address + shift / 2) / mesh */
+/* translated by lattice_point in Cartesian coordinates */
+static double get_q_norm_squared(const int address[3],
+				 const int mesh[3],
+				 const int shift[3],
+				 SPGCONST int transformation[3][3],
+				 SPGCONST double rec_lattice[3][3],
+				 const int lattice_point[3])
+{
+  int i, j;
+  double q[3], norm, v;
+
+  for (i = 0; i < 3; i++) {
+    q[i] = lattice_point[i];
+    for (j = 0; j < 3; j++) {
+      q[i] += transformation[i][j] * (address[j] + shift[j] * 0.5) / mesh[j];
+    }
+  }
+  norm = 0;
+  for (i = 0; i < 3; i++) {
+    v = rec_lattice[i][0] * q[0] + rec_lattice[i][1] * q[1] +
+      rec_lattice[i][2] * q[2];
+    norm += v * v;
+  }
+
+  return norm;
+}
+
+/* Irreducible grid points of map in ascending order and the numbers */
+/* of grid points mapped to them. Their number is returned. */
+static int get_ir_grid_points(int ir_grid_points[],
+			      int weights[],
+			      const int map[],
+			      const int num_grid)
+{
+  int i, j, num_ir;
+
+  num_ir = 0;
+  for (i = 0; i < num_grid; i++) {
+    if (map[i] == i) {
+      ir_grid_points[num_ir] = i;
+      weights[num_ir] = 0;
+      num_ir++;
+    }
+  }
+  for (i = 0; i < num_grid; i++) {
+    for (j = 0; j < num_ir; j++) {
+      if (ir_grid_points[j] == map[i]) {
+	weights[j]++;
+	break;
+      }
+    }
+  }
+
+  return num_ir;
+}
+
+/* Fractional coordinates are shifted by up to amplitude. The */
+/* pseudo-random numbers are the same on every platform. */
+static void set_noisy_positions(double (*position)[3],
+				const Structure *st,
+				const double amplitude,
+				const unsigned int seed)
+{
+  int i, j;
+  unsigned long r;
+
+  r = seed;
+  for (i = 0; i < st->num_atom; i++) {
+    for (j = 0; j < 3; j++) {
+      r = (r * 1103515245 + 12345) & 0xffffffff;
+      position[i][j] = st->position[i][j] +
+	amplitude * (((r >> 8) & 0xffff) / 32767.5 - 1);
+    }
+  }
+}
+
+/* Translations x_j - x_min to the atoms j of the type with least */
+/* atoms, in the order of j, that map every atom onto an atom of the */
+/* same type within symprec. Every candidate is checked. */
+static int get_pure_translations(double (*translation)[3],
+				 SPGCONST Cell *cell,
+				 const double symprec)
+{
+  int i, j, min_atom_index, num_min, num, num_trans;
+  int identity[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  OverlapChecker *checker;
+
+  min_atom_index = 0;
+  num_min = cell->size + 1;
+  for (i = 0; i < cell->size; i++) {
+    num = 0;
+    for (j = 0; j < cell->size; j++) {
+      if (cell->types[j] == cell->types[i]) {
+	if (j < i) {
+	  break;
+	}
+	num++;
+      }
+    }
+    if (num > 0 && num < num_min) {
+      num_min = num;
+      min_atom_index = i;
+    }
+  }
+
+  if ((checker = ovl_overlap_checker_init(cell, symprec)) == NULL) {
+    return 0;
+  }
+  num_trans = 0;
+  for (i = 0; i < cell->size; i++) {
+    if (cell->types[i] != cell->types[min_atom_index]) {
+      continue;
+    }
+    for (j = 0; j < 3; j++) {
+      translation[num_trans][j] =
+	cell->position[i][j] - cell->position[min_atom_index][j];
+    }
+    if (ovl_check_total_overlap(checker, translation[num_trans],
+				identity, 1)) {
+      num_trans++;
+    }
+  }
+  ovl_overlap_checker_free(checker);
+
+  return num_trans;
+}
+
+/* Atoms of cell overlap in the primitive lattice within the */
+/* tolerance of primitive if and only if they are mapped to the same */
+/* atom, which is numbered in the order of the first atom mapped to */
+/* it and placed at the average position of the atoms. */
+static int check_trimmed_cell(const char *name,
+			      SPGCONST Cell *cell,
+			      const Primitive *primitive)
+{
+  int i, j, k, l, ratio, num_overlaps, num_failed;
+  double diff[3], average[3];
+  double tmat[3][3], inv_lattice[3][3];
+  double (*position)[3];
+  SPGCONST Cell *prim_cell;
+
+  prim_cell = primitive->cell;
+  if (prim_cell == NULL || prim_cell->size < 1 ||
+      cell->size % prim_cell->size != 0 ||
+      ! inverse_matrix_d3(inv_lattice, prim_cell->lattice)) {
+    printf("%s: no primitive cell\n", name);
+    return 1;
+  }
+  ratio = cell->size / prim_cell->size;
+
+  /* Positions in the primitive lattice */
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      tmat[i][j] = 0;
+      for (k = 0; k < 3; k++) {
+	tmat[i][j] += inv_lattice[i][k] * cell->lattice[k][j];
+      }
+    }
+  }
+  position = (double (*)[3]) malloc(sizeof(double[3]) * cell->size);
+  for (i = 0; i < cell->size; i++) {
+    for (j = 0; j < 3; j++) {
+      position[i][j] = 0;
+      for (k = 0; k < 3; k++) {
+	position[i][j] += tmat[j][k] * cell->position[i][k];
+      }
+      position[i][j] -= floor(position[i][j] + 0.5);
+    }
+  }
+
+  num_failed = 0;
+  l = -1;
+  for (i = 0; i < cell->size && num_failed == 0; i++) {
+    if (primitive->mapping_table[i] > l + 1) {
+      printf("%s: atom %d mapped to %d before %d\n",
+	     name, i, primitive->mapping_table[i], l + 1);
+      num_failed++;
+      break;
+    }
+    if (primitive->mapping_table[i] == l + 1) {
+      l++;
+    }
+
+    num_overlaps = 0;
+    for (k = 0; k < 3; k++) {
+      average[k] = 0;
+    }
+    for (j = 0; j < cell->size; j++) {
+      if (cell->types[i] != cell->types[j] ||
+	  ! cel_is_overlap(position[i], position[j], prim_cell->lattice,
+			   primitive->tolerance)) {
+	if (primitive->mapping_table[i] == primitive->mapping_table[j]) {
+	  printf("%s: atoms %d and %d are mapped together\n", name, i, j);
+	  num_failed++;
+	  break;
+	}
+	continue;
+      }
+      if (primitive->mapping_table[i] != primitive->mapping_table[j]) {
+	printf("%s: atoms %d and %d overlap\n", name, i, j);
+	num_failed++;
+	break;
+      }
+      for (k = 0; k < 3; k++) {
+	diff[k] = position[j][k] - position[i][k];
+	average[k] += diff[k] - floor(diff[k] + 0.5);
+      }
+      num_overlaps++;
+    }
+    if (num_failed > 0) {
+      break;
+    }
+    if (num_overlaps != ratio) {
+      printf("%s: atom %d overlaps %d atoms\n", name, i, num_overlaps);
+      num_failed++;
+      break;
+    }
+
+    for (k = 0; k < 3; k++) {
+      diff[k] = position[i][k] + average[k] / ratio -
+	prim_cell->position[primitive->mapping_table[i]][k];
+    }
+    if (prim_cell->types[primitive->mapping_table[i]] != cell->types[i] ||
+	! is_integer_vector(diff, 1e-8)) {
+      printf("%s: atom %d of the primitive cell\n",
+	     name, primitive->mapping_table[i]);
+      num_failed++;
+    }
+  }
+  if (num_failed == 0 && l + 1 != prim_cell->size) {
+    printf("%s: %d atoms mapped (%d)\n", name, l + 1, prim_cell->size);
+    num_failed++;
+  }
+
+  free(position);
+
+  return num_failed;
+}
+
+static int is_integer_vector(const double v[3], const double tolerance)
+{
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    if (fabs(v[i] - floor(v[i] + 0.5)) > tolerance) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int inverse_matrix_d3(double m[3][3], SPGCONST double a[3][3])
+{
+  int i, j;
+  double det;
+
+  det = (a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) +
+	 a[0][1] * (a[1][2] * a[2][0] - a[1][0] * a[2][2]) +
+	 a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]));
+  if (fabs(det) < 1e-10) {
+    return 0;
+  }
+
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      m[j][i] = (a[(i + 1) % 3][(j + 1) % 3] * a[(i + 2) % 3][(j + 2) % 3] -
+		 a[(i + 1) % 3][(j + 2) % 3] * a[(i + 2) % 3][(j + 1) % 3])
+	/ det;
+    }
+  }
+  return 1;
+}